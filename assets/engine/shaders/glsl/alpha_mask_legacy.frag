@@ -24,7 +24,7 @@ void main()
     data.normal = frag_normal;
     data.uv0 = frag_uv0;
     data.uv1 = frag_uv1;
-    data.material_index = push_constants.material_index;
+    data.material_index = material_index;
 
     out_frag_color = calcColor(push_constants.material_binding, push_constants.texture_binding, data);
 }
@@ -32,8 +32,8 @@ void main()
     frag_postion = world_position.xyz;
     frag_normal = world_normal;
 
-    frag_uv0 = uv0,
-    frag_uv1 = uv1,
+    frag_uv0 = uv0;
+    frag_uv1 = uv1;
     material_index = cmd.material_index;
 
     gl_Position = push_constants.view_projection_matrix * world_position;
@@ -3,6 +3,27 @@
 #extension GL_EXT_nonuniform_qualifier : enable
 
 #include "include/push_legacy.glsl"
+#include "include/bindless.glsl"
+
+layout(set = 0, binding = 0) uniform LegacyViewBuffer
+{
+    mat4 view_projection_matrix;
+} legacyViewBuffer[];
+
+struct LegacyInstance
+{
+    mat4 model_matrix;
+    mat4 normal_matrix;
+    uint material_index;
+    uint pad0;
+    uint pad1;
+    uint pad2;
+};
+
+layout(set = 0, binding = 1) readonly buffer LegacyInstanceBuffer
+{
+    LegacyInstance instances[];
+} legacyInstanceBuffer[];
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -18,8 +39,9 @@ layout(location = 4) flat out uint material_index;
 
 void main()
 {
-    const mat4 model_matrix = push_constants.model_matrix;
-    mat3 normal_matrix = mat3(model_matrix);
+    const LegacyInstance instance = legacyInstanceBuffer[getIndex(push_constants.instance_binding)].instances[gl_InstanceIndex];
+    const mat4 model_matrix = instance.model_matrix;
+    const mat3 normal_matrix = mat3(instance.normal_matrix);
 
     vec4 world_position = model_matrix * vec4(position, 1.0f);
     vec3 world_normal = normalize(normal_matrix * normal);
@@ -28,9 +50,9 @@ void main()
     frag_postion = world_position.xyz;
     frag_normal = world_normal;
 
-    frag_uv0 = uv0,
-    frag_uv1 = uv1,
-    material_index = push_constants.material_index;
+    frag_uv0 = uv0;
+    frag_uv1 = uv1;
+    material_index = instance.material_index;
 
-    gl_Position = push_constants.view_projection_matrix * world_position;
+    gl_Position = legacyViewBuffer[getIndex(push_constants.view_binding)].view_projection_matrix * world_position;
 }
@@ -27,3 +27,66 @@ vec4 transformSphere(mat4 model_matix, vec4 sphere_pos_radius) {
     const float new_radius = sphere_pos_radius.w * max_scale;
     return vec4(new_pos.xyz, new_radius);
 }
+
+// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere. Michael Mara, Morgan McGuire. 2013
+// center is in the same +z forward view space as isSphereVisible, returns false if the sphere crosses the near plane
+bool projectSphere(vec3 center, float radius, float znear, float P00, float P11, out vec4 aabb) {
+    if (center.z < radius + znear) {
+        return false;
+    }
+
+    const vec3 cr = center * radius;
+    const float czr2 = center.z * center.z - radius * radius;
+
+    const float vx = sqrt(center.x * center.x + czr2);
+    const float minx = (vx * center.x - cr.z) / (vx * center.z + cr.x);
+    const float maxx = (vx * center.x + cr.z) / (vx * center.z - cr.x);
+
+    const float vy = sqrt(center.y * center.y + czr2);
+    const float miny = (vy * center.y - cr.z) / (vy * center.z + cr.y);
+    const float maxy = (vy * center.y + cr.z) / (vy * center.z - cr.y);
+
+    aabb = vec4(minx * P00, miny * P11, maxx * P00, maxy * P11);
+    aabb = aabb.xwzy * vec4(0.5, -0.5, 0.5, -0.5) + vec4(0.5); // clip space -> uv space
+
+    return true;
+}
+
+#ifdef DEPTH_PYRAMID
+// Tests the sphere's nearest depth against the farthest depth in the pyramid texels under its screen bounds
+bool isSphereOccluded(CullData cull_data, DepthPyramidBuffer depth_pyramid, vec4 sphere_pos_radius) {
+    const vec3 center = (cull_data.view_matrix * vec4(sphere_pos_radius.xyz, 1.0)).xyz;
+    const float radius = sphere_pos_radius.w;
+
+    vec4 aabb;
+    if (!projectSphere(center, radius, cull_data.znear, cull_data.P00, cull_data.P11, aabb)) {
+        return false;
+    }
+    aabb = clamp(aabb, 0.0, 1.0);
+
+    // Lowest level where the bounds span at most 2x2 texels, anything larger is treated as visible
+    const float width = (aabb.z - aabb.x) * DEPTH_PYRAMID_WIDTH;
+    const float height = (aabb.w - aabb.y) * DEPTH_PYRAMID_HEIGHT;
+    const uint level = uint(ceil(log2(max(max(width, height), 1.0))));
+    if (level >= DEPTH_PYRAMID_LEVELS) {
+        return false;
+    }
+
+    const uvec2 size = depthPyramidLevelSize(level);
+    const uint offset = depthPyramidLevelOffset(level);
+    const uvec2 first = min(uvec2(aabb.xy * vec2(size)), size - 1);
+    const uvec2 last = min(uvec2(aabb.zw * vec2(size)), size - 1);
+
+    float depth = 0.0;
+    for (uint y = first.y; y <= last.y; y++) {
+        for (uint x = first.x; x <= last.x; x++) {
+            depth = max(depth, depth_pyramid.depth[offset + y * size.x + x]);
+        }
+    }
+
+    // Same 0 at znear to 1 at zfar mapping as the projection matrix
+    const float nearest = center.z - radius;
+    const float sphere_depth = (cull_data.zfar * (nearest - cull_data.znear)) / ((cull_data.zfar - cull_data.znear) * nearest);
+    return sphere_depth > depth;
+}
+#endif
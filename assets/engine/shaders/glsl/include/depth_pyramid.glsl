@@ -0,0 +1,29 @@
+#ifndef DEPTH_PYRAMID
+#define DEPTH_PYRAMID
+
+// Max depth pyramid stored level after level in one buffer, must match depth_pyramid.zig
+#define DEPTH_PYRAMID_WIDTH 512
+#define DEPTH_PYRAMID_HEIGHT 256
+#define DEPTH_PYRAMID_LEVELS 8
+
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer DepthPyramidBuffer
+{
+    float depth[];
+};
+
+uvec2 depthPyramidLevelSize(uint level)
+{
+    return max(uvec2(DEPTH_PYRAMID_WIDTH, DEPTH_PYRAMID_HEIGHT) >> level, uvec2(1));
+}
+
+uint depthPyramidLevelOffset(uint level)
+{
+    uint offset = 0;
+    for (uint i = 0; i < level; i++) {
+        const uvec2 size = depthPyramidLevelSize(i);
+        offset += size.x * size.y;
+    }
+    return offset;
+}
+
+#endif
@@ -31,14 +31,24 @@ layout(std430, buffer_reference) readonly buffer Primitives {
     PrimitiveInfo p[];
 };
 
-//TODO: this
+struct Meshlet {
+    vec4 sphere_pos_radius;
+    vec4 cone_axis_cutoff;
+    uint vertex_offset;
+    uint vertex_count;
+    uint triangle_offset;
+    uint triangle_count;
+};
+
 layout(buffer_reference, std430) readonly buffer Meshlets {
-    uint data[];
+    Meshlet m[];
 };
-layout(buffer_reference, std430) readonly buffer MeshletVertices {
+// Primitive relative vertex indices
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer MeshletVertices {
     uint data[];
 };
-layout(buffer_reference, std430) readonly buffer MeshletTriangles {
+// Meshlet local vertex indices, one byte each packed into words
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer MeshletTriangles {
     uint data[];
 };
 
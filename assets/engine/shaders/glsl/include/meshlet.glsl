@@ -0,0 +1,42 @@
+#ifndef MESHLET
+#define MESHLET
+
+// Capacities of the meshlet culling buffers, must match scene_renderer.zig
+#define MESHLET_TASK_CAPACITY (256 * 1024)
+#define MESHLET_INDEX_CAPACITY (8 * 1024 * 1024)
+#define MESHLET_CULL_GROUP_SIZE 64
+
+// The render bucket is stored in the top bits of a task's command, its command index in the rest
+#define MESHLET_TASK_BUCKET_SHIFT 30
+#define MESHLET_TASK_COMMAND_MASK ((1u << MESHLET_TASK_BUCKET_SHIFT) - 1)
+// Command of a reserved task whose primitive is drawn whole instead
+#define MESHLET_TASK_NONE 0xFFFFFFFFu
+
+// One meshlet of a drawn primitive, appended by build_indirect.comp for meshlet_cull.comp
+struct MeshletTask {
+    uint command;
+    uint mesh_index;
+    uint meshlet_index;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer MeshletTaskBuffer
+{
+    MeshletTask tasks[];
+};
+
+// Indirect dispatch arguments for meshlet_cull.comp followed by the number of tasks appended, may exceed the capacity
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer MeshletCullStateBuffer
+{
+    uint dispatch_x;
+    uint dispatch_y;
+    uint dispatch_z;
+    uint task_count;
+};
+
+// Next free index in the compacted index buffer, shared by every bucket and phase of a frame
+layout(std430, buffer_reference, buffer_reference_align = 4) buffer MeshletIndexAllocatorBuffer
+{
+    uint count;
+};
+
+#endif
@@ -21,6 +21,8 @@ pub fn build(b: *std.Build) !void {
         );
     }
 
+    buildBenchmarks(b, target, optimize);
+
     if (!no_main) {
         try buildMain(
             b,
@@ -108,6 +110,30 @@ fn buildAssetRegistry(
     return &run_artifact.step;
 }
 
+fn buildBenchmarks(
+    b: *std.Build,
+    target: std.Build.ResolvedTarget,
+    optimize: std.builtin.OptimizeMode,
+) void {
+    const bench_mod = b.createModule(.{
+        .root_source_file = b.path("src/bench_culling.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+
+    const zmath = b.dependency("zmath", .{});
+    bench_mod.addImport("zmath", zmath.module("root"));
+
+    const bench_exe = b.addExecutable(.{
+        .name = "bench_culling",
+        .root_module = bench_mod,
+    });
+
+    const run_bench = b.addRunArtifact(bench_exe);
+    const bench_step = b.step("bench-culling", "Benchmark batch frustum culling against the scalar path");
+    bench_step.dependOn(&run_bench.step);
+}
+
 fn buildMain(
     b: *std.Build,
     target: std.Build.ResolvedTarget,
@@ -117,13 +143,53 @@ fn buildMain(
         use_llvm: bool,
     },
 ) !void {
+    const exe_mod = createMainModule(b, b.path("src/main.zig"), target, optimize, options.build_sdl3);
+
+    const exe = b.addExecutable(.{
+        .name = "saturn",
+        .root_module = exe_mod,
+        .use_llvm = options.use_llvm,
+    });
+    b.installArtifact(exe);
+
+    const run_cmd = b.addRunArtifact(exe);
+    run_cmd.setCwd(b.path("zig-out/"));
+
+    run_cmd.step.dependOn(b.getInstallStep());
+    if (b.args) |args| {
+        run_cmd.addArgs(args);
+    }
+    const run_step = b.step("run", "Run the saturn editor");
+
+    run_step.dependOn(&run_cmd.step);
+
+    // Tests live next to the code they cover, src/tests.zig references every file that has some
+    const test_mod = createMainModule(b, b.path("src/tests.zig"), target, optimize, options.build_sdl3);
+    const tests = b.addTest(.{
+        .root_module = test_mod,
+        .use_llvm = options.use_llvm,
+    });
+
+    const run_tests = b.addRunArtifact(tests);
+    const test_step = b.step("test", "Run the engine tests");
+    test_step.dependOn(&run_tests.step);
+}
+
+/// Module with everything the engine links against, shared by the editor and the tests
+fn createMainModule(
+    b: *std.Build,
+    root_source_file: std.Build.LazyPath,
+    target: std.Build.ResolvedTarget,
+    optimize: std.builtin.OptimizeMode,
+    build_sdl3: bool,
+) *std.Build.Module {
     const exe_mod = b.createModule(.{
-        .root_source_file = b.path("src/main.zig"),
+        .root_source_file = root_source_file,
         .target = target,
         .optimize = optimize,
     });
 
-    if (options.build_sdl3) {
+    if (build_sdl3) {
         const sdl3 = b.lazyDependency("sdl", .{
             .target = target,
             .optimize = optimize,
@@ -197,21 +263,5 @@ fn buildMain(
     const zjolt = b.dependency("zjolt", .{ .target = target, .optimize = optimize });
     exe_mod.addImport("zjolt", zjolt.module("zjolt"));
 
-    const exe = b.addExecutable(.{
-        .name = "saturn",
-        .root_module = exe_mod,
-        .use_llvm = options.use_llvm,
-    });
-    b.installArtifact(exe);
-
-    const run_cmd = b.addRunArtifact(exe);
-    run_cmd.setCwd(b.path("zig-out/"));
-
-    run_cmd.step.dependOn(b.getInstallStep());
-    if (b.args) |args| {
-        run_cmd.addArgs(args);
-    }
-    const run_step = b.step("run", "Run the saturn editor");
-
-    run_step.dependOn(&run_cmd.step);
+    return exe_mod;
 }
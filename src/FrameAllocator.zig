@@ -0,0 +1,232 @@
+//Frame temporary allocator with one arena per TaskPool thread, so frame prep can allocate from workers without locking.
+//Arenas are buffered by frames in flight and indexed by the device's frame slot, memory handed to render graph callbacks stays valid until that frame's fence has signaled.
+
+const std = @import("std");
+
+const TaskPool = @import("TaskPool.zig");
+
+pub const ThreadArena = struct {
+    arena: std.heap.ArenaAllocator,
+
+    // Only touched by the owning thread during a frame, read by the main thread between frames.
+    used_bytes: usize = 0,
+
+    /// Bytes used the last time this arena was in flight
+    last_used_bytes: usize = 0,
+
+    /// Most bytes ever used in a single frame
+    high_water_mark: usize = 0,
+
+    fn grow(self: *ThreadArena, bytes: usize) void {
+        self.used_bytes += bytes;
+        self.high_water_mark = @max(self.high_water_mark, self.used_bytes);
+    }
+
+    fn shrink(self: *ThreadArena, bytes: usize) void {
+        // Memory can be freed by a thread other than the one that allocated it, so this is only an estimate
+        self.used_bytes -|= bytes;
+    }
+};
+
+pub const Stats = struct {
+    /// Bytes used by the most recently finished frame across all threads
+    last_frame_bytes: usize = 0,
+
+    /// Sum of each arena's high water mark
+    high_water_mark: usize = 0,
+
+    /// Bytes held by the arenas, including retained capacity
+    capacity_bytes: usize = 0,
+};
+
+const Self = @This();
+
+gpa: std.mem.Allocator,
+task_pool: *TaskPool,
+
+frame_count: usize,
+thread_count: usize,
+frame_index: usize = 0,
+
+/// frame_count * thread_count arenas, grouped by frame
+arenas: []ThreadArena,
+
+pub fn init(gpa: std.mem.Allocator, task_pool: *TaskPool, frames_in_flight: u32) error{OutOfMemory}!Self {
+    const frame_count: usize = @max(1, frames_in_flight);
+    const thread_count = task_pool.getThreadCount();
+
+    const arenas = try gpa.alloc(ThreadArena, frame_count * thread_count);
+    for (arenas) |*thread_arena| {
+        thread_arena.* = .{ .arena = .init(gpa) };
+    }
+
+    return .{
+        .gpa = gpa,
+        .task_pool = task_pool,
+        .frame_count = frame_count,
+        .thread_count = thread_count,
+        .arenas = arenas,
+    };
+}
+
+pub fn deinit(self: *Self) void {
+    for (self.arenas) |*thread_arena| {
+        thread_arena.arena.deinit();
+    }
+    self.gpa.free(self.arenas);
+}
+
+/// Moves to the arenas of frame_slot and resets them, call after DeviceInterface.beginFrame has handed out that slot.
+/// Must be called from the main thread while nothing is running on the pool.
+pub fn beginFrame(self: *Self, frame_slot: u32) void {
+    self.frame_index = frame_slot % self.frame_count;
+
+    for (self.getFrameArenas(self.frame_index)) |*thread_arena| {
+        thread_arena.last_used_bytes = thread_arena.used_bytes;
+        thread_arena.used_bytes = 0;
+        _ = thread_arena.arena.reset(.retain_capacity);
+    }
+}
+
+pub fn allocator(self: *Self) std.mem.Allocator {
+    return .{
+        .ptr = self,
+        .vtable = &.{
+            .alloc = alloc,
+            .resize = resize,
+            .remap = remap,
+            .free = free,
+        },
+    };
+}
+
+pub fn getFrameArenas(self: *const Self, frame_index: usize) []ThreadArena {
+    return self.arenas[frame_index * self.thread_count ..][0..self.thread_count];
+}
+
+pub fn getStats(self: *const Self) Stats {
+    // The previous frame is the newest one that is no longer being written to
+    const last_frame_index = (self.frame_index + self.frame_count - 1) % self.frame_count;
+
+    var stats: Stats = .{};
+    for (self.getFrameArenas(last_frame_index)) |thread_arena| {
+        stats.last_frame_bytes += thread_arena.used_bytes;
+    }
+
+    for (self.arenas) |thread_arena| {
+        stats.high_water_mark += thread_arena.high_water_mark;
+        stats.capacity_bytes += thread_arena.arena.queryCapacity();
+    }
+    return stats;
+}
+
+fn getThreadArena(self: *Self) *ThreadArena {
+    return &self.getFrameArenas(self.frame_index)[self.task_pool.getThreadIndex()];
+}
+
+fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+    const self: *Self = @ptrCast(@alignCast(ctx));
+    const thread_arena = self.getThreadArena();
+    const ptr = thread_arena.arena.allocator().rawAlloc(len, alignment, ret_addr) orelse return null;
+    thread_arena.grow(len);
+    return ptr;
+}
+
+fn resize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+    const self: *Self = @ptrCast(@alignCast(ctx));
+    const thread_arena = self.getThreadArena();
+
+    // Arenas only grow their most recent allocation, so memory from another thread's arena can only shrink here
+    if (!thread_arena.arena.allocator().rawResize(memory, alignment, new_len, ret_addr)) {
+        return false;
+    }
+
+    if (new_len > memory.len) {
+        thread_arena.grow(new_len - memory.len);
+    } else {
+        thread_arena.shrink(memory.len - new_len);
+    }
+    return true;
+}
+
+fn remap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+    return if (resize(ctx, memory, alignment, new_len, ret_addr)) memory.ptr else null;
+}
+
+fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+    const self: *Self = @ptrCast(@alignCast(ctx));
+    const thread_arena = self.getThreadArena();
+    thread_arena.arena.allocator().rawFree(memory, alignment, ret_addr);
+    thread_arena.shrink(memory.len);
+}
+
+test "frame_allocator.accounting" {
+    var pool: TaskPool = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 1 });
+    defer pool.deinit();
+
+    var frame_allocator: Self = try .init(std.testing.allocator, &pool, 2);
+    defer frame_allocator.deinit();
+    const tpa = frame_allocator.allocator();
+
+    frame_allocator.beginFrame(0);
+    const owner_arena = &frame_allocator.getFrameArenas(0)[0];
+
+    const memory = try tpa.alloc(u8, 100);
+    try std.testing.expectEqual(@as(usize, 100), owner_arena.used_bytes);
+
+    // Shrinking the newest allocation gives the bytes back to the arena
+    try std.testing.expect(tpa.resize(memory, 40));
+    try std.testing.expectEqual(@as(usize, 40), owner_arena.used_bytes);
+
+    tpa.free(memory[0..40]);
+    try std.testing.expectEqual(@as(usize, 0), owner_arena.used_bytes);
+    try std.testing.expectEqual(@as(usize, 100), owner_arena.high_water_mark);
+}
+
+test "frame_allocator.per_thread_frames" {
+    const item_count = 256;
+    const item_bytes = 16;
+
+    var pool: TaskPool = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 3 });
+    defer pool.deinit();
+
+    var frame_allocator: Self = try .init(std.testing.allocator, &pool, 2);
+    defer frame_allocator.deinit();
+
+    const Filler = struct {
+        tpa: std.mem.Allocator,
+        items: *[item_count][]u8,
+
+        fn run(ctx: @This(), range: TaskPool.Range) error{OutOfMemory}!void {
+            for (range.start..range.end) |i| {
+                const item = try ctx.tpa.alloc(u8, item_bytes);
+                @memset(item, @truncate(i));
+                ctx.items[i] = item;
+            }
+        }
+    };
+
+    var items: [item_count][]u8 = undefined;
+    frame_allocator.beginFrame(0);
+    try pool.parallelFor(item_count, .{}, Filler{ .tpa = frame_allocator.allocator(), .items = &items }, Filler.run);
+
+    // Every allocation lands in the arena of the thread that made it, nothing was freed
+    var used_bytes: usize = 0;
+    for (frame_allocator.getFrameArenas(0)) |thread_arena| used_bytes += thread_arena.used_bytes;
+    try std.testing.expectEqual(@as(usize, item_count * item_bytes), used_bytes);
+
+    // Moving on to the next slot leaves the frame still in flight untouched
+    frame_allocator.beginFrame(1);
+    try std.testing.expectEqual(@as(usize, item_count * item_bytes), frame_allocator.getStats().last_frame_bytes);
+    for (items, 0..) |item, i| {
+        for (item) |byte| try std.testing.expectEqual(@as(u8, @truncate(i)), byte);
+    }
+
+    // Coming back around to the slot resets its arenas but keeps their high water marks
+    frame_allocator.beginFrame(2);
+    for (frame_allocator.getFrameArenas(0)) |thread_arena| try std.testing.expectEqual(@as(usize, 0), thread_arena.used_bytes);
+    try std.testing.expectEqual(@as(usize, 0), frame_allocator.getStats().last_frame_bytes);
+    try std.testing.expect(frame_allocator.getStats().high_water_mark >= item_count * item_bytes);
+}
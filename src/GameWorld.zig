@@ -4,6 +4,7 @@ const zm = @import("zmath");
 
 const zjolt = @import("zjolt");
 
+const TaskPool = @import("TaskPool.zig");
 const Transform = @import("transform.zig");
 const Camera = @import("rendering/camera.zig").Camera;
 const RenderScene = @import("rendering/scene.zig");
@@ -71,15 +72,29 @@ pub fn deinit(self: *Self) void {
     if (self.components.physics) |*world| world.deinit();
 }
 
-pub fn update(self: *Self, dt: f32) void {
+pub fn update(self: *Self, task_pool: *TaskPool, dt: f32) void {
     if (self.components.rendering) |*scene| {
-        for (self.entities.items) |*entity| {
-            if (entity.components.static_mesh) |static_mesh| {
-                scene.updateStaticMeshInstance(static_mesh, true, entity.transform);
+        // Every entity owns a distinct instance, so the scene can be synced in parallel
+        const SyncContext = struct {
+            scene: *RenderScene,
+            entities: []const Entity,
+
+            fn run(ctx: @This(), range: TaskPool.Range) void {
+                for (ctx.entities[range.start..range.end]) |*entity| {
+                    if (entity.components.static_mesh) |static_mesh| {
+                        ctx.scene.updateStaticMeshInstance(static_mesh, true, entity.transform);
+                    }
+                }
             }
-        }
+        };
+        task_pool.parallelFor(self.entities.items.len, .{ .min_grain_size = 256 }, SyncContext{
+            .scene = scene,
+            .entities = self.entities.items,
+        }, SyncContext.run);
     }
 
+    // The physics sync loops stay serial, zjolt makes no promise that its body calls can be made from several threads at once
+
     if (self.components.physics) |*physics| {
         for (self.entities.items) |*entity| {
             if (entity.components.rigid_body) |rigid_body| {
@@ -0,0 +1,235 @@
+//Per-subsystem memory accounting, each tag gets an allocator wrapper that counts live bytes, peak bytes and allocation rate.
+//Counters are atomic since most subsystems allocate from TaskPool workers as well as the main thread.
+
+const std = @import("std");
+
+pub const Tag = enum {
+    asset_pool,
+    game_world,
+    physics,
+    render_graph,
+    transfer_queue,
+};
+pub const tag_count = std.enums.values(Tag).len;
+
+pub const Counters = struct {
+    live_bytes: std.atomic.Value(usize) = .init(0),
+    peak_bytes: std.atomic.Value(usize) = .init(0),
+    alloc_count: std.atomic.Value(u64) = .init(0),
+    alloc_bytes: std.atomic.Value(u64) = .init(0),
+    free_count: std.atomic.Value(u64) = .init(0),
+
+    fn grow(self: *Counters, bytes: usize) void {
+        const live_bytes = self.live_bytes.fetchAdd(bytes, .monotonic) + bytes;
+        _ = self.peak_bytes.fetchMax(live_bytes, .monotonic);
+        _ = self.alloc_bytes.fetchAdd(bytes, .monotonic);
+    }
+
+    fn shrink(self: *Counters, bytes: usize) void {
+        _ = self.live_bytes.fetchSub(bytes, .monotonic);
+    }
+};
+
+/// Wraps a child allocator and counts everything that passes through it into one tag's counters.
+/// Must not move while the allocator returned from allocator() is in use.
+pub const TaggedAllocator = struct {
+    child: std.mem.Allocator,
+    counters: *Counters,
+
+    pub fn allocator(self: *TaggedAllocator) std.mem.Allocator {
+        return .{
+            .ptr = self,
+            .vtable = &.{
+                .alloc = alloc,
+                .resize = resize,
+                .remap = remap,
+                .free = free,
+            },
+        };
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *TaggedAllocator = @ptrCast(@alignCast(ctx));
+        const ptr = self.child.rawAlloc(len, alignment, ret_addr) orelse return null;
+        _ = self.counters.alloc_count.fetchAdd(1, .monotonic);
+        self.counters.grow(len);
+        return ptr;
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *TaggedAllocator = @ptrCast(@alignCast(ctx));
+        if (!self.child.rawResize(memory, alignment, new_len, ret_addr)) {
+            return false;
+        }
+        self.resized(memory.len, new_len);
+        return true;
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const self: *TaggedAllocator = @ptrCast(@alignCast(ctx));
+        const ptr = self.child.rawRemap(memory, alignment, new_len, ret_addr) orelse return null;
+        self.resized(memory.len, new_len);
+        return ptr;
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+        const self: *TaggedAllocator = @ptrCast(@alignCast(ctx));
+        self.child.rawFree(memory, alignment, ret_addr);
+        _ = self.counters.free_count.fetchAdd(1, .monotonic);
+        self.counters.shrink(memory.len);
+    }
+
+    fn resized(self: *TaggedAllocator, old_len: usize, new_len: usize) void {
+        if (new_len > old_len) {
+            self.counters.grow(new_len - old_len);
+        } else {
+            self.counters.shrink(old_len - new_len);
+        }
+    }
+};
+
+pub const TagStats = struct {
+    tag: Tag,
+    live_bytes: usize = 0,
+    peak_bytes: usize = 0,
+    alloc_count: u64 = 0,
+    free_count: u64 = 0,
+
+    /// Rates over the last sample period
+    allocs_per_second: f64 = 0.0,
+    bytes_per_second: f64 = 0.0,
+};
+
+const Self = @This();
+
+counters: [tag_count]Counters = @splat(.{}),
+tagged: [tag_count]TaggedAllocator,
+
+// Totals at the last sample, only touched by sample()
+last_alloc_count: [tag_count]u64 = @splat(0),
+last_alloc_bytes: [tag_count]u64 = @splat(0),
+sample_timer: f32 = 0.0,
+stats: [tag_count]TagStats,
+
+/// Must not move after init, the tag allocators point back into it.
+pub fn init(self: *Self, child: std.mem.Allocator) void {
+    self.* = .{
+        .tagged = undefined,
+        .stats = undefined,
+    };
+    for (&self.tagged, &self.counters, &self.stats, 0..) |*tagged, *counters, *stats, i| {
+        tagged.* = .{ .child = child, .counters = counters };
+        stats.* = .{ .tag = @enumFromInt(i) };
+    }
+}
+
+pub fn allocator(self: *Self, tag: Tag) std.mem.Allocator {
+    return self.tagged[@intFromEnum(tag)].allocator();
+}
+
+/// Wraps a different child allocator, used for memory that does not come from the tracker's child (e.g. frame memory)
+pub fn wrap(self: *Self, tag: Tag, child: std.mem.Allocator) TaggedAllocator {
+    return .{ .child = child, .counters = &self.counters[@intFromEnum(tag)] };
+}
+
+/// Updates the stats and rates, call once per frame from the main thread
+pub fn sample(self: *Self, delta_time: f32) void {
+    const SAMPLE_PERIOD = 0.5;
+
+    self.sample_timer += delta_time;
+    const update_rates = self.sample_timer >= SAMPLE_PERIOD;
+
+    for (&self.counters, &self.stats, 0..) |*counters, *stats, i| {
+        stats.live_bytes = counters.live_bytes.load(.monotonic);
+        stats.peak_bytes = counters.peak_bytes.load(.monotonic);
+        stats.alloc_count = counters.alloc_count.load(.monotonic);
+        stats.free_count = counters.free_count.load(.monotonic);
+
+        if (update_rates) {
+            const alloc_bytes = counters.alloc_bytes.load(.monotonic);
+            stats.allocs_per_second = @as(f64, @floatFromInt(stats.alloc_count - self.last_alloc_count[i])) / self.sample_timer;
+            stats.bytes_per_second = @as(f64, @floatFromInt(alloc_bytes - self.last_alloc_bytes[i])) / self.sample_timer;
+            self.last_alloc_count[i] = stats.alloc_count;
+            self.last_alloc_bytes[i] = alloc_bytes;
+        }
+    }
+
+    if (update_rates) {
+        self.sample_timer = 0.0;
+    }
+}
+
+/// Stats as of the last sample()
+pub fn getStats(self: *const Self) []const TagStats {
+    return &self.stats;
+}
+
+pub fn writeJson(self: *const Self, writer: *std.Io.Writer) !void {
+    try std.json.Stringify.value(self.getStats(), .{ .whitespace = .indent_tab }, writer);
+}
+
+pub fn dumpJson(self: *const Self, dir: std.fs.Dir, path: []const u8) !void {
+    const file = try dir.createFile(path, .{});
+    defer file.close();
+
+    var writer_buffer: [4096]u8 = undefined;
+    var file_writer = file.writer(&writer_buffer);
+    try self.writeJson(&file_writer.interface);
+    try file_writer.interface.flush();
+}
+
+test "memory_tracker.tagged_counters" {
+    const gpa = std.testing.allocator;
+
+    var tracker: Self = undefined;
+    tracker.init(gpa);
+    const tagged = tracker.allocator(.asset_pool);
+
+    const first = try tagged.alloc(u8, 100);
+    const second = try tagged.alloc(u8, 50);
+    tracker.sample(0.0);
+    {
+        const stats = tracker.getStats()[@intFromEnum(Tag.asset_pool)];
+        try std.testing.expectEqual(@as(usize, 150), stats.live_bytes);
+        try std.testing.expectEqual(@as(usize, 150), stats.peak_bytes);
+        try std.testing.expectEqual(@as(u64, 2), stats.alloc_count);
+    }
+
+    // The child decides whether a shrink happens in place, the counters follow whatever it did
+    const shrunk = if (tagged.resize(first, 30)) first[0..30] else first;
+    tagged.free(second);
+    tracker.sample(0.0);
+    {
+        const stats = tracker.getStats()[@intFromEnum(Tag.asset_pool)];
+        try std.testing.expectEqual(shrunk.len, stats.live_bytes);
+        try std.testing.expectEqual(@as(usize, 150), stats.peak_bytes);
+        try std.testing.expectEqual(@as(u64, 1), stats.free_count);
+    }
+
+    tagged.free(shrunk);
+    tracker.sample(1.0);
+    {
+        const stats = tracker.getStats()[@intFromEnum(Tag.asset_pool)];
+        try std.testing.expectEqual(@as(usize, 0), stats.live_bytes);
+        try std.testing.expectEqual(@as(usize, 150), stats.peak_bytes);
+        try std.testing.expectEqual(@as(u64, 2), stats.free_count);
+        try std.testing.expectEqual(@as(f64, 2.0), stats.allocs_per_second);
+        try std.testing.expectEqual(@as(f64, 150.0), stats.bytes_per_second);
+    }
+
+    // Other tags never saw any of it
+    const physics = tracker.getStats()[@intFromEnum(Tag.physics)];
+    try std.testing.expectEqual(@as(usize, 0), physics.peak_bytes);
+    try std.testing.expectEqual(@as(u64, 0), physics.alloc_count);
+
+    var json: std.Io.Writer.Allocating = .init(gpa);
+    defer json.deinit();
+    try tracker.writeJson(&json.writer);
+
+    const parsed = try std.json.parseFromSlice([]TagStats, gpa, json.written(), .{});
+    defer parsed.deinit();
+    try std.testing.expectEqual(tag_count, parsed.value.len);
+    for (parsed.value, tracker.getStats()) |parsed_stats, stats| {
+        try std.testing.expectEqual(stats, parsed_stats);
+    }
+}
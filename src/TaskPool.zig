@@ -1,52 +1,181 @@
-//Wrapper around thread pool that manages error collection and std.Progress
+//Work-stealing job system that manages error collection and std.Progress
+//Every worker owns a Chase-Lev deque of task slot indices and steals from the others when it runs dry.
+//Task data is stored inline in a fixed pool of slots, so spawning a task never touches an allocator.
 
 const std = @import("std");
 
-pub fn Task(comptime T: type, comptime run: anytype) type {
-    return struct {
-        fn runTask(pool: *Self, name: []const u8, data: *anyopaque, prog_node: ?std.Progress.Node) void {
-            const child_node: ?std.Progress.Node = if (prog_node) |node| node.start(name, 0) else null;
-            defer if (child_node) |node| node.end();
+pub const InitOptions = struct {
+    n_jobs: ?usize = null,
 
-            const ReturnType = @typeInfo(@TypeOf(run)).@"fn".return_type orelse void;
-            const can_error = switch (@typeInfo(ReturnType)) {
-                .error_union => true,
-                else => false,
-            };
+    /// Max number of tasks that can be in flight at once, spawning past this helps run tasks until a slot is freed
+    task_capacity: u32 = 4096,
+};
 
-            const t_data: *T = @ptrCast(@alignCast(data));
+/// Max size of the data passed to a task, larger data should be passed by pointer
+pub const task_data_size = 128;
+pub const task_data_align = 16;
 
-            if (can_error) {
-                run(pool, name, t_data, child_node) catch |err| {
-                    pool.err_mutex.lock();
-                    defer pool.err_mutex.unlock();
-
-                    const task_name = pool.gpa.dupe(u8, name) catch return;
-                    pool.err_list.append(pool.gpa, .{
-                        .name = task_name,
-                        .err = err,
-                    }) catch return;
-                };
-            } else {
-                run(pool, name, t_data, child_node);
-            }
+/// Names longer than this are truncated
+pub const task_name_capacity = 48;
+
+/// Continuations past this limit fall back to waiting on the dependency during spawn
+pub const max_continuations = 8;
+
+const invalid_index = std.math.maxInt(u32);
+
+pub const TaskHandle = struct {
+    index: u32,
+    generation: u32,
+};
+
+const TaskSlot = struct {
+    run_fn: *const fn (pool: *Self, slot: *TaskSlot) void = undefined,
+    data: [task_data_size]u8 align(task_data_align) = undefined,
+    name_buffer: [task_name_capacity]u8 = undefined,
+    name_len: u8 = 0,
+    progress_node: ?std.Progress.Node = null,
+    wait_group: ?*std.Thread.WaitGroup = null,
+
+    // Incremented every time the slot is released, stale handles are treated as completed.
+    generation: std.atomic.Value(u32) = .init(0),
+
+    // Unfinished dependencies plus one guard count held by the spawning thread.
+    pending: std.atomic.Value(u32) = .init(0),
+
+    // Mutex protects the continuation list from a racing completion.
+    mutex: std.Thread.Mutex = .{},
+    completed: bool = false,
+    continuation_count: u8 = 0,
+    continuations: [max_continuations]u32 = undefined,
+
+    next_free: std.atomic.Value(u32) = .init(invalid_index),
+
+    fn getName(self: *const TaskSlot) []const u8 {
+        return self.name_buffer[0..self.name_len];
+    }
+
+    fn setName(self: *TaskSlot, name: []const u8) void {
+        const len = @min(name.len, task_name_capacity);
+        @memcpy(self.name_buffer[0..len], name[0..len]);
+        self.name_len = @intCast(len);
+    }
+};
+
+/// Fixed capacity Chase-Lev deque, the owning worker pushes and pops the bottom while thieves take from the top.
+/// Capacity is never smaller than the slot count so it can't overflow.
+const Deque = struct {
+    top: std.atomic.Value(i64) = .init(0),
+    bottom: std.atomic.Value(i64) = .init(0),
+    buffer: []std.atomic.Value(u32),
+
+    fn init(gpa: std.mem.Allocator, capacity: usize) !Deque {
+        const buffer = try gpa.alloc(std.atomic.Value(u32), std.math.ceilPowerOfTwoAssert(usize, capacity));
+        @memset(buffer, .init(invalid_index));
+        return .{ .buffer = buffer };
+    }
+
+    fn deinit(self: *Deque, gpa: std.mem.Allocator) void {
+        gpa.free(self.buffer);
+    }
+
+    fn slot(self: *Deque, i: i64) *std.atomic.Value(u32) {
+        return &self.buffer[@as(usize, @intCast(i)) & (self.buffer.len - 1)];
+    }
+
+    fn push(self: *Deque, index: u32) void {
+        const b = self.bottom.load(.monotonic);
+        const t = self.top.load(.acquire);
+        std.debug.assert(b - t < self.buffer.len);
+        self.slot(b).store(index, .monotonic);
+        self.bottom.store(b + 1, .release);
+    }
+
+    fn pop(self: *Deque) ?u32 {
+        const b = self.bottom.load(.monotonic) - 1;
+        self.bottom.store(b, .seq_cst);
+        const t = self.top.load(.seq_cst);
+
+        if (t > b) {
+            self.bottom.store(b + 1, .monotonic);
+            return null;
         }
-    };
-}
 
-pub const InitOptions = struct {
-    n_jobs: ?usize = null,
+        const index = self.slot(b).load(.monotonic);
+        if (t == b) {
+            // Last item, race any thieves for it
+            const won = self.top.cmpxchgStrong(t, t + 1, .seq_cst, .monotonic) == null;
+            self.bottom.store(b + 1, .monotonic);
+            return if (won) index else null;
+        }
+        return index;
+    }
+
+    fn steal(self: *Deque) ?u32 {
+        var t = self.top.load(.seq_cst);
+        while (t < self.bottom.load(.seq_cst)) {
+            const index = self.slot(t).load(.monotonic);
+            t = self.top.cmpxchgWeak(t, t + 1, .seq_cst, .seq_cst) orelse return index;
+        }
+        return null;
+    }
 };
 
-pub fn TaskContext(comptime T: type) type {
-    return struct {
-        name: []const u8,
-        data: T,
+/// Queue for tasks spawned from threads outside the pool
+const Injector = struct {
+    mutex: std.Thread.Mutex = .{},
+    buffer: []u32,
+    head: usize = 0,
+    len: std.atomic.Value(usize) = .init(0),
 
-        pool: *Self,
-        progress_node: ?std.Progress.Node,
-    };
-}
+    fn push(self: *Injector, index: u32) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const len = self.len.raw;
+        std.debug.assert(len < self.buffer.len);
+        self.buffer[(self.head + len) % self.buffer.len] = index;
+        self.len.store(len + 1, .release);
+    }
+
+    fn pop(self: *Injector) ?u32 {
+        if (self.len.load(.acquire) == 0) {
+            return null;
+        }
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const len = self.len.raw;
+        if (len == 0) {
+            return null;
+        }
+
+        const index = self.buffer[self.head];
+        self.head = (self.head + 1) % self.buffer.len;
+        self.len.store(len - 1, .release);
+        return index;
+    }
+};
+
+const Worker = struct {
+    pool: *Self,
+    index: usize,
+    thread: std.Thread = undefined,
+    deque: Deque,
+    rng_state: u32,
+
+    fn nextRandom(self: *Worker) u32 {
+        // xorshift32, only used to spread out steal victims
+        var x = self.rng_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        self.rng_state = x;
+        return x;
+    }
+};
+
+threadlocal var current_worker: ?*Worker = null;
 
 const ErrorEntry = struct {
     name: []const u8,
@@ -58,30 +187,124 @@ const ErrorList = std.ArrayList(ErrorEntry);
 const Self = @This();
 
 gpa: std.mem.Allocator,
-inner: *std.Thread.Pool,
+workers: []Worker,
+slots: []TaskSlot,
+injector: Injector,
+
+// The thread that created the pool, it runs tasks as thread index 0 while waiting.
+owner_thread: std.Thread.Id,
+
+// Index of the first free slot in the low 32 bits, ABA tag in the high 32 bits.
+free_head: std.atomic.Value(u64) = .init(invalid_index),
+
+// Bumped on every submission, idle workers sleep on it.
+work_epoch: std.atomic.Value(u32) = .init(0),
+sleeping: std.atomic.Value(u32) = .init(0),
+is_running: std.atomic.Value(bool) = .init(true),
 
 // Mutex protects the error list, which may be appended from many threads.
 err_mutex: std.Thread.Mutex = .{},
 err_list: ErrorList = .empty,
 
-pub fn init(gpa: std.mem.Allocator, opts: InitOptions) !Self {
-    const pool: *std.Thread.Pool = try gpa.create(std.Thread.Pool);
-    errdefer gpa.destroy(pool);
+/// Pool must not be moved after init since workers keep a pointer to it
+pub fn init(self: *Self, gpa: std.mem.Allocator, opts: InitOptions) !void {
+    const job_count = @max(1, opts.n_jobs orelse std.Thread.getCpuCount() catch 1);
+    const task_capacity = @max(1, opts.task_capacity);
 
-    try pool.init(.{ .allocator = gpa, .n_jobs = opts.n_jobs });
+    const slots = try gpa.alloc(TaskSlot, task_capacity);
+    errdefer gpa.free(slots);
 
-    return .{
+    const injector_buffer = try gpa.alloc(u32, task_capacity);
+    errdefer gpa.free(injector_buffer);
+
+    const workers = try gpa.alloc(Worker, job_count);
+    errdefer gpa.free(workers);
+
+    self.* = .{
         .gpa = gpa,
-        .inner = pool,
+        .workers = workers,
+        .slots = slots,
+        .injector = .{ .buffer = injector_buffer },
+        .owner_thread = std.Thread.getCurrentId(),
     };
+
+    for (slots, 0..) |*slot, i| {
+        slot.* = .{};
+        slot.next_free.raw = if (i + 1 < slots.len) @intCast(i + 1) else invalid_index;
+    }
+    self.free_head.raw = 0;
+
+    var deque_count: usize = 0;
+    errdefer for (workers[0..deque_count]) |*worker| worker.deque.deinit(gpa);
+    for (workers, 0..) |*worker, i| {
+        worker.* = .{
+            .pool = self,
+            .index = i,
+            .deque = try .init(gpa, task_capacity),
+            .rng_state = @intCast(i + 1),
+        };
+        deque_count += 1;
+    }
+
+    var spawned_count: usize = 0;
+    errdefer self.joinWorkers(workers[0..spawned_count]);
+    for (workers) |*worker| {
+        worker.thread = try std.Thread.spawn(.{}, workerMain, .{worker});
+        spawned_count += 1;
+    }
 }
 
 pub fn deinit(self: *Self) void {
-    self.inner.deinit();
-    self.gpa.destroy(self.inner);
+    self.joinWorkers(self.workers);
+
+    for (self.workers) |*worker| {
+        worker.deque.deinit(self.gpa);
+    }
+    self.gpa.free(self.workers);
+    self.gpa.free(self.injector.buffer);
+    self.gpa.free(self.slots);
+
+    for (self.err_list.items) |err| {
+        self.gpa.free(err.name);
+    }
     self.err_list.deinit(self.gpa);
 }
 
+fn joinWorkers(self: *Self, workers: []Worker) void {
+    self.is_running.store(false, .release);
+    _ = self.work_epoch.fetchAdd(1, .seq_cst);
+    std.Thread.Futex.wake(&self.work_epoch, std.math.maxInt(u32));
+
+    for (workers) |*worker| {
+        worker.thread.join();
+    }
+}
+
+pub fn getWorkerCount(self: *const Self) usize {
+    return self.workers.len;
+}
+
+/// Number of threads that can run tasks, the workers plus the thread that created the pool
+pub fn getThreadCount(self: *const Self) usize {
+    return self.workers.len + 1;
+}
+
+/// 0 for the thread that created the pool and 1 + worker index for workers, for indexing per-thread data
+pub fn getThreadIndex(self: *const Self) usize {
+    if (self.getCurrentWorker()) |worker| {
+        return worker.index + 1;
+    }
+
+    std.debug.assert(std.Thread.getCurrentId() == self.owner_thread);
+    return 0;
+}
+
+pub fn errorCount(self: *Self) usize {
+    self.err_mutex.lock();
+    defer self.err_mutex.unlock();
+    return self.err_list.items.len;
+}
+
 pub fn logErrors(self: *Self) void {
     self.err_mutex.lock();
     defer self.err_mutex.unlock();
@@ -94,58 +317,828 @@ pub fn logErrors(self: *Self) void {
     self.err_list.clearRetainingCapacity();
 }
 
+fn recordError(self: *Self, name: []const u8, err: anyerror) void {
+    self.err_mutex.lock();
+    defer self.err_mutex.unlock();
+
+    const task_name = self.gpa.dupe(u8, name) catch return;
+    self.err_list.append(self.gpa, .{
+        .name = task_name,
+        .err = err,
+    }) catch self.gpa.free(task_name);
+}
+
+fn Runner(comptime T: type, comptime run: anytype) type {
+    return struct {
+        fn runTask(pool: *Self, slot: *TaskSlot) void {
+            const name = slot.getName();
+            const child_node: ?std.Progress.Node = if (slot.progress_node) |node| node.start(name, 0) else null;
+            defer if (child_node) |node| node.end();
+
+            const data: *T = @ptrCast(@alignCast(&slot.data));
+
+            const ReturnType = @typeInfo(@TypeOf(run)).@"fn".return_type orelse void;
+            const can_error = switch (@typeInfo(ReturnType)) {
+                .error_union => true,
+                else => false,
+            };
+
+            if (can_error) {
+                run(pool, name, data.*, child_node) catch |err| pool.recordError(name, err);
+            } else {
+                run(pool, name, data.*, child_node);
+            }
+        }
+    };
+}
+
+/// Spawns a task that calls `run(pool, name, data, progress_node)`, the name is copied so it doesn't need to outlive the call.
 pub fn spawn(
     self: *Self,
     comptime T: type,
-    wg: *std.Thread.WaitGroup,
+    wg: ?*std.Thread.WaitGroup,
+    name: []const u8,
+    data: T,
+    progress_node: ?std.Progress.Node,
+    comptime run: anytype,
+) TaskHandle {
+    return self.spawnAfter(T, &.{}, wg, name, data, progress_node, run);
+}
+
+/// Same as spawn but the task is only scheduled once every task in `dependencies` has completed.
+pub fn spawnAfter(
+    self: *Self,
+    comptime T: type,
+    dependencies: []const TaskHandle,
+    wg: ?*std.Thread.WaitGroup,
     name: []const u8,
     data: T,
     progress_node: ?std.Progress.Node,
     comptime run: anytype,
-) !void {
-    const Ctx = TaskContext(T);
+) TaskHandle {
+    comptime {
+        if (@sizeOf(T) > task_data_size) @compileError("Task data " ++ @typeName(T) ++ " is too large, pass it by pointer instead");
+        if (@alignOf(T) > task_data_align) @compileError("Task data " ++ @typeName(T) ++ " is over aligned");
+    }
+
+    const index = self.acquireSlot();
+    const slot = &self.slots[index];
 
-    // Allocate the context on the heap so it outlives the caller's frame.
-    const ctx = try self.allocator.create(Ctx);
-    ctx.* = .{
-        .name = try self.allocator.dupe(u8, name),
-        .data = data,
-        .pool = self,
-        .progress_node = progress_node,
+    const slot_data: *T = @ptrCast(@alignCast(&slot.data));
+    slot_data.* = data;
+    slot.run_fn = Runner(T, run).runTask;
+    slot.setName(name);
+    slot.progress_node = progress_node;
+    slot.wait_group = wg;
+    slot.pending.store(@intCast(dependencies.len + 1), .monotonic);
+
+    if (wg) |wait_group| {
+        wait_group.start();
+    }
+
+    const handle: TaskHandle = .{
+        .index = index,
+        .generation = slot.generation.load(.monotonic),
     };
 
-    const Runner = struct {
-        fn runTask(c: *Ctx) void {
-            const child_node: ?std.Progress.Node = if (progress_node) |node| node.start(c.name, 0) else null;
-            defer if (child_node) |node| node.end();
+    for (dependencies) |dependency| {
+        if (!self.addContinuation(dependency, index)) {
+            // Never reaches zero here since the guard count is still held.
+            _ = slot.pending.fetchSub(1, .acq_rel);
+        }
+    }
 
-            c.progress_node = child_node;
+    self.resolveDependency(index);
+    return handle;
+}
 
-            const ReturnType = @typeInfo(@TypeOf(run)).@"fn".return_type orelse void;
-            const can_error = switch (@typeInfo(ReturnType)) {
-                .error_union => true,
-                else => false,
+pub fn isDone(self: *const Self, handle: TaskHandle) bool {
+    return self.slots[handle.index].generation.load(.acquire) != handle.generation;
+}
+
+/// Runs other tasks while waiting so it is safe to call from inside a task.
+pub fn wait(self: *Self, handle: TaskHandle) void {
+    while (!self.isDone(handle)) {
+        if (!self.helpOne()) {
+            std.Thread.yield() catch {};
+        }
+    }
+}
+
+/// Runs other tasks while waiting so it is safe to call from inside a task.
+pub fn waitAndWork(self: *Self, wg: *std.Thread.WaitGroup) void {
+    while (!wg.isDone()) {
+        if (!self.helpOne()) {
+            std.Thread.yield() catch {};
+        }
+    }
+    wg.wait();
+}
+
+pub const ParallelOptions = struct {
+    /// Raise this for cheap loop bodies so the per-chunk overhead stays small
+    min_grain_size: usize = 1,
+};
+
+pub const Range = struct {
+    /// Index of the chunk, chunks are numbered in range order from 0 to chunkCount
+    chunk: usize,
+    start: usize,
+    end: usize,
+};
+
+// Roughly how many chunks each thread gets, more gives stealing room to balance uneven work.
+const chunks_per_thread = 4;
+
+pub fn grainSize(self: *const Self, len: usize, options: ParallelOptions) usize {
+    const target_chunks = (self.workers.len + 1) * chunks_per_thread;
+    return @max(@max(options.min_grain_size, 1), std.math.divCeil(usize, len, target_chunks) catch unreachable);
+}
+
+/// Number of chunks parallelFor and parallelReduce will split `len` into, useful for sizing per-chunk outputs
+pub fn chunkCount(self: *const Self, len: usize, options: ParallelOptions) usize {
+    return std.math.divCeil(usize, len, self.grainSize(len, options)) catch unreachable;
+}
+
+fn BodyError(comptime body: anytype) type {
+    const ReturnType = @typeInfo(@TypeOf(body)).@"fn".return_type orelse void;
+    return switch (@typeInfo(ReturnType)) {
+        .error_union => |info| info.error_set,
+        else => error{},
+    };
+}
+
+fn BodyValue(comptime body: anytype) type {
+    const ReturnType = @typeInfo(@TypeOf(body)).@"fn".return_type orelse void;
+    return switch (@typeInfo(ReturnType)) {
+        .error_union => |info| info.payload,
+        else => ReturnType,
+    };
+}
+
+/// Non-failing bodies get a plain return type so callers don't need to catch an empty error set
+fn ParallelResult(comptime body: anytype, comptime T: type) type {
+    const E = BodyError(body);
+    return if (E == error{}) T else E!T;
+}
+
+fn callBody(comptime body: anytype, ctx: anytype, range: Range) BodyError(body)!BodyValue(body) {
+    return body(ctx, range);
+}
+
+/// Calls `body(ctx, range)` over chunks of 0..len across the pool, the calling thread helps until every chunk is done.
+/// If `body` returns an error the remaining chunks still run and the first error is returned.
+pub fn parallelFor(
+    self: *Self,
+    len: usize,
+    options: ParallelOptions,
+    ctx: anytype,
+    comptime body: anytype,
+) ParallelResult(body, void) {
+    const Reducer = struct {
+        fn combine(a: void, b: void) void {
+            _ = a; // autofix
+            _ = b; // autofix
+        }
+    };
+    return self.parallelReduce(void, len, options, {}, ctx, body, Reducer.combine);
+}
+
+/// Calls `map(ctx, range)` over chunks of 0..len and folds the results together with `combine`, starting from `identity`.
+/// Chunks complete in any order so `combine` must be associative and commutative.
+pub fn parallelReduce(
+    self: *Self,
+    comptime T: type,
+    len: usize,
+    options: ParallelOptions,
+    identity: T,
+    ctx: anytype,
+    comptime map: anytype,
+    comptime combine: fn (a: T, b: T) T,
+) ParallelResult(map, T) {
+    comptime std.debug.assert(BodyValue(map) == T);
+
+    const E = BodyError(map);
+    const Ctx = @TypeOf(ctx);
+
+    if (len == 0) {
+        return identity;
+    }
+
+    const grain_size = self.grainSize(len, options);
+
+    const Shared = struct {
+        ctx: Ctx,
+        mutex: std.Thread.Mutex = .{},
+        result: T,
+        first_err: ?E = null,
+
+        fn runChunk(shared: *@This(), range: Range) void {
+            const value = callBody(map, shared.ctx, range) catch |err| {
+                shared.mutex.lock();
+                defer shared.mutex.unlock();
+                if (shared.first_err == null) shared.first_err = err;
+                return;
             };
 
-            if (can_error) {
-                run(c.pool, c.name, c.data, c.progress_node) catch |err| {
-                    c.pool.err_mutex.lock();
-                    defer c.pool.err_mutex.unlock();
-
-                    const task_name = c.pool.gpa.dupe(u8, c.name) catch return;
-                    c.pool.err_list.append(c.pool.gpa, .{
-                        .name = task_name,
-                        .err = err,
-                    }) catch return;
-                };
-            } else {
-                run(c.pool, c.name, c.data, c.progress_node);
+            shared.mutex.lock();
+            defer shared.mutex.unlock();
+            shared.result = combine(shared.result, value);
+        }
+    };
+
+    const Chunk = struct {
+        shared: *Shared,
+        range: Range,
+
+        fn run(pool: *Self, name: []const u8, chunk: @This(), progress_node: ?std.Progress.Node) void {
+            _ = pool; // autofix
+            _ = name; // autofix
+            _ = progress_node; // autofix
+            chunk.shared.runChunk(chunk.range);
+        }
+    };
+
+    var shared: Shared = .{ .ctx = ctx, .result = identity };
+    var wait_group: std.Thread.WaitGroup = .{};
+
+    // The first chunk is kept for the calling thread
+    var chunk_index: usize = 1;
+    var start: usize = grain_size;
+    while (start < len) : ({
+        start += grain_size;
+        chunk_index += 1;
+    }) {
+        _ = self.spawn(Chunk, &wait_group, "parallel chunk", .{
+            .shared = &shared,
+            .range = .{ .chunk = chunk_index, .start = start, .end = @min(start + grain_size, len) },
+        }, null, Chunk.run);
+    }
+
+    shared.runChunk(.{ .chunk = 0, .start = 0, .end = @min(grain_size, len) });
+    self.waitAndWork(&wait_group);
+
+    if (E != error{}) {
+        if (shared.first_err) |err| {
+            return err;
+        }
+    }
+    return shared.result;
+}
+
+/// Returns false if the dependency has already completed.
+fn addContinuation(self: *Self, dependency: TaskHandle, index: u32) bool {
+    const slot = &self.slots[dependency.index];
+
+    while (true) {
+        slot.mutex.lock();
+        if (slot.generation.load(.monotonic) != dependency.generation or slot.completed) {
+            slot.mutex.unlock();
+            return false;
+        }
+
+        if (slot.continuation_count < max_continuations) {
+            slot.continuations[slot.continuation_count] = index;
+            slot.continuation_count += 1;
+            slot.mutex.unlock();
+            return true;
+        }
+        slot.mutex.unlock();
+
+        // No room left to chain on, so wait it out instead.
+        self.wait(dependency);
+    }
+}
+
+fn resolveDependency(self: *Self, index: u32) void {
+    if (self.slots[index].pending.fetchSub(1, .acq_rel) == 1) {
+        self.schedule(index);
+    }
+}
+
+fn schedule(self: *Self, index: u32) void {
+    if (self.getCurrentWorker()) |worker| {
+        worker.deque.push(index);
+    } else {
+        self.injector.push(index);
+    }
+
+    _ = self.work_epoch.fetchAdd(1, .seq_cst);
+    if (self.sleeping.load(.seq_cst) > 0) {
+        std.Thread.Futex.wake(&self.work_epoch, 1);
+    }
+}
+
+fn acquireSlot(self: *Self) u32 {
+    while (true) {
+        var head = self.free_head.load(.acquire);
+        while (true) {
+            const index: u32 = @truncate(head);
+            if (index == invalid_index) {
+                break;
+            }
+
+            const tag: u32 = @truncate(head >> 32);
+            const next = self.slots[index].next_free.load(.monotonic);
+            const new_head = (@as(u64, tag +% 1) << 32) | next;
+            head = self.free_head.cmpxchgWeak(head, new_head, .acq_rel, .acquire) orelse {
+                const slot = &self.slots[index];
+                slot.mutex.lock();
+                defer slot.mutex.unlock();
+                slot.completed = false;
+                slot.continuation_count = 0;
+                return index;
+            };
+        }
+
+        // Every slot is in flight, help drain the pool until one frees up.
+        if (!self.helpOne()) {
+            std.Thread.yield() catch {};
+        }
+    }
+}
+
+fn releaseSlot(self: *Self, index: u32) void {
+    const slot = &self.slots[index];
+    _ = slot.generation.fetchAdd(1, .release);
+
+    var head = self.free_head.load(.monotonic);
+    while (true) {
+        slot.next_free.store(@truncate(head), .monotonic);
+        const tag: u32 = @truncate(head >> 32);
+        const new_head = (@as(u64, tag +% 1) << 32) | index;
+        head = self.free_head.cmpxchgWeak(head, new_head, .release, .monotonic) orelse return;
+    }
+}
+
+fn execute(self: *Self, index: u32) void {
+    const slot = &self.slots[index];
+    slot.run_fn(self, slot);
+
+    var continuations: [max_continuations]u32 = undefined;
+    slot.mutex.lock();
+    slot.completed = true;
+    const continuation_count = slot.continuation_count;
+    @memcpy(continuations[0..continuation_count], slot.continuations[0..continuation_count]);
+    slot.mutex.unlock();
+
+    const wait_group = slot.wait_group;
+    self.releaseSlot(index);
+
+    for (continuations[0..continuation_count]) |continuation| {
+        self.resolveDependency(continuation);
+    }
+
+    if (wait_group) |wg| {
+        wg.finish();
+    }
+}
+
+fn findTask(self: *Self, worker: ?*Worker) ?u32 {
+    if (worker) |w| {
+        if (w.deque.pop()) |index| {
+            return index;
+        }
+    }
+
+    if (self.injector.pop()) |index| {
+        return index;
+    }
+
+    const start: usize = if (worker) |w| w.nextRandom() else 0;
+    for (0..self.workers.len) |offset| {
+        const victim = &self.workers[(start + offset) % self.workers.len];
+        if (victim == worker) {
+            continue;
+        }
+
+        if (victim.deque.steal()) |index| {
+            return index;
+        }
+    }
+
+    return null;
+}
+
+fn getCurrentWorker(self: *const Self) ?*Worker {
+    if (current_worker) |worker| {
+        if (worker.pool == self) {
+            return worker;
+        }
+    }
+    return null;
+}
+
+fn helpOne(self: *Self) bool {
+    if (self.findTask(self.getCurrentWorker())) |index| {
+        self.execute(index);
+        return true;
+    }
+    return false;
+}
+
+fn workerMain(worker: *Worker) void {
+    current_worker = worker;
+    defer current_worker = null;
+
+    const pool = worker.pool;
+    while (true) {
+        const epoch = pool.work_epoch.load(.acquire);
+        if (pool.findTask(worker)) |index| {
+            pool.execute(index);
+            continue;
+        }
+
+        if (!pool.is_running.load(.acquire)) {
+            break;
+        }
+
+        // Sleeping is skipped if anything was submitted since the epoch was read.
+        _ = pool.sleeping.fetchAdd(1, .seq_cst);
+        std.Thread.Futex.wait(&pool.work_epoch, epoch);
+        _ = pool.sleeping.fetchSub(1, .seq_cst);
+    }
+}
+
+test "task_pool.spawn_and_wait" {
+    const Counter = struct {
+        count: *std.atomic.Value(u32),
+
+        fn run(pool: *Self, name: []const u8, data: @This(), progress_node: ?std.Progress.Node) void {
+            _ = pool;
+            _ = name;
+            _ = progress_node;
+            _ = data.count.fetchAdd(1, .monotonic);
+        }
+    };
+
+    var pool: Self = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 4 });
+    defer pool.deinit();
+
+    var count: std.atomic.Value(u32) = .init(0);
+    var wait_group: std.Thread.WaitGroup = .{};
+    for (0..1000) |_| {
+        _ = pool.spawn(Counter, &wait_group, "counter", .{ .count = &count }, null, Counter.run);
+    }
+    pool.waitAndWork(&wait_group);
+    try std.testing.expectEqual(@as(u32, 1000), count.load(.monotonic));
+
+    // Handles outlive their slot, a finished task stays done after the slot is reused
+    const handle = pool.spawn(Counter, null, "counter", .{ .count = &count }, null, Counter.run);
+    pool.wait(handle);
+    try std.testing.expect(pool.isDone(handle));
+    try std.testing.expectEqual(@as(u32, 1001), count.load(.monotonic));
+
+    const reused = pool.spawn(Counter, null, "counter", .{ .count = &count }, null, Counter.run);
+    try std.testing.expect(pool.isDone(handle));
+    pool.wait(reused);
+    try std.testing.expectEqual(@as(u32, 1002), count.load(.monotonic));
+}
+
+test "task_pool.continuation_ordering" {
+    const Step = struct {
+        log: *std.ArrayList(u32),
+        mutex: *std.Thread.Mutex,
+        id: u32,
+        sleep_ns: u64,
+
+        fn run(pool: *Self, name: []const u8, data: @This(), progress_node: ?std.Progress.Node) void {
+            _ = pool;
+            _ = name;
+            _ = progress_node;
+            // Gives the dependents a chance to run too early if continuations were broken
+            std.Thread.sleep(data.sleep_ns);
+            data.mutex.lock();
+            defer data.mutex.unlock();
+            data.log.appendAssumeCapacity(data.id);
+        }
+    };
+
+    var pool: Self = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 4 });
+    defer pool.deinit();
+
+    var log: std.ArrayList(u32) = try .initCapacity(std.testing.allocator, 64);
+    defer log.deinit(std.testing.allocator);
+    var mutex: std.Thread.Mutex = .{};
+
+    for (0..20) |_| {
+        log.clearRetainingCapacity();
+        var wait_group: std.Thread.WaitGroup = .{};
+
+        // A chain, then more dependents of the root than it has continuation slots for, then a join on everything
+        const root = pool.spawn(Step, &wait_group, "root", .{ .log = &log, .mutex = &mutex, .id = 0, .sleep_ns = std.time.ns_per_ms }, null, Step.run);
+        const middle = pool.spawnAfter(Step, &.{root}, &wait_group, "middle", .{ .log = &log, .mutex = &mutex, .id = 1, .sleep_ns = 100 * std.time.ns_per_us }, null, Step.run);
+
+        var fan_out: [max_continuations + 4]TaskHandle = undefined;
+        for (&fan_out) |*handle| {
+            handle.* = pool.spawnAfter(Step, &.{root}, &wait_group, "fan out", .{ .log = &log, .mutex = &mutex, .id = 2, .sleep_ns = 0 }, null, Step.run);
+        }
+
+        var join_dependencies: [fan_out.len + 1]TaskHandle = undefined;
+        join_dependencies[0] = middle;
+        @memcpy(join_dependencies[1..], &fan_out);
+        _ = pool.spawnAfter(Step, &join_dependencies, &wait_group, "join", .{ .log = &log, .mutex = &mutex, .id = 3, .sleep_ns = 0 }, null, Step.run);
+
+        pool.waitAndWork(&wait_group);
+
+        try std.testing.expectEqual(@as(usize, fan_out.len + 3), log.items.len);
+        try std.testing.expectEqual(@as(u32, 0), log.items[0]);
+        try std.testing.expectEqual(@as(u32, 3), log.items[log.items.len - 1]);
+        for (log.items[1 .. log.items.len - 1]) |id| {
+            try std.testing.expect(id == 1 or id == 2);
+        }
+    }
+}
+
+test "task_pool.slot_exhaustion" {
+    const Spawner = struct {
+        count: *std.atomic.Value(u32),
+        wait_group: *std.Thread.WaitGroup,
+
+        fn leaf(pool: *Self, name: []const u8, data: @This(), progress_node: ?std.Progress.Node) void {
+            _ = pool;
+            _ = name;
+            _ = progress_node;
+            _ = data.count.fetchAdd(1, .monotonic);
+        }
+
+        // Spawning from inside a task with every other slot taken has to run the queued leaves instead of spinning
+        fn run(pool: *Self, name: []const u8, data: @This(), progress_node: ?std.Progress.Node) void {
+            _ = name;
+            _ = progress_node;
+            for (0..50) |_| {
+                _ = pool.spawn(@This(), data.wait_group, "leaf", data, null, leaf);
+            }
+        }
+    };
+
+    var pool: Self = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 3, .task_capacity = 4 });
+    defer pool.deinit();
+
+    var count: std.atomic.Value(u32) = .init(0);
+    var wait_group: std.Thread.WaitGroup = .{};
+    const data: Spawner = .{ .count = &count, .wait_group = &wait_group };
+
+    // From outside the pool
+    for (0..100) |_| {
+        _ = pool.spawn(Spawner, &wait_group, "leaf", data, null, Spawner.leaf);
+    }
+    pool.waitAndWork(&wait_group);
+    try std.testing.expectEqual(@as(u32, 100), count.load(.monotonic));
+
+    // From a worker
+    _ = pool.spawn(Spawner, &wait_group, "spawner", data, null, Spawner.run);
+    pool.waitAndWork(&wait_group);
+    try std.testing.expectEqual(@as(u32, 150), count.load(.monotonic));
+
+    // Every slot went back to the free list
+    var free_count: usize = 0;
+    var index: u32 = @truncate(pool.free_head.load(.acquire));
+    while (index != invalid_index) : (index = pool.slots[index].next_free.load(.monotonic)) {
+        free_count += 1;
+    }
+    try std.testing.expectEqual(pool.slots.len, free_count);
+}
+
+test "task_pool.deque_steal_contention" {
+    const item_count = 50_000;
+    const thief_count = 3;
+
+    const Shared = struct {
+        deque: Deque,
+        taken: [item_count]std.atomic.Value(u8) = @splat(.init(0)),
+        done: std.atomic.Value(bool) = .init(false),
+
+        fn take(shared: *@This(), index: u32) void {
+            _ = shared.taken[index].fetchAdd(1, .monotonic);
+        }
+
+        fn thief(shared: *@This()) void {
+            while (true) {
+                if (shared.deque.steal()) |index| {
+                    shared.take(index);
+                } else if (shared.done.load(.acquire)) {
+                    break;
+                } else {
+                    std.atomic.spinLoopHint();
+                }
+            }
+        }
+    };
+
+    const shared = try std.testing.allocator.create(Shared);
+    defer std.testing.allocator.destroy(shared);
+    shared.* = .{ .deque = try .init(std.testing.allocator, item_count) };
+    defer shared.deque.deinit(std.testing.allocator);
+
+    var threads: [thief_count]std.Thread = undefined;
+    for (&threads) |*thread| {
+        thread.* = try std.Thread.spawn(.{}, Shared.thief, .{shared});
+    }
+
+    // The owner keeps popping between pushes so the bottom is contended the whole time
+    for (0..item_count) |i| {
+        shared.deque.push(@intCast(i));
+        if (i % 3 == 0) {
+            if (shared.deque.pop()) |index| shared.take(index);
+        }
+    }
+    while (shared.deque.pop()) |index| shared.take(index);
+
+    shared.done.store(true, .release);
+    for (threads) |thread| thread.join();
+
+    for (&shared.taken) |*taken| {
+        try std.testing.expectEqual(@as(u8, 1), taken.load(.monotonic));
+    }
+}
+
+test "task_pool.deque_last_item_race" {
+    const round_count = 20_000;
+
+    // The thief steals once per round while the owner pops the single item it just pushed
+    const Race = struct {
+        deque: Deque,
+        round: std.atomic.Value(u32) = .init(0),
+        finished_round: std.atomic.Value(u32) = .init(0),
+        stolen: std.atomic.Value(u32) = .init(invalid_index),
+        stop: std.atomic.Value(bool) = .init(false),
+
+        fn thief(race: *@This()) void {
+            var seen: u32 = 0;
+            while (true) {
+                const round = race.round.load(.acquire);
+                if (round == seen) {
+                    if (race.stop.load(.acquire)) break;
+                    std.atomic.spinLoopHint();
+                    continue;
+                }
+                seen = round;
+                race.stolen.store(race.deque.steal() orelse invalid_index, .monotonic);
+                race.finished_round.store(round, .release);
+            }
+        }
+    };
+
+    var race: Race = .{ .deque = try .init(std.testing.allocator, 16) };
+    defer race.deque.deinit(std.testing.allocator);
+
+    const thread = try std.Thread.spawn(.{}, Race.thief, .{&race});
+    defer {
+        race.stop.store(true, .release);
+        race.round.store(round_count + 1, .release);
+        thread.join();
+    }
+
+    for (1..round_count + 1) |round_index| {
+        const round: u32 = @intCast(round_index);
+        race.deque.push(round);
+        race.round.store(round, .release);
+        const popped = race.deque.pop();
+
+        while (race.finished_round.load(.acquire) != round) {
+            std.atomic.spinLoopHint();
+        }
+        const stolen = race.stolen.load(.monotonic);
+
+        // Exactly one side gets the item, never both and never neither
+        if (popped) |index| {
+            try std.testing.expectEqual(round, index);
+            try std.testing.expectEqual(invalid_index, stolen);
+        } else {
+            try std.testing.expectEqual(round, stolen);
+        }
+        try std.testing.expect(race.deque.pop() == null);
+    }
+}
+
+test "task_pool.parallel_for_ranges" {
+    const Hits = struct {
+        hits: []std.atomic.Value(u32),
+        chunks: []std.atomic.Value(u32),
+        grain_size: usize,
+
+        fn body(ctx: *const @This(), range: Range) void {
+            std.debug.assert(range.start == range.chunk * ctx.grain_size);
+            std.debug.assert(range.start < range.end and range.end - range.start <= ctx.grain_size);
+            _ = ctx.chunks[range.chunk].fetchAdd(1, .monotonic);
+            for (range.start..range.end) |i| {
+                _ = ctx.hits[i].fetchAdd(1, .monotonic);
             }
+        }
+    };
+
+    var pool: Self = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 3 });
+    defer pool.deinit();
+
+    const max_len = 1237;
+    const hits = try std.testing.allocator.alloc(std.atomic.Value(u32), max_len);
+    defer std.testing.allocator.free(hits);
+    const chunks = try std.testing.allocator.alloc(std.atomic.Value(u32), max_len);
+    defer std.testing.allocator.free(chunks);
+
+    // Empty, fewer items than a grain, exact multiples and ranges that leave a short last chunk
+    for ([_]usize{ 0, 1, 5, 63, 64, 65, 1000, max_len }) |len| {
+        for ([_]usize{ 0, 1, 7, 64, 10_000 }) |min_grain_size| {
+            const options: ParallelOptions = .{ .min_grain_size = min_grain_size };
+            @memset(hits, .init(0));
+            @memset(chunks, .init(0));
+
+            const ctx: Hits = .{ .hits = hits, .chunks = chunks, .grain_size = pool.grainSize(len, options) };
+            pool.parallelFor(len, options, &ctx, Hits.body);
+
+            for (hits[0..len]) |*hit| try std.testing.expectEqual(@as(u32, 1), hit.load(.monotonic));
+            for (hits[len..]) |*hit| try std.testing.expectEqual(@as(u32, 0), hit.load(.monotonic));
 
-            ctx.pool.gpa.free(c.name);
-            ctx.pool.gpa.destroy(c);
+            const chunk_count = pool.chunkCount(len, options);
+            for (chunks[0..chunk_count]) |*chunk| try std.testing.expectEqual(@as(u32, 1), chunk.load(.monotonic));
+            for (chunks[chunk_count..]) |*chunk| try std.testing.expectEqual(@as(u32, 0), chunk.load(.monotonic));
+        }
+    }
+}
+
+test "task_pool.parallel_for_error" {
+    const Failing = struct {
+        hits: *std.atomic.Value(usize),
+
+        fn body(ctx: @This(), range: Range) error{OddChunk}!void {
+            _ = ctx.hits.fetchAdd(range.end - range.start, .monotonic);
+            if (range.chunk % 2 == 1) return error.OddChunk;
         }
     };
 
-    self.inner.spawnWg(wg, Runner.runTask, .{ctx});
+    var pool: Self = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 3 });
+    defer pool.deinit();
+
+    var hits: std.atomic.Value(usize) = .init(0);
+
+    // Every chunk still runs after one fails
+    try std.testing.expectError(error.OddChunk, pool.parallelFor(1000, .{ .min_grain_size = 10 }, Failing{ .hits = &hits }, Failing.body));
+    try std.testing.expectEqual(@as(usize, 1000), hits.load(.monotonic));
+
+    // A single chunk is only ever chunk 0, which doesn't fail
+    hits.store(0, .monotonic);
+    try pool.parallelFor(5, .{ .min_grain_size = 10 }, Failing{ .hits = &hits }, Failing.body);
+    try std.testing.expectEqual(@as(usize, 5), hits.load(.monotonic));
+
+    try pool.parallelFor(0, .{}, Failing{ .hits = &hits }, Failing.body);
+    try std.testing.expectEqual(@as(usize, 5), hits.load(.monotonic));
+}
+
+test "task_pool.parallel_reduce" {
+    const Reduce = struct {
+        values: []const u64,
+
+        fn sum(ctx: @This(), range: Range) u64 {
+            var total: u64 = 0;
+            for (ctx.values[range.start..range.end]) |value| total += value;
+            return total;
+        }
+
+        fn add(a: u64, b: u64) u64 {
+            return a + b;
+        }
+
+        fn minimum(ctx: @This(), range: Range) error{Empty}!u64 {
+            if (range.start == range.end) return error.Empty;
+            return std.mem.min(u64, ctx.values[range.start..range.end]);
+        }
+
+        fn min(a: u64, b: u64) u64 {
+            return @min(a, b);
+        }
+    };
+
+    var pool: Self = undefined;
+    try pool.init(std.testing.allocator, .{ .n_jobs = 3 });
+    defer pool.deinit();
+
+    var prng: std.Random.DefaultPrng = .init(0x5eed);
+    const random = prng.random();
+
+    const values = try std.testing.allocator.alloc(u64, 4099);
+    defer std.testing.allocator.free(values);
+    for (values) |*value| value.* = random.intRangeAtMost(u64, 1, 1_000_000);
+
+    for ([_]usize{ 0, 1, 2, 17, 256, 4096, values.len }) |len| {
+        for ([_]usize{ 1, 3, 100, 5000 }) |min_grain_size| {
+            const options: ParallelOptions = .{ .min_grain_size = min_grain_size };
+            const ctx: Reduce = .{ .values = values[0..len] };
+
+            var expected_sum: u64 = 0;
+            for (values[0..len]) |value| expected_sum += value;
+            const expected_min = if (len == 0) std.math.maxInt(u64) else std.mem.min(u64, values[0..len]);
+
+            try std.testing.expectEqual(expected_sum, pool.parallelReduce(u64, len, options, 0, ctx, Reduce.sum, Reduce.add));
+            try std.testing.expectEqual(expected_min, try pool.parallelReduce(u64, len, options, std.math.maxInt(u64), ctx, Reduce.minimum, Reduce.min));
+        }
+    }
+
+    // Nothing to fold, the identity comes back untouched
+    try std.testing.expectEqual(@as(u64, 7), pool.parallelReduce(u64, 0, .{}, 7, Reduce{ .values = values }, Reduce.sum, Reduce.add));
 }
@@ -1,7 +1,9 @@
 const std = @import("std");
 
 const MAGIC: [8]u8 = .{ 'S', '-', 'A', 'S', 'S', 'E', 'T', 'S' };
-const VERSION: usize = 1;
+/// Bump whenever a serialized asset layout changes, older files are then rejected instead of misread.
+/// 2: Meshlet gained cone_axis_cutoff
+const VERSION: usize = 2;
 
 pub const HeaderV1 = extern struct {
     magic: [8]u8 = MAGIC,
@@ -34,6 +34,8 @@ pub const Primitive = struct {
 
 pub const Meshlet = extern struct {
     sphere_pos_radius: [4]f32,
+    /// Normal cone for backface culling, axis in xyz and cos of the cutoff angle in w
+    cone_axis_cutoff: [4]f32,
     vertex_offset: u32,
     vertex_count: u32,
     triangle_offset: u32,
@@ -240,6 +240,7 @@ pub fn generateMeshlets(
         );
         dst.* = .{
             .sphere_pos_radius = .{ bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius },
+            .cone_axis_cutoff = .{ bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff },
             .vertex_offset = src.vertex_offset,
             .vertex_count = src.vertex_count,
             .triangle_offset = src.triangle_offset,
@@ -0,0 +1,97 @@
+//Microbenchmark for frustum culling, compares the scalar Frustum.intersects loop with the SoA batch kernel.
+//Run with: zig build bench-culling -Doptimize=ReleaseFast
+
+const std = @import("std");
+
+const zm = @import("zmath");
+
+const culling = @import("rendering/culling.zig");
+const TaskPool = @import("TaskPool.zig");
+
+const SPHERE_COUNT = 100_000;
+const ITERATIONS = 200;
+
+pub fn main() !void {
+    var debug_allocator = std.heap.DebugAllocator(.{}).init;
+    defer _ = debug_allocator.deinit();
+    const gpa = debug_allocator.allocator();
+
+    var prng = std.Random.DefaultPrng.init(0x5A7_0C0);
+    const random = prng.random();
+
+    const spheres = try gpa.alloc(culling.Sphere, SPHERE_COUNT);
+    defer gpa.free(spheres);
+
+    var sphere_list: culling.SphereList = .empty;
+    defer sphere_list.deinit(gpa);
+    try sphere_list.ensureTotalCapacity(gpa, SPHERE_COUNT);
+
+    for (spheres) |*sphere| {
+        sphere.* = .{ .pos_radius = .{
+            random.float(f32) * 200.0 - 100.0,
+            random.float(f32) * 200.0 - 100.0,
+            random.float(f32) * 200.0 - 100.0,
+            random.float(f32) * 2.0 + 0.1,
+        } };
+        sphere_list.appendAssumeCapacity(.fromSphere(sphere.*));
+    }
+
+    const view_matrix = zm.lookAtLh(zm.f32x4(0.0, 0.0, -10.0, 1.0), zm.f32x4(0.0, 0.0, 0.0, 1.0), zm.f32x4(0.0, 1.0, 0.0, 0.0));
+    const projection_matrix = zm.perspectiveFovLh(std.math.degreesToRadians(70.0), 16.0 / 9.0, 0.1, 150.0);
+    const frustum: culling.Frustum = .fromViewProjectionMatrix(zm.mul(view_matrix, projection_matrix));
+
+    const scalar_indices = try gpa.alloc(u32, SPHERE_COUNT);
+    defer gpa.free(scalar_indices);
+    const batch_indices = try gpa.alloc(u32, SPHERE_COUNT);
+    defer gpa.free(batch_indices);
+
+    const soa = culling.SphereSlices.fromList(&sphere_list);
+
+    var scalar_count: usize = 0;
+    var timer = try std.time.Timer.start();
+    for (0..ITERATIONS) |_| {
+        scalar_count = culling.cullSpheresScalar(&frustum, spheres, scalar_indices);
+        std.mem.doNotOptimizeAway(scalar_count);
+    }
+    const scalar_ns = timer.lap();
+
+    var batch_count: usize = 0;
+    for (0..ITERATIONS) |_| {
+        batch_count = culling.cullSpheres(&frustum, soa, 0, SPHERE_COUNT, batch_indices);
+        std.mem.doNotOptimizeAway(batch_count);
+    }
+    const batch_ns = timer.lap();
+
+    var task_pool: TaskPool = undefined;
+    try task_pool.init(gpa, .{});
+    defer task_pool.deinit();
+
+    const parallel_buffers: culling.ParallelCullBuffers = .{
+        .indices = try gpa.alloc(u32, SPHERE_COUNT),
+        .chunk_counts = try gpa.alloc(u32, task_pool.chunkCount(SPHERE_COUNT, culling.parallel_options)),
+    };
+    defer gpa.free(parallel_buffers.indices);
+    defer gpa.free(parallel_buffers.chunk_counts);
+
+    var parallel_indices: []u32 = &.{};
+    _ = timer.lap();
+    for (0..ITERATIONS) |_| {
+        parallel_indices = culling.cullSpheresParallel(&task_pool, &frustum, soa, parallel_buffers);
+        std.mem.doNotOptimizeAway(parallel_indices.len);
+    }
+    const parallel_ns = timer.lap();
+
+    if (scalar_count != batch_count or
+        !std.mem.eql(u32, scalar_indices[0..scalar_count], batch_indices[0..batch_count]) or
+        !std.mem.eql(u32, scalar_indices[0..scalar_count], parallel_indices))
+    {
+        // Spheres sitting exactly on a plane can round differently between the two paths
+        std.log.warn("Culling results differ: scalar {} batch {} parallel {}", .{ scalar_count, batch_count, parallel_indices.len });
+    }
+
+    const per_sphere = @as(f64, @floatFromInt(SPHERE_COUNT * ITERATIONS));
+    std.log.info("{} spheres, {} visible, {} iterations", .{ SPHERE_COUNT, scalar_count, ITERATIONS });
+    std.log.info("scalar:   {d:.3} ns/sphere", .{@as(f64, @floatFromInt(scalar_ns)) / per_sphere});
+    std.log.info("batch x{}: {d:.3} ns/sphere", .{ culling.batch_lanes, @as(f64, @floatFromInt(batch_ns)) / per_sphere });
+    std.log.info("parallel ({} threads): {d:.3} ns/sphere", .{ task_pool.getThreadCount(), @as(f64, @floatFromInt(parallel_ns)) / per_sphere });
+}
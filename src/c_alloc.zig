@@ -1,110 +1,508 @@
+//Allocator for C/C++ libraries, small blocks come from size-class slabs cached per thread.
+//Slabs live in span_size aligned spans, so the size class of any pointer is found by masking it down to the span header.
+//Blocks larger than the biggest size class go straight to the backing allocator with the same header layout.
+
 const std = @import("std");
 
-pub var mem_allocator: ?std.mem.Allocator = null;
-const Metadata = struct {
-    size: usize,
+const span_size = 64 * 1024;
+const span_alignment: std.mem.Alignment = .fromByteUnits(span_size);
+
+/// Alignments above this are rejected, larger would put the data past the first span of a large allocation
+pub const max_alignment = span_size / 2;
+
+/// Alignment of blocks from alloc/calloc/realloc, matches max_align_t
+const default_alignment = 16;
+
+/// Slab blocks are never aligned past this, requests for more take the large path
+const max_block_alignment = 4096;
+
+const span_magic: u32 = 0x5A7A_11C0;
+const large_class: u32 = std.math.maxInt(u32);
+
+// Header size is a multiple of 64 so blocks in every class start on a cache line.
+const SpanHeader = extern struct {
+    magic: u32,
+    size_class: u32,
+
+    // Only used by large allocations
+    total_len: usize,
     alignment: usize,
+
+    fn fromPtr(ptr: *anyopaque) *SpanHeader {
+        const header: *SpanHeader = @ptrFromInt(std.mem.alignBackward(usize, @intFromPtr(ptr), span_size));
+        std.debug.assert(header.magic == span_magic);
+        return header;
+    }
 };
+const span_header_size = std.mem.alignForward(usize, @sizeOf(SpanHeader), 64);
+
+/// 16 byte steps up to 128, then 4 steps per power of two
+pub const size_classes = blk: {
+    var table: [8 + 4 * 7]u32 = undefined;
+    for (0..8) |i| {
+        table[i] = 16 * (i + 1);
+    }
+
+    var pow: u32 = 128;
+    var i: usize = 8;
+    while (i < table.len) : (pow *= 2) {
+        for (1..5) |step| {
+            table[i] = pow + (pow / 4) * step;
+            i += 1;
+        }
+    }
+    break :blk table;
+};
+pub const class_count = size_classes.len;
+pub const max_small_size = size_classes[class_count - 1];
+
+fn sizeToClass(size: usize) usize {
+    if (size <= 128) {
+        return (@max(size, 1) + 15) / 16 - 1;
+    }
 
-pub fn alloc(size: usize) callconv(.C) ?*anyopaque {
-    return alignedAlloc(size, 64);
+    const k: usize = std.math.log2_int(usize, size - 1);
+    const pow = @as(usize, 1) << @intCast(k);
+    const step = pow / 4;
+    return 8 + (k - 7) * 4 + (size - pow + step - 1) / step - 1;
 }
 
-pub fn calloc(count: usize, size: usize) callconv(.C) ?*anyopaque {
-    return alloc(count * size);
+fn classBlockAlignment(class: usize) usize {
+    const size = size_classes[class];
+    return @min(@as(usize, 1) << @ctz(size), max_block_alignment);
 }
 
-pub fn realloc(maybe_ptr: ?*anyopaque, new_size: usize) callconv(.C) ?*anyopaque {
-    if (maybe_ptr) |data_ptr| {
-        const data_ptr_int: usize = @intFromPtr(data_ptr);
-        const allocation_ptr: [*]u8 = @ptrFromInt(data_ptr_int - @sizeOf(Metadata));
-        const metadata_ptr: *Metadata = @ptrCast(@alignCast(allocation_ptr));
-        return reallocate(maybe_ptr, metadata_ptr.size + @sizeOf(Metadata), new_size);
+/// Returns null if the request needs the large path
+fn findClass(size: usize, alignment: usize) ?usize {
+    if (size > max_small_size or alignment > max_block_alignment) {
+        return null;
+    }
+
+    var class = sizeToClass(size);
+    while (class < class_count) : (class += 1) {
+        if (classBlockAlignment(class) >= alignment) {
+            return class;
+        }
     }
     return null;
 }
 
-pub fn alignedAlloc(size: usize, alignment: usize) callconv(.C) ?*anyopaque {
-    if (mem_allocator) |allocator| {
-        const allocation_size = size + alignment;
+const FreeBlock = struct {
+    next: ?*FreeBlock,
+};
 
-        const allocation: []u8 = switch (alignment) {
-            16 => allocator.alignedAlloc(u8, 16, allocation_size),
-            32 => allocator.alignedAlloc(u8, 32, allocation_size),
-            64 => allocator.alignedAlloc(u8, 64, allocation_size),
-            else => |x| std.debug.panic("Unsupported memory aligment: {}", .{x}),
-        } catch return null;
+pub const ClassStats = struct {
+    block_size: usize = 0,
+    span_count: usize = 0,
+    alloc_count: usize = 0,
+    free_count: usize = 0,
 
-        const data_ptr_int: usize = @as(usize, @intFromPtr(allocation.ptr)) + alignment;
-        const data_ptr: *u8 = @ptrFromInt(data_ptr_int);
-        const metadata_ptr: *Metadata = @ptrFromInt(data_ptr_int - @sizeOf(Metadata));
-        metadata_ptr.size = size;
-        metadata_ptr.alignment = alignment;
+    pub fn liveBlocks(self: ClassStats) usize {
+        return self.alloc_count -| self.free_count;
+    }
+};
 
-        return data_ptr;
+pub const Stats = struct {
+    classes: [class_count]ClassStats = undefined,
+    large_alloc_count: usize = 0,
+    large_free_count: usize = 0,
+    large_live_bytes: usize = 0,
+
+    pub fn spanBytes(self: *const Stats) usize {
+        var total: usize = 0;
+        for (self.classes) |class| {
+            total += class.span_count * span_size;
+        }
+        return total;
     }
-    return null;
+};
+
+const SizeClass = struct {
+    mutex: std.Thread.Mutex = .{},
+    free_list: ?*FreeBlock = null,
+    free_count: usize = 0,
+    spans: std.ArrayList([*]align(span_size) u8) = .empty,
+    stats: ClassStats = .{},
+
+    fn blockCount(class: usize) usize {
+        const first_block = std.mem.alignForward(usize, span_header_size, classBlockAlignment(class));
+        return (span_size - first_block) / size_classes[class];
+    }
+
+    fn newSpan(self: *SizeClass, backing: std.mem.Allocator, class: usize) bool {
+        self.spans.ensureUnusedCapacity(backing, 1) catch return false;
+        const span = backing.rawAlloc(span_size, span_alignment, @returnAddress()) orelse return false;
+        self.spans.appendAssumeCapacity(@alignCast(span));
+
+        const header: *SpanHeader = @ptrCast(@alignCast(span));
+        header.* = .{
+            .magic = span_magic,
+            .size_class = @intCast(class),
+            .total_len = span_size,
+            .alignment = span_size,
+        };
+
+        const block_size = size_classes[class];
+        const first_block = std.mem.alignForward(usize, span_header_size, classBlockAlignment(class));
+        const block_count = blockCount(class);
+
+        // Pushed in reverse so blocks are handed out in address order
+        var i = block_count;
+        while (i > 0) {
+            i -= 1;
+            const block: *FreeBlock = @ptrCast(@alignCast(span + first_block + i * block_size));
+            block.next = self.free_list;
+            self.free_list = block;
+        }
+        self.free_count += block_count;
+        self.stats.span_count += 1;
+        return true;
+    }
+};
+
+const ThreadCache = struct {
+    const Bin = struct {
+        head: ?*FreeBlock = null,
+        count: u32 = 0,
+
+        // Counted locally and flushed into the class stats whenever the bin talks to the global state
+        alloc_count: u32 = 0,
+        free_count: u32 = 0,
+    };
+
+    generation: u32 = 0,
+    bins: [class_count]Bin = @splat(.{}),
+};
+
+// Blocks moved between a thread cache and the global lists at once
+const batch_size = 32;
+const max_cached_blocks = batch_size * 2;
+
+var backing_allocator: ?std.mem.Allocator = null;
+var classes: [class_count]SizeClass = @splat(.{});
+
+// Bumped on deinit so caches from a previous init are thrown away instead of handing out freed spans
+var generation: std.atomic.Value(u32) = .init(1);
+
+var large_mutex: std.Thread.Mutex = .{};
+var large_stats: struct { alloc_count: usize = 0, free_count: usize = 0, live_bytes: usize = 0 } = .{};
+
+threadlocal var thread_cache: ThreadCache = .{};
+
+pub fn init(backing: std.mem.Allocator) void {
+    std.debug.assert(backing_allocator == null);
+    backing_allocator = backing;
+    for (&classes, 0..) |*size_class, i| {
+        size_class.* = .{};
+        size_class.stats.block_size = size_classes[i];
+    }
+}
+
+/// Frees every span, all memory handed out must already be freed or be otherwise unused
+pub fn deinit() void {
+    const backing = backing_allocator orelse return;
+
+    for (&classes) |*size_class| {
+        for (size_class.spans.items) |span| {
+            backing.rawFree(span[0..span_size], span_alignment, @returnAddress());
+        }
+        size_class.spans.deinit(backing);
+        size_class.* = .{};
+    }
+
+    if (large_stats.alloc_count != large_stats.free_count) {
+        std.log.warn("c_alloc: {} large allocations were never freed", .{large_stats.alloc_count - large_stats.free_count});
+    }
+    large_stats = .{};
+
+    _ = generation.fetchAdd(1, .release);
+    backing_allocator = null;
+}
+
+pub fn getStats() Stats {
+    var stats: Stats = .{};
+    for (&classes, &stats.classes) |*size_class, *class_stats| {
+        size_class.mutex.lock();
+        defer size_class.mutex.unlock();
+        class_stats.* = size_class.stats;
+    }
+
+    large_mutex.lock();
+    defer large_mutex.unlock();
+    stats.large_alloc_count = large_stats.alloc_count;
+    stats.large_free_count = large_stats.free_count;
+    stats.large_live_bytes = large_stats.live_bytes;
+    return stats;
+}
+
+fn getThreadCache() *ThreadCache {
+    const current_generation = generation.load(.acquire);
+    if (thread_cache.generation != current_generation) {
+        thread_cache = .{ .generation = current_generation };
+    }
+    return &thread_cache;
+}
+
+fn flushBinStats(size_class: *SizeClass, bin: *ThreadCache.Bin) void {
+    size_class.stats.alloc_count += bin.alloc_count;
+    size_class.stats.free_count += bin.free_count;
+    bin.alloc_count = 0;
+    bin.free_count = 0;
+}
+
+fn allocSmall(backing: std.mem.Allocator, class: usize) ?[*]u8 {
+    const bin = &getThreadCache().bins[class];
+
+    if (bin.head == null) {
+        const size_class = &classes[class];
+        size_class.mutex.lock();
+        defer size_class.mutex.unlock();
+
+        flushBinStats(size_class, bin);
+
+        if (size_class.free_list == null and !size_class.newSpan(backing, class)) {
+            return null;
+        }
+
+        while (bin.count < batch_size) {
+            const block = size_class.free_list orelse break;
+            size_class.free_list = block.next;
+            size_class.free_count -= 1;
+            block.next = bin.head;
+            bin.head = block;
+            bin.count += 1;
+        }
+    }
+
+    const block = bin.head.?;
+    bin.head = block.next;
+    bin.count -= 1;
+    bin.alloc_count += 1;
+    return @ptrCast(block);
+}
+
+fn freeSmall(ptr: [*]u8, class: usize) void {
+    const bin = &getThreadCache().bins[class];
+
+    const block: *FreeBlock = @ptrCast(@alignCast(ptr));
+    block.next = bin.head;
+    bin.head = block;
+    bin.count += 1;
+    bin.free_count += 1;
+
+    if (bin.count > max_cached_blocks) {
+        const size_class = &classes[class];
+        size_class.mutex.lock();
+        defer size_class.mutex.unlock();
+
+        flushBinStats(size_class, bin);
+
+        while (bin.count > batch_size) {
+            const returned = bin.head.?;
+            bin.head = returned.next;
+            bin.count -= 1;
+            returned.next = size_class.free_list;
+            size_class.free_list = returned;
+            size_class.free_count += 1;
+        }
+    }
+}
+
+fn largeDataOffset(alignment: usize) usize {
+    return @max(span_header_size, alignment);
+}
+
+fn allocLarge(backing: std.mem.Allocator, size: usize, alignment: usize) ?[*]u8 {
+    const data_offset = largeDataOffset(alignment);
+    const total_len = std.math.add(usize, size, data_offset) catch return null;
+
+    const base = backing.rawAlloc(total_len, span_alignment, @returnAddress()) orelse return null;
+    const header: *SpanHeader = @ptrCast(@alignCast(base));
+    header.* = .{
+        .magic = span_magic,
+        .size_class = large_class,
+        .total_len = total_len,
+        .alignment = alignment,
+    };
+
+    large_mutex.lock();
+    defer large_mutex.unlock();
+    large_stats.alloc_count += 1;
+    large_stats.live_bytes += total_len;
+
+    return base + data_offset;
+}
+
+fn freeLarge(backing: std.mem.Allocator, header: *SpanHeader) void {
+    const total_len = header.total_len;
+    header.magic = 0;
+    backing.rawFree(@as([*]u8, @ptrCast(header))[0..total_len], span_alignment, @returnAddress());
+
+    large_mutex.lock();
+    defer large_mutex.unlock();
+    large_stats.free_count += 1;
+    large_stats.live_bytes -= total_len;
+}
+
+fn usableSize(ptr: *anyopaque) usize {
+    const header = SpanHeader.fromPtr(ptr);
+    if (header.size_class == large_class) {
+        return header.total_len - largeDataOffset(header.alignment);
+    }
+    return size_classes[header.size_class];
+}
+
+pub fn alloc(size: usize) callconv(.c) ?*anyopaque {
+    return alignedAlloc(size, default_alignment);
+}
+
+pub fn calloc(count: usize, size: usize) callconv(.c) ?*anyopaque {
+    const total = std.math.mul(usize, count, size) catch return null;
+    const ptr: [*]u8 = @ptrCast(alloc(total) orelse return null);
+    @memset(ptr[0..total], 0);
+    return ptr;
+}
+
+pub fn realloc(maybe_ptr: ?*anyopaque, new_size: usize) callconv(.c) ?*anyopaque {
+    const data_ptr = maybe_ptr orelse return alloc(new_size);
+    return reallocate(data_ptr, usableSize(data_ptr), new_size);
 }
 
-pub fn reallocate(maybe_ptr: ?*anyopaque, old_size: usize, new_size: usize) callconv(.C) ?*anyopaque {
-    if (maybe_ptr) |data_ptr| {
-        if (mem_allocator) |allocator| {
-            const data_ptr_int: usize = @intFromPtr(data_ptr);
-            const metadata_ptr: *Metadata = @ptrFromInt(data_ptr_int - @sizeOf(Metadata));
-            const allocation_ptr: [*]u8 = @ptrFromInt(data_ptr_int - metadata_ptr.alignment);
-            const allocation_size: usize = metadata_ptr.size + metadata_ptr.alignment;
-
-            if (old_size != metadata_ptr.size) {
-                std.log.warn("Expected memory size({}) doesn't match memory's metadata({}), there may be a bug in the allocator", .{ old_size, metadata_ptr.size });
-            }
-
-            const new_allocation_size = new_size + metadata_ptr.alignment;
-
-            // Try to resize current buffer
-            const resized: bool = switch (metadata_ptr.alignment) {
-                16 => allocator.resize(@as([*]align(16) u8, @alignCast(allocation_ptr))[0..allocation_size], new_allocation_size),
-                32 => allocator.resize(@as([*]align(32) u8, @alignCast(allocation_ptr))[0..allocation_size], new_allocation_size),
-                64 => allocator.resize(@as([*]align(64) u8, @alignCast(allocation_ptr))[0..allocation_size], new_allocation_size),
-                else => |x| std.debug.panic("Unsupported memory aligment: {}", .{x}),
-            };
-            if (resized) {
-                metadata_ptr.size = new_size;
-                return data_ptr;
-            }
-
-            // If resize fails, try allocate and memcopy new buffer
-            if (alignedAlloc(new_size, metadata_ptr.alignment)) |new_ptr| {
-                defer free(maybe_ptr);
-
-                if (new_size != 0) {
-                    var old_data_ptr_bytes: [*]u8 = @ptrCast(data_ptr);
-                    var new_data_ptr_bytes: [*]u8 = @ptrCast(new_ptr);
-                    const copy_size = @min(metadata_ptr.size, new_size);
-                    @memcpy(new_data_ptr_bytes[0..copy_size], old_data_ptr_bytes[0..copy_size]);
-                    return new_ptr;
-                } else {
-                    return null;
-                }
-            }
+pub fn alignedAlloc(size: usize, alignment: usize) callconv(.c) ?*anyopaque {
+    const backing = backing_allocator orelse return null;
+
+    if (alignment == 0 or !std.math.isPowerOfTwo(alignment) or alignment > max_alignment) {
+        std.log.err("c_alloc: unsupported alignment {}", .{alignment});
+        return null;
+    }
+
+    const ptr = if (findClass(size, alignment)) |class|
+        allocSmall(backing, class)
+    else
+        allocLarge(backing, size, @max(alignment, default_alignment));
+    return @ptrCast(ptr);
+}
+
+pub fn reallocate(maybe_ptr: ?*anyopaque, old_size: usize, new_size: usize) callconv(.c) ?*anyopaque {
+    const data_ptr = maybe_ptr orelse return alloc(new_size);
+    const backing = backing_allocator orelse return null;
+
+    if (new_size == 0) {
+        free(data_ptr);
+        return null;
+    }
+
+    const header = SpanHeader.fromPtr(data_ptr);
+    const usable_size = usableSize(data_ptr);
+    if (old_size > usable_size) {
+        std.log.warn("Expected memory size({}) is larger than the block({}), there may be a bug in the caller", .{ old_size, usable_size });
+    }
+
+    if (header.size_class == large_class) {
+        // Large blocks can often grow or shrink in place
+        const data_offset = largeDataOffset(header.alignment);
+        const new_total_len = std.math.add(usize, new_size, data_offset) catch return null;
+        const base: [*]u8 = @ptrCast(header);
+        if (new_total_len > max_small_size + data_offset and backing.rawResize(base[0..header.total_len], span_alignment, new_total_len, @returnAddress())) {
+            large_mutex.lock();
+            defer large_mutex.unlock();
+            large_stats.live_bytes = large_stats.live_bytes - header.total_len + new_total_len;
+            header.total_len = new_total_len;
+            return data_ptr;
         }
+    } else if (new_size <= usable_size and new_size > usable_size / 2) {
+        // Still fits its size class without wasting more than half of it
+        return data_ptr;
+    }
+
+    const alignment = if (header.size_class == large_class) header.alignment else default_alignment;
+    const new_ptr: [*]u8 = @ptrCast(alignedAlloc(new_size, alignment) orelse return null);
+    const old_bytes: [*]const u8 = @ptrCast(data_ptr);
+    const copy_size = @min(usable_size, new_size);
+    @memcpy(new_ptr[0..copy_size], old_bytes[0..copy_size]);
+    free(data_ptr);
+    return new_ptr;
+}
+
+pub fn free(maybe_ptr: ?*anyopaque) callconv(.c) void {
+    const data_ptr = maybe_ptr orelse return;
+    const backing = backing_allocator orelse return;
+
+    const header = SpanHeader.fromPtr(data_ptr);
+    if (header.size_class == large_class) {
+        freeLarge(backing, header);
+    } else {
+        freeSmall(@ptrCast(data_ptr), header.size_class);
     }
-    return alloc(new_size);
 }
 
-pub fn free(maybe_ptr: ?*anyopaque) callconv(.C) void {
-    if (maybe_ptr) |data_ptr| {
-        if (mem_allocator) |allocator| {
-            const data_ptr_int: usize = @intFromPtr(data_ptr);
-            const metadata_ptr: *Metadata = @ptrFromInt(data_ptr_int - @sizeOf(Metadata));
-            const allocation_ptr: [*]u8 = @ptrFromInt(data_ptr_int - metadata_ptr.alignment);
-            const allocation_size: usize = metadata_ptr.size + metadata_ptr.alignment;
+/// Zig allocator over the same slabs, for libraries such as zjolt that take a std.mem.Allocator and hand it to their C side
+pub fn allocator() std.mem.Allocator {
+    return .{
+        .ptr = undefined,
+        .vtable = &.{
+            .alloc = zigAlloc,
+            .resize = zigResize,
+            .remap = zigRemap,
+            .free = zigFree,
+        },
+    };
+}
+
+fn zigAlloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, ret_addr: usize) ?[*]u8 {
+    _ = ctx;
+    _ = ret_addr;
+    return @ptrCast(alignedAlloc(len, alignment.toByteUnits()));
+}
+
+fn zigResize(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) bool {
+    _ = ctx;
+    _ = alignment;
+    _ = ret_addr;
+    // Only in place within the block, growing past it is left to the allocator's alloc, copy and free
+    return new_len <= usableSize(memory.ptr);
+}
+
+fn zigRemap(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+    return if (zigResize(ctx, memory, alignment, new_len, ret_addr)) memory.ptr else null;
+}
+
+fn zigFree(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, ret_addr: usize) void {
+    _ = ctx;
+    _ = alignment;
+    _ = ret_addr;
+    free(memory.ptr);
+}
 
-            switch (metadata_ptr.alignment) {
-                16 => allocator.free(@as([*]align(16) u8, @alignCast(allocation_ptr))[0..allocation_size]),
-                32 => allocator.free(@as([*]align(32) u8, @alignCast(allocation_ptr))[0..allocation_size]),
-                64 => allocator.free(@as([*]align(64) u8, @alignCast(allocation_ptr))[0..allocation_size]),
-                else => |x| std.debug.panic("Unsupported memory aligment: {}", .{x}),
-            }
+test "c_alloc.size_classes" {
+    for (size_classes, 0..) |class_size, class| {
+        try std.testing.expectEqual(class, sizeToClass(class_size));
+        if (class + 1 < class_count) {
+            try std.testing.expectEqual(class + 1, sizeToClass(class_size + 1));
         }
     }
+
+    init(std.testing.allocator);
+    defer deinit();
+
+    var alignment: usize = 1;
+    while (alignment <= max_alignment) : (alignment *= 2) {
+        for ([_]usize{ 1, 24, 1000, max_small_size, max_small_size + 1, 100_000 }) |size| {
+            const ptr = alignedAlloc(size, alignment).?;
+            try std.testing.expect(std.mem.isAligned(@intFromPtr(ptr), alignment));
+            try std.testing.expect(usableSize(ptr) >= size);
+
+            const grown = reallocate(ptr, size, size * 3).?;
+            try std.testing.expect(usableSize(grown) >= size * 3);
+            free(grown);
+        }
+    }
+}
+
+test "c_alloc.allocator" {
+    init(std.testing.allocator);
+    defer deinit();
+
+    try std.heap.testAllocator(allocator());
+    try std.heap.testAllocatorAligned(allocator());
 }
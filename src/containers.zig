@@ -122,6 +122,18 @@ pub fn SlotMap(comptime T: type) type {
             return null;
         }
 
+        /// Number of slots including freed ones, used with getPtrAtIndex to split iteration into ranges
+        pub fn slotCount(self: Self) usize {
+            return self.list.items.len;
+        }
+
+        pub fn getPtrAtIndex(self: Self, index: usize) ?*T {
+            if (self.list.items[index].value) |*value| {
+                return value;
+            }
+            return null;
+        }
+
         pub fn iterator(self: *const Self) Iterator {
             return .{
                 .slice = self.list.items,
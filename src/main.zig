@@ -11,6 +11,10 @@ const Camera = @import("rendering/camera.zig").Camera;
 const Transform = @import("transform.zig");
 
 const saturn = @import("root.zig");
+const FrameAllocator = @import("FrameAllocator.zig");
+const MemoryTracker = @import("MemoryTracker.zig");
+const c_alloc = @import("c_alloc.zig");
+const TaskPool = @import("TaskPool.zig");
 const AssetPool = @import("rendering/asset_pool.zig");
 const TransferQueue = @import("rendering/transfer_queue.zig");
 const Scene = @import("rendering/scene.zig");
@@ -32,8 +36,15 @@ pub fn main() !void {
     //      .Debug, .ReleaseSafe => debug_allocator.allocator(),
     //  };
 
+    var memory_tracker: MemoryTracker = undefined;
+    memory_tracker.init(allocator);
+
+    // Jolt makes lots of small allocations from its job threads, the slabs keep those off the general purpose allocator
+    c_alloc.init(memory_tracker.allocator(.physics));
+    defer c_alloc.deinit();
+
     const @"10MB": usize = 1024 * 1024 * 10;
-    zjolt.init(allocator, @"10MB", 1);
+    zjolt.init(c_alloc.allocator(), @"10MB", 1);
     defer zjolt.deinit();
 
     var config: App.Config = .{};
@@ -50,12 +61,18 @@ pub fn main() !void {
             config.power_level = .prefer_low_power;
         } else if (std.mem.eql(u8, arg, "--vsync")) {
             config.vsync = true;
+        } else if (std.mem.eql(u8, arg, "--frames-in-flight")) {
+            const count = args.next() orelse "";
+            config.frames_in_flight = std.fmt.parseInt(u32, count, 10) catch blk: {
+                std.log.warn("Invalid frames in flight: {s}", .{count});
+                break :blk null;
+            };
         } else {
             std.log.warn("Unknown argument: {s}", .{arg});
         }
     }
 
-    var app: App = try .init(allocator, config);
+    var app: App = try .init(allocator, &memory_tracker, config);
     defer app.deinit();
 
     try app.platform.initImgui(app.gpu_device, app.window);
@@ -159,6 +176,8 @@ const App = struct {
         window_size: saturn.WindowSize = .{ .windowed = .{ 1920, 1080 } },
         vsync: bool = false,
         power_level: saturn.DevicePowerPreference = .prefer_high_power,
+        /// Device default when null
+        frames_in_flight: ?u32 = null,
     };
 
     const Self = @This();
@@ -166,6 +185,7 @@ const App = struct {
     is_running: bool = true,
 
     allocator: std.mem.Allocator,
+    memory_tracker: *MemoryTracker,
 
     platform: saturn.PlatformInterface,
     window: saturn.WindowHandle,
@@ -173,11 +193,16 @@ const App = struct {
 
     asset_registry: *AssetRegistry,
 
+    task_pool: *TaskPool,
+
     transfer_queue: TransferQueue,
     asset_pool: *AssetPool,
 
     scene_renderer: SceneRenderer,
 
+    /// Rebuilt every frame over the same memory, see RenderGraph.reset
+    render_graph: saturn.RenderGraph,
+
     free_camera: DebugCamera = .{},
 
     worlds: std.ArrayList(GameWorld) = .empty,
@@ -189,7 +214,7 @@ const App = struct {
 
     gamepad: @import("Input.zig") = .{},
 
-    temp_allocator: std.heap.ArenaAllocator,
+    frame_allocator: FrameAllocator,
 
     timer: f32 = 0,
     frames: f32 = 0,
@@ -203,7 +228,7 @@ const App = struct {
     prop_win: PropertiesWindow = .{},
     demo_win: DemoWindow = .{},
 
-    pub fn init(allocator: std.mem.Allocator, config: Config) !Self {
+    pub fn init(allocator: std.mem.Allocator, memory_tracker: *MemoryTracker, config: Config) !Self {
         const platform = try saturn.init(allocator, .{
             .app_info = .{ .name = "Saturn Engine", .version = .init(0, 0, 1, 0) },
             .validation = true,
@@ -217,7 +242,7 @@ const App = struct {
         });
         errdefer platform.destroyWindow(window);
 
-        const gpu_device = try platform.createDeviceBasic(window, config.power_level);
+        const gpu_device = try platform.createDeviceBasic(window, config.power_level, config.frames_in_flight);
         errdefer platform.destroyDevice(gpu_device);
 
         const info = gpu_device.getInfo();
@@ -274,44 +299,57 @@ const App = struct {
         try asset_registry.addRepository("engine", "assets/engine");
         try asset_registry.addRepository("game", "assets/game");
 
+        const task_pool = try allocator.create(TaskPool);
+        errdefer allocator.destroy(task_pool);
+
+        try task_pool.init(allocator, .{});
+        errdefer task_pool.deinit();
+
+        var frame_allocator: FrameAllocator = try .init(allocator, task_pool, gpu_device.getFramesInFlight());
+        errdefer frame_allocator.deinit();
+
         const asset_pool = try allocator.create(AssetPool);
         errdefer allocator.destroy(asset_pool);
 
-        asset_pool.* = try .init(allocator, asset_registry, gpu_device);
+        asset_pool.* = try .init(memory_tracker.allocator(.asset_pool), asset_registry, gpu_device);
         errdefer asset_pool.deinit();
 
-        var transfer_queue: TransferQueue = .init(allocator, gpu_device);
+        var transfer_queue: TransferQueue = try .init(memory_tracker.allocator(.transfer_queue), gpu_device);
         errdefer transfer_queue.deinit();
 
-        var scene_renderer: SceneRenderer = try .init(allocator, gpu_device, asset_registry, RenderTarget);
+        var scene_renderer: SceneRenderer = try .init(allocator, gpu_device, asset_registry, task_pool, RenderTarget);
         errdefer scene_renderer.deinit();
 
         return .{
             .allocator = allocator,
+            .memory_tracker = memory_tracker,
             .platform = platform,
             .window = window,
             .gpu_device = gpu_device,
 
             .asset_registry = asset_registry,
 
+            .task_pool = task_pool,
+
             .transfer_queue = transfer_queue,
             .asset_pool = asset_pool,
 
             .scene_renderer = scene_renderer,
 
-            .temp_allocator = .init(allocator),
+            .render_graph = .init(memory_tracker.allocator(.render_graph)),
+
+            .frame_allocator = frame_allocator,
         };
     }
 
     pub fn deinit(self: *Self) void {
         self.gpu_device.waitIdle();
 
-        self.temp_allocator.deinit();
-
         for (self.worlds.items) |*world| world.deinit();
         self.worlds.deinit(self.allocator);
 
         self.scene_renderer.deinit();
+        self.render_graph.deinit();
 
         self.asset_pool.deinit();
         self.allocator.destroy(self.asset_pool);
@@ -320,6 +358,12 @@ const App = struct {
         self.asset_registry.deinit();
         self.allocator.destroy(self.asset_registry);
 
+        self.frame_allocator.deinit();
+
+        self.task_pool.logErrors();
+        self.task_pool.deinit();
+        self.allocator.destroy(self.task_pool);
+
         self.gpu_device.releaseWindow(self.window);
         self.platform.destroyDevice(self.gpu_device);
         self.platform.destroyWindow(self.window);
@@ -327,9 +371,10 @@ const App = struct {
     }
 
     pub fn createWorld(self: *Self, name: []const u8, gravity: zjolt.Vec3) !usize {
-        var world: GameWorld = try .init(self.allocator, name);
+        const world_allocator = self.memory_tracker.allocator(.game_world);
+        var world: GameWorld = try .init(world_allocator, name);
         errdefer world.deinit();
-        world.components.rendering = try .init(self.allocator, self.gpu_device, self.asset_pool, 4096);
+        world.components.rendering = try .init(world_allocator, self.gpu_device, self.asset_pool, 4096);
         world.components.physics = .init(.{
             .max_bodies = 1024,
             .num_body_mutexes = 0,
@@ -346,8 +391,11 @@ const App = struct {
     }
 
     pub fn update(self: *Self, delta_time: f32, mem_usage_opt: ?usize) !void {
-        _ = self.temp_allocator.reset(.retain_capacity);
-        const tpa = self.temp_allocator.allocator();
+        // Blocks until the gpu is done with the frame that used this slot last, everything per frame is indexed by it
+        const frame = try self.gpu_device.beginFrame();
+        self.frame_allocator.beginFrame(frame.slot);
+        try self.transfer_queue.beginFrame(frame);
+        const tpa = self.frame_allocator.allocator();
 
         {
             self.timer += delta_time;
@@ -362,6 +410,13 @@ const App = struct {
 
         self.perf_win.average_dt = self.average_dt;
         self.perf_win.mem_usage = mem_usage_opt;
+        self.perf_win.frame_memory = self.frame_allocator.getStats();
+        self.perf_win.render_graph_stats = self.gpu_device.getRenderGraphStats();
+        self.perf_win.frame_pacing = self.gpu_device.getFramePacingStats();
+
+        self.memory_tracker.sample(delta_time);
+        self.perf_win.memory_tracker = self.memory_tracker;
+        self.perf_win.render_path = &self.scene_renderer.render_path;
 
         self.platform.processEvents(.{
             .ctx = self,
@@ -450,7 +505,7 @@ const App = struct {
 
         // Game Code Update
         for (self.worlds.items) |*world| {
-            world.update(delta_time);
+            world.update(self.task_pool, delta_time);
             if (world.components.rendering) |*scene| {
                 try scene.addTransfers(&self.transfer_queue);
             }
@@ -458,10 +513,18 @@ const App = struct {
 
         try self.asset_pool.addTransfers(&self.transfer_queue);
 
-        var render_graph: saturn.RenderGraph = .init(tpa);
-        defer render_graph.deinit();
+        // Meshes uploaded above can now be resolved into draws
+        for (self.worlds.items) |*world| {
+            if (world.components.rendering) |*scene| {
+                try scene.syncRenderBuckets();
+            }
+        }
+
+        const render_graph = &self.render_graph;
+        render_graph.reset();
+        render_graph.task_pool = self.task_pool;
 
-        try self.transfer_queue.buildPasses(&render_graph);
+        try self.transfer_queue.buildPasses(render_graph);
 
         const swapchain_texture = try render_graph.acquireWindowTexture(self.window);
 
@@ -485,9 +548,8 @@ const App = struct {
             const scene = &game_world.components.rendering.?;
 
             try self.scene_renderer.addPasses(
-                tpa,
                 swapchain_texture,
-                &render_graph,
+                render_graph,
                 scene,
                 &.{ .camera = camera, .transform = camera_transform },
                 self.asset_pool,
@@ -505,15 +567,15 @@ const App = struct {
         }
 
         if (IMGUI_ENABLED) {
-            const imgui_pass_handle = self.gpu_device.createImguiPass(swapchain_texture, &render_graph);
+            const imgui_pass_handle = self.gpu_device.createImguiPass(swapchain_texture, render_graph);
             _ = imgui_pass_handle; // autofix
         }
 
-        try self.gpu_device.submitRenderGraph(tpa, &render_graph);
+        try self.gpu_device.submitRenderGraph(tpa, render_graph);
     }
 
     pub fn loadScene(self: *Self, world_index: usize, scene_filepath: []const u8) !void {
-        const tpa = self.temp_allocator.allocator();
+        const tpa = self.frame_allocator.allocator();
 
         var scene_json: std.json.Parsed(SceneAsset) = undefined;
         {
@@ -784,6 +846,11 @@ pub const PerformanceWindow = struct {
 
     average_dt: f32 = 0.0,
     mem_usage: ?usize = null,
+    frame_memory: ?FrameAllocator.Stats = null,
+    render_graph_stats: ?saturn.RenderGraphStats = null,
+    frame_pacing: ?saturn.FramePacingStats = null,
+    memory_tracker: ?*MemoryTracker = null,
+    render_path: ?*SceneRenderer.RenderPath = null,
 
     pub fn draw(self: *PerformanceWindow, tpa: std.mem.Allocator) void {
         if (self.open) {
@@ -795,6 +862,59 @@ pub const PerformanceWindow = struct {
                     imgui.text(std.fmt.allocPrintSentinel(tpa, "Memory Usage: {s}", .{@import("utils.zig").formatBytes(tpa, mem_usage) catch ""}, 0) catch "");
                 }
 
+                if (self.frame_memory) |frame_memory| {
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Frame Memory: {s}", .{@import("utils.zig").formatBytes(tpa, frame_memory.last_frame_bytes) catch ""}, 0) catch "");
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Frame Memory Peak: {s}", .{@import("utils.zig").formatBytes(tpa, frame_memory.high_water_mark) catch ""}, 0) catch "");
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Frame Memory Reserved: {s}", .{@import("utils.zig").formatBytes(tpa, frame_memory.capacity_bytes) catch ""}, 0) catch "");
+                }
+
+                if (self.frame_pacing) |pacing| {
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Frames In Flight: {} (GPU Queued: {})", .{ pacing.frames_in_flight, pacing.gpu_frames_queued }, 0) catch "");
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "CPU (ms): {d:.3} GPU Wait (ms): {d:.3} ({d:.1}%)", .{
+                        @as(f64, @floatFromInt(pacing.cpu_ns)) / std.time.ns_per_ms,
+                        @as(f64, @floatFromInt(pacing.wait_ns)) / std.time.ns_per_ms,
+                        pacing.waitRatio() * 100.0,
+                    }, 0) catch "");
+                }
+
+                if (self.render_graph_stats) |stats| {
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Transient Memory: {s} (Saved: {s})", .{
+                        @import("utils.zig").formatBytes(tpa, stats.transient_allocated_bytes) catch "",
+                        @import("utils.zig").formatBytes(tpa, stats.transientSavedBytes()) catch "",
+                    }, 0) catch "");
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Transient Creations: {}", .{stats.transient_resources_created}, 0) catch "");
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Graph Compile Cache Hits: {d:.1}%", .{stats.compileCacheHitRate() * 100.0}, 0) catch "");
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Barriers: {} (Eliminated: {})", .{ stats.barriers_emitted, stats.barriers_eliminated }, 0) catch "");
+                    imgui.text(std.fmt.allocPrintSentinel(tpa, "Passes: {} (Culled: {})", .{ stats.passes_executed, stats.passes_culled }, 0) catch "");
+                }
+
+                if (self.render_path) |render_path| {
+                    imgui.c.ImGui_Separator();
+                    inline for (@typeInfo(SceneRenderer.RenderPath).@"enum".fields) |field| {
+                        const path: SceneRenderer.RenderPath = @enumFromInt(field.value);
+                        if (imgui.radioButton("Render Path: " ++ field.name, render_path.* == path)) {
+                            render_path.* = path;
+                        }
+                    }
+                }
+
+                if (self.memory_tracker) |memory_tracker| {
+                    imgui.c.ImGui_Separator();
+                    for (memory_tracker.getStats()) |stats| {
+                        imgui.text(std.fmt.allocPrintSentinel(tpa, "{s}: {s} (Peak: {s}) {d:.0} allocs/s {s}/s", .{
+                            @tagName(stats.tag),
+                            @import("utils.zig").formatBytes(tpa, stats.live_bytes) catch "",
+                            @import("utils.zig").formatBytes(tpa, stats.peak_bytes) catch "",
+                            stats.allocs_per_second,
+                            @import("utils.zig").formatBytes(tpa, @intFromFloat(stats.bytes_per_second)) catch "",
+                        }, 0) catch "");
+                    }
+
+                    if (imgui.button("Dump Memory Stats")) {
+                        memory_tracker.dumpJson(std.fs.cwd(), "memory_stats.json") catch |err| std.log.err("Failed to dump memory stats {}", .{err});
+                    }
+                }
+
                 imgui.end();
             }
         }
@@ -11,18 +11,19 @@ const Material = @import("asset/material.zig");
 const Shader = @import("asset/shader.zig");
 const obj = @import("asset/obj.zig");
 const stbi = @import("asset/stbi.zig");
+const TaskPool = @import("TaskPool.zig");
 
 pub const ProcessMetaFn = *const fn (allocator: std.mem.Allocator, prog_node: ?std.Progress.Node, meta_file_path: []const u8) anyerror!void;
 
-pub fn thread_worker_meta(process_fn: ProcessMetaFn, prog_node: ?std.Progress.Node, name: []const u8, meta_path: []const u8) void {
-    const child_node: ?std.Progress.Node = if (prog_node) |node| node.start(name, 0) else null;
-    defer if (child_node) |node| node.end();
+const MetaTask = struct {
+    process_fn: ProcessMetaFn,
+    meta_path: []const u8,
+};
 
-    process_fn(global_allocator, child_node, meta_path) catch |err| {
-        _ = error_count.fetchAnd(1, .monotonic);
-        //TODO: collect errors
-        std.log.err("Failed to process {s}: {}", .{ name, err });
-    };
+pub fn thread_worker_meta(pool: *TaskPool, name: []const u8, task: MetaTask, prog_node: ?std.Progress.Node) !void {
+    _ = pool; // autofix
+    _ = name; // autofix
+    try task.process_fn(global_allocator, prog_node, task.meta_path);
 }
 
 pub const MetaFileBase = struct {
@@ -40,10 +41,8 @@ var repo_name: []const u8 = &.{};
 var input_dir: std.fs.Dir = undefined;
 var output_dir: std.fs.Dir = undefined;
 
-var error_count = std.atomic.Value(usize).init(0);
-
 var global_allocator: std.mem.Allocator = undefined;
-var thread_pool: std.Thread.Pool = undefined;
+var task_pool: TaskPool = undefined;
 
 pub fn main() !void {
     var debug_allocator = std.heap.DebugAllocator(.{}){};
@@ -56,8 +55,8 @@ pub fn main() !void {
     defer arena.deinit();
     const arena_allocator = arena.allocator();
 
-    try thread_pool.init(.{ .allocator = global_allocator });
-    defer thread_pool.deinit();
+    try task_pool.init(global_allocator, .{});
+    defer task_pool.deinit();
 
     //Asset Init
     stbi.init(global_allocator);
@@ -113,18 +112,18 @@ pub fn main() !void {
                 if (readMetaType(global_allocator, input_dir, entry.path)) |meta_type| {
                     defer global_allocator.free(meta_type);
                     if (meta_type_process_fns.get(meta_type)) |process_fn| {
-                        const name = try arena_allocator.dupe(u8, entry.basename);
                         const meta_path = try arena_allocator.dupe(u8, entry.path);
-                        thread_pool.spawnWg(&wait_group, thread_worker_meta, .{ process_fn, root_node, name, meta_path });
+                        _ = task_pool.spawn(MetaTask, &wait_group, entry.basename, .{ .process_fn = process_fn, .meta_path = meta_path }, root_node, thread_worker_meta);
                     }
                 }
             }
         }
     }
 
-    thread_pool.waitAndWork(&wait_group);
+    task_pool.waitAndWork(&wait_group);
 
-    const failed = error_count.load(.monotonic);
+    const failed = task_pool.errorCount();
+    task_pool.logErrors();
     if (failed > 0) {
         std.log.err("Failed to process {} assets", .{failed});
         return error.failedToProccessAssets;
@@ -273,33 +272,47 @@ fn processGlslShaderDir(allocator: std.mem.Allocator, meta_data: Shader.Director
     }
 }
 
-fn GltfResourceWorker(comptime load_fn: anytype, comptime asset_name: []const u8, comptime atype: AssetType) type {
-    return struct {
-        fn run(gltf_file: *Gltf, allocator: std.mem.Allocator, prog_node: ?std.Progress.Node, index: usize) void {
-            const name = std.fmt.allocPrint(allocator, "{s}_{}", .{ asset_name, index }) catch |err| std.debug.panic("Failed to alloc name {}", .{err});
-            defer allocator.free(name);
+const GltfResourceContext = struct {
+    gltf_file: *Gltf,
+    allocator: std.mem.Allocator,
+    prog_node: ?std.Progress.Node,
+    mesh_count: usize,
+    texture_count: usize,
+
+    // Meshes, textures and materials share a single index range so they are balanced together
+    fn run(ctx: @This(), range: TaskPool.Range) void {
+        for (range.start..range.end) |i| {
+            if (i < ctx.mesh_count) {
+                processGltfResource(Gltf.loadMesh, "mesh", .mesh, ctx, i);
+            } else if (i < ctx.mesh_count + ctx.texture_count) {
+                processGltfResource(Gltf.loadTexture, "texture", .texture, ctx, i - ctx.mesh_count);
+            } else {
+                processGltfResource(Gltf.loadMaterial, "material", .material, ctx, i - ctx.mesh_count - ctx.texture_count);
+            }
+        }
+    }
+};
 
-            const child_node: ?std.Progress.Node = if (prog_node) |node| node.start(name, 0) else null;
-            defer if (child_node) |node| node.end();
+fn processGltfResource(comptime load_fn: anytype, comptime asset_name: []const u8, comptime atype: AssetType, ctx: GltfResourceContext, index: usize) void {
+    var name_buffer: [64]u8 = undefined;
+    const name = std.fmt.bufPrint(&name_buffer, "{s}_{}", .{ asset_name, index }) catch asset_name;
 
-            if (load_fn(gltf_file.*, allocator, index)) |result| {
-                defer result.value.deinit(allocator);
+    const child_node: ?std.Progress.Node = if (ctx.prog_node) |node| node.start(name, 0) else null;
+    defer if (child_node) |node| node.end();
 
-                const output_file_path = result.output_path;
+    if (load_fn(ctx.gltf_file.*, ctx.allocator, index)) |result| {
+        defer result.value.deinit(ctx.allocator);
 
-                io.writeFile(output_dir, atype, output_file_path, result.value) catch |err| {
-                    std.log.err("Failed to write asset file: {}", .{err});
-                    return;
-                };
-            } else |err| {
-                std.log.err("Failed to load " ++ asset_name ++ " {}: {}", .{ index, err });
-            }
-        }
-    };
+        const output_file_path = result.output_path;
+
+        io.writeFile(output_dir, atype, output_file_path, result.value) catch |err| {
+            std.log.err("Failed to write asset file: {}", .{err});
+            return;
+        };
+    } else |err| {
+        std.log.err("Failed to load " ++ asset_name ++ " {}: {}", .{ index, err });
+    }
 }
-const mesh_thread_worker = GltfResourceWorker(Gltf.loadMesh, "mesh", .mesh).run;
-const texture_thread_worker = GltfResourceWorker(Gltf.loadTexture, "texture", .texture).run;
-const material_thread_worker = GltfResourceWorker(Gltf.loadMaterial, "material", .material).run;
 
 fn processGltf(allocator: std.mem.Allocator, prog_node: ?std.Progress.Node, meta_file_path: []const u8) !void {
     const file_path = removeExt(meta_file_path);
@@ -310,22 +323,16 @@ fn processGltf(allocator: std.mem.Allocator, prog_node: ?std.Progress.Node, meta
     var gltf_dir = try output_dir.makeOpenPath(gltf_dir_path, .{});
     defer gltf_dir.close();
 
-    var wait_group = std.Thread.WaitGroup{};
-
     const mesh_count = gltf_file.getMeshCount();
-    for (0..mesh_count) |i| {
-        thread_pool.spawnWg(&wait_group, mesh_thread_worker, .{ &gltf_file, allocator, prog_node, i });
-    }
-
     const texture_count = gltf_file.getTextureCount();
-    for (0..texture_count) |i| {
-        thread_pool.spawnWg(&wait_group, texture_thread_worker, .{ &gltf_file, allocator, prog_node, i });
-    }
-
     const material_count = gltf_file.getMaterialCount();
-    for (0..material_count) |i| {
-        thread_pool.spawnWg(&wait_group, material_thread_worker, .{ &gltf_file, allocator, prog_node, i });
-    }
+    task_pool.parallelFor(mesh_count + texture_count + material_count, .{}, GltfResourceContext{
+        .gltf_file = &gltf_file,
+        .allocator = allocator,
+        .prog_node = prog_node,
+        .mesh_count = mesh_count,
+        .texture_count = texture_count,
+    }, GltfResourceContext.run);
 
     if (gltf_file.gltf_file.data.scene) |default_scene| {
         const scene = try gltf_file.loadScene(allocator, default_scene);
@@ -342,8 +349,6 @@ fn processGltf(allocator: std.mem.Allocator, prog_node: ?std.Progress.Node, meta
         try scene.serialize(&writer.interface);
         try writer.interface.flush();
     }
-
-    thread_pool.waitAndWork(&wait_group);
 }
 
 pub fn loadZonFile(comptime T: type, allocator: std.mem.Allocator, dir: std.fs.Dir, path: []const u8, options: std.zon.parse.Options) !T {
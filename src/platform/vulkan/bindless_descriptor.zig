@@ -128,18 +128,23 @@ pub fn writeUpdates(self: *Self, temp_allocator: std.mem.Allocator) !void {
 pub fn bind(self: Self, command_buffer: vk.CommandBufferProxy, layout: vk.PipelineLayout) void {
     const bind_points = [_]vk.PipelineBindPoint{ .graphics, .compute };
     for (bind_points) |bind_point| {
-        command_buffer.bindDescriptorSets(
-            bind_point,
-            layout,
-            0,
-            1,
-            @ptrCast(&self.set),
-            0,
-            null,
-        );
+        self.bindPoint(command_buffer, layout, bind_point);
     }
 }
 
+/// For command buffers of queues that only support some of the bind points
+pub fn bindPoint(self: Self, command_buffer: vk.CommandBufferProxy, layout: vk.PipelineLayout, bind_point: vk.PipelineBindPoint) void {
+    command_buffer.bindDescriptorSets(
+        bind_point,
+        layout,
+        0,
+        1,
+        @ptrCast(&self.set),
+        0,
+        null,
+    );
+}
+
 pub const Binding = struct {
     binding: u16,
     index: u16,
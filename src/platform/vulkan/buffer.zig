@@ -26,17 +26,50 @@ pub fn init(
     usage: saturn.BufferUsage,
     memory: saturn.MemoryLocation,
 ) !Self {
-    const result = try device.gpu_allocator.createBuffer(&.{
+    const result = try device.gpu_allocator.createBuffer(&getCreateInfo(size, usage), memory);
+    return initFromHandle(device, result.buffer, result.allocation, size, usage, memory);
+}
+
+/// Places the buffer at offset in memory from GpuAllocator.allocateAliasingMemory, other resources may share that memory
+pub fn initAliased(
+    device: *Device,
+    size: vk.DeviceSize,
+    usage: saturn.BufferUsage,
+    memory: GpuAllocator.Allocation,
+    offset: vk.DeviceSize,
+) !Self {
+    const handle = try device.gpu_allocator.createAliasingBuffer(memory, offset, &getCreateInfo(size, usage));
+
+    // No vma_allocation so deinit only destroys the buffer
+    const allocation: GpuAllocator.Allocation = .{
+        .memory = memory.memory,
+        .offset = memory.offset + offset,
+        .size = size,
+        .location = .gpu_only,
+        .mapped_ptr = null,
+    };
+    return initFromHandle(device, handle, allocation, size, usage, .gpu_only);
+}
+
+pub fn getCreateInfo(size: vk.DeviceSize, usage: saturn.BufferUsage) vk.BufferCreateInfo {
+    return .{
         .size = size,
         .usage = getVkUsage(usage),
         .sharing_mode = .exclusive,
         .queue_family_index_count = 0,
         .p_queue_family_indices = undefined,
         .flags = .{},
-    }, memory);
-    const handle = result.buffer;
-    const allocation = result.allocation;
+    };
+}
 
+fn initFromHandle(
+    device: *Device,
+    handle: vk.Buffer,
+    allocation: GpuAllocator.Allocation,
+    size: vk.DeviceSize,
+    usage: saturn.BufferUsage,
+    memory: saturn.MemoryLocation,
+) Self {
     var buffer: Self = .{
         .handle = handle,
         .allocation = allocation,
@@ -124,6 +124,7 @@ pub fn init(
         .shader_storage_image_array_non_uniform_indexing = .true,
 
         .draw_indirect_count = .true,
+        .timeline_semaphore = .true,
         //.scalar_block_layout = .true,
     };
 
@@ -185,3 +185,93 @@ pub fn destroyTexture(
 ) void {
     vma.vmaDestroyImage(self.allocator, @ptrFromInt(@intFromEnum(image)), allocation.vma_allocation);
 }
+
+/// Device local memory that several resources are placed into with createAliasingBuffer and createAliasingTexture
+pub fn allocateAliasingMemory(
+    self: *Self,
+    requirements: vk.MemoryRequirements,
+) error{OutOfMemory}!Allocation {
+    const alloc_info: vma.VmaAllocationCreateInfo = .{
+        .preferredFlags = vma.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    };
+
+    var vma_allocation: vma.VmaAllocation = null;
+    var vma_allocation_info: vma.VmaAllocationInfo = .{};
+
+    const result = vma.vmaAllocateMemory(
+        self.allocator,
+        @ptrCast(&requirements),
+        &alloc_info,
+        &vma_allocation,
+        &vma_allocation_info,
+    );
+
+    if (result != 0) {
+        return error.OutOfMemory;
+    }
+
+    return .{
+        .memory = @enumFromInt(@intFromPtr(vma_allocation_info.deviceMemory)),
+        .offset = vma_allocation_info.offset,
+        .size = vma_allocation_info.size,
+        .location = .gpu_only,
+        .mapped_ptr = null,
+        .vma_allocation = vma_allocation,
+    };
+}
+
+/// Only frees the memory, every resource placed in it must be destroyed first
+pub fn freeMemory(
+    self: *Self,
+    allocation: Allocation,
+) void {
+    vma.vmaFreeMemory(self.allocator, allocation.vma_allocation);
+}
+
+/// The buffer doesn't own its memory, destroying it with destroyBuffer and a null vma_allocation leaves the memory alone
+pub fn createAliasingBuffer(
+    self: *Self,
+    memory: Allocation,
+    offset: vk.DeviceSize,
+    create_info: *const vk.BufferCreateInfo,
+) error{OutOfMemory}!vk.Buffer {
+    var vk_buffer: vma.VkBuffer = null;
+
+    const result = vma.vmaCreateAliasingBuffer2(
+        self.allocator,
+        memory.vma_allocation,
+        offset,
+        @ptrCast(create_info),
+        &vk_buffer,
+    );
+
+    if (result != 0) {
+        return error.OutOfMemory;
+    }
+
+    return @enumFromInt(@intFromPtr(vk_buffer));
+}
+
+/// The image doesn't own its memory, it is destroyed directly rather than through destroyTexture
+pub fn createAliasingTexture(
+    self: *Self,
+    memory: Allocation,
+    offset: vk.DeviceSize,
+    create_info: *const vk.ImageCreateInfo,
+) error{OutOfMemory}!vk.Image {
+    var vk_image: vma.VkImage = null;
+
+    const result = vma.vmaCreateAliasingImage2(
+        self.allocator,
+        memory.vma_allocation,
+        offset,
+        @ptrCast(create_info),
+        &vk_image,
+    );
+
+    if (result != 0) {
+        return error.OutOfMemory;
+    }
+
+    return @enumFromInt(@intFromPtr(vk_image));
+}
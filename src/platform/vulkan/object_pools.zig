@@ -11,13 +11,15 @@ pub const CommandBufferPool = struct {
     next_free: usize,
     device: *Device,
     command_pool: vk.CommandPool,
+    level: vk.CommandBufferLevel,
     allocator: std.mem.Allocator,
 
-    pub fn init(allocator: std.mem.Allocator, device: *Device, queue: Queue) !Self {
+    pub fn init(allocator: std.mem.Allocator, device: *Device, queue: Queue, level: vk.CommandBufferLevel) !Self {
         return Self{
             .objects = .empty,
             .next_free = 0,
             .device = device,
+            .level = level,
             .command_pool = try device.proxy.createCommandPool(
                 &.{ .flags = .{}, .queue_family_index = queue.family_index },
                 null,
@@ -45,7 +47,7 @@ pub const CommandBufferPool = struct {
 
         const alloc_info = vk.CommandBufferAllocateInfo{
             .command_pool = self.command_pool,
-            .level = .primary,
+            .level = self.level,
             .command_buffer_count = @intCast(command_buffers.len),
         };
 
@@ -85,6 +87,52 @@ pub const CommandBufferPool = struct {
     }
 };
 
+// Worker Command Buffer Pools
+// Command pools must be externally synchronized, so every thread that records gets its own pool of secondary buffers
+pub const WorkerCommandBufferPools = struct {
+    const Self = @This();
+
+    pools: std.ArrayList(CommandBufferPool),
+    device: *Device,
+    queue: Queue,
+    allocator: std.mem.Allocator,
+
+    pub fn init(allocator: std.mem.Allocator, device: *Device, queue: Queue) Self {
+        return Self{
+            .pools = .empty,
+            .device = device,
+            .queue = queue,
+            .allocator = allocator,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        for (self.pools.items) |*pool| {
+            pool.deinit();
+        }
+        self.pools.deinit(self.allocator);
+    }
+
+    /// Must be called from the submitting thread before any worker records, pools are never created from workers
+    pub fn ensureThreadCount(self: *Self, thread_count: usize) !void {
+        try self.pools.ensureTotalCapacity(self.allocator, thread_count);
+        while (self.pools.items.len < thread_count) {
+            self.pools.appendAssumeCapacity(try .init(self.allocator, self.device, self.queue, .secondary));
+        }
+    }
+
+    /// Only the thread with this index may call this while recording
+    pub fn get(self: *Self, thread_index: usize) !vk.CommandBuffer {
+        return self.pools.items[thread_index].get();
+    }
+
+    pub fn reset(self: *Self) error{PoolResetFailed}!void {
+        for (self.pools.items) |*pool| {
+            try pool.reset();
+        }
+    }
+};
+
 // Fence Pool
 pub const FencePool = struct {
     const Self = @This();
@@ -11,6 +11,7 @@ const Swapchain = @import("swapchain.zig");
 const object_pools = @import("object_pools.zig");
 const Buffer = @import("buffer.zig");
 const Texture = @import("texture.zig");
+const TransientCache = @import("transient_cache.zig");
 const Pipeline = @import("pipeline.zig");
 const BindlessDescriptor = @import("bindless_descriptor.zig");
 const render_graph_executor = @import("render_graph_executor.zig");
@@ -210,12 +211,16 @@ pub const QueueFamily = enum {
 const BufferInfo = struct {
     buffer: Buffer,
     owner_queue: ?QueueFamily = null,
+    /// Last access of the most recent graph that used it, however many frames ago that was
+    last_access: ?saturn.BufferAccess = null,
 };
 
 const TextureInfo = struct {
     texture: Texture,
     owner_queue: ?QueueFamily = null,
     layout: vk.ImageLayout = .undefined,
+    /// Last access of the most recent graph that used it, the layout it was left in follows from this
+    last_access: ?saturn.TextureAccess = null,
 };
 
 pub const Device = struct {
@@ -246,46 +251,40 @@ pub const Device = struct {
     pub const PerFrameData = struct {
         frame_wait_fences: std.ArrayList(vk.Fence) = .empty,
         graphics_command_pool: object_pools.CommandBufferPool,
+        /// Null when the device has no such queue
+        async_compute_command_pool: ?object_pools.CommandBufferPool,
+        async_transfer_command_pool: ?object_pools.CommandBufferPool,
+        worker_command_pools: object_pools.WorkerCommandBufferPools,
         semaphore_pool: object_pools.SemaphorePool,
         fence_pool: object_pools.FencePool,
 
-        buffer_access: std.AutoArrayHashMap(saturn.BufferHandle, saturn.BufferAccess),
-        texture_access: std.AutoArrayHashMap(saturn.TextureHandle, saturn.TextureAccess),
-
-        transient_buffers: std.ArrayList(Buffer) = .empty,
-        transient_textures: std.ArrayList(Texture) = .empty,
+        transient_cache: TransientCache,
 
         freed: FreedLists = .{},
 
         pub fn init(gpa: std.mem.Allocator, device: *VkDevice) !PerFrameData {
             return .{
-                .graphics_command_pool = try .init(gpa, device, device.graphics_queue),
+                .graphics_command_pool = try .init(gpa, device, device.graphics_queue, .primary),
+                .async_compute_command_pool = if (device.async_compute_queue) |queue| try .init(gpa, device, queue, .primary) else null,
+                .async_transfer_command_pool = if (device.async_transfer_queue) |queue| try .init(gpa, device, queue, .primary) else null,
+                .worker_command_pools = .init(gpa, device, device.graphics_queue),
                 .semaphore_pool = .init(gpa, device, .binary, 0),
                 .fence_pool = .init(gpa, device, .{}),
 
-                .buffer_access = .init(gpa),
-                .texture_access = .init(gpa),
+                .transient_cache = .init(gpa),
             };
         }
 
         pub fn deinit(self: *PerFrameData, gpa: std.mem.Allocator, device: *VkDevice) void {
             self.frame_wait_fences.deinit(gpa);
             self.graphics_command_pool.deinit();
+            if (self.async_compute_command_pool) |*pool| pool.deinit();
+            if (self.async_transfer_command_pool) |*pool| pool.deinit();
+            self.worker_command_pools.deinit();
             self.semaphore_pool.deinit();
             self.fence_pool.deinit();
 
-            for (self.transient_buffers.items) |buffer| {
-                buffer.deinit(device);
-            }
-            self.transient_buffers.deinit(gpa);
-
-            for (self.transient_textures.items) |texture| {
-                texture.deinit(device);
-            }
-            self.transient_textures.deinit(gpa);
-
-            self.buffer_access.deinit();
-            self.texture_access.deinit();
+            self.transient_cache.deinit(device);
 
             self.freed.deinit(gpa);
         }
@@ -298,31 +297,37 @@ pub const Device = struct {
             return true;
         }
 
+        /// Doesn't block, true while any of the frame's submissions is still running
+        pub fn isPending(self: *const @This(), device: vk.DeviceProxy) bool {
+            for (self.frame_wait_fences.items) |fence| {
+                const status = device.getFenceStatus(fence) catch return false;
+                if (status == .not_ready) return true;
+            }
+            return false;
+        }
+
         pub fn reset(self: *@This(), device: *VkDevice) void {
             self.frame_wait_fences.clearRetainingCapacity();
             self.graphics_command_pool.reset() catch |err| {
                 //If this fails, well just allocate more buffers I guess ¯\_(ツ)_/¯
                 std.log.err("Failed to reset command pool: {}", .{err});
             };
+            if (self.async_compute_command_pool) |*pool| pool.reset() catch |err| {
+                std.log.err("Failed to reset async compute command pool: {}", .{err});
+            };
+            if (self.async_transfer_command_pool) |*pool| pool.reset() catch |err| {
+                std.log.err("Failed to reset async transfer command pool: {}", .{err});
+            };
+            self.worker_command_pools.reset() catch |err| {
+                std.log.err("Failed to reset worker command pools: {}", .{err});
+            };
             self.semaphore_pool.reset();
             self.fence_pool.reset() catch |err| {
                 //If this fails, IDK what to do ¯\_(ツ)_/¯
                 std.log.err("Failed to reset fence pool: {}", .{err});
             };
 
-            self.buffer_access.clearRetainingCapacity();
-            self.texture_access.clearRetainingCapacity();
-
-            for (self.transient_buffers.items) |buffer| {
-                buffer.deinit(device);
-            }
-            self.transient_buffers.clearRetainingCapacity();
-
-            for (self.transient_textures.items) |texture| {
-                texture.deinit(device);
-            }
-
-            self.transient_textures.clearRetainingCapacity();
+            self.transient_cache.evict(device);
 
             self.freed.clear();
         }
@@ -358,11 +363,29 @@ pub const Device = struct {
     freed: FreedLists = .{},
 
     // Dynamic frames in flight
+    /// Slot of the frame being prepared or last submitted, frame_number % per_frame_data.len
     frame_index: usize = 0,
+    /// Zero until the first frame begins
+    frame_number: u64 = 0,
+    /// Set by beginFrame, cleared once the frame is submitted
+    frame_begun: bool = false,
     per_frame_data: []PerFrameData,
 
+    /// Pacing of the frame being prepared, moved to frame_pacing when it is submitted
+    current_pacing: saturn.FramePacingStats = .{},
+    frame_pacing: saturn.FramePacingStats = .{},
+    last_frame_begin: ?std.time.Instant = null,
+
     imguiRenderer: ?ImGuiRenderer = null,
 
+    render_graph_stats: saturn.RenderGraphStats = .{},
+
+    /// The last compiled graph, reused while submitted graphs hash the same
+    compiled_graph: ?struct {
+        hash: u64,
+        compiled: saturn.RenderGraphCompiled,
+    } = null,
+
     submit_timeout_ns: u64 = std.time.ns_per_s * 5,
 
     pub fn init(
@@ -442,7 +465,7 @@ pub const Device = struct {
         }
         errdefer {
             for (per_frame_data) |*frame_data| {
-                frame_data.deinit(gpa);
+                frame_data.deinit(gpa, device);
             }
         }
 
@@ -473,6 +496,10 @@ pub const Device = struct {
 
         self.freed.deinit(self.gpa);
 
+        if (self.compiled_graph) |*cached| {
+            cached.compiled.deinit(self.gpa);
+        }
+
         for (self.per_frame_data) |*frame_data| {
             frame_data.deinit(self.gpa, self.device);
         }
@@ -533,6 +560,9 @@ pub const Device = struct {
             .ctx = self,
             .vtable = &.{
                 .getInfo = getInfo,
+                .getFramesInFlight = getFramesInFlight,
+                .beginFrame = beginFrameCallback,
+                .getFrameInfo = getFrameInfo,
                 .createBuffer = createBuffer,
                 .destroyBuffer = destroyBuffer,
                 .getBufferInfo = getBufferInfo,
@@ -554,6 +584,8 @@ pub const Device = struct {
                 .submit = submit,
                 .waitIdle = waitIdle,
                 .createImguiPass = createImguiPass,
+                .getRenderGraphStats = getRenderGraphStats,
+                .getFramePacingStats = getFramePacingStats,
             },
         };
     }
@@ -563,6 +595,26 @@ pub const Device = struct {
         return self.backend.instance.physical_devices_info[self.physical_device_index];
     }
 
+    fn getFramesInFlight(ctx: *anyopaque) u32 {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        return @intCast(self.per_frame_data.len);
+    }
+
+    fn beginFrameCallback(ctx: *anyopaque) saturn.Error!saturn.FrameInfo {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        self.beginFrame();
+        return self.currentFrameInfo();
+    }
+
+    fn getFrameInfo(ctx: *anyopaque) saturn.FrameInfo {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        return self.currentFrameInfo();
+    }
+
+    fn currentFrameInfo(self: *const Self) saturn.FrameInfo {
+        return .{ .number = self.frame_number, .slot = @intCast(self.frame_index) };
+    }
+
     fn createBuffer(ctx: *anyopaque, desc: saturn.BufferDesc) saturn.Error!saturn.BufferHandle {
         const self: *Self = @ptrCast(@alignCast(ctx));
 
@@ -940,19 +992,40 @@ pub const Device = struct {
 
         const self: *Self = @ptrCast(@alignCast(ctx));
 
-        const frame_data = self.getNextFrameData();
+        const frame_data = self.getFrameData();
         _ = frame_data; // autofix
 
     }
 
-    fn submit(ctx: *anyopaque, tpa: std.mem.Allocator, render_graph: *const saturn.RenderGraph) saturn.Error!void {
-        const self: *Self = @ptrCast(@alignCast(ctx));
+    /// Moves to the next frame slot and waits for the gpu to finish the frame that used it last,
+    /// after that its deferred deletions, command pools and transient cache can be reused.
+    /// Waiting here instead of in submit means a ring of frames_in_flight slots is enough for anything the cpu writes while preparing a frame.
+    pub fn beginFrame(self: *Self) void {
+        if (self.frame_begun) return;
+        self.frame_begun = true;
+        self.frame_number += 1;
 
-        const frame_data = self.getNextFrameData();
+        self.frame_index = @intCast(self.frame_number % self.per_frame_data.len);
+        const frame_data = self.getFrameData();
 
+        const wait_start = std.time.Instant.now() catch null;
         if (!frame_data.waitForPrevious(self.device.proxy, self.submit_timeout_ns)) {
             std.log.err("Failed to wait for previous frame fences", .{});
         }
+        const wait_end = std.time.Instant.now() catch null;
+
+        self.current_pacing = .{ .frames_in_flight = @intCast(self.per_frame_data.len) };
+        if (wait_start != null and wait_end != null) {
+            self.current_pacing.wait_ns = wait_end.?.since(wait_start.?);
+            if (self.last_frame_begin) |last| self.current_pacing.frame_ns = wait_start.?.since(last);
+        }
+        self.last_frame_begin = wait_start;
+
+        for (self.per_frame_data, 0..) |*other_frame_data, index| {
+            if (index != self.frame_index and other_frame_data.isPending(self.device.proxy)) {
+                self.current_pacing.gpu_frames_queued += 1;
+            }
+        }
 
         //Clear prior freed objects
         {
@@ -972,8 +1045,32 @@ pub const Device = struct {
             }
         }
 
-        self.device.descriptor.writeUpdates(tpa) catch return error.Unknown;
         frame_data.reset(self.device);
+    }
+
+    /// Ends the frame beginFrame started, whether or not the submit succeeded
+    fn endFrame(self: *Self) void {
+        if (self.last_frame_begin) |begin| {
+            if (std.time.Instant.now()) |now| {
+                self.current_pacing.cpu_ns = now.since(begin) -| self.current_pacing.wait_ns;
+            } else |_| {}
+        }
+        self.frame_pacing = self.current_pacing;
+
+        self.frame_begun = false;
+    }
+
+    fn submit(ctx: *anyopaque, tpa: std.mem.Allocator, render_graph: *const saturn.RenderGraph) saturn.Error!void {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+
+        // Submitting without beginFrame still works, the wait just happens here
+        self.beginFrame();
+        defer self.endFrame();
+
+        const frame_data = self.getFrameData();
+
+        // Anything destroyed while this frame was prepared may still be used by it or an earlier frame,
+        // it is released the next time this slot begins, once this frame's fences have signaled
         try frame_data.freed.append(self.gpa, self.freed);
         self.freed.clear();
 
@@ -983,12 +1080,20 @@ pub const Device = struct {
                     self.device.proxy.deviceWaitIdle() catch {};
                     const new_size = self.backend.get_window_size_fn(window.handle, self.backend.get_window_size_user_data);
                     swapchain.rebuild(.{ .width = new_size[0], .height = new_size[1] }) catch |err| std.log.err("Failed to rebuild swapchain {}", .{err});
+
+                    // Transients sized relative to the window are stale now, the device is idle so every frame's can go
+                    for (self.per_frame_data) |*other_frame_data| {
+                        other_frame_data.transient_cache.clear(self.device);
+                    }
                 }
             }
         }
 
         var executor = render_graph_executor.RenderGraphExecutor.init(self, tpa, frame_data, render_graph) catch return error.Unknown;
         defer executor.deinit();
+
+        // After the executor so this frame's transient resources have their bindings written before recording
+        self.device.descriptor.writeUpdates(tpa) catch return error.Unknown;
         try executor.execute();
 
         return;
@@ -1009,465 +1114,68 @@ pub const Device = struct {
         return null;
     }
 
-    pub fn getNextFrameData(self: *Self) *PerFrameData {
-        defer self.frame_index = @mod(self.frame_index + 1, self.per_frame_data.len);
-        return &self.per_frame_data[self.frame_index];
+    fn getRenderGraphStats(ctx: *anyopaque) saturn.RenderGraphStats {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        return self.render_graph_stats;
     }
 
-    // *************************************************************************************************************************
-    // Render Graph code starts here
-    // *************************************************************************************************************************
-
-    pub fn getBufferResource(self: *const Self, handle: saturn.BufferHandle) ?render_graph_executor.BufferResource {
-        const info = self.buffers.get(handle) orelse return null;
-
-        var resource: render_graph_executor.BufferResource = .{
-            .interface = info.buffer,
-            .queue = info.owner_queue,
-        };
-
-        var frame_index: usize = self.frame_index;
-        for (0..(self.per_frame_data.len - 1)) |_| {
-            frame_index = (frame_index + self.per_frame_data.len - 1) % self.per_frame_data.len;
-
-            if (self.per_frame_data[frame_index].buffer_access.get(handle)) |access| {
-                resource.last_access = access;
-                break;
-            }
-        }
-
-        return resource;
+    fn getFramePacingStats(ctx: *anyopaque) saturn.FramePacingStats {
+        const self: *Self = @ptrCast(@alignCast(ctx));
+        return self.frame_pacing;
     }
 
-    pub fn getTextureResource(self: *const Self, handle: saturn.TextureHandle) ?render_graph_executor.TextureResource {
-        const info = self.textures.get(handle) orelse return null;
-
-        var resource: render_graph_executor.TextureResource = .{
-            .interface = info.texture,
-            .queue = info.owner_queue,
-            .layout = info.layout,
-        };
+    /// Compiles render_graph unless its structure matches the last one compiled
+    pub fn getCompiledGraph(self: *Self, tpa: std.mem.Allocator, render_graph: *const saturn.RenderGraph) !*const saturn.RenderGraphCompiled {
+        const hash = render_graph.structureHash();
 
-        var frame_index: usize = self.frame_index;
-        for (0..(self.per_frame_data.len - 1)) |_| {
-            frame_index = (frame_index + self.per_frame_data.len - 1) % self.per_frame_data.len;
-
-            if (self.per_frame_data[frame_index].texture_access.get(handle)) |access| {
-                resource.last_access = access;
-                break;
+        if (self.compiled_graph) |*cached| {
+            if (cached.hash == hash) {
+                self.render_graph_stats.compile_cache_hits += 1;
+                return &cached.compiled;
             }
+            cached.compiled.deinit(self.gpa);
+            self.compiled_graph = null;
         }
 
-        return resource;
-    }
-
-    const BufferResource = struct {
-        interface: Buffer,
-        queue: ?QueueFamily,
-        last_access: ?saturn.BufferAccess = null,
-    };
-
-    const TextureResource = struct {
-        interface: Texture,
-        queue: ?QueueFamily,
-        last_access: ?saturn.TextureAccess = null,
-        layout: vk.ImageLayout,
-    };
-
-    const GraphResources = struct {
-        buffers: []BufferResource,
-        textures: []TextureResource,
-
-        pub fn deinit(self: *const @This(), allocator: std.mem.Allocator) void {
-            allocator.free(self.buffers);
-            allocator.free(self.textures);
-        }
-    };
-
-    const SwapchainTexture = struct {
-        swapchain: *Swapchain,
-        index: u32,
-        interface: Texture,
-        wait_semaphore: vk.Semaphore,
-        present_semaphore: vk.Semaphore,
-        resource: saturn.RGTextureHandle,
-    };
-
-    fn getTextureSize(texture_extent: saturn.RGTextureExtent, textures: []const TextureResource) vk.Extent2D {
-        return switch (texture_extent) {
-            .fixed => |extent| .{ .width = extent[0], .height = extent[1] },
-            .relative => |rel_tex| textures[rel_tex.idx].interface.extent,
+        self.render_graph_stats.compile_cache_misses += 1;
+        self.compiled_graph = .{
+            .hash = hash,
+            .compiled = try .compile(self.gpa, tpa, render_graph, .{
+                .graphics = true,
+                .async_compute = self.device.async_compute_queue != null,
+                .async_transfer = self.device.async_transfer_queue != null,
+            }),
         };
+        return &self.compiled_graph.?.compiled;
     }
 
-    pub fn fetchResources(self: *const Self, tpa: std.mem.Allocator, frame_data: *PerFrameData, render_graph: *const saturn.RenderGraph, swapchain_textures: []const SwapchainTexture) !GraphResources {
-
-        //***************************************************
-        //TODO: ACTUALLY RESUSE AND ALIAS TRANSIENT RESOURCES
-        //***************************************************W
-
-        const buffers: []BufferResource = try tpa.alloc(BufferResource, render_graph.buffers.items.len);
-        errdefer tpa.free(buffers);
-
-        const textures: []TextureResource = try tpa.alloc(TextureResource, render_graph.textures.items.len);
-        errdefer tpa.free(textures);
-
-        for (render_graph.buffers.items, buffers) |graph_buffer, *resource| {
-            resource.* = switch (graph_buffer.source) {
-                .persistent => |handle| self.getBufferResource(handle).?,
-                .transient => |idx| result: {
-                    const desc = render_graph.transient_buffers.items[idx];
-
-                    //TODO: finish desc
-                    const buffer = try Buffer.init(self.device, desc.size, .{ .storage_buffer_bit = true }, .gpu_only);
-                    try frame_data.transient_buffers.append(self.gpa, buffer);
-                    break :result BufferResource{
-                        .interface = buffer,
-                        .queue = null,
-                        .last_access = null,
-                    };
-                },
-            };
-        }
-
-        for (render_graph.textures.items, textures, 0..) |graph_texture, *resource, i| {
-            resource.* = switch (graph_texture.source) {
-                .persistent => |handle| self.getTextureResource(handle).?,
-                .transient => |idx| result: {
-                    const desc = render_graph.transient_textures.items[idx];
-
-                    //TODO: finish desc
-                    const texture = try Texture.init(
-                        self.device,
-                        getTextureSize(desc.extent, textures[0..i]),
-                        1,
-                        .r8g8b8a8_unorm,
-                        .{ .storage_bit = true },
-                        .gpu_only,
-                    );
-                    try frame_data.transient_textures.append(self.gpa, texture);
-                    break :result TextureResource{
-                        .interface = texture,
-                        .queue = null,
-                        .last_access = null,
-                        .layout = .undefined,
-                    };
-                },
-                .window => |idx| TextureResource{
-                    .interface = swapchain_textures[idx].interface,
-                    .queue = null,
-                    .last_access = null,
-                    .layout = .undefined,
-                },
-            };
-        }
-
-        return .{
-            .buffers = buffers,
-            .textures = textures,
-        };
-    }
-
-    const BufferStateAccess = struct {
-        access: vk.AccessFlags2,
-        state: vk.PipelineStageFlags2,
-    };
-
-    pub fn getBufferStateAccess(access: saturn.BufferAccess) BufferStateAccess {
-        return switch (access) {
-            .none => .{
-                .access = .{},
-                .state = .{},
-            },
-
-            .vertex_read => .{
-                .access = .{ .vertex_attribute_read_bit = true },
-                .state = .{ .vertex_input_bit = true },
-            },
-            .index_read => .{
-                .access = .{ .index_read_bit = true },
-                .state = .{ .index_input_bit = true },
-            },
-            .indirect_read => .{
-                .access = .{ .indirect_command_read_bit = true },
-                .state = .{ .draw_indirect_bit = true },
-            },
-
-            .compute_uniform_read => .{
-                .access = .{ .uniform_read_bit = true },
-                .state = .{ .compute_shader_bit = true },
-            },
-            .graphics_uniform_read => .{
-                .access = .{ .uniform_read_bit = true },
-                .state = .{ .all_graphics_bit = true },
-            },
-
-            .compute_storage_read => .{
-                .access = .{ .shader_storage_read_bit = true },
-                .state = .{ .compute_shader_bit = true },
-            },
-            .graphics_storage_read => .{
-                .access = .{ .shader_storage_read_bit = true },
-                .state = .{ .all_graphics_bit = true },
-            },
-
-            .compute_storage_write => .{
-                .access = .{ .shader_storage_read_bit = true, .shader_storage_write_bit = true },
-                .state = .{ .compute_shader_bit = true },
-            },
-            .graphics_storage_write => .{
-                .access = .{ .shader_storage_read_bit = true, .shader_storage_write_bit = true },
-                .state = .{ .all_graphics_bit = true },
-            },
-
-            .transfer_read => .{
-                .access = .{ .transfer_read_bit = true },
-                .state = .{ .all_transfer_bit = true },
-            },
-            .transfer_write => .{
-                .access = .{ .transfer_write_bit = true },
-                .state = .{ .all_transfer_bit = true },
-            },
-        };
+    pub fn getFrameData(self: *Self) *PerFrameData {
+        return &self.per_frame_data[self.frame_index];
     }
 
-    pub fn getBufferMemoryBarrier(
-        self: *Self,
-        handle: vk.Buffer,
-        src_access: saturn.BufferAccess,
-        dst_access: saturn.BufferAccess,
-    ) vk.BufferMemoryBarrier2 {
-        _ = self; // autofix
+    // *************************************************************************************************************************
+    // Render Graph code starts here
+    // *************************************************************************************************************************
 
-        const src = getBufferStateAccess(src_access);
-        const dst = getBufferStateAccess(dst_access);
+    pub fn getBufferResource(self: *const Self, handle: saturn.BufferHandle) ?render_graph_executor.BufferResource {
+        const info = self.buffers.get(handle) orelse return null;
 
         return .{
-            .buffer = handle,
-            .offset = 0,
-            .size = vk.WHOLE_SIZE,
-            .src_access_mask = src.access,
-            .src_stage_mask = src.state,
-            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .dst_access_mask = dst.access,
-            .dst_stage_mask = dst.state,
-            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-        };
-    }
-
-    const TextureStateAccess = struct {
-        access: vk.AccessFlags2,
-        state: vk.PipelineStageFlags2,
-        layout: vk.ImageLayout,
-    };
-
-    pub fn getTextureStateAccess(access: saturn.TextureAccess, is_color: bool, unifined_image_layout: bool) TextureStateAccess {
-        var result: TextureStateAccess = switch (access) {
-            .none => .{
-                .access = .{},
-                .state = .{},
-                .layout = .undefined,
-            },
-
-            .attachment_read => if (is_color) .{
-                .access = .{ .color_attachment_read_bit = true },
-                .state = .{ .color_attachment_output_bit = true, .fragment_shader_bit = true },
-                .layout = .attachment_optimal, //TODO: what is the best layout for this stage?
-            } else .{
-                .access = .{ .depth_stencil_attachment_read_bit = true },
-                .state = .{ .early_fragment_tests_bit = true, .late_fragment_tests_bit = true },
-                .layout = .attachment_optimal,
-            },
-            .attachment_write => if (is_color) .{
-                .access = .{ .color_attachment_write_bit = true },
-                .state = .{ .color_attachment_output_bit = true },
-                .layout = .attachment_optimal,
-            } else .{
-                .access = .{ .depth_stencil_attachment_write_bit = true },
-                .state = .{ .early_fragment_tests_bit = true, .late_fragment_tests_bit = true },
-                .layout = .attachment_optimal,
-            },
-
-            .compute_sampled_read => .{
-                .access = .{ .shader_sampled_read_bit = true },
-                .state = .{ .compute_shader_bit = true },
-                .layout = .shader_read_only_optimal,
-            },
-            .graphics_sampled_read => .{
-                .access = .{ .shader_sampled_read_bit = true },
-                .state = .{ .all_graphics_bit = true },
-                .layout = .shader_read_only_optimal,
-            },
-
-            .compute_storage_read => .{
-                .access = .{ .shader_storage_read_bit = true },
-                .state = .{ .compute_shader_bit = true },
-                .layout = .general,
-            },
-            .graphics_storage_read => .{
-                .access = .{ .shader_storage_read_bit = true },
-                .state = .{ .all_graphics_bit = true },
-                .layout = .general,
-            },
-
-            .compute_storage_write => .{
-                .access = .{ .shader_storage_read_bit = true, .shader_storage_write_bit = true },
-                .state = .{ .compute_shader_bit = true },
-                .layout = .general,
-            },
-            .graphics_storage_write => .{
-                .access = .{ .shader_storage_read_bit = true, .shader_storage_write_bit = true },
-                .state = .{ .all_graphics_bit = true },
-                .layout = .general,
-            },
-
-            .transfer_read => .{
-                .access = .{ .transfer_read_bit = true },
-                .state = .{ .all_transfer_bit = true },
-                .layout = .transfer_src_optimal,
-            },
-            .transfer_write => .{
-                .access = .{ .transfer_write_bit = true },
-                .state = .{ .all_transfer_bit = true },
-                .layout = .transfer_dst_optimal,
-            },
+            .interface = info.buffer,
+            .queue = info.owner_queue,
+            .last_access = info.last_access,
         };
-
-        if (access != .none and unifined_image_layout) {
-            result.layout = .general;
-        }
-
-        return result;
     }
 
-    pub fn getTextureMemoryBarrier(
-        self: *Self,
-        texture: Texture,
-        src_access: saturn.TextureAccess,
-        dst_access: saturn.TextureAccess,
-    ) ?vk.ImageMemoryBarrier2 {
-        const aspect_mask = Texture.getFormatAspectMask(texture.format);
-        const is_color = aspect_mask.color_bit;
-        const unified_image_layouts = self.device.extensions.unified_image_layouts;
-
-        const src = getTextureStateAccess(src_access, is_color, unified_image_layouts);
-        const dst = getTextureStateAccess(dst_access, is_color, unified_image_layouts);
+    pub fn getTextureResource(self: *const Self, handle: saturn.TextureHandle) ?render_graph_executor.TextureResource {
+        const info = self.textures.get(handle) orelse return null;
 
         return .{
-            .image = texture.handle,
-            .subresource_range = .{
-                .aspect_mask = aspect_mask,
-                .base_array_layer = 0,
-                .layer_count = 1,
-                .base_mip_level = 0,
-                .level_count = 1,
-            },
-            .src_access_mask = src.access,
-            .src_stage_mask = src.state,
-            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .old_layout = src.layout,
-
-            .dst_access_mask = dst.access,
-            .dst_stage_mask = dst.state,
-            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .new_layout = dst.layout,
-        };
-    }
-
-    pub fn buildBarriers(
-        self: *Self,
-        tpa: std.mem.Allocator,
-        command_buffer: vk.CommandBufferProxy,
-        render_graph: *const saturn.RenderGraph,
-        pass: saturn.RenderGraphCompiled.Pass,
-        resources: *const GraphResources,
-    ) !void {
-
-        //TODO: use only single MemoryBarrier, we wont need more than one
-        var memory_barriers: std.ArrayList(vk.MemoryBarrier2) = .empty;
-        defer memory_barriers.deinit(tpa);
-
-        //TODO: limit to max number, if overflow switch to single MemoryBarrier
-        var buffer_barriers: std.ArrayList(vk.BufferMemoryBarrier2) = .empty;
-        defer buffer_barriers.deinit(tpa);
-
-        var texture_barriers: std.ArrayList(vk.ImageMemoryBarrier2) = .empty;
-        defer texture_barriers.deinit(tpa);
-
-        const DEBUG_FULL_PIPELINE_BARRIER: bool = false;
-        if (DEBUG_FULL_PIPELINE_BARRIER) {
-            try memory_barriers.append(tpa, .{
-                .src_access_mask = .{ .memory_read_bit = true, .memory_write_bit = true },
-                .src_stage_mask = .{ .all_commands_bit = true },
-                .dst_access_mask = .{ .memory_read_bit = true, .memory_write_bit = true },
-                .dst_stage_mask = .{ .all_commands_bit = true },
-            });
-        }
-
-        const dst_pass = &render_graph.passes.items[pass.handle.idx];
-
-        for (pass.first_usages.items) |first_usage| {
-            switch (first_usage) {
-                .buffer => |handle| {
-                    const buffer = &resources.buffers[handle.idx];
-                    if (buffer.last_access) |src_access| {
-                        if (dst_pass.getBufferAccess(handle)) |dst_access| {
-                            try buffer_barriers.append(tpa, self.getBufferMemoryBarrier(buffer.interface.handle, src_access, dst_access));
-                        }
-                    }
-                },
-                .texture => |handle| {
-                    const texture = &resources.textures[handle.idx];
-                    if (dst_pass.getTextureAccess(handle)) |dst_access| {
-                        if (self.getTextureMemoryBarrier(texture.interface, texture.last_access orelse .none, dst_access)) |barrier| {
-                            try texture_barriers.append(tpa, barrier);
-                        }
-                    }
-                },
-            }
-        }
-
-        for (pass.pass_dependencies.items) |pass_dependency| {
-            const src_pass = &render_graph.passes.items[pass_dependency.pass.idx];
-
-            for (pass_dependency.dependencies.items) |dependency| {
-                switch (dependency) {
-                    .buffer => |handle| {
-                        const buffer = &resources.buffers[handle.idx];
-                        if (src_pass.getBufferAccess(handle)) |src_access| {
-                            if (dst_pass.getBufferAccess(handle)) |dst_access| {
-                                try buffer_barriers.append(tpa, self.getBufferMemoryBarrier(buffer.interface.handle, src_access, dst_access));
-                            }
-                        }
-                    },
-                    .texture => |handle| {
-                        const texture = &resources.textures[handle.idx];
-                        if (src_pass.getTextureAccess(handle)) |src_access| {
-                            if (dst_pass.getTextureAccess(handle)) |dst_access| {
-                                if (self.getTextureMemoryBarrier(texture.interface, src_access, dst_access)) |barrier| {
-                                    try texture_barriers.append(tpa, barrier);
-                                }
-                            }
-                        }
-                    },
-                }
-            }
-        }
-
-        const dependencies: vk.DependencyInfo = .{
-            .memory_barrier_count = @intCast(memory_barriers.items.len),
-            .p_memory_barriers = memory_barriers.items.ptr,
-
-            .buffer_memory_barrier_count = @intCast(buffer_barriers.items.len),
-            .p_buffer_memory_barriers = buffer_barriers.items.ptr,
-
-            .image_memory_barrier_count = @intCast(texture_barriers.items.len),
-            .p_image_memory_barriers = texture_barriers.items.ptr,
+            .interface = info.texture,
+            .queue = info.owner_queue,
+            .last_access = info.last_access,
+            .layout = info.layout,
         };
-
-        if (dependencies.memory_barrier_count + dependencies.buffer_memory_barrier_count + dependencies.image_memory_barrier_count > 0) {
-            command_buffer.pipelineBarrier2(&dependencies);
-        }
     }
 };
 
@@ -6,11 +6,26 @@ family_index: u32,
 handle: vk.Queue,
 command_pool: vk.CommandPool,
 
+/// Signaled by every render graph submission on this queue, other queues wait on it for the work they depend on
+timeline: vk.Semaphore,
+/// Last value submitted to signal the timeline
+timeline_value: u64 = 0,
+
 pub fn init(device: vk.DeviceProxy, family_index: u32) !Self {
+    const command_pool = try device.createCommandPool(&.{ .flags = .{ .reset_command_buffer_bit = true }, .queue_family_index = family_index }, null);
+    errdefer device.destroyCommandPool(command_pool, null);
+
+    const type_create_info: vk.SemaphoreTypeCreateInfo = .{
+        .semaphore_type = .timeline,
+        .initial_value = 0,
+    };
+    const timeline = try device.createSemaphore(&.{ .p_next = &type_create_info }, null);
+
     return .{
         .family_index = family_index,
         .handle = device.getDeviceQueue(family_index, 0),
-        .command_pool = try device.createCommandPool(&.{ .flags = .{ .reset_command_buffer_bit = true }, .queue_family_index = family_index }, null),
+        .command_pool = command_pool,
+        .timeline = timeline,
     };
 }
 
@@ -18,5 +33,6 @@ pub fn deinit(
     self: Self,
     device: vk.DeviceProxy,
 ) void {
+    device.destroySemaphore(self.timeline, null);
     device.destroyCommandPool(self.command_pool, null);
 }
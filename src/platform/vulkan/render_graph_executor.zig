@@ -1,14 +1,22 @@
 const std = @import("std");
 const vk = @import("vulkan");
 const saturn = @import("../../root.zig");
+const TaskPool = @import("../../TaskPool.zig");
 
 const platform = @import("platform.zig");
 const Device = platform.Device;
 const QueueFamily = platform.QueueFamily;
+const object_pools = @import("object_pools.zig");
+const VkQueue = @import("queue.zig");
+
+const Queue = saturn.RenderGraphCompiled.Queue;
+const QueueTransfer = saturn.RenderGraphCompiled.QueueTransfer;
 
 const Buffer = @import("buffer.zig");
 const Texture = @import("texture.zig");
 const Swapchain = @import("swapchain.zig");
+const transient_aliasing = @import("transient_aliasing.zig");
+const TransientCache = @import("transient_cache.zig");
 
 pub const BufferResource = struct {
     interface: Buffer,
@@ -33,6 +41,14 @@ pub const GraphResources = struct {
     }
 };
 
+const AliasedResource = TransientCache.AliasedResource;
+
+const FetchedResources = struct {
+    resources: GraphResources,
+    /// Owned by the frame's transient cache
+    aliases: []const AliasedResource,
+};
+
 const SwapchainTexture = struct {
     swapchain: *Swapchain,
     index: u32,
@@ -42,26 +58,48 @@ const SwapchainTexture = struct {
     resource: saturn.RGTextureHandle,
 };
 
+/// Consecutive sorted passes on the same queue, recorded into one command buffer and submitted together
+const Batch = struct {
+    queue: Queue,
+    command_buffer: vk.CommandBuffer,
+    /// Latest batch on each other queue this one depends on
+    waits: std.EnumArray(Queue, ?u32) = .initFill(null),
+    /// Takes over a resource the prologue released on graphics
+    waits_prologue: bool = false,
+    /// Value signaled on the queue's timeline once submitted
+    signal_value: u64 = 0,
+};
+
 pub const RenderGraphExecutor = struct {
     const Self = @This();
 
     device: *Device,
     tpa: std.mem.Allocator,
     render_graph: *const saturn.RenderGraph,
-    compiled: saturn.RenderGraphCompiled,
+    /// Owned by the device, reused while the graph's structure doesn't change
+    compiled: *const saturn.RenderGraphCompiled,
     frame_data: *Device.PerFrameData,
     resources: GraphResources,
+    aliases: []const AliasedResource,
     swapchain_textures: []SwapchainTexture,
 
+    batches: std.ArrayList(Batch) = .empty,
+    /// Batch of each sorted pass
+    pass_batches: []u32 = &.{},
+    /// Releases on graphics for persistent resources whose first access this frame is on another queue
+    prologue: BarrierList = .{},
+
+    barriers_emitted: u32 = 0,
+    barriers_eliminated: u32 = 0,
+
     pub fn init(device: *Device, tpa: std.mem.Allocator, frame_data: *Device.PerFrameData, render_graph: *const saturn.RenderGraph) !Self {
-        var compiled = try saturn.RenderGraphCompiled.compile(tpa, render_graph);
-        errdefer compiled.deinit(tpa);
+        const compiled = try device.getCompiledGraph(tpa, render_graph);
 
         const swapchain_textures = try acquireSwapchainImages(device, tpa, frame_data, render_graph);
         errdefer tpa.free(swapchain_textures);
 
-        const resources = try fetchResources(device, tpa, frame_data, render_graph, swapchain_textures);
-        errdefer resources.deinit(tpa);
+        const fetched = try fetchResources(device, tpa, frame_data, render_graph, compiled, swapchain_textures);
+        errdefer fetched.resources.deinit(tpa);
 
         return .{
             .device = device,
@@ -69,19 +107,24 @@ pub const RenderGraphExecutor = struct {
             .render_graph = render_graph,
             .compiled = compiled,
             .frame_data = frame_data,
-            .resources = resources,
+            .resources = fetched.resources,
+            .aliases = fetched.aliases,
             .swapchain_textures = swapchain_textures,
+            .barriers_eliminated = compiled.merged_read_barriers,
         };
     }
 
     pub fn deinit(self: *Self) void {
-        self.compiled.deinit(self.tpa);
         self.resources.deinit(self.tpa);
         self.tpa.free(self.swapchain_textures);
+        self.batches.deinit(self.tpa);
+        self.tpa.free(self.pass_batches);
+        self.prologue.deinit(self.tpa);
     }
 
     pub fn execute(self: *Self) saturn.Error!void {
-        self.recordCommandBuffer() catch return error.Unknown;
+        self.recordBatches() catch return error.Unknown;
+        self.submitBatches() catch return error.Unknown;
         self.present() catch return error.Unknown;
         self.writeLastUsages();
     }
@@ -124,65 +167,259 @@ pub const RenderGraphExecutor = struct {
     // Resource Fetch
     // ------------------------------------------------------------------
 
-    fn getTextureExtentSize(texture_extent: saturn.RGTextureExtent, textures: []const TextureResource) saturn.TextureExtent {
+    fn getTextureExtentSize(texture_extent: saturn.RGTextureExtent, extents: []const saturn.TextureExtent) saturn.TextureExtent {
         return switch (texture_extent) {
             .fixed => |extent| .{ .width = extent[0], .height = extent[1], .depth = 1 },
-            .relative => |rel_tex| textures[rel_tex.idx].interface.extent,
+            .relative => |rel_tex| extents[rel_tex.idx],
+        };
+    }
+
+    /// Only called for transients some pass that runs accesses
+    fn getLifetime(resource: saturn.RenderGraphCompiled.Resource) transient_aliasing.Lifetime {
+        return .{
+            .first = resource.first_sorted_access.?,
+            .last = resource.last_sorted_access.?,
         };
     }
 
     fn fetchResources(
-        device: *const Device,
+        device: *Device,
         tpa: std.mem.Allocator,
         frame_data: *Device.PerFrameData,
         render_graph: *const saturn.RenderGraph,
+        compiled: *const saturn.RenderGraphCompiled,
         swapchain_textures: []const SwapchainTexture,
-    ) !GraphResources {
+    ) !FetchedResources {
         const buffers = try tpa.alloc(BufferResource, render_graph.buffers.items.len);
         errdefer tpa.free(buffers);
 
         const textures = try tpa.alloc(TextureResource, render_graph.textures.items.len);
         errdefer tpa.free(textures);
 
-        for (render_graph.buffers.items, buffers) |graph_buffer, *resource| {
-            resource.* = switch (graph_buffer.source) {
-                .persistent => |handle| device.getBufferResource(handle).?,
-                .transient => |idx| blk: {
+        // Transients are only described here, they come from the cache or are created together once every key is known
+        var keys: std.ArrayList(TransientCache.Key) = .empty;
+        defer keys.deinit(tpa);
+
+        for (render_graph.buffers.items, buffers, 0..) |graph_buffer, *resource, i| {
+            switch (graph_buffer.source) {
+                .persistent => |handle| resource.* = device.getBufferResource(handle).?,
+                .transient => |idx| {
+                    // Only touched by culled passes, nothing that runs will look at it
+                    if (compiled.buffers.items[i].access_count == 0) {
+                        resource.* = undefined;
+                        continue;
+                    }
+
                     const desc = render_graph.transient_buffers.items[idx];
-                    const buffer = try Buffer.init(device.device, desc.size, desc.usage, desc.memory);
-                    try frame_data.transient_buffers.append(device.gpa, buffer);
-                    break :blk .{ .interface = buffer, .queue = null, .last_access = null };
+                    try keys.append(tpa, .{ .buffer = .{
+                        .index = @intCast(i),
+                        .size = desc.size,
+                        .usage = desc.usage,
+                        .memory = desc.memory,
+                        .lifetime = getLifetime(compiled.buffers.items[i]),
+                    } });
                 },
-            };
+            }
         }
 
+        const texture_extents = try tpa.alloc(saturn.TextureExtent, render_graph.textures.items.len);
+        defer tpa.free(texture_extents);
+
         for (render_graph.textures.items, textures, 0..) |graph_texture, *resource, i| {
-            resource.* = switch (graph_texture.source) {
-                .persistent => |handle| device.getTextureResource(handle).?,
-                .transient => |idx| blk: {
+            switch (graph_texture.source) {
+                .persistent => |handle| resource.* = device.getTextureResource(handle).?,
+                .transient => |idx| {
                     const desc = render_graph.transient_textures.items[idx];
-                    const texture = try Texture.init(
-                        device.device,
-                        getTextureExtentSize(desc.extent, textures[0..i]),
-                        desc.mip_levels,
-                        desc.format,
-                        desc.usage,
-                        desc.memory,
-                        .null_handle, //TODO: allow sampler for transient textures
-                    );
-                    try frame_data.transient_textures.append(device.gpa, texture);
-                    break :blk .{ .interface = texture, .queue = null, .last_access = null, .layout = .undefined };
+                    texture_extents[i] = getTextureExtentSize(desc.extent, texture_extents[0..i]);
+                    if (compiled.textures.items[i].access_count == 0) {
+                        resource.* = undefined;
+                        continue;
+                    }
+
+                    try keys.append(tpa, .{ .texture = .{
+                        .index = @intCast(i),
+                        .extent = texture_extents[i],
+                        .mip_levels = desc.mip_levels,
+                        .format = desc.format,
+                        .usage = desc.usage,
+                        .sampler = desc.sampler,
+                        .lifetime = getLifetime(compiled.textures.items[i]),
+                    } });
+                    continue;
                 },
-                .window => |idx| .{
+                .window => |idx| resource.* = .{
                     .interface = swapchain_textures[idx].interface,
                     .queue = null,
                     .last_access = null,
                     .layout = .undefined,
                 },
+            }
+            texture_extents[i] = resource.interface.extent;
+        }
+
+        var created: u32 = 0;
+        const entry = frame_data.transient_cache.find(keys.items) orelse blk: {
+            const new_entry = try frame_data.transient_cache.create(keys.items);
+            createTransients(device, tpa, new_entry) catch |err| {
+                frame_data.transient_cache.destroy(device.device, new_entry);
+                return err;
             };
+            created = @intCast(new_entry.resourceCount());
+            break :blk new_entry;
+        };
+
+        // The entry holds the transients in key order
+        var next_buffer: usize = 0;
+        var next_texture: usize = 0;
+        for (entry.keys) |key| {
+            switch (key) {
+                .buffer => |buffer_key| {
+                    buffers[buffer_key.index] = .{ .interface = entry.buffers.items[next_buffer], .queue = null, .last_access = null };
+                    next_buffer += 1;
+                },
+                .texture => |texture_key| {
+                    textures[texture_key.index] = .{ .interface = entry.textures.items[next_texture], .queue = null, .last_access = null, .layout = .undefined };
+                    next_texture += 1;
+                },
+            }
+        }
+
+        device.render_graph_stats.transient_requested_bytes = entry.requested_bytes;
+        device.render_graph_stats.transient_allocated_bytes = entry.allocated_bytes;
+        device.render_graph_stats.transient_resources_created = created;
+
+        return .{
+            .resources = .{ .buffers = buffers, .textures = textures },
+            .aliases = entry.aliases.items,
+        };
+    }
+
+    /// Creates the transients of a new cache entry, gpu only buffers and all textures share memory where their lifetimes allow
+    fn createTransients(device: *Device, tpa: std.mem.Allocator, entry: *TransientCache.Entry) !void {
+        const gpa = device.gpa;
+
+        var buffer_requests: std.ArrayList(transient_aliasing.Request) = .empty;
+        defer buffer_requests.deinit(tpa);
+        var aliased_buffers: std.ArrayList(u32) = .empty;
+        defer aliased_buffers.deinit(tpa);
+
+        var texture_requests: std.ArrayList(transient_aliasing.Request) = .empty;
+        defer texture_requests.deinit(tpa);
+        var aliased_textures: std.ArrayList(u32) = .empty;
+        defer aliased_textures.deinit(tpa);
+
+        for (entry.keys) |key| {
+            var requirements: vk.MemoryRequirements2 = .{ .memory_requirements = undefined };
+            switch (key) {
+                .buffer => |buffer_key| {
+                    // Mapped transients get their own memory
+                    if (buffer_key.memory != .gpu_only) continue;
+
+                    device.device.proxy.getDeviceBufferMemoryRequirements(&.{ .p_create_info = &Buffer.getCreateInfo(buffer_key.size, buffer_key.usage) }, &requirements);
+                    try buffer_requests.append(tpa, .{
+                        .size = requirements.memory_requirements.size,
+                        .alignment = requirements.memory_requirements.alignment,
+                        .memory_type_bits = requirements.memory_requirements.memory_type_bits,
+                        .lifetime = buffer_key.lifetime,
+                    });
+                    try aliased_buffers.append(tpa, buffer_key.index);
+                },
+                .texture => |texture_key| {
+                    device.device.proxy.getDeviceImageMemoryRequirements(&.{
+                        .p_create_info = &Texture.getCreateInfo(texture_key.extent, texture_key.mip_levels, texture_key.format, texture_key.usage),
+                        .plane_aspect = .{},
+                    }, &requirements);
+                    try texture_requests.append(tpa, .{
+                        .size = requirements.memory_requirements.size,
+                        .alignment = requirements.memory_requirements.alignment,
+                        .memory_type_bits = requirements.memory_requirements.memory_type_bits,
+                        .lifetime = texture_key.lifetime,
+                    });
+                    try aliased_textures.append(tpa, texture_key.index);
+                },
+            }
+        }
+
+        // Buffers and images are planned apart so linear and optimal resources never share a block
+        const buffer_plan = try transient_aliasing.plan(tpa, buffer_requests.items);
+        defer buffer_plan.deinit(tpa);
+        const buffer_memory_start = entry.memory.items.len;
+        try allocatePlanMemory(device, entry, buffer_plan);
+
+        const texture_plan = try transient_aliasing.plan(tpa, texture_requests.items);
+        defer texture_plan.deinit(tpa);
+        const texture_memory_start = entry.memory.items.len;
+        try allocatePlanMemory(device, entry, texture_plan);
+
+        var next_buffer_request: usize = 0;
+        var next_texture_request: usize = 0;
+        for (entry.keys) |key| {
+            switch (key) {
+                .buffer => |buffer_key| {
+                    const buffer = if (buffer_key.memory != .gpu_only)
+                        try Buffer.init(device.device, buffer_key.size, buffer_key.usage, buffer_key.memory)
+                    else blk: {
+                        const placement = buffer_plan.placements[next_buffer_request];
+                        next_buffer_request += 1;
+                        break :blk try Buffer.initAliased(device.device, buffer_key.size, buffer_key.usage, entry.memory.items[buffer_memory_start + placement.block], placement.offset);
+                    };
+                    entry.buffers.append(gpa, buffer) catch |err| {
+                        buffer.deinit(device.device);
+                        return err;
+                    };
+                },
+                .texture => |texture_key| {
+                    const placement = texture_plan.placements[next_texture_request];
+                    next_texture_request += 1;
+
+                    const texture = try Texture.initAliased(
+                        device.device,
+                        texture_key.extent,
+                        texture_key.mip_levels,
+                        texture_key.format,
+                        texture_key.usage,
+                        entry.memory.items[texture_memory_start + placement.block],
+                        placement.offset,
+                        if (texture_key.sampler) |handle| device.samplers.get(handle).? else .null_handle,
+                    );
+                    entry.textures.append(gpa, texture) catch |err| {
+                        texture.deinit(device.device);
+                        return err;
+                    };
+                },
+            }
+        }
+
+        for (buffer_plan.aliases) |alias| {
+            try entry.aliases.append(gpa, .{
+                .resource = .{ .buffer = .{ .idx = aliased_buffers.items[alias.resource] } },
+                .previous = .{ .buffer = .{ .idx = aliased_buffers.items[alias.previous] } },
+            });
+        }
+        for (texture_plan.aliases) |alias| {
+            try entry.aliases.append(gpa, .{
+                .resource = .{ .texture = .{ .idx = aliased_textures.items[alias.resource] } },
+                .previous = .{ .texture = .{ .idx = aliased_textures.items[alias.previous] } },
+            });
         }
 
-        return .{ .buffers = buffers, .textures = textures };
+        entry.requested_bytes = transient_aliasing.requestedBytes(buffer_requests.items) + transient_aliasing.requestedBytes(texture_requests.items);
+        entry.allocated_bytes = buffer_plan.allocatedBytes() + texture_plan.allocatedBytes();
+    }
+
+    /// One allocation per planned block, appended to the entry's memory so they are freed after the resources placed in them
+    fn allocatePlanMemory(device: *Device, entry: *TransientCache.Entry, plan: transient_aliasing.Plan) !void {
+        for (plan.blocks) |block| {
+            const allocation = try device.device.gpu_allocator.allocateAliasingMemory(.{
+                .size = block.size,
+                .alignment = block.alignment,
+                .memory_type_bits = block.memory_type_bits,
+            });
+            entry.memory.append(device.gpa, allocation) catch |err| {
+                device.device.gpu_allocator.freeMemory(allocation);
+                return err;
+            };
+        }
     }
 
     // ------------------------------------------------------------------
@@ -200,6 +437,7 @@ pub const RenderGraphExecutor = struct {
             .vertex_read => .{ .access = .{ .vertex_attribute_read_bit = true }, .stage = .{ .vertex_input_bit = true } },
             .index_read => .{ .access = .{ .index_read_bit = true }, .stage = .{ .index_input_bit = true } },
             .indirect_read => .{ .access = .{ .indirect_command_read_bit = true }, .stage = .{ .draw_indirect_bit = true } },
+            .indirect_storage_read => .{ .access = .{ .indirect_command_read_bit = true, .shader_storage_read_bit = true }, .stage = .{ .draw_indirect_bit = true, .all_graphics_bit = true, .compute_shader_bit = true } },
             .compute_uniform_read => .{ .access = .{ .uniform_read_bit = true }, .stage = .{ .compute_shader_bit = true } },
             .graphics_uniform_read => .{ .access = .{ .uniform_read_bit = true }, .stage = .{ .all_graphics_bit = true } },
             .compute_storage_read => .{ .access = .{ .shader_storage_read_bit = true }, .stage = .{ .compute_shader_bit = true } },
@@ -211,9 +449,18 @@ pub const RenderGraphExecutor = struct {
         };
     }
 
-    fn buildBufferBarrier(handle: vk.Buffer, src_access: saturn.BufferAccess, dst_access: saturn.BufferAccess) vk.BufferMemoryBarrier2 {
-        const src = getBufferStateAccess(src_access);
-        const dst = getBufferStateAccess(dst_access);
+    fn getBufferSetStateAccess(set: saturn.RenderGraphCompiled.BufferAccessSet) BufferStateAccess {
+        var result: BufferStateAccess = .{ .access = .{}, .stage = .{} };
+        var iter = set.iterator();
+        while (iter.next()) |access| {
+            const state = getBufferStateAccess(access);
+            result.access = result.access.merge(state.access);
+            result.stage = result.stage.merge(state.stage);
+        }
+        return result;
+    }
+
+    fn buildBufferBarrier(handle: vk.Buffer, src: BufferStateAccess, dst: BufferStateAccess) vk.BufferMemoryBarrier2 {
         return .{
             .buffer = handle,
             .offset = 0,
@@ -267,21 +514,24 @@ pub const RenderGraphExecutor = struct {
         return result;
     }
 
-    fn buildTextureBarrier(
-        device: *const Device,
-        texture: Texture,
-        src_access: saturn.TextureAccess,
-        dst_access: saturn.TextureAccess,
-    ) vk.ImageMemoryBarrier2 {
-        const aspect_mask = Texture.getFormatAspectMask(texture.format);
-        const is_color = aspect_mask.color_bit;
-        const unified = device.device.extensions.unified_image_layouts;
-        const src = getTextureStateAccess(src_access, is_color, unified);
-        const dst = getTextureStateAccess(dst_access, is_color, unified);
+    /// Every access in the set shares a layout, the graph only merges reads in the same state and the usages of one pass
+    fn getTextureSetStateAccess(set: saturn.RenderGraphCompiled.TextureAccessSet, is_color: bool, unified_image_layouts: bool) TextureStateAccess {
+        var result: TextureStateAccess = .{ .access = .{}, .stage = .{}, .layout = .undefined };
+        var iter = set.iterator();
+        while (iter.next()) |access| {
+            const state = getTextureStateAccess(access, is_color, unified_image_layouts);
+            result.access = result.access.merge(state.access);
+            result.stage = result.stage.merge(state.stage);
+            result.layout = state.layout;
+        }
+        return result;
+    }
+
+    fn buildTextureBarrier(texture: Texture, src: TextureStateAccess, dst: TextureStateAccess) vk.ImageMemoryBarrier2 {
         return .{
             .image = texture.handle,
             .subresource_range = .{
-                .aspect_mask = aspect_mask,
+                .aspect_mask = Texture.getFormatAspectMask(texture.format),
                 .base_array_layer = 0,
                 .layer_count = 1,
                 .base_mip_level = 0,
@@ -298,22 +548,83 @@ pub const RenderGraphExecutor = struct {
         };
     }
 
+    fn hasWrite(set: anytype) bool {
+        var iter = set.iterator();
+        while (iter.next()) |access| {
+            if (access.isWrite()) return true;
+        }
+        return false;
+    }
+
+    /// Stage and access of every transient whose memory resource took over, empty when it has the memory to itself.
+    /// Previous occupants on another queue can't be named in a pipeline barrier, the batch waits on theirs instead.
+    fn getAliasedSource(self: *Self, resource: saturn.Dependency, batch_index: usize) BufferStateAccess {
+        var result: BufferStateAccess = .{ .access = .{}, .stage = .{} };
+        for (self.aliases) |alias| {
+            if (!std.meta.eql(alias.resource, resource)) continue;
+
+            const last = switch (alias.previous) {
+                .buffer => |handle| self.compiled.buffers.items[handle.idx].last_sorted_access,
+                .texture => |handle| self.compiled.textures.items[handle.idx].last_sorted_access,
+            } orelse continue;
+
+            if (self.compiled.passes.items[last].queue != self.batches.items[batch_index].queue) {
+                self.waitForPass(batch_index, last);
+                continue;
+            }
+
+            const pass = self.compiled.passes.items[last].handle;
+            const src: BufferStateAccess = switch (alias.previous) {
+                .buffer => |handle| getBufferStateAccess(self.render_graph.getBufferAccess(pass, handle).?),
+                .texture => |handle| blk: {
+                    const texture = &self.resources.textures[handle.idx];
+                    const state = getTextureStateAccess(
+                        self.render_graph.getTextureAccess(pass, handle).?,
+                        Texture.getFormatAspectMask(texture.interface.format).color_bit,
+                        self.device.device.extensions.unified_image_layouts,
+                    );
+                    break :blk .{ .access = state.access, .stage = state.stage };
+                },
+            };
+            result.access = result.access.merge(src.access);
+            result.stage = result.stage.merge(src.stage);
+        }
+        return result;
+    }
+
+    const TransferHalf = enum { release, acquire };
+
+    /// Turns a barrier into one half of an ownership transfer, the release only has a source scope and the acquire only a destination one
+    fn ownershipHalf(self: *const Self, barrier: anytype, transfer: QueueTransfer, half: TransferHalf) @TypeOf(barrier) {
+        var result = barrier;
+        result.src_queue_family_index = self.getQueue(transfer.src).family_index;
+        result.dst_queue_family_index = self.getQueue(transfer.dst).family_index;
+        switch (half) {
+            .release => {
+                result.dst_access_mask = .{};
+                result.dst_stage_mask = .{};
+            },
+            .acquire => {
+                result.src_access_mask = .{};
+                result.src_stage_mask = .{};
+            },
+        }
+        return result;
+    }
+
     fn emitBarriers(
         self: *Self,
         command_buffer: vk.CommandBufferProxy,
         compiled_pass: saturn.RenderGraphCompiled.Pass,
+        batch_index: usize,
     ) !void {
         const DEBUG_FULL_PIPELINE_BARRIER = false;
 
-        var memory_barriers: std.ArrayList(vk.MemoryBarrier2) = .empty;
-        defer memory_barriers.deinit(self.tpa);
-        var buffer_barriers: std.ArrayList(vk.BufferMemoryBarrier2) = .empty;
-        defer buffer_barriers.deinit(self.tpa);
-        var texture_barriers: std.ArrayList(vk.ImageMemoryBarrier2) = .empty;
-        defer texture_barriers.deinit(self.tpa);
+        var barriers: BarrierList = .{};
+        defer barriers.deinit(self.tpa);
 
         if (DEBUG_FULL_PIPELINE_BARRIER) {
-            try memory_barriers.append(self.tpa, .{
+            try barriers.memory.append(self.tpa, .{
                 .src_access_mask = .{ .memory_read_bit = true, .memory_write_bit = true },
                 .src_stage_mask = .{ .all_commands_bit = true },
                 .dst_access_mask = .{ .memory_read_bit = true, .memory_write_bit = true },
@@ -321,90 +632,295 @@ pub const RenderGraphExecutor = struct {
             });
         }
 
-        const dst_pass = &self.render_graph.passes.items[compiled_pass.handle.idx];
+        // Ownership transfers can't be folded into a global barrier, so they are kept apart from the plain buffer barriers
+        var transfer_barriers: std.ArrayList(vk.BufferMemoryBarrier2) = .empty;
+        defer transfer_barriers.deinit(self.tpa);
+
+        const unified = self.device.device.extensions.unified_image_layouts;
+
+        for (compiled_pass.barriers.items) |barrier| {
+            switch (barrier) {
+                .buffer => |buffer_barrier| {
+                    const buffer = &self.resources.buffers[buffer_barrier.handle.idx];
+                    const dst = getBufferSetStateAccess(buffer_barrier.dst);
+
+                    if (buffer_barrier.queue_transfer) |transfer| acquire: {
+                        const src = if (transfer.release_pass) |release_pass| blk: {
+                            self.waitForPass(batch_index, release_pass);
+                            break :blk getBufferSetStateAccess(buffer_barrier.src.?);
+                        } else blk: {
+                            // Nothing to keep when it was never used, the first queue to touch it takes it
+                            const last_access = buffer.last_access orelse break :acquire;
+
+                            const last_state = getBufferStateAccess(last_access);
+                            try self.prologue.buffer.append(self.tpa, self.ownershipHalf(buildBufferBarrier(buffer.interface.handle, last_state, dst), transfer, .release));
+                            self.batches.items[batch_index].waits_prologue = true;
+                            break :blk last_state;
+                        };
+
+                        try transfer_barriers.append(self.tpa, self.ownershipHalf(buildBufferBarrier(buffer.interface.handle, src, dst), transfer, .acquire));
+                        continue;
+                    }
 
-        // Barriers for resources with no prior pass (cross-frame dependencies)
-        for (compiled_pass.first_usages.items) |first_usage| {
-            switch (first_usage) {
-                .buffer => |handle| {
-                    const buffer = &self.resources.buffers[handle.idx];
-                    if (buffer.last_access) |src_access| {
-                        if (dst_pass.getBufferAccess(handle)) |dst_access| {
-                            try buffer_barriers.append(self.tpa, buildBufferBarrier(buffer.interface.handle, src_access, dst_access));
+                    const src = if (buffer_barrier.src) |src_set| getBufferSetStateAccess(src_set) else blk: {
+                        // First access this frame, waits on the last frame's access and anything that used the memory before it
+                        var state: BufferStateAccess = .{ .access = .{}, .stage = .{} };
+                        if (buffer.last_access) |last_access| {
+                            if (last_access.isWrite() or hasWrite(buffer_barrier.dst)) {
+                                state = getBufferStateAccess(last_access);
+                            } else {
+                                self.barriers_eliminated += 1;
+                            }
                         }
-                    }
+
+                        const aliased = self.getAliasedSource(.{ .buffer = buffer_barrier.handle }, batch_index);
+                        state.access = state.access.merge(aliased.access);
+                        state.stage = state.stage.merge(aliased.stage);
+                        break :blk state;
+                    };
+
+                    if (src.stage.toInt() == 0) continue;
+                    try barriers.buffer.append(self.tpa, buildBufferBarrier(buffer.interface.handle, src, dst));
                 },
-                .texture => |handle| {
-                    const texture = &self.resources.textures[handle.idx];
-                    if (dst_pass.getTextureAccess(handle)) |dst_access| {
-                        try texture_barriers.append(self.tpa, buildTextureBarrier(self.device, texture.interface, texture.last_access orelse .none, dst_access));
+                .texture => |texture_barrier| {
+                    const texture = &self.resources.textures[texture_barrier.handle.idx];
+                    const is_color = Texture.getFormatAspectMask(texture.interface.format).color_bit;
+                    const dst = getTextureSetStateAccess(texture_barrier.dst, is_color, unified);
+
+                    if (texture_barrier.queue_transfer) |transfer| acquire: {
+                        const src = if (transfer.release_pass) |release_pass| blk: {
+                            self.waitForPass(batch_index, release_pass);
+                            break :blk getTextureSetStateAccess(texture_barrier.src.?, is_color, unified);
+                        } else blk: {
+                            const last_access = texture.last_access orelse break :acquire;
+
+                            const last_state = getTextureStateAccess(last_access, is_color, unified);
+                            try self.prologue.texture.append(self.tpa, self.ownershipHalf(buildTextureBarrier(texture.interface, last_state, dst), transfer, .release));
+                            self.batches.items[batch_index].waits_prologue = true;
+                            break :blk last_state;
+                        };
+
+                        try barriers.texture.append(self.tpa, self.ownershipHalf(buildTextureBarrier(texture.interface, src, dst), transfer, .acquire));
+                        continue;
                     }
+
+                    const src = if (texture_barrier.src) |src_set| getTextureSetStateAccess(src_set, is_color, unified) else blk: {
+                        var state = getTextureStateAccess(texture.last_access orelse .none, is_color, unified);
+
+                        // Still in the layout last frame's reads left it in
+                        if (texture.last_access) |last_access| {
+                            if (!last_access.isWrite() and !hasWrite(texture_barrier.dst) and state.layout == dst.layout) {
+                                self.barriers_eliminated += 1;
+                                continue;
+                            }
+                        }
+
+                        // Aliased images start undefined, the layout transition just has to wait for the previous occupant
+                        const aliased = self.getAliasedSource(.{ .texture = texture_barrier.handle }, batch_index);
+                        state.access = state.access.merge(aliased.access);
+                        state.stage = state.stage.merge(aliased.stage);
+                        break :blk state;
+                    };
+
+                    try barriers.texture.append(self.tpa, buildTextureBarrier(texture.interface, src, dst));
                 },
             }
         }
 
-        // Barriers for pass-to-pass dependencies within this frame
-        for (compiled_pass.pass_dependencies.items) |pass_dep| {
-            const src_pass = &self.render_graph.passes.items[pass_dep.pass.idx];
-            for (pass_dep.dependencies.items) |dep| {
-                switch (dep) {
-                    .buffer => |handle| {
-                        const buffer = &self.resources.buffers[handle.idx];
-                        if (src_pass.getBufferAccess(handle)) |src_access| {
-                            if (dst_pass.getBufferAccess(handle)) |dst_access| {
-                                try buffer_barriers.append(self.tpa, buildBufferBarrier(buffer.interface.handle, src_access, dst_access));
-                            }
-                        }
-                    },
-                    .texture => |handle| {
-                        const texture = &self.resources.textures[handle.idx];
-                        if (src_pass.getTextureAccess(handle)) |src_access| {
-                            if (dst_pass.getTextureAccess(handle)) |dst_access| {
-                                try texture_barriers.append(self.tpa, buildTextureBarrier(self.device, texture.interface, src_access, dst_access));
-                            }
-                        }
-                    },
-                }
+        // Without layouts or queue transfers buffer barriers act like global ones, so several are cheaper as one
+        if (barriers.memory.items.len + barriers.buffer.items.len > 1) {
+            var merged: vk.MemoryBarrier2 = .{};
+            for (barriers.memory.items) |memory_barrier| {
+                merged.src_access_mask = merged.src_access_mask.merge(memory_barrier.src_access_mask);
+                merged.src_stage_mask = merged.src_stage_mask.merge(memory_barrier.src_stage_mask);
+                merged.dst_access_mask = merged.dst_access_mask.merge(memory_barrier.dst_access_mask);
+                merged.dst_stage_mask = merged.dst_stage_mask.merge(memory_barrier.dst_stage_mask);
+            }
+            for (barriers.buffer.items) |buffer_barrier| {
+                merged.src_access_mask = merged.src_access_mask.merge(buffer_barrier.src_access_mask);
+                merged.src_stage_mask = merged.src_stage_mask.merge(buffer_barrier.src_stage_mask);
+                merged.dst_access_mask = merged.dst_access_mask.merge(buffer_barrier.dst_access_mask);
+                merged.dst_stage_mask = merged.dst_stage_mask.merge(buffer_barrier.dst_stage_mask);
             }
+
+            barriers.memory.clearRetainingCapacity();
+            barriers.buffer.clearRetainingCapacity();
+            try barriers.memory.append(self.tpa, merged);
         }
+        try barriers.buffer.appendSlice(self.tpa, transfer_barriers.items);
 
-        const dep_info: vk.DependencyInfo = .{
-            .memory_barrier_count = @intCast(memory_barriers.items.len),
-            .p_memory_barriers = memory_barriers.items.ptr,
-            .buffer_memory_barrier_count = @intCast(buffer_barriers.items.len),
-            .p_buffer_memory_barriers = buffer_barriers.items.ptr,
-            .image_memory_barrier_count = @intCast(texture_barriers.items.len),
-            .p_image_memory_barriers = texture_barriers.items.ptr,
-        };
+        self.barriers_emitted += barriers.record(command_buffer, self.batches.items[batch_index].queue);
+    }
+
+    /// Release halves of the ownership transfers a pass hands to later passes on other queues
+    fn emitReleases(self: *Self, command_buffer: vk.CommandBufferProxy, queue: Queue, releases: []const saturn.RenderGraphCompiled.Barrier) !void {
+        var barriers: BarrierList = .{};
+        defer barriers.deinit(self.tpa);
 
-        const total = dep_info.memory_barrier_count + dep_info.buffer_memory_barrier_count + dep_info.image_memory_barrier_count;
-        if (total > 0) command_buffer.pipelineBarrier2(&dep_info);
+        for (releases) |release| {
+            try self.appendTransferHalf(&barriers, release, .release);
+        }
+
+        self.barriers_emitted += barriers.record(command_buffer, queue);
     }
 
+    /// Both halves of a transfer between two passes of the graph, src and dst come from the access sets on either side
+    fn appendTransferHalf(self: *Self, barriers: *BarrierList, barrier: saturn.RenderGraphCompiled.Barrier, half: TransferHalf) !void {
+        const unified = self.device.device.extensions.unified_image_layouts;
+        switch (barrier) {
+            .buffer => |buffer_barrier| {
+                const buffer = &self.resources.buffers[buffer_barrier.handle.idx];
+                const src = getBufferSetStateAccess(buffer_barrier.src.?);
+                const dst = getBufferSetStateAccess(buffer_barrier.dst);
+                try barriers.buffer.append(self.tpa, self.ownershipHalf(buildBufferBarrier(buffer.interface.handle, src, dst), buffer_barrier.queue_transfer.?, half));
+            },
+            .texture => |texture_barrier| {
+                const texture = &self.resources.textures[texture_barrier.handle.idx];
+                const is_color = Texture.getFormatAspectMask(texture.interface.format).color_bit;
+                const src = getTextureSetStateAccess(texture_barrier.src.?, is_color, unified);
+                const dst = getTextureSetStateAccess(texture_barrier.dst, is_color, unified);
+                try barriers.texture.append(self.tpa, self.ownershipHalf(buildTextureBarrier(texture.interface, src, dst), texture_barrier.queue_transfer.?, half));
+            },
+        }
+    }
+
+    const BarrierList = struct {
+        memory: std.ArrayList(vk.MemoryBarrier2) = .empty,
+        buffer: std.ArrayList(vk.BufferMemoryBarrier2) = .empty,
+        texture: std.ArrayList(vk.ImageMemoryBarrier2) = .empty,
+
+        fn deinit(self: *BarrierList, tpa: std.mem.Allocator) void {
+            self.memory.deinit(tpa);
+            self.buffer.deinit(tpa);
+            self.texture.deinit(tpa);
+        }
+
+        /// Records every barrier in a single call, returns how many there were
+        fn record(self: *BarrierList, command_buffer: vk.CommandBufferProxy, queue: Queue) u32 {
+            // Some access states span graphics and compute stages, only the ones the queue has may be named
+            if (queue != .graphics) {
+                const supported = getQueueStages(queue);
+                for (self.memory.items) |*barrier| {
+                    barrier.src_stage_mask = barrier.src_stage_mask.intersect(supported);
+                    barrier.dst_stage_mask = barrier.dst_stage_mask.intersect(supported);
+                }
+                for (self.buffer.items) |*barrier| {
+                    barrier.src_stage_mask = barrier.src_stage_mask.intersect(supported);
+                    barrier.dst_stage_mask = barrier.dst_stage_mask.intersect(supported);
+                }
+                for (self.texture.items) |*barrier| {
+                    barrier.src_stage_mask = barrier.src_stage_mask.intersect(supported);
+                    barrier.dst_stage_mask = barrier.dst_stage_mask.intersect(supported);
+                }
+            }
+
+            const dep_info: vk.DependencyInfo = .{
+                .memory_barrier_count = @intCast(self.memory.items.len),
+                .p_memory_barriers = self.memory.items.ptr,
+                .buffer_memory_barrier_count = @intCast(self.buffer.items.len),
+                .p_buffer_memory_barriers = self.buffer.items.ptr,
+                .image_memory_barrier_count = @intCast(self.texture.items.len),
+                .p_image_memory_barriers = self.texture.items.ptr,
+            };
+
+            const total = dep_info.memory_barrier_count + dep_info.buffer_memory_barrier_count + dep_info.image_memory_barrier_count;
+            if (total > 0) command_buffer.pipelineBarrier2(&dep_info);
+            return total;
+        }
+    };
+
     // ------------------------------------------------------------------
-    // Record
+    // Queues
     // ------------------------------------------------------------------
 
-    //TODO: multi queue recording
-    fn recordCommandBuffer(self: *Self) !void {
-        const fence = try self.frame_data.fence_pool.get();
-        try self.frame_data.frame_wait_fences.append(self.device.gpa, fence);
+    fn getQueueStages(queue: Queue) vk.PipelineStageFlags2 {
+        const transfer: vk.PipelineStageFlags2 = .{
+            .top_of_pipe_bit = true,
+            .bottom_of_pipe_bit = true,
+            .all_commands_bit = true,
+            .all_transfer_bit = true,
+            .copy_bit = true,
+            .clear_bit = true,
+        };
+        return switch (queue) {
+            // Graphics queues support every stage, their barriers are never filtered
+            .graphics => unreachable,
+            .async_compute => transfer.merge(.{ .draw_indirect_bit = true, .compute_shader_bit = true }),
+            .async_transfer => transfer,
+        };
+    }
 
-        const command_buffer_handle = try self.frame_data.graphics_command_pool.get();
-        const command_buffer = vk.CommandBufferProxy.init(command_buffer_handle, self.device.device.proxy.wrapper);
+    fn getQueue(self: *const Self, queue: Queue) *VkQueue {
+        return switch (queue) {
+            .graphics => &self.device.device.graphics_queue,
+            .async_compute => &self.device.device.async_compute_queue.?,
+            .async_transfer => &self.device.device.async_transfer_queue.?,
+        };
+    }
 
-        var cmd_data: platform.CommandEncoderData = .{
-            .tpa = self.tpa,
-            .command_buffer = command_buffer,
-            .device = self.device,
-            .graph_resources = self.resources,
+    fn getCommandPool(self: *const Self, queue: Queue) *object_pools.CommandBufferPool {
+        return switch (queue) {
+            .graphics => &self.frame_data.graphics_command_pool,
+            .async_compute => &self.frame_data.async_compute_command_pool.?,
+            .async_transfer => &self.frame_data.async_transfer_command_pool.?,
         };
+    }
+
+    /// Makes a batch wait for the one the sorted pass was recorded in, when that one ran on another queue
+    fn waitForPass(self: *Self, batch_index: usize, sorted_index: usize) void {
+        const src_batch = self.pass_batches[sorted_index];
+        const src_queue = self.batches.items[src_batch].queue;
+        const batch = &self.batches.items[batch_index];
+        if (src_queue == batch.queue) return;
+
+        const wait = batch.waits.getPtr(src_queue);
+        wait.* = if (wait.*) |current| @max(current, src_batch) else src_batch;
+    }
+
+    fn beginBatch(self: *Self, queue: Queue) !vk.CommandBufferProxy {
+        const handle = try self.getCommandPool(queue).get();
+        const command_buffer = vk.CommandBufferProxy.init(handle, self.device.device.proxy.wrapper);
 
         try command_buffer.beginCommandBuffer(&.{});
 
-        self.device.device.descriptor.bind(command_buffer, self.device.pipeline_layout);
+        const descriptor = &self.device.device.descriptor;
+        switch (queue) {
+            .graphics => descriptor.bind(command_buffer, self.device.pipeline_layout),
+            .async_compute => descriptor.bindPoint(command_buffer, self.device.pipeline_layout, .compute),
+            // Nothing to bind descriptors for on a transfer only queue
+            .async_transfer => {},
+        }
+
+        try self.batches.append(self.tpa, .{ .queue = queue, .command_buffer = handle });
+        return command_buffer;
+    }
+
+    // ------------------------------------------------------------------
+    // Record
+    // ------------------------------------------------------------------
+
+    /// Splits the sorted passes into batches of consecutive passes on the same queue, each recorded into its own command buffer.
+    /// The last batch is always on graphics, it takes persistent resources back from the async queues and hands the swapchain images over for present.
+    fn recordBatches(self: *Self) !void {
+        self.pass_batches = try self.tpa.alloc(u32, self.compiled.passes.items.len);
+
+        var command_buffer: vk.CommandBufferProxy = undefined;
+        var cmd_data: platform.CommandEncoderData = undefined;
+
+        for (self.compiled.passes.items, 0..) |compiled_pass, sorted_index| {
+            if (self.batches.items.len == 0 or self.batches.getLast().queue != compiled_pass.queue) {
+                if (self.batches.items.len > 0) try command_buffer.endCommandBuffer();
+                command_buffer = try self.beginBatch(compiled_pass.queue);
+                cmd_data = .{
+                    .tpa = self.tpa,
+                    .command_buffer = command_buffer,
+                    .device = self.device,
+                    .graph_resources = self.resources,
+                };
+            }
+            const batch_index = self.batches.items.len - 1;
+            self.pass_batches[sorted_index] = @intCast(batch_index);
 
-        for (self.compiled.passes.items) |compiled_pass| {
             const pass = self.render_graph.passes.items[compiled_pass.handle.idx];
 
             if (self.device.device.debug) {
@@ -414,7 +930,7 @@ pub const RenderGraphExecutor = struct {
             }
             defer if (self.device.device.debug) command_buffer.endDebugUtilsLabelEXT();
 
-            try self.emitBarriers(command_buffer, compiled_pass);
+            try self.emitBarriers(command_buffer, compiled_pass, batch_index);
 
             if (pass.callback) |pass_callback| {
                 switch (pass_callback) {
@@ -425,14 +941,48 @@ pub const RenderGraphExecutor = struct {
                         compute.func(compute.ctx, .{ .ctx = &cmd_data, .vtable = &platform.ComputeCommandEncoder.Vtable });
                     },
                     .graphics => |graphics| {
-                        const target_resolution = self.beginRenderPass(command_buffer, graphics.render_target);
+                        const target_resolution = self.beginRenderPass(command_buffer, graphics.render_target, .{});
+                        setViewportAndScissor(command_buffer, target_resolution);
                         graphics.func(graphics.ctx, .{ .ctx = &cmd_data, .vtable = &platform.GraphicsCommandEncoder.Vtable }, target_resolution);
                         command_buffer.endRendering();
                     },
+                    .graphics_chunked => |graphics| {
+                        if (self.render_graph.task_pool) |task_pool| {
+                            try self.recordChunksParallel(command_buffer, task_pool, graphics);
+                        } else {
+                            const target_resolution = self.beginRenderPass(command_buffer, graphics.render_target, .{});
+                            setViewportAndScissor(command_buffer, target_resolution);
+                            const chunk_count = graphics.prepare(graphics.ctx, target_resolution);
+                            for (0..chunk_count) |chunk_index| {
+                                graphics.func(graphics.ctx, @intCast(chunk_index), .{ .ctx = &cmd_data, .vtable = &platform.GraphicsCommandEncoder.Vtable }, target_resolution);
+                            }
+                            command_buffer.endRendering();
+                        }
+                    },
                 }
             }
+
+            try self.emitReleases(command_buffer, compiled_pass.queue, compiled_pass.releases.items);
+        }
+
+        if (self.batches.items.len == 0 or self.batches.getLast().queue != .graphics) {
+            if (self.batches.items.len > 0) try command_buffer.endCommandBuffer();
+            command_buffer = try self.beginBatch(.graphics);
+        }
+
+        // The next frame's graphics work must come after everything this frame did on the other queues
+        const final_index = self.batches.items.len - 1;
+        for (self.batches.items[0..final_index], 0..) |batch, batch_index| {
+            if (batch.queue != .graphics) self.batches.items[final_index].waits.set(batch.queue, @intCast(batch_index));
         }
 
+        var epilogue: BarrierList = .{};
+        defer epilogue.deinit(self.tpa);
+        for (self.compiled.epilogue.items) |barrier| {
+            try self.appendTransferHalf(&epilogue, barrier, .acquire);
+        }
+        self.barriers_emitted += epilogue.record(command_buffer, .graphics);
+
         // if (true) {
         //     const cimgui = @import("../imgui.zig").c;
         //     cimgui.ImGui_Render();
@@ -442,32 +992,212 @@ pub const RenderGraphExecutor = struct {
 
         try self.emitSwapchainTransitions(command_buffer);
         try command_buffer.endCommandBuffer();
+    }
+
+    // ------------------------------------------------------------------
+    // Submit
+    // ------------------------------------------------------------------
+
+    /// Submits the prologue, when anything had to be released on graphics first, then every batch in order.
+    /// Batches signal their queue's timeline and wait on the values of the batches they depend on, which were always submitted before them.
+    fn submitBatches(self: *Self) !void {
+        var prologue_value: u64 = 0;
+        if (self.prologue.buffer.items.len + self.prologue.texture.items.len > 0) {
+            const handle = try self.frame_data.graphics_command_pool.get();
+            const command_buffer = vk.CommandBufferProxy.init(handle, self.device.device.proxy.wrapper);
+            try command_buffer.beginCommandBuffer(&.{});
+            self.barriers_emitted += self.prologue.record(command_buffer, .graphics);
+            try command_buffer.endCommandBuffer();
+
+            prologue_value = try self.submit(.graphics, handle, &.{}, &.{});
+        }
+
+        var wait_infos: std.ArrayList(vk.SemaphoreSubmitInfo) = .empty;
+        defer wait_infos.deinit(self.tpa);
+        var signal_infos: std.ArrayList(vk.SemaphoreSubmitInfo) = .empty;
+        defer signal_infos.deinit(self.tpa);
+
+        var waited_swapchain = false;
+        for (self.batches.items, 0..) |*batch, batch_index| {
+            wait_infos.clearRetainingCapacity();
+            signal_infos.clearRetainingCapacity();
+
+            for (std.enums.values(Queue)) |queue| {
+                const wait_batch = batch.waits.get(queue) orelse continue;
+                try wait_infos.append(self.tpa, .{
+                    .semaphore = self.getQueue(queue).timeline,
+                    .value = self.batches.items[wait_batch].signal_value,
+                    .stage_mask = .{ .all_commands_bit = true },
+                    .device_index = 0,
+                });
+            }
+
+            if (batch.waits_prologue and batch.queue != .graphics) {
+                try wait_infos.append(self.tpa, .{
+                    .semaphore = self.getQueue(.graphics).timeline,
+                    .value = prologue_value,
+                    .stage_mask = .{ .all_commands_bit = true },
+                    .device_index = 0,
+                });
+            }
+
+            // Swapchain images are only used on graphics, the first graphics batch waits for them to be acquired
+            if (batch.queue == .graphics and !waited_swapchain) {
+                waited_swapchain = true;
+                for (self.swapchain_textures) |sc| {
+                    try wait_infos.append(self.tpa, .{
+                        .semaphore = sc.wait_semaphore,
+                        .value = 0,
+                        .stage_mask = .{ .all_commands_bit = true },
+                        .device_index = 0,
+                    });
+                }
+            }
+
+            if (batch_index == self.batches.items.len - 1) {
+                for (self.swapchain_textures) |sc| {
+                    try signal_infos.append(self.tpa, .{
+                        .semaphore = sc.present_semaphore,
+                        .value = 0,
+                        .stage_mask = .{ .all_commands_bit = true },
+                        .device_index = 0,
+                    });
+                }
+            }
+
+            batch.signal_value = try self.submit(batch.queue, batch.command_buffer, wait_infos.items, signal_infos.items);
+        }
+
+        self.device.render_graph_stats.barriers_emitted = self.barriers_emitted;
+        self.device.render_graph_stats.barriers_eliminated = self.barriers_eliminated;
+        self.device.render_graph_stats.passes_executed = @intCast(self.compiled.passes.items.len);
+        self.device.render_graph_stats.passes_culled = self.compiled.culled_passes;
+    }
+
+    /// Submits one command buffer that also signals the queue's timeline, returns the value it signals
+    fn submit(self: *Self, queue: Queue, command_buffer: vk.CommandBuffer, waits: []const vk.SemaphoreSubmitInfo, signals: []const vk.SemaphoreSubmitInfo) !u64 {
+        const vk_queue = self.getQueue(queue);
+
+        const signal_infos = try self.tpa.alloc(vk.SemaphoreSubmitInfo, signals.len + 1);
+        defer self.tpa.free(signal_infos);
+        @memcpy(signal_infos[0..signals.len], signals);
+        signal_infos[signals.len] = .{
+            .semaphore = vk_queue.timeline,
+            .value = vk_queue.timeline_value + 1,
+            .stage_mask = .{ .all_commands_bit = true },
+            .device_index = 0,
+        };
+
+        const command_buffer_info: vk.CommandBufferSubmitInfo = .{
+            .command_buffer = command_buffer,
+            .device_mask = 0,
+        };
+
+        const submit_info: vk.SubmitInfo2 = .{
+            .wait_semaphore_info_count = @intCast(waits.len),
+            .p_wait_semaphore_infos = waits.ptr,
+            .command_buffer_info_count = 1,
+            .p_command_buffer_infos = @ptrCast(&command_buffer_info),
+            .signal_semaphore_info_count = @intCast(signal_infos.len),
+            .p_signal_semaphore_infos = signal_infos.ptr,
+        };
+
+        // Every submission of the frame has to finish before its resources are reused
+        const fence = try self.frame_data.fence_pool.get();
+        try self.frame_data.frame_wait_fences.append(self.device.gpa, fence);
+
+        try self.device.device.proxy.queueSubmit2(vk_queue.handle, 1, @ptrCast(&submit_info), fence);
+        vk_queue.timeline_value += 1;
+        return vk_queue.timeline_value;
+    }
+
+    const ChunkedPass = @FieldType(saturn.RGPassCallback, "graphics_chunked");
 
-        // Build semaphore arrays and submit
-        const wait_semaphores = try self.tpa.alloc(vk.Semaphore, self.swapchain_textures.len);
-        defer self.tpa.free(wait_semaphores);
-        const wait_stages = try self.tpa.alloc(vk.PipelineStageFlags, self.swapchain_textures.len);
-        defer self.tpa.free(wait_stages);
-        const signal_semaphores = try self.tpa.alloc(vk.Semaphore, self.swapchain_textures.len);
-        defer self.tpa.free(signal_semaphores);
-
-        for (self.swapchain_textures, 0..) |sc, i| {
-            wait_semaphores[i] = sc.wait_semaphore;
-            wait_stages[i] = .{ .all_commands_bit = true };
-            signal_semaphores[i] = sc.present_semaphore;
-        }
-
-        const submit_info = vk.SubmitInfo{
-            .command_buffer_count = 1,
-            .p_command_buffers = @ptrCast(&command_buffer_handle),
-            .wait_semaphore_count = @intCast(wait_semaphores.len),
-            .p_wait_semaphores = wait_semaphores.ptr,
-            .p_wait_dst_stage_mask = wait_stages.ptr,
-            .signal_semaphore_count = @intCast(signal_semaphores.len),
-            .p_signal_semaphores = signal_semaphores.ptr,
+    /// Records each chunk into its own secondary command buffer on the task pool, then executes them in chunk order
+    fn recordChunksParallel(self: *Self, command_buffer: vk.CommandBufferProxy, task_pool: *TaskPool, pass: ChunkedPass) !void {
+        const target_resolution = self.beginRenderPass(command_buffer, pass.render_target, .{ .contents_secondary_command_buffers_bit = true });
+        defer command_buffer.endRendering();
+
+        const chunk_count = pass.prepare(pass.ctx, target_resolution);
+        if (chunk_count == 0) return;
+
+        try self.frame_data.worker_command_pools.ensureThreadCount(task_pool.getThreadCount());
+
+        const color_formats = try self.tpa.alloc(vk.Format, pass.render_target.color_attachments.len);
+        defer self.tpa.free(color_formats);
+        for (color_formats, pass.render_target.color_attachments) |*format, attachment| {
+            format.* = Texture.getVkFormat(self.resources.textures[attachment.texture.idx].interface.format);
+        }
+
+        const rendering_info: vk.CommandBufferInheritanceRenderingInfo = .{
+            .view_mask = 0,
+            .color_attachment_count = @intCast(color_formats.len),
+            .p_color_attachment_formats = color_formats.ptr,
+            .depth_attachment_format = if (pass.render_target.depth_attachment) |attachment|
+                Texture.getVkFormat(self.resources.textures[attachment.texture.idx].interface.format)
+            else
+                .undefined,
+            .stencil_attachment_format = .undefined,
+            .rasterization_samples = .{ .@"1_bit" = true },
+        };
+        const inheritance_info: vk.CommandBufferInheritanceInfo = .{
+            .p_next = &rendering_info,
+            .subpass = 0,
+            .occlusion_query_enable = .false,
         };
 
-        try self.device.device.proxy.queueSubmit(self.device.device.graphics_queue.handle, 1, @ptrCast(&submit_info), fence);
+        const chunk_command_buffers = try self.tpa.alloc(vk.CommandBuffer, chunk_count);
+        defer self.tpa.free(chunk_command_buffers);
+
+        const ChunkRecorder = struct {
+            executor: *const Self,
+            task_pool: *TaskPool,
+            pass: *const ChunkedPass,
+            inheritance_info: *const vk.CommandBufferInheritanceInfo,
+            target_resolution: [2]u32,
+            command_buffers: []vk.CommandBuffer,
+
+            fn run(ctx: @This(), range: TaskPool.Range) error{RecordFailed}!void {
+                const device = ctx.executor.device;
+                const thread_index = ctx.task_pool.getThreadIndex();
+
+                for (range.start..range.end) |chunk_index| {
+                    const handle = ctx.executor.frame_data.worker_command_pools.get(thread_index) catch return error.RecordFailed;
+                    const chunk_buffer = vk.CommandBufferProxy.init(handle, device.device.proxy.wrapper);
+
+                    chunk_buffer.beginCommandBuffer(&.{
+                        .flags = .{ .one_time_submit_bit = true, .render_pass_continue_bit = true },
+                        .p_inheritance_info = ctx.inheritance_info,
+                    }) catch return error.RecordFailed;
+
+                    // Secondary command buffers inherit none of the primary's bound state
+                    device.device.descriptor.bind(chunk_buffer, device.pipeline_layout);
+                    setViewportAndScissor(chunk_buffer, ctx.target_resolution);
+
+                    var cmd_data: platform.CommandEncoderData = .{
+                        .tpa = ctx.executor.tpa,
+                        .command_buffer = chunk_buffer,
+                        .device = device,
+                        .graph_resources = ctx.executor.resources,
+                    };
+                    ctx.pass.func(ctx.pass.ctx, @intCast(chunk_index), .{ .ctx = &cmd_data, .vtable = &platform.GraphicsCommandEncoder.Vtable }, ctx.target_resolution);
+
+                    chunk_buffer.endCommandBuffer() catch return error.RecordFailed;
+                    ctx.command_buffers[chunk_index] = handle;
+                }
+            }
+        };
+
+        try task_pool.parallelFor(chunk_count, .{}, ChunkRecorder{
+            .executor = self,
+            .task_pool = task_pool,
+            .pass = &pass,
+            .inheritance_info = &inheritance_info,
+            .target_resolution = target_resolution,
+            .command_buffers = chunk_command_buffers,
+        }, ChunkRecorder.run);
+
+        command_buffer.executeCommands(@intCast(chunk_command_buffers.len), chunk_command_buffers.ptr);
     }
 
     fn emitSwapchainTransitions(self: *Self, command_buffer: vk.CommandBufferProxy) !void {
@@ -476,10 +1206,9 @@ pub const RenderGraphExecutor = struct {
 
         for (self.swapchain_textures, barriers) |sc, *barrier| {
             var src_access: saturn.TextureAccess = .none;
-            if (self.render_graph.textures.items[sc.resource.idx].last_usage) |last_pass| {
-                if (self.render_graph.passes.items[last_pass.idx].getTextureAccess(sc.resource)) |access| {
-                    src_access = access;
-                }
+            if (self.compiled.textures.items[sc.resource.idx].last_sorted_access) |last| {
+                const pass = self.compiled.passes.items[last].handle;
+                src_access = self.render_graph.getTextureAccess(pass, sc.resource).?;
             }
             const src = getTextureStateAccess(src_access, true, self.device.device.extensions.unified_image_layouts);
             barrier.* = .{
@@ -504,9 +1233,10 @@ pub const RenderGraphExecutor = struct {
             .image_memory_barrier_count = @intCast(barriers.len),
             .p_image_memory_barriers = barriers.ptr,
         });
+        self.barriers_emitted += @intCast(barriers.len);
     }
 
-    fn beginRenderPass(self: *Self, command_buffer: vk.CommandBufferProxy, render_target: saturn.RGRenderTarget) [2]u32 {
+    fn beginRenderPass(self: *Self, command_buffer: vk.CommandBufferProxy, render_target: saturn.RGRenderTarget, flags: vk.RenderingFlags) [2]u32 {
         const unified_image_layouts = self.device.device.extensions.unified_image_layouts;
 
         const color_attachments = self.tpa.alloc(vk.RenderingAttachmentInfo, render_target.color_attachments.len) catch @panic("Failed to alloc");
@@ -550,6 +1280,7 @@ pub const RenderGraphExecutor = struct {
             .extent = render_area_extent,
         };
         command_buffer.beginRendering(&.{
+            .flags = flags,
             .render_area = render_area,
             .layer_count = 1,
             .view_mask = 0,
@@ -558,6 +1289,15 @@ pub const RenderGraphExecutor = struct {
             .p_depth_attachment = if (render_target.depth_attachment != null) &depth_attachment else null,
             .p_stencil_attachment = null,
         });
+
+        return [2]u32{ render_area.extent.width, render_area.extent.height };
+    }
+
+    fn setViewportAndScissor(command_buffer: vk.CommandBufferProxy, target_resolution: [2]u32) void {
+        const render_area: vk.Rect2D = .{
+            .offset = .{ .x = 0, .y = 0 },
+            .extent = .{ .width = target_resolution[0], .height = target_resolution[1] },
+        };
         const viewport: vk.Viewport = .{
             .width = @floatFromInt(render_area.extent.width),
             .height = @floatFromInt(render_area.extent.height),
@@ -568,8 +1308,6 @@ pub const RenderGraphExecutor = struct {
         };
         command_buffer.setViewport(0, 1, @ptrCast(&viewport));
         command_buffer.setScissor(0, 1, @ptrCast(&render_area));
-
-        return [2]u32{ render_area.extent.width, render_area.extent.height };
     }
 
     // ------------------------------------------------------------------
@@ -594,7 +1332,7 @@ pub const RenderGraphExecutor = struct {
     // ------------------------------------------------------------------
 
     /// Write the final access state for each persistent resource back into
-    /// the per-frame tracking maps so the next frame can read them as
+    /// its device info so whichever frame uses it next can read it as
     /// cross-frame `last_access` when building barriers.
     fn writeLastUsages(self: *Self) void {
         for (self.render_graph.buffers.items, 0..) |graph_buffer, idx| {
@@ -605,23 +1343,13 @@ pub const RenderGraphExecutor = struct {
 
             const rg_handle = saturn.RGBufferHandle{ .idx = @intCast(idx) };
 
-            var last_access: ?saturn.BufferAccess = null;
-            var i: usize = self.compiled.passes.items.len;
-            while (i > 0) {
-                i -= 1;
-                const compiled_pass = &self.compiled.passes.items[i];
-                const pass = &self.render_graph.passes.items[compiled_pass.handle.idx];
-                if (pass.getBufferAccess(rg_handle)) |access| {
-                    last_access = access;
-                    break;
+            if (self.compiled.buffers.items[idx].last_sorted_access) |last| {
+                const pass = self.compiled.passes.items[last].handle;
+                const access = self.render_graph.getBufferAccess(pass, rg_handle).?;
+                if (self.device.buffers.getPtr(handle)) |info| {
+                    info.last_access = access;
                 }
             }
-
-            if (last_access) |access| {
-                self.frame_data.buffer_access.put(handle, access) catch {
-                    std.log.err("writeLastUsages: failed to store buffer access for handle {}", .{handle});
-                };
-            }
         }
 
         for (self.render_graph.textures.items, 0..) |graph_texture, idx| {
@@ -632,23 +1360,13 @@ pub const RenderGraphExecutor = struct {
 
             const rg_handle = saturn.RGTextureHandle{ .idx = @intCast(idx) };
 
-            var last_access: ?saturn.TextureAccess = null;
-            var i: usize = self.compiled.passes.items.len;
-            while (i > 0) {
-                i -= 1;
-                const compiled_pass = &self.compiled.passes.items[i];
-                const pass = &self.render_graph.passes.items[compiled_pass.handle.idx];
-                if (pass.getTextureAccess(rg_handle)) |access| {
-                    last_access = access;
-                    break;
+            if (self.compiled.textures.items[idx].last_sorted_access) |last| {
+                const pass = self.compiled.passes.items[last].handle;
+                const access = self.render_graph.getTextureAccess(pass, rg_handle).?;
+                if (self.device.textures.getPtr(handle)) |info| {
+                    info.last_access = access;
                 }
             }
-
-            if (last_access) |access| {
-                self.frame_data.texture_access.put(handle, access) catch {
-                    std.log.err("writeLastUsages: failed to store texture access for handle {}", .{handle});
-                };
-            }
         }
     }
 };
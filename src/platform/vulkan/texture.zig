@@ -23,22 +23,34 @@ sampled_binding: ?Binding = null,
 storage_binding: ?Binding = null,
 
 pub fn init(device: *Device, extent: saturn.TextureExtent, mip_levels: u32, format: saturn.TextureFormat, usage: saturn.TextureUsage, memory: saturn.MemoryLocation, sampler: vk.Sampler) !Self {
-    const vk_format = getVkFormat(format);
+    const result = try device.gpu_allocator.createTexture(&getCreateInfo(extent, mip_levels, format, usage));
+    errdefer device.gpu_allocator.destroyTexture(result.texture, result.allocation);
 
-    var image_type: vk.ImageType = .@"3d";
-    var image_view_type: vk.ImageViewType = .@"3d";
+    return initFromImage(device, result.texture, result.allocation, extent, mip_levels, format, usage, memory, sampler);
+}
+
+/// Places the texture at offset in memory from GpuAllocator.allocateAliasingMemory, other resources may share that memory
+pub fn initAliased(device: *Device, extent: saturn.TextureExtent, mip_levels: u32, format: saturn.TextureFormat, usage: saturn.TextureUsage, memory: GpuAllocator.Allocation, offset: vk.DeviceSize, sampler: vk.Sampler) !Self {
+    const handle = try device.gpu_allocator.createAliasingTexture(memory, offset, &getCreateInfo(extent, mip_levels, format, usage));
+    errdefer device.proxy.destroyImage(handle, null);
+
+    // No allocation so deinit only destroys the image
+    return initFromImage(device, handle, null, extent, mip_levels, format, usage, .gpu_only, sampler);
+}
 
+fn getImageType(extent: saturn.TextureExtent) vk.ImageType {
     if (extent.depth <= 1 and extent.height > 1) {
-        image_type = .@"2d";
-        image_view_type = .@"2d";
+        return .@"2d";
     } else if (extent.depth <= 1 and extent.height <= 1) {
-        image_type = .@"1d";
-        image_view_type = .@"1d";
+        return .@"1d";
     }
+    return .@"3d";
+}
 
-    const result = try device.gpu_allocator.createTexture(&.{
-        .image_type = image_type,
-        .format = vk_format,
+pub fn getCreateInfo(extent: saturn.TextureExtent, mip_levels: u32, format: saturn.TextureFormat, usage: saturn.TextureUsage) vk.ImageCreateInfo {
+    return .{
+        .image_type = getImageType(extent),
+        .format = getVkFormat(format),
         .extent = .{ .width = extent.width, .height = extent.height, .depth = extent.depth },
         .mip_levels = mip_levels,
         .array_layers = 1,
@@ -47,14 +59,30 @@ pub fn init(device: *Device, extent: saturn.TextureExtent, mip_levels: u32, form
         .usage = getVkImageUsage(usage, format.isColor()),
         .sharing_mode = .exclusive,
         .initial_layout = .undefined,
-    });
-    const handle = result.texture;
-    const allocation = result.allocation;
+    };
+}
+
+fn initFromImage(
+    device: *Device,
+    handle: vk.Image,
+    allocation: ?GpuAllocator.Allocation,
+    extent: saturn.TextureExtent,
+    mip_levels: u32,
+    format: saturn.TextureFormat,
+    usage: saturn.TextureUsage,
+    memory: saturn.MemoryLocation,
+    sampler: vk.Sampler,
+) !Self {
+    const image_view_type: vk.ImageViewType = switch (getImageType(extent)) {
+        .@"1d" => .@"1d",
+        .@"2d" => .@"2d",
+        else => .@"3d",
+    };
 
     const view_handle = try device.proxy.createImageView(&.{
         .view_type = image_view_type,
         .image = handle,
-        .format = vk_format,
+        .format = getVkFormat(format),
         .components = .{ .r = .identity, .g = .identity, .b = .identity, .a = .identity },
         .subresource_range = .{
             .aspect_mask = getFormatAspectMask(format),
@@ -0,0 +1,186 @@
+//Packs transient render graph resources into shared memory blocks, resources whose lifetimes don't overlap can share bytes.
+//A lifetime is the range of sorted passes that touch the resource, taken from RenderGraphCompiled.
+//Anything placed over bytes an earlier resource used needs a barrier against that resource's last access before its first one.
+
+const std = @import("std");
+
+pub const Lifetime = struct {
+    first: usize,
+    last: usize,
+
+    pub fn overlaps(self: Lifetime, other: Lifetime) bool {
+        return self.first <= other.last and other.first <= self.last;
+    }
+};
+
+pub const Request = struct {
+    size: u64,
+    alignment: u64,
+    memory_type_bits: u32,
+    lifetime: Lifetime,
+};
+
+pub const Placement = struct {
+    block: u32,
+    offset: u64,
+};
+
+pub const Block = struct {
+    size: u64 = 0,
+    alignment: u64 = 1,
+    memory_type_bits: u32,
+};
+
+/// `resource` reuses bytes `previous` was done with, so it must wait on previous's last access
+pub const Alias = struct {
+    resource: u32,
+    previous: u32,
+};
+
+pub const Plan = struct {
+    /// One per request
+    placements: []Placement,
+    blocks: []Block,
+    aliases: []Alias,
+
+    pub fn deinit(self: *const Plan, tpa: std.mem.Allocator) void {
+        tpa.free(self.placements);
+        tpa.free(self.blocks);
+        tpa.free(self.aliases);
+    }
+
+    pub fn allocatedBytes(self: *const Plan) u64 {
+        var total: u64 = 0;
+        for (self.blocks) |block| total += block.size;
+        return total;
+    }
+};
+
+/// What the requests would take with an allocation each
+pub fn requestedBytes(requests: []const Request) u64 {
+    var total: u64 = 0;
+    for (requests) |request| total += request.size;
+    return total;
+}
+
+fn rangesOverlap(a_offset: u64, a_size: u64, b_offset: u64, b_size: u64) bool {
+    return a_offset < b_offset + b_size and b_offset < a_offset + a_size;
+}
+
+/// The lowest offset is either the start of the block or right after a resource that is live at the same time
+fn lowestFreeOffset(requests: []const Request, placements: []const Placement, placed: []const u32, block: u32, request: Request) u64 {
+    var best: u64 = std.math.maxInt(u64);
+
+    // Index placed.len stands for the start of the block
+    for (0..placed.len + 1) |candidate| {
+        const offset = if (candidate == placed.len) 0 else blk: {
+            const other_index = placed[candidate];
+            if (placements[other_index].block != block) continue;
+            if (!requests[other_index].lifetime.overlaps(request.lifetime)) continue;
+            break :blk std.mem.alignForward(u64, placements[other_index].offset + requests[other_index].size, request.alignment);
+        };
+        if (offset >= best) continue;
+
+        const collides = for (placed) |other_index| {
+            if (placements[other_index].block != block) continue;
+            if (!requests[other_index].lifetime.overlaps(request.lifetime)) continue;
+            if (rangesOverlap(offset, request.size, placements[other_index].offset, requests[other_index].size)) break true;
+        } else false;
+
+        if (!collides) best = offset;
+    }
+
+    return best;
+}
+
+/// Largest first, placing each at the lowest offset that doesn't collide with a live resource in a compatible block.
+/// Buffers and images should be planned separately so linear and optimal resources never share a block.
+pub fn plan(tpa: std.mem.Allocator, requests: []const Request) error{OutOfMemory}!Plan {
+    const placements = try tpa.alloc(Placement, requests.len);
+    errdefer tpa.free(placements);
+
+    var blocks: std.ArrayList(Block) = .empty;
+    errdefer blocks.deinit(tpa);
+
+    const order = try tpa.alloc(u32, requests.len);
+    defer tpa.free(order);
+    for (order, 0..) |*index, i| index.* = @intCast(i);
+
+    const SizeOrder = struct {
+        fn greaterThan(reqs: []const Request, a: u32, b: u32) bool {
+            return reqs[a].size > reqs[b].size;
+        }
+    };
+    std.mem.sort(u32, order, requests, SizeOrder.greaterThan);
+
+    for (order, 0..) |request_index, placed_count| {
+        const request = requests[request_index];
+        const placed = order[0..placed_count];
+
+        var best: ?struct { block: u32, offset: u64, growth: u64 } = null;
+
+        for (blocks.items, 0..) |block, block_index| {
+            if (block.memory_type_bits & request.memory_type_bits == 0) continue;
+
+            const offset = lowestFreeOffset(requests, placements, placed, @intCast(block_index), request);
+            const growth = (offset + request.size) -| block.size;
+            if (best == null or growth < best.?.growth) {
+                best = .{ .block = @intCast(block_index), .offset = offset, .growth = growth };
+            }
+        }
+
+        const target = best orelse blk: {
+            try blocks.append(tpa, .{ .memory_type_bits = request.memory_type_bits });
+            break :blk .{ .block = @as(u32, @intCast(blocks.items.len - 1)), .offset = @as(u64, 0), .growth = request.size };
+        };
+
+        const block = &blocks.items[target.block];
+        block.size = @max(block.size, target.offset + request.size);
+        block.alignment = @max(block.alignment, request.alignment);
+        block.memory_type_bits &= request.memory_type_bits;
+
+        placements[request_index] = .{ .block = target.block, .offset = target.offset };
+    }
+
+    var aliases: std.ArrayList(Alias) = .empty;
+    errdefer aliases.deinit(tpa);
+
+    for (requests, placements, 0..) |request, placement, resource| {
+        for (requests, placements, 0..) |other, other_placement, previous| {
+            if (other_placement.block != placement.block) continue;
+            if (other.lifetime.last >= request.lifetime.first) continue;
+            if (!rangesOverlap(placement.offset, request.size, other_placement.offset, other.size)) continue;
+            try aliases.append(tpa, .{ .resource = @intCast(resource), .previous = @intCast(previous) });
+        }
+    }
+
+    return .{
+        .placements = placements,
+        .blocks = try blocks.toOwnedSlice(tpa),
+        .aliases = try aliases.toOwnedSlice(tpa),
+    };
+}
+
+test "transient_aliasing.disjoint_lifetimes" {
+    const requests = [_]Request{
+        .{ .size = 100, .alignment = 16, .memory_type_bits = 0b11, .lifetime = .{ .first = 0, .last = 1 } },
+        .{ .size = 100, .alignment = 16, .memory_type_bits = 0b01, .lifetime = .{ .first = 2, .last = 3 } },
+        .{ .size = 50, .alignment = 16, .memory_type_bits = 0b11, .lifetime = .{ .first = 1, .last = 2 } },
+        // No memory type in common with the rest
+        .{ .size = 10, .alignment = 16, .memory_type_bits = 0b100, .lifetime = .{ .first = 0, .last = 3 } },
+    };
+
+    const result = try plan(std.testing.allocator, &requests);
+    defer result.deinit(std.testing.allocator);
+
+    try std.testing.expectEqual(@as(usize, 2), result.blocks.len);
+    try std.testing.expectEqual(result.placements[0].block, result.placements[1].block);
+    try std.testing.expectEqual(result.placements[0].offset, result.placements[1].offset);
+    try std.testing.expectEqual(@as(u64, 112), result.placements[2].offset);
+    try std.testing.expectEqual(@as(u64, 162), result.blocks[result.placements[0].block].size);
+    try std.testing.expectEqual(@as(u32, 0b01), result.blocks[result.placements[0].block].memory_type_bits);
+    try std.testing.expect(result.placements[3].block != result.placements[0].block);
+
+    try std.testing.expectEqual(@as(usize, 1), result.aliases.len);
+    try std.testing.expectEqual(Alias{ .resource = 1, .previous = 0 }, result.aliases[0]);
+}
@@ -0,0 +1,162 @@
+//Keeps the transient resources of one frame in flight alive across frames, so a graph with a stable shape creates nothing.
+//An entry holds every transient of a graph at once since aliasing places each of them relative to the others,
+//it is keyed by the descriptor, resolved extent and lifetime of each transient in graph order.
+//Only touched between the frame's fence wait and its submit, so nothing in the cache is ever in use by the gpu when it is freed.
+
+const std = @import("std");
+
+const saturn = @import("../../root.zig");
+
+const Device = @import("device.zig");
+const Buffer = @import("buffer.zig");
+const Texture = @import("texture.zig");
+const GpuAllocator = @import("gpu_allocator.zig");
+const transient_aliasing = @import("transient_aliasing.zig");
+
+/// Frames an entry may go unused before its memory is given back
+pub const MAX_UNUSED_FRAMES = 8;
+
+pub const Key = union(enum) {
+    buffer: struct {
+        index: u32,
+        size: usize,
+        usage: saturn.BufferUsage,
+        memory: saturn.MemoryLocation,
+        lifetime: transient_aliasing.Lifetime,
+    },
+    texture: struct {
+        index: u32,
+        extent: saturn.TextureExtent,
+        mip_levels: u32,
+        format: saturn.TextureFormat,
+        usage: saturn.TextureUsage,
+        sampler: ?saturn.SamplerHandle,
+        lifetime: transient_aliasing.Lifetime,
+    },
+};
+
+/// A transient placed over memory `previous` used earlier in the frame, its first access has to wait for previous's last
+pub const AliasedResource = struct {
+    resource: saturn.Dependency,
+    previous: saturn.Dependency,
+};
+
+pub const Entry = struct {
+    keys: []Key,
+
+    /// In the order of the buffer and texture keys
+    buffers: std.ArrayList(Buffer) = .empty,
+    textures: std.ArrayList(Texture) = .empty,
+
+    /// Blocks the aliased transients are placed in, freed after the resources in them
+    memory: std.ArrayList(GpuAllocator.Allocation) = .empty,
+    aliases: std.ArrayList(AliasedResource) = .empty,
+
+    requested_bytes: u64 = 0,
+    allocated_bytes: u64 = 0,
+
+    unused_frames: u32 = 0,
+    used: bool = true,
+
+    pub fn deinit(self: *Entry, gpa: std.mem.Allocator, device: *Device) void {
+        for (self.buffers.items) |buffer| {
+            buffer.deinit(device);
+        }
+        self.buffers.deinit(gpa);
+
+        for (self.textures.items) |texture| {
+            texture.deinit(device);
+        }
+        self.textures.deinit(gpa);
+
+        for (self.memory.items) |memory| {
+            device.gpu_allocator.freeMemory(memory);
+        }
+        self.memory.deinit(gpa);
+
+        self.aliases.deinit(gpa);
+        gpa.free(self.keys);
+    }
+
+    pub fn resourceCount(self: *const Entry) usize {
+        return self.buffers.items.len + self.textures.items.len;
+    }
+};
+
+const Self = @This();
+
+gpa: std.mem.Allocator,
+entries: std.ArrayList(*Entry) = .empty,
+
+pub fn init(gpa: std.mem.Allocator) Self {
+    return .{ .gpa = gpa };
+}
+
+pub fn deinit(self: *Self, device: *Device) void {
+    self.clear(device);
+    self.entries.deinit(self.gpa);
+}
+
+/// The entry created for exactly these keys, marked as used this frame
+pub fn find(self: *Self, keys: []const Key) ?*Entry {
+    for (self.entries.items) |entry| {
+        if (entry.keys.len != keys.len) continue;
+
+        const matches = for (entry.keys, keys) |entry_key, key| {
+            if (!std.meta.eql(entry_key, key)) break false;
+        } else true;
+
+        if (matches) {
+            entry.used = true;
+            return entry;
+        }
+    }
+    return null;
+}
+
+/// An empty entry for keys to be filled by the caller, already marked as used this frame
+pub fn create(self: *Self, keys: []const Key) error{OutOfMemory}!*Entry {
+    const entry = try self.gpa.create(Entry);
+    errdefer self.gpa.destroy(entry);
+
+    entry.* = .{ .keys = try self.gpa.dupe(Key, keys) };
+    errdefer self.gpa.free(entry.keys);
+
+    try self.entries.append(self.gpa, entry);
+    return entry;
+}
+
+/// Frees an entry that failed to fill, so a half created set is never handed out
+pub fn destroy(self: *Self, device: *Device, entry: *Entry) void {
+    const index = std.mem.indexOfScalar(*Entry, self.entries.items, entry).?;
+    _ = self.entries.swapRemove(index);
+    entry.deinit(self.gpa, device);
+    self.gpa.destroy(entry);
+}
+
+/// Called once per frame before the graph is executed, ages out entries the last frames didn't use
+pub fn evict(self: *Self, device: *Device) void {
+    var i: usize = 0;
+    while (i < self.entries.items.len) {
+        const entry = self.entries.items[i];
+        entry.unused_frames = if (entry.used) 0 else entry.unused_frames + 1;
+        entry.used = false;
+
+        if (entry.unused_frames > MAX_UNUSED_FRAMES) {
+            _ = self.entries.swapRemove(i);
+            entry.deinit(self.gpa, device);
+            self.gpa.destroy(entry);
+        } else {
+            i += 1;
+        }
+    }
+}
+
+/// Frees every entry, the gpu must be done with all of them
+pub fn clear(self: *Self, device: *Device) void {
+    for (self.entries.items) |entry| {
+        entry.deinit(self.gpa, device);
+        self.gpa.destroy(entry);
+    }
+    self.entries.clearRetainingCapacity();
+}
@@ -172,7 +172,7 @@ pub fn getMeshAsset(self: *Self, asset_handle: AssetRegistry.Handle) error{OutOf
         self.allocator,
         asset_handle,
         .{
-            .load_meshlets = false,
+            .load_meshlets = true,
         },
     )) |mesh| {
         mesh_asset.cpu = mesh;
@@ -251,41 +251,43 @@ pub fn getMaterialAsset(self: *Self, asset_handle: AssetRegistry.Handle) error{O
 }
 
 pub fn addTransfers(self: *Self, transfer_queue: *TransferQueue) !void {
-    try self.mesh_pool.info_buffer.addTransfers(transfer_queue);
-    try self.material_pool.addTransfers(transfer_queue);
-    try self.texture_pool.info_buffer.addTransfers(transfer_queue);
-
-    if (self.mesh_gpu_load_list.items.len != 0) {
+    // Loads stop once the staging ring is full, the rest wait in the list until the backlog clears
+    {
         const MAX_MESH_UPLOADS = 100;
 
-        const upload_count: usize = @min(self.mesh_gpu_load_list.items.len, MAX_MESH_UPLOADS);
-        const start = self.mesh_gpu_load_list.items.len - upload_count;
-        const end = start + upload_count;
-
-        for (self.mesh_gpu_load_list.items[start..end]) |handle| {
+        var upload_count: usize = 0;
+        while (upload_count < MAX_MESH_UPLOADS and !transfer_queue.isBackedUp()) : (upload_count += 1) {
+            const handle = self.mesh_gpu_load_list.pop() orelse break;
             if (self.mesh_assets.getPtr(handle)) |asset| {
                 const cpu_asset = &asset.cpu.?;
                 self.mesh_pool.unload(handle); //Unload incase this already exists
                 try self.mesh_pool.load(transfer_queue, handle, cpu_asset);
             }
         }
-        self.mesh_gpu_load_list.shrinkRetainingCapacity(start);
     }
 
-    if (self.texture_gpu_load_list.items.len != 0) {
+    {
         const MAX_TEXTURE_UPLOADS = 100;
 
-        const upload_count: usize = @min(self.texture_gpu_load_list.items.len, MAX_TEXTURE_UPLOADS);
-        const start = self.texture_gpu_load_list.items.len - upload_count;
-        const end = start + upload_count;
-
-        for (self.texture_gpu_load_list.items[start..end]) |handle| {
+        var upload_count: usize = 0;
+        while (upload_count < MAX_TEXTURE_UPLOADS and !transfer_queue.isBackedUp()) : (upload_count += 1) {
+            const handle = self.texture_gpu_load_list.pop() orelse break;
             if (self.texture_assets.getPtr(handle)) |asset| {
                 const cpu_asset = &asset.cpu.?;
                 self.texture_pool.unload(handle); //Unload incase this already exists
-                try self.texture_pool.load(transfer_queue, handle, cpu_asset, self.default_sampler);
+                // Data that doesn't match its gpu format is skipped rather than taking the frame down
+                self.texture_pool.load(transfer_queue, handle, cpu_asset, self.default_sampler) catch |err| switch (err) {
+                    error.InvalidUsage => std.log.err("Failed to upload texture {} {}", .{ handle, err }),
+                    else => return err,
+                };
             }
         }
-        self.texture_gpu_load_list.shrinkRetainingCapacity(start);
     }
+    // Publishing stages info for assets whose data is all copied by this frame's graph, so infos go in after it
+    try self.mesh_pool.publishUploaded(transfer_queue);
+    self.texture_pool.publishUploaded(transfer_queue);
+
+    try self.mesh_pool.info_buffer.addTransfers(transfer_queue);
+    try self.material_pool.addTransfers(transfer_queue);
+    try self.texture_pool.info_buffer.addTransfers(transfer_queue);
 }
@@ -0,0 +1,369 @@
+//Bounding volume hierarchy over bounding spheres, built with binned SAH and stored as a flat depth first node array.
+//The left child of an interior node is always the next node, so only the right child index is stored and a node fits in 32 bytes.
+//Items are indices into whatever sphere list the tree was built from, so one tree can serve camera culling, shadow views and raycasts.
+
+const std = @import("std");
+
+const zm = @import("zmath");
+
+const culling = @import("culling.zig");
+
+pub const Node = extern struct {
+    min: [3]f32,
+    /// Interior: index of the right child, Leaf: first entry in indices
+    right_or_first: u32,
+    max: [3]f32,
+    /// 0 for interior nodes
+    count: u32,
+
+    pub fn isLeaf(self: Node) bool {
+        return self.count != 0;
+    }
+};
+
+const Bounds = struct {
+    min: zm.Vec = @splat(std.math.inf(f32)),
+    max: zm.Vec = @splat(-std.math.inf(f32)),
+
+    fn fromSphere(spheres: culling.SphereSlices, index: usize) Bounds {
+        const center: zm.Vec = .{ spheres.x[index], spheres.y[index], spheres.z[index], 0.0 };
+        const radius: zm.Vec = .{ spheres.r[index], spheres.r[index], spheres.r[index], 0.0 };
+        return .{ .min = center - radius, .max = center + radius };
+    }
+
+    fn grow(self: *Bounds, other: Bounds) void {
+        self.min = @min(self.min, other.min);
+        self.max = @max(self.max, other.max);
+    }
+
+    fn growPoint(self: *Bounds, point: zm.Vec) void {
+        self.min = @min(self.min, point);
+        self.max = @max(self.max, point);
+    }
+
+    fn halfArea(self: Bounds) f32 {
+        if (self.min[0] > self.max[0]) return 0.0;
+        const extent = self.max - self.min;
+        return extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0];
+    }
+
+    fn fromNode(node: Node) Bounds {
+        return .{
+            .min = .{ node.min[0], node.min[1], node.min[2], 0.0 },
+            .max = .{ node.max[0], node.max[1], node.max[2], 0.0 },
+        };
+    }
+
+    fn store(self: Bounds, node: *Node) void {
+        node.min = .{ self.min[0], self.min[1], self.min[2] };
+        node.max = .{ self.max[0], self.max[1], self.max[2] };
+    }
+};
+
+const BIN_COUNT = 12;
+const MAX_LEAF_ITEMS = 4;
+const MAX_DEPTH = 60;
+
+const Self = @This();
+
+nodes: std.ArrayList(Node) = .empty,
+indices: std.ArrayList(u32) = .empty,
+
+pub fn deinit(self: *Self, gpa: std.mem.Allocator) void {
+    self.nodes.deinit(gpa);
+    self.indices.deinit(gpa);
+}
+
+pub fn itemCount(self: *const Self) usize {
+    return self.indices.items.len;
+}
+
+/// Rebuilds the whole tree, reusing the node and index storage
+pub fn build(self: *Self, gpa: std.mem.Allocator, spheres: culling.SphereSlices) error{OutOfMemory}!void {
+    const item_count = spheres.len();
+
+    self.nodes.clearRetainingCapacity();
+    self.indices.clearRetainingCapacity();
+    if (item_count == 0) return;
+
+    try self.indices.ensureTotalCapacity(gpa, item_count);
+    for (0..item_count) |i| {
+        self.indices.appendAssumeCapacity(@intCast(i));
+    }
+
+    // A binary tree with at least one item per leaf never has more than 2n - 1 nodes
+    try self.nodes.ensureTotalCapacity(gpa, item_count * 2 - 1);
+    self.buildNode(spheres, 0, item_count, 0);
+}
+
+fn buildNode(self: *Self, spheres: culling.SphereSlices, first: usize, count: usize, depth: usize) void {
+    const node = self.nodes.addOneAssumeCapacity();
+
+    var bounds: Bounds = .{};
+    var centroid_bounds: Bounds = .{};
+    for (self.indices.items[first..][0..count]) |item| {
+        const item_bounds: Bounds = .fromSphere(spheres, item);
+        bounds.grow(item_bounds);
+        centroid_bounds.growPoint((item_bounds.min + item_bounds.max) * zm.splat(zm.Vec, 0.5));
+    }
+    bounds.store(node);
+
+    const split = if (count > MAX_LEAF_ITEMS and depth < MAX_DEPTH) self.findSplit(spheres, first, count, bounds, centroid_bounds) else null;
+    const left_count = split orelse {
+        node.right_or_first = @intCast(first);
+        node.count = @intCast(count);
+        return;
+    };
+
+    // Capacity is reserved up front, so node stays valid through the recursion
+    self.buildNode(spheres, first, left_count, depth + 1);
+    node.right_or_first = @intCast(self.nodes.items.len);
+    node.count = 0;
+    self.buildNode(spheres, first + left_count, count - left_count, depth + 1);
+}
+
+/// Partitions the node's items around the cheapest SAH split and returns the size of the left half,
+/// or null if keeping the node as a leaf is cheaper.
+fn findSplit(self: *Self, spheres: culling.SphereSlices, first: usize, count: usize, bounds: Bounds, centroid_bounds: Bounds) ?usize {
+    const Bin = struct {
+        bounds: Bounds = .{},
+        count: usize = 0,
+    };
+
+    const items = self.indices.items[first..][0..count];
+    const centroid_extent = centroid_bounds.max - centroid_bounds.min;
+
+    var best_cost = std.math.inf(f32);
+    var best_axis: usize = 0;
+    var best_bin: usize = 0;
+
+    inline for (0..3) |axis| {
+        // Axes where every centroid is in the same spot can't be split
+        if (centroid_extent[axis] > std.math.floatEps(f32)) {
+            const bin_scale = BIN_COUNT / centroid_extent[axis];
+
+            var bins: [BIN_COUNT]Bin = @splat(.{});
+            for (items) |item| {
+                const item_bounds: Bounds = .fromSphere(spheres, item);
+                const centroid = (item_bounds.min[axis] + item_bounds.max[axis]) * 0.5;
+                const bin_index = binIndex(centroid, centroid_bounds.min[axis], bin_scale);
+                bins[bin_index].bounds.grow(item_bounds);
+                bins[bin_index].count += 1;
+            }
+
+            // Sweep from the right to get the cost of everything past each split plane
+            var right_area: [BIN_COUNT - 1]f32 = undefined;
+            var right_count: [BIN_COUNT - 1]usize = undefined;
+            var right_bounds: Bounds = .{};
+            var right_total: usize = 0;
+            var i: usize = BIN_COUNT - 1;
+            while (i > 0) : (i -= 1) {
+                right_bounds.grow(bins[i].bounds);
+                right_total += bins[i].count;
+                right_area[i - 1] = right_bounds.halfArea();
+                right_count[i - 1] = right_total;
+            }
+
+            var left_bounds: Bounds = .{};
+            var left_total: usize = 0;
+            for (0..BIN_COUNT - 1) |split| {
+                left_bounds.grow(bins[split].bounds);
+                left_total += bins[split].count;
+                if (left_total == 0 or right_count[split] == 0) continue;
+
+                const cost = @as(f32, @floatFromInt(left_total)) * left_bounds.halfArea() + @as(f32, @floatFromInt(right_count[split])) * right_area[split];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = split;
+                }
+            }
+        }
+    }
+
+    // All centroids are in the same spot, nothing to gain from splitting
+    if (best_cost == std.math.inf(f32)) return null;
+
+    const leaf_cost = @as(f32, @floatFromInt(count)) * bounds.halfArea();
+    if (best_cost >= leaf_cost and count <= MAX_LEAF_ITEMS * 4) return null;
+
+    const centroid_extent_array: [4]f32 = centroid_extent;
+    const centroid_min_array: [4]f32 = centroid_bounds.min;
+    const bin_scale = BIN_COUNT / centroid_extent_array[best_axis];
+    var left: usize = 0;
+    var right: usize = count;
+    while (left < right) {
+        const item_bounds: Bounds = .fromSphere(spheres, items[left]);
+        const item_min: [4]f32 = item_bounds.min;
+        const item_max: [4]f32 = item_bounds.max;
+        const centroid = (item_min[best_axis] + item_max[best_axis]) * 0.5;
+        if (binIndex(centroid, centroid_min_array[best_axis], bin_scale) <= best_bin) {
+            left += 1;
+        } else {
+            right -= 1;
+            std.mem.swap(u32, &items[left], &items[right]);
+        }
+    }
+    return left;
+}
+
+fn binIndex(centroid: f32, min: f32, bin_scale: f32) usize {
+    const bin: usize = @intFromFloat(@max((centroid - min) * bin_scale, 0.0));
+    return @min(bin, BIN_COUNT - 1);
+}
+
+/// Updates node bounds after items moved without changing the tree shape.
+/// Quality degrades if items move far from where they were at build time, rebuild in that case.
+pub fn refit(self: *Self, spheres: culling.SphereSlices) void {
+    // Children always come after their parent, so walking backwards sees children first
+    var i = self.nodes.items.len;
+    while (i > 0) {
+        i -= 1;
+        const node = &self.nodes.items[i];
+
+        var bounds: Bounds = .{};
+        if (node.isLeaf()) {
+            for (self.indices.items[node.right_or_first..][0..node.count]) |item| {
+                bounds.grow(.fromSphere(spheres, item));
+            }
+        } else {
+            bounds = .fromNode(self.nodes.items[i + 1]);
+            bounds.grow(.fromNode(self.nodes.items[node.right_or_first]));
+        }
+        bounds.store(node);
+    }
+}
+
+const PlaneTest = enum { outside, intersecting, inside };
+
+fn testFrustum(frustum: *const culling.Frustum, node: Node) PlaneTest {
+    const center: zm.Vec = .{
+        (node.min[0] + node.max[0]) * 0.5,
+        (node.min[1] + node.max[1]) * 0.5,
+        (node.min[2] + node.max[2]) * 0.5,
+        0.0,
+    };
+    const extent: zm.Vec = .{
+        (node.max[0] - node.min[0]) * 0.5,
+        (node.max[1] - node.min[1]) * 0.5,
+        (node.max[2] - node.min[2]) * 0.5,
+        0.0,
+    };
+
+    var result: PlaneTest = .inside;
+    for (frustum.planes[0..frustum.plane_count]) |plane| {
+        const distance = plane.distanceTo(center);
+        const radius = zm.dot3(@abs(plane.normal_distance), extent)[0];
+        if (distance < -radius) {
+            return .outside;
+        }
+        if (distance < radius) {
+            result = .intersecting;
+        }
+    }
+    return result;
+}
+
+/// Writes the indices of every item intersecting the frustum to visible_indices and returns how many there were.
+/// Subtrees fully inside the frustum skip all further tests. Output order follows the tree, not the item order.
+pub fn cullFrustum(self: *const Self, frustum: *const culling.Frustum, spheres: culling.SphereSlices, visible_indices: []u32) usize {
+    std.debug.assert(visible_indices.len >= self.itemCount());
+    if (self.nodes.items.len == 0) return 0;
+
+    const StackEntry = struct {
+        node: u32,
+        inside: bool,
+    };
+    var stack: [MAX_DEPTH + 4]StackEntry = undefined;
+    stack[0] = .{ .node = 0, .inside = false };
+    var stack_len: usize = 1;
+
+    var count: usize = 0;
+    while (stack_len > 0) {
+        stack_len -= 1;
+        const entry = stack[stack_len];
+        const node = self.nodes.items[entry.node];
+
+        var inside = entry.inside;
+        if (!inside) {
+            switch (testFrustum(frustum, node)) {
+                .outside => continue,
+                .intersecting => {},
+                .inside => inside = true,
+            }
+        }
+
+        if (node.isLeaf()) {
+            for (self.indices.items[node.right_or_first..][0..node.count]) |item| {
+                if (inside or frustum.intersects(culling.Sphere, spheres.get(item))) {
+                    visible_indices[count] = item;
+                    count += 1;
+                }
+            }
+        } else {
+            // Right is pushed first so the left subtree is visited next, keeping traversal in memory order
+            stack[stack_len] = .{ .node = node.right_or_first, .inside = inside };
+            stack[stack_len + 1] = .{ .node = entry.node + 1, .inside = inside };
+            stack_len += 2;
+        }
+    }
+    return count;
+}
+
+test "bvh.cull_matches_scalar" {
+    const gpa = std.testing.allocator;
+    const count = 2000;
+
+    var prng = std.Random.DefaultPrng.init(0xB7B7);
+    const random = prng.random();
+
+    var list: culling.SphereList = .empty;
+    defer list.deinit(gpa);
+    try list.ensureTotalCapacity(gpa, count);
+    for (0..count) |_| {
+        list.appendAssumeCapacity(.{
+            .x = random.float(f32) * 200.0 - 100.0,
+            .y = random.float(f32) * 200.0 - 100.0,
+            .z = random.float(f32) * 200.0 - 100.0,
+            .r = random.float(f32) * 3.0 + 0.1,
+        });
+    }
+
+    const view = zm.lookAtRh(zm.f32x4(0.0, 0.0, 0.0, 1.0), zm.f32x4(0.3, 0.1, -1.0, 1.0), zm.f32x4(0.0, 1.0, 0.0, 0.0));
+    const projection = zm.perspectiveFovRh(std.math.degreesToRadians(60.0), 16.0 / 9.0, 0.1, 120.0);
+    const frustum: culling.Frustum = .fromViewProjectionMatrix(zm.mul(view, projection));
+
+    var bvh: Self = .{};
+    defer bvh.deinit(gpa);
+    try bvh.build(gpa, .fromList(&list));
+
+    const spheres = try gpa.alloc(culling.Sphere, count);
+    defer gpa.free(spheres);
+    const expected = try gpa.alloc(u32, count);
+    defer gpa.free(expected);
+    const actual = try gpa.alloc(u32, count);
+    defer gpa.free(actual);
+
+    for (0..2) |pass| {
+        // The second pass moves every sphere a little and refits instead of rebuilding
+        if (pass == 1) {
+            for (list.items(.x), list.items(.y), list.items(.z)) |*x, *y, *z| {
+                x.* += random.float(f32) * 10.0 - 5.0;
+                y.* += random.float(f32) * 10.0 - 5.0;
+                z.* += random.float(f32) * 10.0 - 5.0;
+            }
+            bvh.refit(.fromList(&list));
+        }
+
+        const slices: culling.SphereSlices = .fromList(&list);
+        for (spheres, 0..) |*sphere, i| sphere.* = slices.get(i);
+
+        const expected_count = culling.cullSpheresScalar(&frustum, spheres, expected);
+        const actual_count = bvh.cullFrustum(&frustum, slices, actual);
+        try std.testing.expect(expected_count > 0 and expected_count < count);
+
+        // Scalar output is in item order, the tree's follows its nodes
+        std.mem.sort(u32, actual[0..actual_count], {}, std.sort.asc(u32));
+        try std.testing.expectEqualSlices(u32, expected[0..expected_count], actual[0..actual_count]);
+    }
+}
@@ -2,6 +2,7 @@ const std = @import("std");
 
 const zm = @import("zmath");
 const Transform = @import("../transform.zig");
+const TaskPool = @import("../TaskPool.zig");
 
 pub const Sphere = struct {
     const Self = @This();
@@ -91,3 +92,234 @@ pub const Frustum = struct {
         return true;
     }
 };
+
+/// Element type for SphereList, std.MultiArrayList stores each field in its own array
+pub const SphereLanes = struct {
+    x: f32,
+    y: f32,
+    z: f32,
+    r: f32,
+
+    pub fn fromSphere(sphere: Sphere) SphereLanes {
+        return .{ .x = sphere.pos_radius[0], .y = sphere.pos_radius[1], .z = sphere.pos_radius[2], .r = sphere.pos_radius[3] };
+    }
+};
+pub const SphereList = std.MultiArrayList(SphereLanes);
+
+pub const SphereSlices = struct {
+    x: []const f32,
+    y: []const f32,
+    z: []const f32,
+    r: []const f32,
+
+    pub fn fromList(list: *const SphereList) SphereSlices {
+        const slice = list.slice();
+        return .{ .x = slice.items(.x), .y = slice.items(.y), .z = slice.items(.z), .r = slice.items(.r) };
+    }
+
+    pub fn len(self: SphereSlices) usize {
+        return self.x.len;
+    }
+
+    pub fn get(self: SphereSlices, index: usize) Sphere {
+        return .{ .pos_radius = .{ self.x[index], self.y[index], self.z[index], self.r[index] } };
+    }
+};
+
+pub const batch_lanes = 8;
+const LaneVec = @Vector(batch_lanes, f32);
+const LaneMask = std.meta.Int(.unsigned, batch_lanes);
+
+/// Tests spheres[start..end] against the frustum batch_lanes at a time.
+/// Writes the indices of the visible spheres to visible_indices in ascending order and returns how many there were.
+pub fn cullSpheres(frustum: *const Frustum, spheres: SphereSlices, start: usize, end: usize, visible_indices: []u32) usize {
+    std.debug.assert(visible_indices.len >= end - start);
+
+    var plane_x: [6]LaneVec = undefined;
+    var plane_y: [6]LaneVec = undefined;
+    var plane_z: [6]LaneVec = undefined;
+    var plane_d: [6]LaneVec = undefined;
+    for (frustum.planes[0..frustum.plane_count], 0..) |plane, i| {
+        plane_x[i] = @splat(plane.normal_distance[0]);
+        plane_y[i] = @splat(plane.normal_distance[1]);
+        plane_z[i] = @splat(plane.normal_distance[2]);
+        plane_d[i] = @splat(plane.normal_distance[3]);
+    }
+
+    var count: usize = 0;
+    var index = start;
+    while (index + batch_lanes <= end) : (index += batch_lanes) {
+        const x: LaneVec = spheres.x[index..][0..batch_lanes].*;
+        const y: LaneVec = spheres.y[index..][0..batch_lanes].*;
+        const z: LaneVec = spheres.z[index..][0..batch_lanes].*;
+        const neg_r: LaneVec = -@as(LaneVec, spheres.r[index..][0..batch_lanes].*);
+
+        var inside: LaneMask = std.math.maxInt(LaneMask);
+        for (0..frustum.plane_count) |i| {
+            const distance = plane_x[i] * x + plane_y[i] * y + plane_z[i] * z + plane_d[i];
+            inside &= @as(LaneMask, @bitCast(distance > neg_r));
+        }
+
+        while (inside != 0) : (inside &= inside - 1) {
+            visible_indices[count] = @intCast(index + @ctz(inside));
+            count += 1;
+        }
+    }
+
+    // Tail that doesn't fill a whole batch
+    while (index < end) : (index += 1) {
+        if (frustum.intersects(Sphere, spheres.get(index))) {
+            visible_indices[count] = @intCast(index);
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+/// One sphere at a time reference path, kept for validating and benchmarking cullSpheres
+pub fn cullSpheresScalar(frustum: *const Frustum, spheres: []const Sphere, visible_indices: []u32) usize {
+    var count: usize = 0;
+    for (spheres, 0..) |sphere, i| {
+        if (frustum.intersects(Sphere, sphere)) {
+            visible_indices[count] = @intCast(i);
+            count += 1;
+        }
+    }
+    return count;
+}
+
+pub const parallel_options: TaskPool.ParallelOptions = .{ .min_grain_size = 1024 };
+
+/// Output space for cullSpheresParallel, allocate up front so culling itself never allocates
+/// indices needs one entry per sphere, chunk_counts one per TaskPool.chunkCount(sphere_count, parallel_options)
+pub const ParallelCullBuffers = struct {
+    indices: []u32,
+    chunk_counts: []u32,
+};
+
+/// Splits cullSpheres across the pool, each chunk compacts into its own range then the ranges are packed in chunk order.
+/// Returns the visible indices in ascending order, backed by buffers.indices.
+pub fn cullSpheresParallel(task_pool: *TaskPool, frustum: *const Frustum, spheres: SphereSlices, buffers: ParallelCullBuffers) []u32 {
+    const CullContext = struct {
+        frustum: *const Frustum,
+        spheres: SphereSlices,
+        buffers: ParallelCullBuffers,
+
+        fn run(ctx: @This(), range: TaskPool.Range) void {
+            ctx.buffers.chunk_counts[range.chunk] = @intCast(cullSpheres(ctx.frustum, ctx.spheres, range.start, range.end, ctx.buffers.indices[range.start..range.end]));
+        }
+    };
+
+    const sphere_count = spheres.len();
+    task_pool.parallelFor(sphere_count, parallel_options, CullContext{
+        .frustum = frustum,
+        .spheres = spheres,
+        .buffers = buffers,
+    }, CullContext.run);
+
+    const grain_size = task_pool.grainSize(sphere_count, parallel_options);
+    var visible_count: usize = 0;
+    for (buffers.chunk_counts[0..task_pool.chunkCount(sphere_count, parallel_options)], 0..) |chunk_count, chunk| {
+        const chunk_start = chunk * grain_size;
+        std.mem.copyForwards(u32, buffers.indices[visible_count..], buffers.indices[chunk_start..][0..chunk_count]);
+        visible_count += chunk_count;
+    }
+    return buffers.indices[0..visible_count];
+}
+
+test "culling.batch_matches_scalar" {
+    const gpa = std.testing.allocator;
+    const max_count = 5003;
+
+    var prng = std.Random.DefaultPrng.init(0xC011);
+    const random = prng.random();
+
+    var pool: TaskPool = undefined;
+    try pool.init(gpa, .{ .n_jobs = 3 });
+    defer pool.deinit();
+
+    // Every plane of the box has a single non zero normal component, so distances are exact and spheres can sit right on a plane
+    const box: Frustum = .{ .plane_count = 6, .planes = .{
+        .{ .normal_distance = .{ 1.0, 0.0, 0.0, 16.0 } },
+        .{ .normal_distance = .{ -1.0, 0.0, 0.0, 16.0 } },
+        .{ .normal_distance = .{ 0.0, 1.0, 0.0, 16.0 } },
+        .{ .normal_distance = .{ 0.0, -1.0, 0.0, 16.0 } },
+        .{ .normal_distance = .{ 0.0, 0.0, 1.0, 0.0 } },
+        .{ .normal_distance = .{ 0.0, 0.0, -1.0, 64.0 } },
+    } };
+
+    const view = zm.lookAtLh(zm.f32x4(0.0, 0.0, -10.0, 1.0), zm.f32x4(0.2, -0.1, 0.0, 1.0), zm.f32x4(0.0, 1.0, 0.0, 0.0));
+    const projection = zm.perspectiveFovLh(std.math.degreesToRadians(70.0), 16.0 / 9.0, 0.1, 100.0);
+    const perspective: Frustum = .fromViewProjectionMatrix(zm.mul(view, projection));
+
+    const box_spheres = try gpa.alloc(Sphere, max_count);
+    defer gpa.free(box_spheres);
+    for (box_spheres) |*sphere| {
+        // Centre the sphere so its signed distance to one plane is a small multiple of the radius, from fully outside to fully inside
+        const radius = @as(f32, @floatFromInt(random.intRangeAtMost(u32, 1, 8))) * 0.5;
+        const distance = radius * (@as(f32, @floatFromInt(random.intRangeAtMost(i32, -4, 4))) * 0.5);
+        var pos: zm.Vec = .{
+            @floatFromInt(random.intRangeAtMost(i32, -12, 12)),
+            @floatFromInt(random.intRangeAtMost(i32, -12, 12)),
+            @floatFromInt(random.intRangeAtMost(i32, 4, 60)),
+            radius,
+        };
+        const plane = box.planes[random.uintLessThan(usize, 6)].normal_distance;
+        const axis: usize = if (plane[0] != 0.0) 0 else if (plane[1] != 0.0) 1 else 2;
+        pos[axis] = plane[axis] * (distance - plane[3]);
+        sphere.* = .{ .pos_radius = pos };
+    }
+
+    const perspective_spheres = try gpa.alloc(Sphere, max_count);
+    defer gpa.free(perspective_spheres);
+    for (perspective_spheres) |*sphere| {
+        sphere.* = .{ .pos_radius = .{
+            random.float(f32) * 160.0 - 80.0,
+            random.float(f32) * 160.0 - 80.0,
+            random.float(f32) * 130.0 - 20.0,
+            random.float(f32) * 5.0,
+        } };
+    }
+
+    var list: SphereList = .empty;
+    defer list.deinit(gpa);
+    try list.ensureTotalCapacity(gpa, max_count);
+
+    const expected = try gpa.alloc(u32, max_count);
+    defer gpa.free(expected);
+    const actual = try gpa.alloc(u32, max_count);
+    defer gpa.free(actual);
+    const chunk_counts = try gpa.alloc(u32, pool.chunkCount(max_count, parallel_options));
+    defer gpa.free(chunk_counts);
+
+    const cases = [_]struct { frustum: *const Frustum, spheres: []const Sphere }{
+        .{ .frustum = &box, .spheres = box_spheres },
+        .{ .frustum = &perspective, .spheres = perspective_spheres },
+    };
+    for (cases) |case| {
+        // Empty, a lone sphere, around one batch and enough for several parallel chunks with a short tail
+        for ([_]usize{ 0, 1, 7, 8, 9, 15, 17, 100, max_count }) |count| {
+            const spheres = case.spheres[0..count];
+            list.clearRetainingCapacity();
+            for (spheres) |sphere| list.appendAssumeCapacity(.fromSphere(sphere));
+            const slices: SphereSlices = .fromList(&list);
+
+            const expected_count = cullSpheresScalar(case.frustum, spheres, expected);
+            if (count == max_count) try std.testing.expect(expected_count > 0 and expected_count < count);
+
+            const batch_count = cullSpheres(case.frustum, slices, 0, count, actual);
+            try std.testing.expectEqualSlices(u32, expected[0..expected_count], actual[0..batch_count]);
+
+            // A range starting off a batch boundary, as the parallel chunks may
+            const start = count / 3;
+            const range_count = cullSpheres(case.frustum, slices, start, count, actual);
+            var range_first: usize = 0;
+            while (range_first < expected_count and expected[range_first] < start) : (range_first += 1) {}
+            try std.testing.expectEqualSlices(u32, expected[range_first..expected_count], actual[0..range_count]);
+
+            const parallel = cullSpheresParallel(&pool, case.frustum, slices, .{ .indices = actual[0..count], .chunk_counts = chunk_counts });
+            try std.testing.expectEqualSlices(u32, expected[0..expected_count], parallel);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+//Hierarchical max depth of the scene depth buffer for gpu occlusion culling, built with one compute pass per level.
+//Levels are stored one after another in a single buffer since transient textures only have a view of their first mip.
+//The size is fixed so the number of passes is known when the graph is built, level 0 takes the max of every depth pixel it covers.
+
+const std = @import("std");
+
+const saturn = @import("../root.zig");
+const utils = @import("utils.zig");
+
+const AssetRegistry = @import("../asset/registry.zig");
+
+// Must match include/depth_pyramid.glsl
+pub const WIDTH = 512;
+pub const HEIGHT = 256;
+pub const LEVELS = 8;
+
+/// local_size_x and local_size_y of depth_pyramid.comp
+const GROUP_SIZE = 8;
+
+pub const TEXEL_COUNT = blk: {
+    var count: usize = 0;
+    for (0..LEVELS) |level| {
+        const size = levelSize(level);
+        count += size[0] * size[1];
+    }
+    break :blk count;
+};
+
+pub fn levelSize(level: usize) [2]u32 {
+    return .{ @max(@as(u32, WIDTH) >> @intCast(level), 1), @max(@as(u32, HEIGHT) >> @intCast(level), 1) };
+}
+
+/// Matches the push constants in depth_pyramid.comp
+const PushConstants = extern struct {
+    depth_pyramid_address: u64,
+    depth_binding: u32,
+    level: u32,
+};
+
+const LevelPassData = struct {
+    pipeline: saturn.ComputePipelineHandle,
+    depth_texture: saturn.RGTextureHandle,
+    depth_pyramid: saturn.RGBufferHandle,
+    level: u32,
+};
+
+const Self = @This();
+
+pipeline: saturn.ComputePipelineHandle,
+
+pub fn init(gpa: std.mem.Allocator, device: saturn.DeviceInterface, registry: *const AssetRegistry) !Self {
+    const shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", "shaders/glsl/depth_pyramid.comp.asset"));
+    defer device.destroyShaderModule(shader);
+
+    return .{
+        .pipeline = try device.createComputePipeline(.{
+            .name = "Depth Pyramid Pipeline",
+            .shader = shader,
+        }),
+    };
+}
+
+pub fn deinit(self: *const Self, device: saturn.DeviceInterface) void {
+    device.destroyComputePipeline(self.pipeline);
+}
+
+/// Adds the passes reducing depth_texture into a new pyramid buffer, the depth texture needs a sampled binding
+pub fn addPasses(self: *const Self, render_graph: *saturn.RenderGraph, depth_texture: saturn.RGTextureHandle) saturn.Error!saturn.RGBufferHandle {
+    const depth_pyramid = try render_graph.createTransientBuffer(.{
+        .size = TEXEL_COUNT * @sizeOf(f32),
+        .usage = .{ .storage = true, .device_address = true },
+        .memory = .gpu_only,
+    });
+
+    for (0..LEVELS) |level| {
+        const pass_data = try render_graph.dupe(LevelPassData, .{
+            .pipeline = self.pipeline,
+            .depth_texture = depth_texture,
+            .depth_pyramid = depth_pyramid,
+            .level = @intCast(level),
+        });
+
+        // Each level reads the one before it from the same buffer, the write usage orders the passes
+        const pass = try render_graph.addComputePass("Depth Pyramid Pass", pass_data, levelPassCallback);
+        if (level == 0) {
+            try render_graph.addTextureUsage(pass, depth_texture, .compute_sampled_read);
+        }
+        try render_graph.addBufferUsage(pass, depth_pyramid, .compute_storage_write);
+    }
+
+    return depth_pyramid;
+}
+
+fn levelPassCallback(ctx: ?*anyopaque, cmd: saturn.ComputeCommandEncoder) void {
+    const data: *const LevelPassData = @ptrCast(@alignCast(ctx.?));
+    const size = levelSize(data.level);
+
+    cmd.setPipeline(data.pipeline);
+    cmd.pushConstants(PushConstants, .{
+        .depth_pyramid_address = cmd.getBufferInfo(.from(data.depth_pyramid)).?.device_address.?,
+        .depth_binding = cmd.getTextureInfo(.from(data.depth_texture)).?.sampled.?,
+        .level = data.level,
+    });
+    cmd.dispatch(
+        std.math.divCeil(u32, size[0], GROUP_SIZE) catch unreachable,
+        std.math.divCeil(u32, size[1], GROUP_SIZE) catch unreachable,
+        1,
+    );
+}
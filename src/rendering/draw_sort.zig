@@ -0,0 +1,173 @@
+//Draw ordering through packed 64-bit keys and an LSD radix sort, linear in the number of visible draws.
+//Opaque keys group by pipeline, mesh and material before depth so runs of one mesh stay together and can be drawn instanced.
+//Blend keys put depth right after the pipeline since back to front order is required for correct results.
+
+const std = @import("std");
+
+const zm = @import("zmath");
+
+const culling = @import("culling.zig");
+const Scene = @import("scene.zig");
+
+pub const Order = enum {
+    /// Sorted for state changes first, then front to back for early depth rejection
+    front_to_back,
+    /// Sorted back to front only, state changes are secondary
+    back_to_front,
+};
+
+const PIPELINE_BITS = 4;
+const MATERIAL_BITS = 18;
+const MESH_BITS = 18;
+const DEPTH_BITS = 24;
+
+comptime {
+    std.debug.assert(PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS == 64);
+}
+
+/// Builds the sort key for one draw, pipeline is any small id that separates draws using different pipelines
+pub fn makeKey(order: Order, pipeline: u32, draw: *const Scene.InstanceDrawData, camera_distance_squared: f32) u64 {
+    const pipeline_bits: u64 = pipeline & maxValue(PIPELINE_BITS);
+    const material_bits: u64 = draw.material_index & maxValue(MATERIAL_BITS);
+
+    // The first index is unique per mesh primitive, hashing keeps collisions rare once truncated
+    const mesh_bits: u64 = std.hash.int(draw.draw_data.first_index) & maxValue(MESH_BITS);
+
+    // Bits of a non-negative float sort the same as the value, the top bits are a log scale depth
+    const distance_bits: u32 = @bitCast(@max(camera_distance_squared, 0.0));
+    const depth_bits: u64 = distance_bits >> (32 - DEPTH_BITS);
+
+    return switch (order) {
+        .front_to_back => (pipeline_bits << (64 - PIPELINE_BITS)) |
+            (mesh_bits << (MATERIAL_BITS + DEPTH_BITS)) |
+            (material_bits << DEPTH_BITS) |
+            depth_bits,
+        .back_to_front => (pipeline_bits << (64 - PIPELINE_BITS)) |
+            ((maxValue(DEPTH_BITS) - depth_bits) << (MATERIAL_BITS + MESH_BITS)) |
+            (material_bits << MESH_BITS) |
+            mesh_bits,
+    };
+}
+
+fn maxValue(comptime bits: comptime_int) u64 {
+    return (1 << bits) - 1;
+}
+
+/// Scratch for sorting, each slice needs room for the largest index list sorted with it
+pub const SortBuffers = struct {
+    keys: []u64,
+    scratch_keys: []u64,
+    scratch_indices: []u32,
+};
+
+/// Reorders visible draw indices by their sort key
+pub fn sortDraws(
+    order: Order,
+    pipeline: u32,
+    draws: []const Scene.InstanceDrawData,
+    spheres: culling.SphereSlices,
+    camera_pos: zm.Vec,
+    indices: []u32,
+    buffers: SortBuffers,
+) void {
+    const keys = buffers.keys[0..indices.len];
+    for (keys, indices) |*key, index| {
+        const center: zm.Vec = .{ spheres.x[index], spheres.y[index], spheres.z[index], 0.0 };
+        const offset = center - camera_pos;
+        key.* = makeKey(order, pipeline, &draws[index], zm.dot3(offset, offset)[0]);
+    }
+    radixSort(keys, indices, buffers.scratch_keys, buffers.scratch_indices);
+}
+
+/// Stable LSD radix sort of keys, values are moved along with their keys.
+/// Passes where every key has the same byte are skipped, so keys using only a few bits stay cheap.
+pub fn radixSort(keys: []u64, values: []u32, scratch_keys: []u64, scratch_values: []u32) void {
+    std.debug.assert(keys.len == values.len);
+    std.debug.assert(scratch_keys.len >= keys.len and scratch_values.len >= keys.len);
+
+    const RADIX_BITS = 8;
+    const BUCKET_COUNT = 1 << RADIX_BITS;
+    const PASS_COUNT = 64 / RADIX_BITS;
+
+    const count = keys.len;
+    if (count < 2) return;
+
+    // All histograms in one read of the keys
+    var histograms: [PASS_COUNT][BUCKET_COUNT]u32 = @splat(@splat(0));
+    for (keys) |key| {
+        inline for (0..PASS_COUNT) |pass| {
+            const byte: u8 = @truncate(key >> (pass * RADIX_BITS));
+            histograms[pass][byte] += 1;
+        }
+    }
+
+    var src_keys = keys;
+    var src_values = values;
+    var dst_keys = scratch_keys[0..count];
+    var dst_values = scratch_values[0..count];
+
+    for (&histograms, 0..) |*histogram, pass| {
+        const shift: u6 = @intCast(pass * RADIX_BITS);
+        const first_byte: u8 = @truncate(src_keys[0] >> shift);
+        if (histogram[first_byte] == count) continue;
+
+        var offset: u32 = 0;
+        for (histogram) |*bucket| {
+            const bucket_count = bucket.*;
+            bucket.* = offset;
+            offset += bucket_count;
+        }
+
+        for (src_keys, src_values) |key, value| {
+            const byte: u8 = @truncate(key >> shift);
+            const dst = histogram[byte];
+            histogram[byte] += 1;
+            dst_keys[dst] = key;
+            dst_values[dst] = value;
+        }
+
+        std.mem.swap([]u64, &src_keys, &dst_keys);
+        std.mem.swap([]u32, &src_values, &dst_values);
+    }
+
+    // An odd number of passes leaves the result in scratch
+    if (src_keys.ptr != keys.ptr) {
+        @memcpy(keys, src_keys);
+        @memcpy(values, src_values);
+    }
+}
+
+test "draw_sort.radix_sort" {
+    const gpa = std.testing.allocator;
+    const count = 1000;
+
+    var prng = std.Random.DefaultPrng.init(0xD4A3);
+    const random = prng.random();
+
+    const keys = try gpa.alloc(u64, count);
+    defer gpa.free(keys);
+    const values = try gpa.alloc(u32, count);
+    defer gpa.free(values);
+    const scratch_keys = try gpa.alloc(u64, count);
+    defer gpa.free(scratch_keys);
+    const scratch_values = try gpa.alloc(u32, count);
+    defer gpa.free(scratch_values);
+
+    for (keys, values, 0..) |*key, *value, i| {
+        // Few distinct values in the low bits to exercise stability and skipped passes
+        key.* = random.int(u64) & 0xFF00_0000_00FF_FF03;
+        value.* = @intCast(i);
+    }
+    const original = try gpa.dupe(u64, keys);
+    defer gpa.free(original);
+
+    radixSort(keys, values, scratch_keys, scratch_values);
+
+    for (keys[1..], values[1..], keys[0 .. count - 1], values[0 .. count - 1]) |key, value, prev_key, prev_value| {
+        try std.testing.expect(prev_key <= key);
+        if (prev_key == key) try std.testing.expect(prev_value < value);
+    }
+    for (keys, values) |key, value| {
+        try std.testing.expectEqual(original[value], key);
+    }
+}
@@ -0,0 +1,87 @@
+const std = @import("std");
+
+const saturn = @import("../root.zig");
+
+/// Persistently mapped buffers the cpu writes fresh data into every frame, one per frame that can be in flight.
+/// Slots follow the device's frame slot, so one is only handed out again once the frame that last used it has finished on the gpu.
+pub fn FrameRingBuffer(comptime T: type) type {
+    return struct {
+        const Self = @This();
+
+        pub const Slot = struct {
+            buffer: saturn.BufferHandle = .null_handle,
+            /// Uniform binding for uniform buffers, storage binding otherwise
+            binding: u32 = 0,
+            items: []T = &.{},
+        };
+
+        allocator: std.mem.Allocator,
+        device: saturn.DeviceInterface,
+        name: [:0]const u8,
+        buffer_usage: saturn.BufferUsage,
+
+        slots: []Slot,
+
+        pub fn init(
+            allocator: std.mem.Allocator,
+            device: saturn.DeviceInterface,
+            name: [:0]const u8,
+            buffer_usage: saturn.BufferUsage,
+        ) error{OutOfMemory}!Self {
+            const slot_count: usize = @max(1, device.getFramesInFlight());
+
+            const slots = try allocator.alloc(Slot, slot_count);
+            @memset(slots, .{});
+
+            return .{
+                .allocator = allocator,
+                .device = device,
+                .name = name,
+                .buffer_usage = buffer_usage,
+                .slots = slots,
+            };
+        }
+
+        pub fn deinit(self: *Self) void {
+            for (self.slots) |slot| {
+                if (slot.buffer != .null_handle) {
+                    self.device.destroyBuffer(slot.buffer);
+                }
+            }
+            self.allocator.free(self.slots);
+        }
+
+        /// The slot of the current frame, grown to hold at least count items. Call after the device's beginFrame.
+        /// Growing replaces only that slot's buffer, the old one is released once the gpu is done with it.
+        pub fn next(self: *Self, count: usize) saturn.Error!Slot {
+            const slot = &self.slots[self.device.getFrameInfo().slot % self.slots.len];
+
+            if (slot.items.len < count or slot.buffer == .null_handle) {
+                const capacity = std.math.ceilPowerOfTwo(usize, @max(count, 64)) catch count;
+                const size = capacity * @sizeOf(T);
+
+                const buffer = try self.device.createBuffer(.{
+                    .name = self.name,
+                    .size = size,
+                    .usage = self.buffer_usage,
+                    .memory = .cpu_to_gpu,
+                });
+                errdefer self.device.destroyBuffer(buffer);
+
+                const buffer_info = self.device.getBufferInfo(buffer).?;
+                const binding = (if (self.buffer_usage.uniform) buffer_info.uniform else buffer_info.storage) orelse return error.InvalidUsage;
+
+                if (slot.buffer != .null_handle) {
+                    self.device.destroyBuffer(slot.buffer);
+                }
+                slot.* = .{
+                    .buffer = buffer,
+                    .binding = binding,
+                    .items = @alignCast(std.mem.bytesAsSlice(T, buffer_info.mapped_slice.?[0..size])),
+                };
+            }
+
+            return slot.*;
+        }
+    };
+}
@@ -90,9 +90,21 @@ pub fn GpuPool(comptime T: type) type {
             return self.device_address + (@as(u64, index) * @sizeOf(T));
         }
 
+        /// Safe to call from multiple threads as long as each thread stages different indices
         pub fn stage(self: *Self, index: u32, value: T) void {
             self.staging[index] = value;
-            self.dirty.set(index);
+
+            // Neighbouring indices share a mask word, so the dirty bit is set atomically
+            const MaskInt = std.DynamicBitSetUnmanaged.MaskInt;
+            const ShiftInt = std.DynamicBitSetUnmanaged.ShiftInt;
+            const mask_bits = @bitSizeOf(MaskInt);
+            const bit = @as(MaskInt, 1) << @as(ShiftInt, @intCast(index % mask_bits));
+            _ = @atomicRmw(MaskInt, &self.dirty.masks[index / mask_bits], .Or, bit, .monotonic);
+        }
+
+        /// Marks every element dirty so the next addTransfers uploads the whole staging copy
+        pub fn stageAll(self: *Self) void {
+            self.dirty.setRangeValue(.{ .start = 0, .end = self.element_count }, true);
         }
 
         pub fn create(self: *Self, value: T) !u32 {
@@ -101,15 +113,42 @@ pub fn GpuPool(comptime T: type) type {
             return index;
         }
 
+        /// Uploads only the dirty elements, runs of neighbouring elements are merged into one copy
         pub fn addTransfers(self: *Self, transfer_queue: *TransferQueue) !void {
+            var uploads: std.ArrayList(TransferQueue.BufferUpload) = .empty;
+            defer uploads.deinit(self.allocator);
+
             var it = self.dirty.iterator(.{});
+            var run_start: usize = 0;
+            var run_end: usize = 0;
             while (it.next()) |index| {
-                const byte_offset = @as(u64, index) * @sizeOf(T);
-                try transfer_queue.addBufferUpload(self.buffer, byte_offset, std.mem.asBytes(&self.staging[index]));
+                if (run_end != run_start and index == run_end) {
+                    run_end += 1;
+                    continue;
+                }
+
+                if (run_end != run_start) {
+                    try uploads.append(self.allocator, self.runUpload(run_start, run_end));
+                }
+                run_start = index;
+                run_end = index + 1;
+            }
+            if (run_end != run_start) {
+                try uploads.append(self.allocator, self.runUpload(run_start, run_end));
             }
+
+            try transfer_queue.addBulkBufferUpload(uploads.items);
             self.dirty.setRangeValue(.{ .start = 0, .end = self.element_count }, false);
         }
 
+        fn runUpload(self: *const Self, start: usize, end: usize) TransferQueue.BufferUpload {
+            return .{
+                .dst = self.buffer,
+                .offset = start * @sizeOf(T),
+                .data = std.mem.sliceAsBytes(self.staging[start..end]),
+            };
+        }
+
         pub fn freeCount(self: *const Self) usize {
             return self.free_list.count();
         }
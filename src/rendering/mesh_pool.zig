@@ -166,6 +166,9 @@ pub const MeshInfo = struct {
     vertices: GpuBuffer(CpuMesh.Vertex).SubAllocation,
     indices: GpuBuffer(u32).SubAllocation,
     primitives: GpuBuffer(CpuMesh.Primitive).SubAllocation,
+    meshlets: GpuBuffer(CpuMesh.Meshlet).SubAllocation,
+    meshlet_vertices: GpuBuffer(u32).SubAllocation,
+    meshlet_triangles: GpuBuffer(u8).SubAllocation,
 
     fn getGpu(self: MeshInfo) Gpu {
         return .{
@@ -173,11 +176,21 @@ pub const MeshInfo = struct {
             .vertex_buffer_offset = @intCast(self.vertices.offset),
             .index_buffer_offset = @intCast(self.indices.offset),
             .primitive_buffer_address = self.primitives.device_address,
+            .meshlet_buffer_address = self.meshlets.device_address,
+            .meshlet_vertex_buffer_address = self.meshlet_vertices.device_address,
+            .meshlet_triangle_buffer_address = self.meshlet_triangles.device_address,
+            .meshlets_loaded = @intFromBool(self.meshlets.len != 0),
             .loaded = 1,
         };
     }
 };
 
+const PendingLoad = struct {
+    handle: MeshHandle,
+    info: MeshInfo,
+    upload: TransferQueue.UploadId,
+};
+
 const Self = @This();
 
 gpa: std.mem.Allocator,
@@ -185,13 +198,25 @@ device: saturn.DeviceInterface,
 
 info_buffer: GpuPool(MeshInfo.Gpu),
 
+/// Only meshes whose data has been fully copied to the gpu, drawing from this is always safe
 map: std.AutoHashMapUnmanaged(MeshHandle, MeshInfo) = .empty,
 
+/// Meshes whose uploads are still waiting on staging space, moved into map by publishUploaded
+pending_loads: std.ArrayList(PendingLoad) = .empty,
+
+/// Bumped whenever a loaded mesh is unloaded, anything caching buffer offsets from map needs to refresh
+generation: u32 = 0,
+
 //TODO: move back to monolithic buffer, once legacy vertex pipeline is not needed
 vertex_buffer: GpuBuffer(CpuMesh.Vertex),
 index_buffer: GpuBuffer(u32),
 primitive_buffer: GpuBuffer(CpuMesh.Primitive),
 
+// Only read through device addresses by the meshlet culling pass
+meshlet_buffer: GpuBuffer(CpuMesh.Meshlet),
+meshlet_vertex_buffer: GpuBuffer(u32),
+meshlet_triangle_buffer: GpuBuffer(u8),
+
 pub fn init(
     gpa: std.mem.Allocator,
     device: saturn.DeviceInterface,
@@ -214,6 +239,21 @@ pub fn init(
     var primitive_buffer = try GpuBuffer(CpuMesh.Primitive).init(device, "primitive_buffer", buffer_sizes.primitives, geometry_buffer_usage);
     errdefer primitive_buffer.deinit();
 
+    const meshlet_buffer_usage: saturn.BufferUsage = .{
+        .storage = true,
+        .transfer_dst = true,
+        .device_address = true,
+    };
+
+    var meshlet_buffer = try GpuBuffer(CpuMesh.Meshlet).init(device, "meshlet_buffer", buffer_sizes.meshlets, meshlet_buffer_usage);
+    errdefer meshlet_buffer.deinit();
+
+    var meshlet_vertex_buffer = try GpuBuffer(u32).init(device, "meshlet_vertex_buffer", buffer_sizes.meshlet_vertices, meshlet_buffer_usage);
+    errdefer meshlet_vertex_buffer.deinit();
+
+    var meshlet_triangle_buffer = try GpuBuffer(u8).init(device, "meshlet_triangle_buffer", buffer_sizes.meshlet_triangles, meshlet_buffer_usage);
+    errdefer meshlet_triangle_buffer.deinit();
+
     var info_buffer: GpuPool(MeshInfo.Gpu) = try .init(gpa, device, "mesh_info_buffer", max_mesh_count, .{ .storage = true, .transfer_dst = true, .device_address = true }, .{});
     errdefer info_buffer.deinit();
 
@@ -226,6 +266,10 @@ pub fn init(
         .vertex_buffer = vertex_buffer,
         .index_buffer = index_buffer,
         .primitive_buffer = primitive_buffer,
+
+        .meshlet_buffer = meshlet_buffer,
+        .meshlet_vertex_buffer = meshlet_vertex_buffer,
+        .meshlet_triangle_buffer = meshlet_triangle_buffer,
     };
 }
 
@@ -235,10 +279,17 @@ pub fn deinit(self: *Self) void {
         self.gpa.free(info.cpu_primitives);
     }
     self.map.deinit(self.gpa);
+    for (self.pending_loads.items) |pending| {
+        self.gpa.free(pending.info.cpu_primitives);
+    }
+    self.pending_loads.deinit(self.gpa);
     self.info_buffer.deinit();
     self.vertex_buffer.deinit();
     self.index_buffer.deinit();
     self.primitive_buffer.deinit();
+    self.meshlet_buffer.deinit();
+    self.meshlet_vertex_buffer.deinit();
+    self.meshlet_triangle_buffer.deinit();
 }
 
 pub fn create(self: *Self) error{OutOfMemory}!MeshHandle {
@@ -252,6 +303,9 @@ pub fn destroy(self: *Self, handle: MeshHandle) void {
 
 pub fn load(self: *Self, transfer_queue: *TransferQueue, handle: MeshHandle, mesh: *const CpuMesh) saturn.Error!void {
     std.debug.assert(!self.map.contains(handle));
+    std.debug.assert(self.findPendingLoad(handle) == null);
+
+    try self.pending_loads.ensureUnusedCapacity(self.gpa, 1);
 
     const cpu_primitives = try self.gpa.dupe(CpuMesh.Primitive, mesh.primitives);
     errdefer self.gpa.free(cpu_primitives);
@@ -263,7 +317,18 @@ pub fn load(self: *Self, transfer_queue: *TransferQueue, handle: MeshHandle, mes
     errdefer self.index_buffer.free(indices);
 
     const primitives = try self.primitive_buffer.alloc(mesh.primitives.len);
-    errdefer self.vertex_buffer.free(primitives);
+    errdefer self.primitive_buffer.free(primitives);
+
+    // Meshlets are optional, a mesh loaded without them is drawn without meshlet culling
+    const meshlets = try self.meshlet_buffer.alloc(mesh.meshlets.len);
+    errdefer self.meshlet_buffer.free(meshlets);
+
+    const meshlet_vertices = try self.meshlet_vertex_buffer.alloc(mesh.meshlet_vertices.len);
+    errdefer self.meshlet_vertex_buffer.free(meshlet_vertices);
+
+    // Triangles are read as packed u32 words, so each mesh's bytes start on a 4 byte boundary
+    const meshlet_triangles = try self.meshlet_triangle_buffer.alloc(std.mem.alignForward(usize, mesh.meshlet_triangles.len, 4));
+    errdefer self.meshlet_triangle_buffer.free(meshlet_triangles);
 
     const info: MeshInfo = .{
         .cpu_primitives = cpu_primitives,
@@ -271,25 +336,68 @@ pub fn load(self: *Self, transfer_queue: *TransferQueue, handle: MeshHandle, mes
         .vertices = vertices,
         .indices = indices,
         .primitives = primitives,
+        .meshlets = meshlets,
+        .meshlet_vertices = meshlet_vertices,
+        .meshlet_triangles = meshlet_triangles,
     };
-    errdefer self.info_buffer.stage(handle, .{});
 
     try transfer_queue.addBulkBufferUpload(&.{
         .{ .dst = self.vertex_buffer.buffer, .offset = info.vertices.offset * @sizeOf(CpuMesh.Vertex), .data = std.mem.sliceAsBytes(mesh.vertices) },
         .{ .dst = self.index_buffer.buffer, .offset = info.indices.offset * @sizeOf(u32), .data = std.mem.sliceAsBytes(mesh.indices) },
         .{ .dst = self.primitive_buffer.buffer, .offset = info.primitives.offset * @sizeOf(CpuMesh.Primitive), .data = std.mem.sliceAsBytes(mesh.primitives) },
+        .{ .dst = self.meshlet_buffer.buffer, .offset = info.meshlets.offset * @sizeOf(CpuMesh.Meshlet), .data = std.mem.sliceAsBytes(mesh.meshlets) },
+        .{ .dst = self.meshlet_vertex_buffer.buffer, .offset = info.meshlet_vertices.offset * @sizeOf(u32), .data = std.mem.sliceAsBytes(mesh.meshlet_vertices) },
+        .{ .dst = self.meshlet_triangle_buffer.buffer, .offset = info.meshlet_triangles.offset, .data = mesh.meshlet_triangles },
     });
 
-    try self.map.put(self.gpa, handle, info);
-    self.info_buffer.stage(handle, info.getGpu());
+    self.pending_loads.appendAssumeCapacity(.{
+        .handle = handle,
+        .info = info,
+        .upload = transfer_queue.lastUploadId(),
+    });
+}
+
+/// Makes meshes visible to draws once every byte of their data is copied in this frame's graph or earlier.
+/// Must run after this frame's loads and before the info buffer's transfers are added
+pub fn publishUploaded(self: *Self, transfer_queue: *const TransferQueue) error{OutOfMemory}!void {
+    var i: usize = 0;
+    while (i < self.pending_loads.items.len) {
+        const pending = self.pending_loads.items[i];
+        if (!transfer_queue.isUploaded(pending.upload)) {
+            i += 1;
+            continue;
+        }
+
+        try self.map.put(self.gpa, pending.handle, pending.info);
+        self.info_buffer.stage(pending.handle, pending.info.getGpu());
+        _ = self.pending_loads.swapRemove(i);
+    }
 }
 
 pub fn unload(self: *Self, handle: MeshHandle) void {
     if (self.map.fetchRemove(handle)) |entry| {
-        self.gpa.free(entry.value.cpu_primitives);
-        self.vertex_buffer.free(entry.value.vertices);
-        self.index_buffer.free(entry.value.indices);
-        self.primitive_buffer.free(entry.value.primitives);
+        self.freeInfo(entry.value);
         self.info_buffer.stage(handle, .{});
+        self.generation +%= 1;
+    } else if (self.findPendingLoad(handle)) |index| {
+        //Never published, so nothing on the gpu or in any scene refers to it yet
+        self.freeInfo(self.pending_loads.swapRemove(index).info);
     }
 }
+
+fn findPendingLoad(self: *const Self, handle: MeshHandle) ?usize {
+    for (self.pending_loads.items, 0..) |pending, i| {
+        if (pending.handle == handle) return i;
+    }
+    return null;
+}
+
+fn freeInfo(self: *Self, info: MeshInfo) void {
+    self.gpa.free(info.cpu_primitives);
+    self.vertex_buffer.free(info.vertices);
+    self.index_buffer.free(info.indices);
+    self.primitive_buffer.free(info.primitives);
+    self.meshlet_buffer.free(info.meshlets);
+    self.meshlet_vertex_buffer.free(info.meshlet_vertices);
+    self.meshlet_triangle_buffer.free(info.meshlet_triangles);
+}
@@ -0,0 +1,378 @@
+//CPU occlusion culling, a handful of occluder meshes are rasterized into a small depth buffer and candidate bounds are tested against it.
+//Rasterization splits the screen into rows of tiles across TaskPool workers and fills 8 pixels per step with @Vector.
+//Each tile keeps the farthest depth written to it, so a candidate is hidden if it is behind that depth in every tile it covers.
+
+const std = @import("std");
+
+const zm = @import("zmath");
+
+const culling = @import("culling.zig");
+const TaskPool = @import("../TaskPool.zig");
+const MeshAsset = @import("../asset/mesh.zig");
+
+pub const WIDTH = 256;
+pub const HEIGHT = 128;
+pub const TILE_SIZE = 8;
+pub const TILES_X = WIDTH / TILE_SIZE;
+pub const TILES_Y = HEIGHT / TILE_SIZE;
+
+/// Occluders stop being added once this many triangles are queued
+pub const MAX_TRIANGLES = 16 * 1024;
+
+const LANES = 8;
+const Vec8 = @Vector(LANES, f32);
+
+// Vertices closer than this in clip space w are treated as crossing the near plane
+const NEAR_W = 1e-4;
+
+/// Triangle set up for rasterization, edge functions and depth are planes over pixel coordinates
+const Triangle = struct {
+    edge_a: [3]f32,
+    edge_b: [3]f32,
+    edge_c: [3]f32,
+    depth_a: f32,
+    depth_b: f32,
+    depth_c: f32,
+    min_x: u32,
+    min_y: u32,
+    max_x: u32,
+    max_y: u32,
+};
+
+const Self = @This();
+
+gpa: std.mem.Allocator,
+
+/// Nearest occluder depth per pixel, 1.0 where nothing was drawn
+depth: []f32,
+
+/// Farthest depth per tile
+tile_max: []f32,
+
+triangles: std.ArrayList(Triangle),
+
+pub fn init(gpa: std.mem.Allocator) error{OutOfMemory}!Self {
+    const depth = try gpa.alloc(f32, WIDTH * HEIGHT);
+    errdefer gpa.free(depth);
+
+    const tile_max = try gpa.alloc(f32, TILES_X * TILES_Y);
+    errdefer gpa.free(tile_max);
+
+    var triangles: std.ArrayList(Triangle) = try .initCapacity(gpa, MAX_TRIANGLES);
+    errdefer triangles.deinit(gpa);
+
+    @memset(depth, 1.0);
+    @memset(tile_max, 1.0);
+
+    return .{
+        .gpa = gpa,
+        .depth = depth,
+        .tile_max = tile_max,
+        .triangles = triangles,
+    };
+}
+
+pub fn deinit(self: *Self) void {
+    self.gpa.free(self.depth);
+    self.gpa.free(self.tile_max);
+    self.triangles.deinit(self.gpa);
+}
+
+/// Drops all queued occluders
+pub fn clear(self: *Self) void {
+    self.triangles.clearRetainingCapacity();
+}
+
+pub fn triangleCount(self: *const Self) usize {
+    return self.triangles.items.len;
+}
+
+/// Queues an indexed triangle list, indices are relative to vertices and positions are transformed by model_view_projection.
+/// Triangles crossing the near plane are dropped, which only makes the occluder smaller.
+/// Returns false if the triangle budget ran out, the occluder may have been partially added.
+pub fn addOccluder(self: *Self, vertices: []const MeshAsset.Vertex, indices: []const u32, model_view_projection: zm.Mat) bool {
+    var i: usize = 0;
+    while (i + 3 <= indices.len) : (i += 3) {
+        if (self.triangles.items.len == self.triangles.capacity) {
+            return false;
+        }
+
+        var screen: [3]zm.Vec = undefined;
+        var behind_near = false;
+        for (&screen, indices[i..][0..3]) |*vertex, index| {
+            const position = vertices[index].position;
+            const clip = zm.mul(zm.f32x4(position[0], position[1], position[2], 1.0), model_view_projection);
+            if (clip[3] <= NEAR_W) {
+                behind_near = true;
+                break;
+            }
+            vertex.* = toScreen(clip);
+        }
+        if (behind_near) continue;
+
+        if (setupTriangle(screen)) |triangle| {
+            self.triangles.appendAssumeCapacity(triangle);
+        }
+    }
+    return true;
+}
+
+/// Clip space to pixel coordinates, z stays as ndc depth
+fn toScreen(clip: zm.Vec) zm.Vec {
+    const ndc = clip / zm.splat(zm.Vec, clip[3]);
+    return .{
+        (ndc[0] * 0.5 + 0.5) * WIDTH,
+        (ndc[1] * 0.5 + 0.5) * HEIGHT,
+        ndc[2],
+        1.0,
+    };
+}
+
+fn setupTriangle(screen_in: [3]zm.Vec) ?Triangle {
+    var v = screen_in;
+    var area = (v[1][0] - v[0][0]) * (v[2][1] - v[0][1]) - (v[2][0] - v[0][0]) * (v[1][1] - v[0][1]);
+    if (@abs(area) < 1e-6) return null;
+
+    // Occluders are drawn double sided, flip to a consistent winding so inside is always positive
+    if (area < 0.0) {
+        std.mem.swap(zm.Vec, &v[1], &v[2]);
+        area = -area;
+    }
+
+    const min_x = @min(@min(v[0][0], v[1][0]), v[2][0]);
+    const min_y = @min(@min(v[0][1], v[1][1]), v[2][1]);
+    const max_x = @max(@max(v[0][0], v[1][0]), v[2][0]);
+    const max_y = @max(@max(v[0][1], v[1][1]), v[2][1]);
+    if (max_x < 0.0 or max_y < 0.0 or min_x >= WIDTH or min_y >= HEIGHT) return null;
+
+    var triangle: Triangle = .{
+        .edge_a = undefined,
+        .edge_b = undefined,
+        .edge_c = undefined,
+        .depth_a = 0.0,
+        .depth_b = 0.0,
+        .depth_c = 0.0,
+        .min_x = @intFromFloat(@max(min_x, 0.0)),
+        .min_y = @intFromFloat(@max(min_y, 0.0)),
+        .max_x = @intFromFloat(@min(max_x, WIDTH - 1)),
+        .max_y = @intFromFloat(@min(max_y, HEIGHT - 1)),
+    };
+
+    // Edge i is opposite vertex i, E(p) = a * x + b * y + c is positive on the inside
+    for (0..3) |i| {
+        const from = v[(i + 1) % 3];
+        const to = v[(i + 2) % 3];
+        triangle.edge_a[i] = from[1] - to[1];
+        triangle.edge_b[i] = to[0] - from[0];
+        triangle.edge_c[i] = (to[1] - from[1]) * from[0] - (to[0] - from[0]) * from[1];
+
+        // The edge functions divided by area are the barycentric weights, so depth is a plane too
+        const weight = v[i][2] / area;
+        triangle.depth_a += triangle.edge_a[i] * weight;
+        triangle.depth_b += triangle.edge_b[i] * weight;
+        triangle.depth_c += triangle.edge_c[i] * weight;
+    }
+
+    return triangle;
+}
+
+/// Clears the depth buffer and rasterizes every queued occluder
+pub fn rasterize(self: *Self, task_pool: *TaskPool) void {
+    const RasterContext = struct {
+        buffer: *Self,
+
+        fn run(ctx: @This(), range: TaskPool.Range) void {
+            for (range.start..range.end) |tile_y| {
+                ctx.buffer.rasterizeTileRow(@intCast(tile_y));
+            }
+        }
+    };
+
+    task_pool.parallelFor(TILES_Y, .{ .min_grain_size = 1 }, RasterContext{ .buffer = self }, RasterContext.run);
+}
+
+fn rasterizeTileRow(self: *Self, tile_y: u32) void {
+    const row_start = tile_y * TILE_SIZE;
+    const row_end = row_start + TILE_SIZE;
+    @memset(self.depth[row_start * WIDTH .. row_end * WIDTH], 1.0);
+
+    const lane_offsets: Vec8 = std.simd.iota(f32, LANES) + @as(Vec8, @splat(0.5));
+    const zero: Vec8 = @splat(0.0);
+
+    for (self.triangles.items) |triangle| {
+        if (triangle.max_y < row_start or triangle.min_y >= row_end) continue;
+
+        const y_start = @max(triangle.min_y, row_start);
+        const y_end = @min(triangle.max_y + 1, row_end);
+        const x_start = triangle.min_x & ~@as(u32, LANES - 1);
+
+        for (y_start..y_end) |y| {
+            const pixel_y: f32 = @as(f32, @floatFromInt(y)) + 0.5;
+            const row = self.depth[y * WIDTH ..][0..WIDTH];
+
+            var x = x_start;
+            while (x <= triangle.max_x) : (x += LANES) {
+                const pixel_x = @as(Vec8, @splat(@floatFromInt(x))) + lane_offsets;
+
+                var inside_distance: Vec8 = @splat(std.math.inf(f32));
+                for (0..3) |i| {
+                    const edge = @as(Vec8, @splat(triangle.edge_a[i])) * pixel_x + @as(Vec8, @splat(triangle.edge_b[i] * pixel_y + triangle.edge_c[i]));
+                    inside_distance = @min(inside_distance, edge);
+                }
+
+                const depth = @as(Vec8, @splat(triangle.depth_a)) * pixel_x + @as(Vec8, @splat(triangle.depth_b * pixel_y + triangle.depth_c));
+                const current: Vec8 = row[x..][0..LANES].*;
+                row[x..][0..LANES].* = @select(f32, inside_distance >= zero, @min(current, depth), current);
+            }
+        }
+    }
+
+    for (0..TILES_X) |tile_x| {
+        var tile_max: Vec8 = @splat(0.0);
+        for (row_start..row_end) |y| {
+            const pixels: Vec8 = self.depth[y * WIDTH + tile_x * TILE_SIZE ..][0..LANES].*;
+            tile_max = @max(tile_max, pixels);
+        }
+        self.tile_max[tile_y * TILES_X + tile_x] = @reduce(.Max, tile_max);
+    }
+}
+
+/// Returns false only if the sphere is fully hidden behind rasterized occluders
+pub fn testSphere(self: *const Self, view_projection: zm.Mat, sphere: culling.Sphere) bool {
+    const center = sphere.pos_radius;
+    const radius = sphere.pos_radius[3];
+
+    // The nearest point of a box is always one of its corners, so the corners give a conservative depth and screen rect
+    var min_screen: zm.Vec = @splat(std.math.inf(f32));
+    var max_screen: zm.Vec = @splat(-std.math.inf(f32));
+    for (0..8) |corner| {
+        const offset: zm.Vec = .{
+            if (corner & 1 != 0) radius else -radius,
+            if (corner & 2 != 0) radius else -radius,
+            if (corner & 4 != 0) radius else -radius,
+            0.0,
+        };
+        const position = center + offset;
+        const clip = zm.mul(zm.f32x4(position[0], position[1], position[2], 1.0), view_projection);
+        if (clip[3] <= NEAR_W) {
+            return true;
+        }
+        const screen = toScreen(clip);
+        min_screen = @min(min_screen, screen);
+        max_screen = @max(max_screen, screen);
+    }
+
+    if (max_screen[0] < 0.0 or max_screen[1] < 0.0 or min_screen[0] >= WIDTH or min_screen[1] >= HEIGHT) {
+        return true;
+    }
+
+    const tile_x0: usize = @intFromFloat(@max(min_screen[0], 0.0) / TILE_SIZE);
+    const tile_y0: usize = @intFromFloat(@max(min_screen[1], 0.0) / TILE_SIZE);
+    const tile_x1: usize = @intFromFloat(@min(max_screen[0], WIDTH - 1) / TILE_SIZE);
+    const tile_y1: usize = @intFromFloat(@min(max_screen[1], HEIGHT - 1) / TILE_SIZE);
+
+    const nearest_depth = min_screen[2];
+    for (tile_y0..tile_y1 + 1) |tile_y| {
+        for (self.tile_max[tile_y * TILES_X ..][tile_x0 .. tile_x1 + 1]) |tile_depth| {
+            if (nearest_depth <= tile_depth) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/// Filters visible_indices in place across the pool, keeping the order.
+/// chunk_counts needs TaskPool.chunkCount(visible_indices.len, culling.parallel_options) entries.
+pub fn cullVisible(
+    self: *const Self,
+    task_pool: *TaskPool,
+    view_projection: zm.Mat,
+    spheres: culling.SphereSlices,
+    visible_indices: []u32,
+    chunk_counts: []u32,
+) []u32 {
+    if (self.triangles.items.len == 0) {
+        return visible_indices;
+    }
+
+    const OcclusionContext = struct {
+        buffer: *const Self,
+        view_projection: zm.Mat,
+        spheres: culling.SphereSlices,
+        visible_indices: []u32,
+        chunk_counts: []u32,
+
+        fn run(ctx: @This(), range: TaskPool.Range) void {
+            var count: usize = 0;
+            for (range.start..range.end) |i| {
+                const index = ctx.visible_indices[i];
+                if (ctx.buffer.testSphere(ctx.view_projection, ctx.spheres.get(index))) {
+                    ctx.visible_indices[range.start + count] = index;
+                    count += 1;
+                }
+            }
+            ctx.chunk_counts[range.chunk] = @intCast(count);
+        }
+    };
+
+    const chunk_count = task_pool.chunkCount(visible_indices.len, culling.parallel_options);
+    std.debug.assert(chunk_counts.len >= chunk_count);
+
+    task_pool.parallelFor(visible_indices.len, culling.parallel_options, OcclusionContext{
+        .buffer = self,
+        .view_projection = view_projection,
+        .spheres = spheres,
+        .visible_indices = visible_indices,
+        .chunk_counts = chunk_counts,
+    }, OcclusionContext.run);
+
+    const grain_size = task_pool.grainSize(visible_indices.len, culling.parallel_options);
+    var kept: usize = 0;
+    for (chunk_counts[0..chunk_count], 0..) |count, chunk| {
+        std.mem.copyForwards(u32, visible_indices[kept..], visible_indices[chunk * grain_size ..][0..count]);
+        kept += count;
+    }
+    return visible_indices[0..kept];
+}
+
+test "occlusion.full_screen_occluder" {
+    const gpa = std.testing.allocator;
+
+    var task_pool: TaskPool = undefined;
+    try task_pool.init(gpa, .{ .n_jobs = 2 });
+    defer task_pool.deinit();
+
+    var buffer: Self = try .init(gpa);
+    defer buffer.deinit();
+
+    // Already in clip space, a quad covering the whole screen at depth 0.5
+    var vertices: [4]MeshAsset.Vertex = @splat(std.mem.zeroes(MeshAsset.Vertex));
+    vertices[0].position = .{ -1.0, -1.0, 0.5 };
+    vertices[1].position = .{ 1.0, -1.0, 0.5 };
+    vertices[2].position = .{ 1.0, 1.0, 0.5 };
+    vertices[3].position = .{ -1.0, 1.0, 0.5 };
+    try std.testing.expect(buffer.addOccluder(&vertices, &.{ 0, 1, 2, 0, 2, 3 }, zm.identity()));
+    buffer.rasterize(&task_pool);
+
+    for (buffer.tile_max) |tile_depth| {
+        try std.testing.expectApproxEqAbs(0.5, tile_depth, 1e-5);
+    }
+
+    const behind: culling.Sphere = .{ .pos_radius = .{ 0.2, -0.1, 0.8, 0.05 } };
+    const in_front: culling.Sphere = .{ .pos_radius = .{ 0.2, -0.1, 0.2, 0.05 } };
+    try std.testing.expect(!buffer.testSphere(zm.identity(), behind));
+    try std.testing.expect(buffer.testSphere(zm.identity(), in_front));
+
+    var list: culling.SphereList = .empty;
+    defer list.deinit(gpa);
+    try list.append(gpa, .fromSphere(behind));
+    try list.append(gpa, .fromSphere(in_front));
+
+    var visible_indices = [_]u32{ 0, 1 };
+    var chunk_counts: [1]u32 = undefined;
+    try std.testing.expect(task_pool.chunkCount(visible_indices.len, culling.parallel_options) <= chunk_counts.len);
+
+    const visible = buffer.cullVisible(&task_pool, zm.identity(), .fromList(&list), &visible_indices, &chunk_counts);
+    try std.testing.expectEqualSlices(u32, &.{1}, visible);
+}
@@ -19,6 +19,10 @@ pub const StaticMeshInstance = struct {
         material: AssetPool.MaterialAssetHandle,
         alpha_mode: Material.AlphaMode,
         primitive_index: u32,
+
+        /// Index into the render bucket for alpha_mode, null while the primitive has no draw
+        draw_index: ?u32 = null,
+        local_sphere: zm.Vec = @splat(0.0),
     };
 
     visible: bool,
@@ -28,6 +32,12 @@ pub const StaticMeshInstance = struct {
     instance_index: u32,
 
     primitives: std.ArrayList(Primitive) = .empty,
+
+    /// Waiting in pending_instances for its draws to be (re)built
+    pending: bool = false,
+
+    /// Always rasterized into the cpu occlusion buffer when on screen, otherwise occluders are picked by size
+    occluder: bool = false,
 };
 
 pub const GpuInstance = extern struct {
@@ -52,6 +62,12 @@ pub const PrimitiveInstances = struct {
     alpha_mask_primitives: GpuPool(GpuPrimitiveInstance),
     alpha_blend_primitives: GpuPool(GpuPrimitiveInstance),
 
+    // One bit per primitive slot, written only by the gpu culling pass to remember what was visible last frame.
+    // Bits aren't cleared when a slot is reused, a stale bit only costs the new primitive one early draw.
+    // Alpha blend primitives are drawn in a single pass and have no visibility.
+    opaque_visibility: GpuPool(u32),
+    alpha_mask_visibility: GpuPool(u32),
+
     pub fn getPool(self: *PrimitiveInstances, alpha_mode: Material.AlphaMode) *GpuPool(GpuPrimitiveInstance) {
         return switch (alpha_mode) {
             .@"opaque" => &self.opaque_primitives,
@@ -69,61 +85,94 @@ asset_pool: *const AssetPool,
 
 static_mesh_instances: StaticMeshInstanceMap = .empty,
 
-// gpu_instances: GpuPool(GpuInstance),
-// primtive_instances: PrimitiveInstances,
+// Draws are retained between frames and only touched when an instance changes.
+// Structural changes are queued in pending_instances since instances are updated from TaskPool workers.
+render_buckets: RenderBuckets = .{},
+pending_mutex: std.Thread.Mutex = .{},
+pending_instances: std.ArrayList(StaticMeshInstanceHandle) = .empty,
+mesh_pool_generation: u32 = 0,
+
+// Gpu copies of the instances for the indirect path, only the entries that changed are uploaded each frame
+gpu_instances: GpuPool(GpuInstance),
+primitive_instances: PrimitiveInstances,
 
 pub fn init(gpa: std.mem.Allocator, device: saturn.DeviceInterface, asset_pool: *const AssetPool, instance_count: usize) saturn.Error!Self {
-    _ = device; // autofix
-    _ = instance_count; // autofix
-    // var gpu_instances: GpuPool(GpuInstance) = try .init(
-    //     gpa,
-    //     device,
-    //     "instance_data",
-    //     instance_count,
-    //     .{ .storage = true, .transfer_dst = true, .device_address = true },
-    //     .{},
-    // );
-    // errdefer gpu_instances.deinit();
-
-    // var opaque_primitives: GpuPool(GpuPrimitiveInstance) = try .init(
-    //     gpa,
-    //     device,
-    //     "opaque_primitives",
-    //     instance_count,
-    //     .{ .storage = true, .transfer_dst = true, .device_address = true },
-    //     .{},
-    // );
-    // errdefer opaque_primitives.deinit();
-
-    // var alpha_mask_primitives: GpuPool(GpuPrimitiveInstance) = try .init(
-    //     gpa,
-    //     device,
-    //     "alpha_mask_primitives",
-    //     instance_count,
-    //     .{ .storage = true, .transfer_dst = true, .device_address = true },
-    //     .{},
-    // );
-    // errdefer alpha_mask_primitives.deinit();
-
-    // var alpha_blend_primitives: GpuPool(GpuPrimitiveInstance) = try .init(
-    //     gpa,
-    //     device,
-    //     "alpha_blend_primitives",
-    //     instance_count,
-    //     .{ .storage = true, .transfer_dst = true, .device_address = true },
-    //     .{},
-    // );
-    // errdefer alpha_blend_primitives.deinit();
+    var gpu_instances: GpuPool(GpuInstance) = try .init(
+        gpa,
+        device,
+        "instance_data",
+        instance_count,
+        .{ .storage = true, .transfer_dst = true, .device_address = true },
+        .{},
+    );
+    errdefer gpu_instances.deinit();
+
+    var opaque_primitives: GpuPool(GpuPrimitiveInstance) = try .init(
+        gpa,
+        device,
+        "opaque_primitives",
+        instance_count,
+        .{ .storage = true, .transfer_dst = true, .device_address = true },
+        .{},
+    );
+    errdefer opaque_primitives.deinit();
+
+    var alpha_mask_primitives: GpuPool(GpuPrimitiveInstance) = try .init(
+        gpa,
+        device,
+        "alpha_mask_primitives",
+        instance_count,
+        .{ .storage = true, .transfer_dst = true, .device_address = true },
+        .{},
+    );
+    errdefer alpha_mask_primitives.deinit();
+
+    var alpha_blend_primitives: GpuPool(GpuPrimitiveInstance) = try .init(
+        gpa,
+        device,
+        "alpha_blend_primitives",
+        instance_count,
+        .{ .storage = true, .transfer_dst = true, .device_address = true },
+        .{},
+    );
+    errdefer alpha_blend_primitives.deinit();
+
+    const visibility_count = std.math.divCeil(usize, instance_count, 32) catch unreachable;
+
+    var opaque_visibility: GpuPool(u32) = try .init(
+        gpa,
+        device,
+        "opaque_visibility",
+        visibility_count,
+        .{ .storage = true, .transfer_dst = true, .device_address = true },
+        0,
+    );
+    errdefer opaque_visibility.deinit();
+    opaque_visibility.stageAll();
+
+    var alpha_mask_visibility: GpuPool(u32) = try .init(
+        gpa,
+        device,
+        "alpha_mask_visibility",
+        visibility_count,
+        .{ .storage = true, .transfer_dst = true, .device_address = true },
+        0,
+    );
+    errdefer alpha_mask_visibility.deinit();
+    alpha_mask_visibility.stageAll();
 
     return Self{
         .gpa = gpa,
         .asset_pool = asset_pool,
-        // .gpu_instances = gpu_instances,
-        // .primtive_instances = .{
-        //     .opaque_primitives = opaque_primitives,
-        //     .alpha_mask_primitives = alpha_mask_primitives,
-        //     .alpha_blend_primitives = alpha_blend_primitives,
-        // },
+        .mesh_pool_generation = asset_pool.mesh_pool.generation,
+        .gpu_instances = gpu_instances,
+        .primitive_instances = .{
+            .opaque_primitives = opaque_primitives,
+            .alpha_mask_primitives = alpha_mask_primitives,
+            .alpha_blend_primitives = alpha_blend_primitives,
+            .opaque_visibility = opaque_visibility,
+            .alpha_mask_visibility = alpha_mask_visibility,
+        },
     };
 }
 
@@ -133,20 +182,24 @@ pub fn deinit(self: *Self) void {
         instance.primitives.deinit(self.gpa);
     }
     self.static_mesh_instances.deinit(self.gpa);
-
-    // self.gpu_instances.deinit();
-    // self.primtive_instances.opaque_primitives.deinit();
-    // self.primtive_instances.alpha_mask_primitives.deinit();
-    // self.primtive_instances.alpha_blend_primitives.deinit();
+    self.render_buckets.deinit(self.gpa);
+    self.pending_instances.deinit(self.gpa);
+
+    self.gpu_instances.deinit();
+    self.primitive_instances.opaque_primitives.deinit();
+    self.primitive_instances.alpha_mask_primitives.deinit();
+    self.primitive_instances.alpha_blend_primitives.deinit();
+    self.primitive_instances.opaque_visibility.deinit();
+    self.primitive_instances.alpha_mask_visibility.deinit();
 }
 
 pub fn addTransfers(self: *Self, transfer_queue: *TransferQueue) !void {
-    _ = self; // autofix
-    _ = transfer_queue; // autofix
-    // try self.gpu_instances.addTransfers(transfer_queue);
-    // try self.primtive_instances.opaque_primitives.addTransfers(transfer_queue);
-    // try self.primtive_instances.alpha_mask_primitives.addTransfers(transfer_queue);
-    // try self.primtive_instances.alpha_blend_primitives.addTransfers(transfer_queue);
+    try self.gpu_instances.addTransfers(transfer_queue);
+    try self.primitive_instances.opaque_primitives.addTransfers(transfer_queue);
+    try self.primitive_instances.alpha_mask_primitives.addTransfers(transfer_queue);
+    try self.primitive_instances.alpha_blend_primitives.addTransfers(transfer_queue);
+    try self.primitive_instances.opaque_visibility.addTransfers(transfer_queue);
+    try self.primitive_instances.alpha_mask_visibility.addTransfers(transfer_queue);
 }
 
 pub fn createStaticMeshInstance(self: *Self, visible: bool, transform: Transform, mesh: AssetPool.MeshAssetHandle, materials: []const AssetPool.MaterialAssetHandle) error{OutOfMemory}!StaticMeshInstanceHandle {
@@ -154,9 +207,8 @@ pub fn createStaticMeshInstance(self: *Self, visible: bool, transform: Transform
     const cpu_mesh = mesh_asset.cpu.?; //IDK what to do if it isn't loaded yet
     std.debug.assert(cpu_mesh.primitives.len == materials.len);
 
-    // const instance_index = try self.gpu_instances.alloc();
-    // errdefer self.gpu_instances.free(instance_index);
-    const instance_index = 0;
+    const instance_index = try self.gpu_instances.alloc();
+    errdefer self.gpu_instances.free(instance_index);
 
     var static_mesh_instance: StaticMeshInstance = .{
         .visible = visible,
@@ -166,28 +218,24 @@ pub fn createStaticMeshInstance(self: *Self, visible: bool, transform: Transform
         .primitives = try .initCapacity(self.gpa, materials.len),
     };
     errdefer {
-        // for (static_mesh_instance.primitives.items) |primitive| {
-        //     self.primtive_instances.getPool(primitive.alpha_mode).free(primitive.primitive_index);
-        // }
+        for (static_mesh_instance.primitives.items) |primitive| {
+            self.primitive_instances.getPool(primitive.alpha_mode).free(primitive.primitive_index);
+        }
         static_mesh_instance.primitives.deinit(self.gpa);
     }
 
     for (materials, 0..) |material, i| {
-        _ = i; // autofix
         const material_asset = self.asset_pool.material_assets.get(material).?;
         const cpu_material = material_asset.cpu.?;
         const material_gpu = material_asset.gpu.?;
-        _ = material_gpu; // autofix
-
-        // const pool = self.primtive_instances.getPool(cpu_material.alpha_mode);
 
-        // const primitive_index = try pool.create(.{
-        //     .visible = 1,
-        //     .instance_index = instance_index,
-        //     .material_instance_index = material_gpu,
-        //     .primitive_index = @intCast(i),
-        // });
-        const primitive_index = 0;
+        const pool = self.primitive_instances.getPool(cpu_material.alpha_mode);
+        const primitive_index = try pool.create(.{
+            .visible = 1,
+            .instance_index = instance_index,
+            .material_instance_index = material_gpu,
+            .primitive_index = @intCast(i),
+        });
 
         static_mesh_instance.primitives.appendAssumeCapacity(.{
             .material = material,
@@ -196,7 +244,11 @@ pub fn createStaticMeshInstance(self: *Self, visible: bool, transform: Transform
         });
     }
 
+    // Every instance can be pending at most once, so updates never need to allocate
+    try self.pending_instances.ensureTotalCapacity(self.gpa, self.static_mesh_instances.slotCount() + 1);
+
     const handle = try self.static_mesh_instances.insert(self.gpa, static_mesh_instance);
+    self.markPending(handle, self.static_mesh_instances.getPtr(handle).?);
 
     self.updateStaticMeshGPU(handle);
 
@@ -204,104 +256,324 @@ pub fn createStaticMeshInstance(self: *Self, visible: bool, transform: Transform
 }
 
 pub fn destroyStaticMeshInstance(self: *Self, handle: StaticMeshInstanceHandle) void {
+    if (self.static_mesh_instances.getPtr(handle)) |static_mesh_instance| {
+        self.removeInstanceDraws(static_mesh_instance);
+
+        if (static_mesh_instance.pending) {
+            for (self.pending_instances.items, 0..) |pending_handle, i| {
+                if (std.meta.eql(pending_handle, handle)) {
+                    _ = self.pending_instances.swapRemove(i);
+                    break;
+                }
+            }
+        }
+    }
+
     if (self.static_mesh_instances.remove(handle)) |static_mesh_instance| {
-        self.gpa.free(static_mesh_instance.primitives.items);
+        var primitives = static_mesh_instance.primitives;
+        for (primitives.items) |primitive| {
+            self.primitive_instances.getPool(primitive.alpha_mode).free(primitive.primitive_index);
+        }
+        primitives.deinit(self.gpa);
+        self.gpu_instances.free(static_mesh_instance.instance_index);
     }
 }
 
+/// Safe to call from multiple threads as long as each thread updates different instances
 pub fn updateStaticMeshInstance(self: *Self, handle: StaticMeshInstanceHandle, visible: bool, transform: Transform) void {
     if (self.static_mesh_instances.getPtr(handle)) |static_mesh_instance| {
         if ((!static_mesh_instance.transform.eql(&transform)) or (static_mesh_instance.visible != visible)) {
+            const visible_changed = static_mesh_instance.visible != visible;
             static_mesh_instance.visible = visible;
             static_mesh_instance.transform = transform;
             self.updateStaticMeshGPU(handle);
+
+            if (static_mesh_instance.pending) {
+                return;
+            }
+
+            if (visible_changed) {
+                self.markPending(handle, static_mesh_instance);
+            } else {
+                self.patchInstanceDraws(static_mesh_instance);
+            }
         }
     }
 }
 
-fn updateStaticMeshGPU(self: *Self, handle: StaticMeshInstanceHandle) void {
-    _ = self; // autofix
-    _ = handle; // autofix
-    // const static_mesh_instance = self.static_mesh_instances.getPtr(handle).?;
-    // const model_matrix = static_mesh_instance.transform.getModelMatrix();
-    // const normal_matrix = static_mesh_instance.transform.getNormalMatrix();
-    // self.gpu_instances.stage(static_mesh_instance.instance_index, .{
-    //     .model_matrix = model_matrix,
-    //     .normal_matrix = normal_matrix,
-    //     .visible = @intFromBool(static_mesh_instance.visible),
-    //     .mesh_index = static_mesh_instance.mesh,
-    // });
+pub fn setOccluder(self: *Self, handle: StaticMeshInstanceHandle, occluder: bool) void {
+    if (self.static_mesh_instances.getPtr(handle)) |static_mesh_instance| {
+        static_mesh_instance.occluder = occluder;
+    }
 }
 
-//TODO: culling and depth sorting
-pub fn createBuckets(self: *const Self, gpa: std.mem.Allocator, asset_pool: *const AssetPool) error{OutOfMemory}!RenderBuckets {
-    var render_buckets: RenderBuckets = .{ .gpa = gpa };
-
-    var instance_iter = self.static_mesh_instances.iterator();
-    while (instance_iter.nextValue()) |instance| {
-        if (!instance.visible) continue;
-
-        //Is the mesh loaded on the gpu
-        const gpu_mesh = asset_pool.mesh_pool.map.get(instance.mesh) orelse continue;
-
-        const model_matrix = instance.transform.getModelMatrix();
-
-        for (gpu_mesh.cpu_primitives, instance.primitives.items) |cpu_primitive, scene_primitive| {
-            const material_asset = asset_pool.material_assets.get(scene_primitive.material) orelse continue;
-            const cpu_mat = material_asset.cpu orelse continue;
-            const gpu_mat = material_asset.gpu orelse continue;
-
-            try switch (cpu_mat.alpha_mode) {
-                .@"opaque" => render_buckets.opaque_instances,
-                .mask => render_buckets.alpha_mask_instances,
-                .blend => render_buckets.alpha_blend_instances,
-            }.append(gpa, .{
-                .culling_sphere = .initWorld(cpu_primitive.sphere_pos_radius, &instance.transform),
-                .draw_data = .{
-                    .index_count = cpu_primitive.index_count,
-                    .instance_count = 1,
-                    .first_index = @intCast(gpu_mesh.indices.offset + cpu_primitive.index_offset),
-                    .vertex_offset = @intCast(gpu_mesh.vertices.offset + cpu_primitive.vertex_offset),
-                    .first_instance = 0,
-                },
-                .model_matrix = model_matrix,
-                .material_index = gpu_mat,
-            });
+/// Applies queued instance changes to the render buckets, must be called from the main thread once meshes for the frame are loaded
+pub fn syncRenderBuckets(self: *Self) error{OutOfMemory}!void {
+    const mesh_pool_generation = self.asset_pool.mesh_pool.generation;
+    if (self.mesh_pool_generation != mesh_pool_generation) {
+        // A mesh was reloaded and its offsets moved, so every draw gets rebuilt
+        self.mesh_pool_generation = mesh_pool_generation;
+        self.render_buckets.clear();
+
+        var iter = self.static_mesh_instances.iterator();
+        while (iter.next()) |entry| {
+            for (entry.value_ptr.primitives.items) |*primitive| {
+                primitive.draw_index = null;
+            }
+            self.markPending(entry.handle, entry.value_ptr);
         }
     }
 
-    return render_buckets;
+    const pending = self.pending_instances.items;
+    var index: usize = 0;
+    var kept: usize = 0;
+    defer {
+        // On error the unprocessed instances stay queued for the next sync
+        std.mem.copyForwards(StaticMeshInstanceHandle, pending[kept..], pending[index..]);
+        self.pending_instances.shrinkRetainingCapacity(kept + pending.len - index);
+    }
+
+    while (index < pending.len) : (index += 1) {
+        const handle = pending[index];
+        const static_mesh_instance = self.static_mesh_instances.getPtr(handle) orelse continue;
+
+        self.removeInstanceDraws(static_mesh_instance);
+        if (try self.addInstanceDraws(handle, static_mesh_instance)) {
+            static_mesh_instance.pending = false;
+        } else {
+            // Mesh or materials aren't on the gpu yet
+            pending[kept] = handle;
+            kept += 1;
+        }
+    }
+
+    inline for (.{ &self.render_buckets.opaque_instances, &self.render_buckets.alpha_mask_instances, &self.render_buckets.alpha_blend_instances }) |bucket| {
+        try bucket.updateBvh(self.gpa);
+    }
+}
+
+pub fn getDrawLists(self: *const Self) DrawLists {
+    return .{
+        .opaque_instances = self.render_buckets.opaque_instances.getDrawList(),
+        .alpha_mask_instances = self.render_buckets.alpha_mask_instances.getDrawList(),
+        .alpha_blend_instances = self.render_buckets.alpha_blend_instances.getDrawList(),
+    };
+}
+
+fn markPending(self: *Self, handle: StaticMeshInstanceHandle, static_mesh_instance: *StaticMeshInstance) void {
+    if (static_mesh_instance.pending) {
+        return;
+    }
+    static_mesh_instance.pending = true;
+
+    self.pending_mutex.lock();
+    defer self.pending_mutex.unlock();
+    self.pending_instances.appendAssumeCapacity(handle);
+}
+
+/// Returns false if the mesh or one of the materials isn't loaded yet, the instance stays pending until both are
+fn addInstanceDraws(self: *Self, handle: StaticMeshInstanceHandle, static_mesh_instance: *StaticMeshInstance) error{OutOfMemory}!bool {
+    if (!static_mesh_instance.visible) return true;
+
+    //Is the mesh loaded on the gpu
+    const gpu_mesh = self.asset_pool.mesh_pool.map.get(static_mesh_instance.mesh) orelse return false;
+
+    //Are the materials loaded on the gpu, checked before any draw is added so the instance is never half drawn
+    for (static_mesh_instance.primitives.items) |scene_primitive| {
+        const material_asset = self.asset_pool.material_assets.get(scene_primitive.material) orelse continue;
+        if (material_asset.gpu == null) return false;
+    }
+
+    // Reserve up front so a failed append can't leave the instance half added
+    const primitive_count = static_mesh_instance.primitives.items.len;
+    try self.render_buckets.opaque_instances.ensureUnusedCapacity(self.gpa, primitive_count);
+    try self.render_buckets.alpha_mask_instances.ensureUnusedCapacity(self.gpa, primitive_count);
+    try self.render_buckets.alpha_blend_instances.ensureUnusedCapacity(self.gpa, primitive_count);
+
+    const model_matrix = static_mesh_instance.transform.getModelMatrix();
+    const normal_matrix = static_mesh_instance.transform.getNormalMatrix();
+
+    for (gpu_mesh.cpu_primitives, static_mesh_instance.primitives.items, 0..) |cpu_primitive, *scene_primitive, i| {
+        const material_asset = self.asset_pool.material_assets.get(scene_primitive.material) orelse continue;
+        const gpu_mat = material_asset.gpu.?;
+
+        scene_primitive.local_sphere = cpu_primitive.sphere_pos_radius;
+
+        const bucket = self.render_buckets.getBucket(scene_primitive.alpha_mode);
+        bucket.bvh_dirty = true;
+        scene_primitive.draw_index = @intCast(bucket.draws.items.len);
+        bucket.spheres.appendAssumeCapacity(.fromSphere(.initWorld(scene_primitive.local_sphere, &static_mesh_instance.transform)));
+        bucket.draws.appendAssumeCapacity(.{
+            .draw_data = .{
+                .index_count = cpu_primitive.index_count,
+                .instance_count = 1,
+                .first_index = @intCast(gpu_mesh.indices.offset + cpu_primitive.index_offset),
+                .vertex_offset = @intCast(gpu_mesh.vertices.offset + cpu_primitive.vertex_offset),
+                .first_instance = 0,
+            },
+            .model_matrix = model_matrix,
+            .normal_matrix = normal_matrix,
+            .material_index = gpu_mat,
+        });
+        bucket.owners.appendAssumeCapacity(.{ .instance = handle, .primitive = @intCast(i) });
+    }
+
+    return true;
+}
+
+fn removeInstanceDraws(self: *Self, static_mesh_instance: *StaticMeshInstance) void {
+    for (static_mesh_instance.primitives.items) |*primitive| {
+        const draw_index = primitive.draw_index orelse continue;
+        primitive.draw_index = null;
+
+        const bucket = self.render_buckets.getBucket(primitive.alpha_mode);
+        bucket.bvh_dirty = true;
+        _ = bucket.draws.swapRemove(draw_index);
+        bucket.spheres.swapRemove(draw_index);
+        _ = bucket.owners.swapRemove(draw_index);
+
+        // The last draw moved into the freed slot, point its owner at the new index
+        if (draw_index < bucket.owners.items.len) {
+            const moved = bucket.owners.items[draw_index];
+            self.static_mesh_instances.getPtr(moved.instance).?.primitives.items[moved.primitive].draw_index = draw_index;
+        }
+    }
+}
+
+fn patchInstanceDraws(self: *Self, static_mesh_instance: *const StaticMeshInstance) void {
+    const model_matrix = static_mesh_instance.transform.getModelMatrix();
+    const normal_matrix = static_mesh_instance.transform.getNormalMatrix();
+    for (static_mesh_instance.primitives.items) |primitive| {
+        const draw_index = primitive.draw_index orelse continue;
+        const bucket = self.render_buckets.getBucket(primitive.alpha_mode);
+        bucket.draws.items[draw_index].model_matrix = model_matrix;
+        bucket.draws.items[draw_index].normal_matrix = normal_matrix;
+        bucket.spheres.set(draw_index, .fromSphere(.initWorld(primitive.local_sphere, &static_mesh_instance.transform)));
+        bucket.bounds_moved.store(true, .monotonic);
+    }
+}
+
+/// Only touches the instance's own staging slot, so it is safe from the same threads as updateStaticMeshInstance
+fn updateStaticMeshGPU(self: *Self, handle: StaticMeshInstanceHandle) void {
+    const static_mesh_instance = self.static_mesh_instances.getPtr(handle).?;
+    self.gpu_instances.stage(static_mesh_instance.instance_index, .{
+        .model_matrix = static_mesh_instance.transform.getModelMatrix(),
+        .normal_matrix = static_mesh_instance.transform.getNormalMatrix(),
+        .visible = @intFromBool(static_mesh_instance.visible),
+        .mesh_index = static_mesh_instance.mesh,
+    });
 }
 
 const saturn = @import("../root.zig");
-const Sphere = @import("culling.zig").Sphere;
+const culling = @import("culling.zig");
+const Bvh = @import("bvh.zig");
 
 pub const InstanceDrawData = struct {
-    culling_sphere: Sphere,
     draw_data: saturn.IndirectDrawIndexedCommand,
     model_matrix: zm.Mat, //TODO: replace with an index into a buffer
+    normal_matrix: zm.Mat,
     material_index: u32,
 };
 
+pub const DrawOwner = struct {
+    instance: StaticMeshInstanceHandle,
+    primitive: u32,
+};
+
+pub const RenderBucket = struct {
+    draws: std.ArrayList(InstanceDrawData) = .empty,
+
+    /// World space culling spheres, parallel to draws and kept in SoA form for batch culling
+    spheres: culling.SphereList = .empty,
+
+    /// Parallel to draws, used to fix up indices after a swap remove
+    owners: std.ArrayList(DrawOwner) = .empty,
+
+    /// Built over spheres, rebuilt when draws are added or removed and refit when they only move
+    bvh: Bvh = .{},
+    bvh_dirty: bool = false,
+    bounds_moved: std.atomic.Value(bool) = .init(false),
+
+    fn ensureUnusedCapacity(self: *RenderBucket, gpa: std.mem.Allocator, count: usize) error{OutOfMemory}!void {
+        try self.draws.ensureUnusedCapacity(gpa, count);
+        try self.spheres.ensureUnusedCapacity(gpa, count);
+        try self.owners.ensureUnusedCapacity(gpa, count);
+    }
+
+    fn getDrawList(self: *const RenderBucket) DrawList {
+        return .{
+            .draws = self.draws.items,
+            .spheres = .fromList(&self.spheres),
+            .owners = self.owners.items,
+            .bvh = if (self.bvh_dirty) null else &self.bvh,
+        };
+    }
+
+    fn updateBvh(self: *RenderBucket, gpa: std.mem.Allocator) error{OutOfMemory}!void {
+        const bounds_moved = self.bounds_moved.swap(false, .monotonic);
+        if (self.bvh_dirty) {
+            try self.bvh.build(gpa, .fromList(&self.spheres));
+            self.bvh_dirty = false;
+        } else if (bounds_moved) {
+            self.bvh.refit(.fromList(&self.spheres));
+        }
+    }
+
+    fn deinit(self: *RenderBucket, gpa: std.mem.Allocator) void {
+        self.draws.deinit(gpa);
+        self.spheres.deinit(gpa);
+        self.owners.deinit(gpa);
+        self.bvh.deinit(gpa);
+    }
+};
+
 pub const RenderBuckets = struct {
-    gpa: std.mem.Allocator,
-    opaque_instances: std.ArrayList(InstanceDrawData) = .empty,
-    alpha_mask_instances: std.ArrayList(InstanceDrawData) = .empty,
-    alpha_blend_instances: std.ArrayList(InstanceDrawData) = .empty,
+    opaque_instances: RenderBucket = .{},
+    alpha_mask_instances: RenderBucket = .{},
+    alpha_blend_instances: RenderBucket = .{},
 
-    pub fn depthSort(self: *RenderBuckets, camera_pos: zm.Vec) void {
-        std.mem.sort(InstanceDrawData, self.alpha_blend_instances.items, camera_pos, compareInstances);
+    pub fn getBucket(self: *RenderBuckets, alpha_mode: Material.AlphaMode) *RenderBucket {
+        return switch (alpha_mode) {
+            .@"opaque" => &self.opaque_instances,
+            .mask => &self.alpha_mask_instances,
+            .blend => &self.alpha_blend_instances,
+        };
     }
 
-    pub fn deinit(self: RenderBuckets) void {
-        self.opaque_instances.deinit(self.gpa);
-        self.alpha_mask_instances.deinit(self.gpa);
-        self.alpha_mask_instances.deinit(self.gpa);
+    fn clear(self: *RenderBuckets) void {
+        inline for (.{ &self.opaque_instances, &self.alpha_mask_instances, &self.alpha_blend_instances }) |bucket| {
+            bucket.draws.clearRetainingCapacity();
+            bucket.spheres.clearRetainingCapacity();
+            bucket.owners.clearRetainingCapacity();
+            bucket.bvh_dirty = true;
+        }
+    }
+
+    fn deinit(self: *RenderBuckets, gpa: std.mem.Allocator) void {
+        self.opaque_instances.deinit(gpa);
+        self.alpha_mask_instances.deinit(gpa);
+        self.alpha_blend_instances.deinit(gpa);
     }
 };
 
-fn compareInstances(camera_pos: zm.Vec, a: InstanceDrawData, b: InstanceDrawData) bool {
-    const a_dis = zm.length3(camera_pos - a.model_matrix[3]);
-    const b_dis = zm.length3(camera_pos - b.model_matrix[3]);
-    return a_dis[0] > b_dis[0];
-}
+pub const DrawList = struct {
+    draws: []const InstanceDrawData,
+    spheres: culling.SphereSlices,
+    owners: []const DrawOwner,
+    /// Null if the bvh couldn't be rebuilt after the last change
+    bvh: ?*const Bvh,
+
+    pub const empty: DrawList = .{
+        .draws = &.{},
+        .spheres = .{ .x = &.{}, .y = &.{}, .z = &.{}, .r = &.{} },
+        .owners = &.{},
+        .bvh = null,
+    };
+};
+
+/// Read only view of the retained buckets, valid until the next scene update
+pub const DrawLists = struct {
+    opaque_instances: DrawList,
+    alpha_mask_instances: DrawList,
+    alpha_blend_instances: DrawList,
+};
@@ -3,12 +3,18 @@ const std = @import("std");
 const zm = @import("zmath");
 
 const saturn = @import("../root.zig");
+const TaskPool = @import("../TaskPool.zig");
 const Transform = @import("../transform.zig");
 
 const Scene = @import("scene.zig");
 const AssetPool = @import("asset_pool.zig");
 const Material = @import("material.zig");
 const culling = @import("culling.zig");
+const OcclusionBuffer = @import("occlusion.zig");
+const DepthPyramid = @import("depth_pyramid.zig");
+const draw_sort = @import("draw_sort.zig");
+const FrameRingBuffer = @import("frame_ring_buffer.zig").FrameRingBuffer;
+const GpuPool = @import("gpu_pool.zig").GpuPool;
 const utils = @import("utils.zig");
 
 const AssetRegistry = @import("../asset/registry.zig");
@@ -25,43 +31,107 @@ pub const RenderTargetState = struct {
     depth_target: ?saturn.TextureFormat = null,
 };
 
+/// Cull the indirect path against last frame's visible primitives, otherwise only the frustum is tested.
+/// Off until the two phase path has been checked on lavapipe, see the README
+const GPU_OCCLUSION_CULLING_ENABLED: bool = false;
+
+/// Split drawn primitives into meshlets on the gpu and cull those too, draws then read a compacted index buffer
+const GPU_MESHLET_CULLING_ENABLED: bool = true;
+
+/// Which scene pass draws the frame, switchable at runtime
+pub const RenderPath = enum {
+    /// Culled, sorted and instanced on the cpu
+    legacy,
+    /// Culled and compacted on the gpu, drawn with drawIndexedIndirectCount
+    indirect,
+};
+
 const Self = @This();
 
 gpa: std.mem.Allocator,
 device: saturn.DeviceInterface,
 registry: *const AssetRegistry,
+task_pool: *TaskPool,
 
 depth_format: ?saturn.TextureFormat,
 
+render_path: RenderPath = .legacy,
+
 legacy: LegacyScenePass,
+indirect: IndirectScenePass,
+depth_pyramid: DepthPyramid,
+depth_sampler: saturn.SamplerHandle,
+occlusion: OcclusionBuffer,
+instance_buffer: FrameRingBuffer(LegacyScenePass.Instance),
+view_buffer: FrameRingBuffer(LegacyScenePass.View),
 
-pub fn init(gpa: std.mem.Allocator, device: saturn.DeviceInterface, registry: *const AssetRegistry, formats: RenderTargetState) !Self {
+pub fn init(gpa: std.mem.Allocator, device: saturn.DeviceInterface, registry: *const AssetRegistry, task_pool: *TaskPool, formats: RenderTargetState) !Self {
     const legacy: LegacyScenePass = try .init(gpa, device, registry, formats);
     errdefer legacy.deinit(device);
 
+    const indirect: IndirectScenePass = try .init(gpa, device, registry, formats);
+    errdefer indirect.deinit(device);
+
+    const depth_pyramid: DepthPyramid = try .init(gpa, device, registry);
+    errdefer depth_pyramid.deinit(device);
+
+    const depth_sampler = try device.createSampler(.{
+        .name = "Depth Sampler",
+        .mag_filter = .nearest,
+        .min_filter = .nearest,
+        .mipmap_mode = .nearest,
+        .address_mode_u = .clamp_to_edge,
+        .address_mode_v = .clamp_to_edge,
+        .address_mode_w = .clamp_to_edge,
+    });
+    errdefer device.destroySampler(depth_sampler);
+
+    var occlusion: OcclusionBuffer = try .init(gpa);
+    errdefer occlusion.deinit();
+
+    var instance_buffer: FrameRingBuffer(LegacyScenePass.Instance) = try .init(gpa, device, "Legacy Instance Buffer", .{ .storage = true });
+    errdefer instance_buffer.deinit();
+
+    var view_buffer: FrameRingBuffer(LegacyScenePass.View) = try .init(gpa, device, "Legacy View Buffer", .{ .uniform = true });
+    errdefer view_buffer.deinit();
+
     return .{
         .gpa = gpa,
         .device = device,
         .registry = registry,
+        .task_pool = task_pool,
 
         .depth_format = formats.depth_target,
         .legacy = legacy,
+        .indirect = indirect,
+        .depth_pyramid = depth_pyramid,
+        .depth_sampler = depth_sampler,
+        .occlusion = occlusion,
+        .instance_buffer = instance_buffer,
+        .view_buffer = view_buffer,
     };
 }
 
 pub fn deinit(self: *Self) void {
     self.legacy.deinit(self.device);
+    self.indirect.deinit(self.device);
+    self.depth_pyramid.deinit(self.device);
+    self.device.destroySampler(self.depth_sampler);
+    self.occlusion.deinit();
+    self.instance_buffer.deinit();
+    self.view_buffer.deinit();
 }
 
-pub fn rebuild(self: *Self, formats: RenderTargetState) saturn.Error!void {
+pub fn rebuild(self: *Self, formats: RenderTargetState) !void {
     self.legacy.deinit(self.device);
     self.legacy = try LegacyScenePass.init(self.gpa, self.device, self.registry, formats);
-    try self.indirect.rebuild(formats);
+
+    self.indirect.deinit(self.device);
+    self.indirect = try IndirectScenePass.init(self.gpa, self.device, self.registry, formats);
 }
 
 pub fn addPasses(
     self: *Self,
-    tpa: std.mem.Allocator,
     target: saturn.RGTextureHandle,
     render_graph: *saturn.RenderGraph,
     scene: *const Scene,
@@ -73,48 +143,422 @@ pub fn addPasses(
         .format = self.depth_format.?,
         .usage = .{
             .attachment = true,
+            .sampled = true,
         },
         .memory = .gpu_only,
+        .sampler = self.depth_sampler,
     });
 
-    var render_buckets = try scene.createBuckets(tpa, asset_pool);
-    render_buckets.depthSort(camera.transform.position);
+    switch (self.render_path) {
+        .legacy => try self.addLegacyPass("Legacy Scene Pass", target, depth_texture, true, render_graph, scene, camera, asset_pool, scene.getDrawLists()),
+        .indirect => try self.addIndirectPasses(target, depth_texture, render_graph, scene, camera, asset_pool),
+    }
+}
+
+/// Draws render_buckets culled and sorted on the cpu, clear is false when drawing on top of an earlier pass
+fn addLegacyPass(
+    self: *Self,
+    name: []const u8,
+    target: saturn.RGTextureHandle,
+    depth_texture: saturn.RGTextureHandle,
+    clear: bool,
+    render_graph: *saturn.RenderGraph,
+    scene: *const Scene,
+    camera: *const Camera,
+    asset_pool: *const AssetPool,
+    render_buckets: Scene.DrawLists,
+) saturn.Error!void {
+    // Sized for every draw being visible, culling only ever shrinks it
+    const draw_count = render_buckets.opaque_instances.draws.len + render_buckets.alpha_mask_instances.draws.len + render_buckets.alpha_blend_instances.draws.len;
+    const instances = try self.instance_buffer.next(draw_count);
+    const view = try self.view_buffer.next(1);
 
     const legacy_pass_data = try render_graph.alloc(LegacyPassData, 1);
     legacy_pass_data[0] = .{
         .legacy_pass = &self.legacy,
+        .occlusion = &self.occlusion,
+        .task_pool = self.task_pool,
         .scene = scene,
         .camera = camera,
         .asset_pool = asset_pool,
         .render_buckets = render_buckets,
+        .visibility = .{
+            .opaque_instances = try self.allocCullBuffers(render_graph, render_buckets.opaque_instances.draws.len),
+            .alpha_mask_instances = try self.allocCullBuffers(render_graph, render_buckets.alpha_mask_instances.draws.len),
+            .alpha_blend_instances = try self.allocCullBuffers(render_graph, render_buckets.alpha_blend_instances.draws.len),
+        },
+        .instances = instances,
+        .view = view,
+        .sort_buffers = try allocSortBuffers(render_graph, @max(
+            render_buckets.opaque_instances.draws.len,
+            render_buckets.alpha_mask_instances.draws.len,
+            render_buckets.alpha_blend_instances.draws.len,
+        )),
+        .draws = try render_graph.alloc(LegacyScenePass.Draw, draw_count),
     };
 
-    _ = try render_graph.addGraphicsPass(
-        "Legacy Scene Pass",
+    const pass = try render_graph.addChunkedGraphicsPass(
+        name,
         .{
             .color_attachments = &.{
-                .{ .texture = target, .clear = .{ 0.0, 0.0, 0.0, 1.0 } },
+                .{ .texture = target, .clear = if (clear) .{ 0.0, 0.0, 0.0, 1.0 } else null },
             },
-            .depth_attachment = .{ .texture = depth_texture, .clear = 1.0 },
+            .depth_attachment = .{ .texture = depth_texture, .clear = if (clear) 1.0 else null },
         },
         legacy_pass_data.ptr,
-        legacyGraphicsCallback,
+        legacyPrepareCallback,
+        legacyChunkCallback,
     );
+    try render_graph.addBufferUsage(pass, try render_graph.importBuffer(instances.buffer), .graphics_storage_read);
+    try render_graph.addBufferUsage(pass, try render_graph.importBuffer(view.buffer), .graphics_uniform_read);
 }
 
+fn allocCullBuffers(self: *const Self, render_graph: *saturn.RenderGraph, draw_count: usize) saturn.Error!culling.ParallelCullBuffers {
+    return .{
+        .indices = try render_graph.alloc(u32, draw_count),
+        .chunk_counts = try render_graph.alloc(u32, self.task_pool.chunkCount(draw_count, culling.parallel_options)),
+    };
+}
+
+/// Buckets are sorted one after another, so they share one set of buffers sized for the largest
+fn allocSortBuffers(render_graph: *saturn.RenderGraph, draw_count: usize) saturn.Error!draw_sort.SortBuffers {
+    return .{
+        .keys = try render_graph.alloc(u64, draw_count),
+        .scratch_keys = try render_graph.alloc(u64, draw_count),
+        .scratch_indices = try render_graph.alloc(u32, draw_count),
+    };
+}
+
+/// Space for each bucket's visible draw indices, filled in on the task pool before any draws are recorded
+const BucketVisibility = struct {
+    opaque_instances: culling.ParallelCullBuffers,
+    alpha_mask_instances: culling.ParallelCullBuffers,
+    alpha_blend_instances: culling.ParallelCullBuffers,
+};
+
 const LegacyPassData = struct {
     legacy_pass: *const LegacyScenePass,
+    occlusion: *OcclusionBuffer,
+    task_pool: *TaskPool,
     scene: *const Scene,
     camera: *const Camera,
     asset_pool: *const AssetPool,
-    render_buckets: Scene.RenderBuckets,
+    render_buckets: Scene.DrawLists,
+    visibility: BucketVisibility,
+    sort_buffers: draw_sort.SortBuffers,
+    instances: FrameRingBuffer(LegacyScenePass.Instance).Slot,
+    view: FrameRingBuffer(LegacyScenePass.View).Slot,
+    /// Space for every merged draw, filled by the prepare callback and split into chunks for recording
+    draws: []LegacyScenePass.Draw,
+    prepared: LegacyScenePass.Prepared = .{},
 };
 
-fn legacyGraphicsCallback(ctx: ?*anyopaque, cmd: saturn.GraphicsCommandEncoder, target_resolution: [2]u32) void {
+fn legacyPrepareCallback(ctx: ?*anyopaque, target_resolution: [2]u32) u32 {
     const data: *LegacyPassData = @ptrCast(@alignCast(ctx.?));
-    data.legacy_pass.render(cmd, data.render_buckets, data.camera, data.asset_pool, target_resolution);
+    data.prepared = data.legacy_pass.prepare(data.task_pool, data.occlusion, data.scene, data.render_buckets, data.visibility, data.sort_buffers, data.instances, data.view, data.draws, data.camera, data.asset_pool, target_resolution);
+    return LegacyScenePass.chunkCount(data.prepared.draws.len);
+}
+
+fn legacyChunkCallback(ctx: ?*anyopaque, chunk_index: u32, cmd: saturn.GraphicsCommandEncoder, target_resolution: [2]u32) void {
+    _ = target_resolution; // autofix
+    const data: *const LegacyPassData = @ptrCast(@alignCast(ctx.?));
+    LegacyScenePass.recordChunk(cmd, data.prepared, data.asset_pool, chunk_index);
+}
+
+fn addIndirectPasses(
+    self: *Self,
+    target: saturn.RGTextureHandle,
+    depth_texture: saturn.RGTextureHandle,
+    render_graph: *saturn.RenderGraph,
+    scene: *const Scene,
+    camera: *const Camera,
+    asset_pool: *const AssetPool,
+) saturn.Error!void {
+    // Alpha blend has to be drawn back to front, so it is left to the cpu sorted legacy pass after both phases
+    const primitive_pools = [_]?*const GpuPool(Scene.GpuPrimitiveInstance){
+        &scene.primitive_instances.opaque_primitives,
+        &scene.primitive_instances.alpha_mask_primitives,
+        null,
+    };
+    const visibility_pools = [_]?*const GpuPool(u32){
+        &scene.primitive_instances.opaque_visibility,
+        &scene.primitive_instances.alpha_mask_visibility,
+        null,
+    };
+    const material_bindings = [_]u32{
+        asset_pool.material_pool.opaque_material.instance_data.storage_binding.?,
+        asset_pool.material_pool.alpha_mask_material.instance_data.storage_binding.?,
+        asset_pool.material_pool.alpha_blend_material.instance_data.storage_binding.?,
+    };
+
+    // Every primitive slot gets room for a command, so the build pass never has to bounds check its appends.
+    // Each bucket's slice starts on a BUFFER_ALIGNMENT boundary since the shaders assume aligned buffer references.
+    var buckets: [primitive_pools.len]IndirectBucket = undefined;
+    var command_bytes: usize = 0;
+    for (&buckets, primitive_pools, visibility_pools, material_bindings, 0..) |*bucket, pool_opt, visibility_pool, material_binding, i| {
+        const primitive_count: u32 = if (pool_opt) |pool| @intCast(pool.element_count) else 0;
+        const bucket_command_bytes = std.mem.alignForward(usize, primitive_count * IndirectScenePass.COMMAND_STRIDE, IndirectScenePass.BUFFER_ALIGNMENT);
+        bucket.* = .{
+            .material_binding = material_binding,
+            .primitive_address = if (pool_opt) |pool| pool.device_address.? else 0,
+            .primitive_count = primitive_count,
+            .visibility_address = if (visibility_pool) |visibility| visibility.device_address.? else null,
+            .count_offset = i * IndirectScenePass.BUFFER_ALIGNMENT,
+            .command_offset = command_bytes,
+            .whole_count_offset = (buckets.len + 1 + i) * IndirectScenePass.BUFFER_ALIGNMENT,
+            .whole_command_offset = command_bytes + bucket_command_bytes,
+        };
+        command_bytes += bucket_command_bytes * @as(usize, if (GPU_MESHLET_CULLING_ENABLED) 2 else 1);
+    }
+    // Bucket counts, the meshlet culling state, then the counts of whole primitive draws
+    const count_bytes = (buckets.len * 2 + 1) * IndirectScenePass.BUFFER_ALIGNMENT;
+
+    // The early and late phases each get their own counts and commands, the meshlet index allocator comes last
+    const count_buffer = try render_graph.createTransientBuffer(.{
+        .size = count_bytes * IndirectScenePass.PHASE_COUNT + IndirectScenePass.BUFFER_ALIGNMENT,
+        .usage = .{ .storage = true, .indirect = true, .transfer_dst = true, .device_address = true },
+        .memory = .gpu_only,
+    });
+    const command_buffer = try render_graph.createTransientBuffer(.{
+        .size = command_bytes * IndirectScenePass.PHASE_COUNT,
+        .usage = .{ .storage = true, .indirect = true, .device_address = true },
+        .memory = .gpu_only,
+    });
+
+    const meshlet_task_bytes = IndirectScenePass.MESHLET_TASK_CAPACITY * IndirectScenePass.MESHLET_TASK_STRIDE;
+    var meshlet_task_buffer: ?saturn.RGBufferHandle = null;
+    var meshlet_index_buffer: ?saturn.RGBufferHandle = null;
+    if (GPU_MESHLET_CULLING_ENABLED) {
+        meshlet_task_buffer = try render_graph.createTransientBuffer(.{
+            .size = meshlet_task_bytes * IndirectScenePass.PHASE_COUNT,
+            .usage = .{ .storage = true, .device_address = true },
+            .memory = .gpu_only,
+        });
+        meshlet_index_buffer = try render_graph.createTransientBuffer(.{
+            .size = IndirectScenePass.MESHLET_INDEX_CAPACITY * @sizeOf(u32),
+            .usage = .{ .storage = true, .index = true, .device_address = true },
+            .memory = .gpu_only,
+        });
+    }
+
+    const pass_data = try render_graph.dupe(IndirectPassData, .{
+        .indirect_pass = &self.indirect,
+        .camera = camera,
+        .target = target,
+        .count_buffer = count_buffer,
+        .command_buffer = command_buffer,
+        .depth_pyramid = null,
+        .meshlet_task_buffer = meshlet_task_buffer,
+        .meshlet_index_buffer = meshlet_index_buffer,
+        .count_phase_stride = count_bytes,
+        .command_phase_stride = command_bytes,
+        .meshlet_task_phase_stride = meshlet_task_bytes,
+        .instance_address = scene.gpu_instances.device_address.?,
+        .mesh_info_address = asset_pool.mesh_pool.info_buffer.device_address.?,
+        .vertex_buffer = asset_pool.mesh_pool.vertex_buffer.buffer,
+        .index_buffer = asset_pool.mesh_pool.index_buffer.buffer,
+        .texture_binding = asset_pool.texture_pool.info_buffer.storage_binding.?,
+        .buckets = buckets,
+    });
+
+    try ClearBufferPass.addPass(render_graph, count_buffer, 0);
+
+    // Early phase draws what was visible last frame, that depth is reduced into a pyramid the late phase culls the rest against
+    inline for (.{ IndirectScenePass.Phase.early, IndirectScenePass.Phase.late }) |phase| {
+        if (phase == .late and GPU_OCCLUSION_CULLING_ENABLED) {
+            pass_data.depth_pyramid = try self.depth_pyramid.addPasses(render_graph, depth_texture);
+        }
+
+        const phase_data = try render_graph.dupe(IndirectPhaseData, .{ .data = pass_data, .phase = phase });
+
+        const build_pass = try render_graph.addComputePass(if (phase == .early) "Indirect Early Build Pass" else "Indirect Late Build Pass", phase_data, indirectBuildCallback);
+        render_graph.setPassQueue(build_pass, .prefer_async_compute);
+        try render_graph.addBufferUsage(build_pass, count_buffer, .compute_storage_write);
+        try render_graph.addBufferUsage(build_pass, command_buffer, .compute_storage_write);
+        try render_graph.addBufferUsage(build_pass, try render_graph.importBuffer(scene.gpu_instances.buffer), .compute_storage_read);
+        for (primitive_pools) |pool_opt| {
+            const pool = pool_opt orelse continue;
+            try render_graph.addBufferUsage(build_pass, try render_graph.importBuffer(pool.buffer), .compute_storage_read);
+        }
+        for (visibility_pools) |visibility_pool| {
+            const pool = visibility_pool orelse continue;
+            try render_graph.addBufferUsage(build_pass, try render_graph.importBuffer(pool.buffer), if (phase == .early) .compute_storage_read else .compute_storage_write);
+        }
+        if (pass_data.depth_pyramid) |depth_pyramid| {
+            try render_graph.addBufferUsage(build_pass, depth_pyramid, .compute_storage_read);
+        }
+        if (meshlet_task_buffer) |task_buffer| {
+            try render_graph.addBufferUsage(build_pass, task_buffer, .compute_storage_write);
+        }
+        try render_graph.addBufferUsage(build_pass, try render_graph.importBuffer(asset_pool.mesh_pool.info_buffer.buffer), .compute_storage_read);
+        try render_graph.addBufferUsage(build_pass, try render_graph.importBuffer(asset_pool.mesh_pool.primitive_buffer.buffer), .compute_storage_read);
+
+        if (GPU_MESHLET_CULLING_ENABLED) {
+            const meshlet_pass = try render_graph.addComputePass(if (phase == .early) "Indirect Early Meshlet Cull Pass" else "Indirect Late Meshlet Cull Pass", phase_data, indirectMeshletCullCallback);
+            render_graph.setPassQueue(meshlet_pass, .prefer_async_compute);
+            try render_graph.addBufferUsage(meshlet_pass, count_buffer, .indirect_storage_read);
+            try render_graph.addBufferUsage(meshlet_pass, command_buffer, .compute_storage_write);
+            try render_graph.addBufferUsage(meshlet_pass, meshlet_task_buffer.?, .compute_storage_read);
+            try render_graph.addBufferUsage(meshlet_pass, meshlet_index_buffer.?, .compute_storage_write);
+            try render_graph.addBufferUsage(meshlet_pass, try render_graph.importBuffer(scene.gpu_instances.buffer), .compute_storage_read);
+            if (pass_data.depth_pyramid) |depth_pyramid| {
+                try render_graph.addBufferUsage(meshlet_pass, depth_pyramid, .compute_storage_read);
+            }
+            try render_graph.addBufferUsage(meshlet_pass, try render_graph.importBuffer(asset_pool.mesh_pool.info_buffer.buffer), .compute_storage_read);
+            try render_graph.addBufferUsage(meshlet_pass, try render_graph.importBuffer(asset_pool.mesh_pool.meshlet_buffer.buffer), .compute_storage_read);
+            try render_graph.addBufferUsage(meshlet_pass, try render_graph.importBuffer(asset_pool.mesh_pool.meshlet_vertex_buffer.buffer), .compute_storage_read);
+            try render_graph.addBufferUsage(meshlet_pass, try render_graph.importBuffer(asset_pool.mesh_pool.meshlet_triangle_buffer.buffer), .compute_storage_read);
+        }
+
+        // The late phase draws on top of the early one
+        const draw_pass = try render_graph.addGraphicsPass(
+            if (phase == .early) "Indirect Early Scene Pass" else "Indirect Late Scene Pass",
+            .{
+                .color_attachments = &.{
+                    .{ .texture = target, .clear = if (phase == .early) .{ 0.0, 0.0, 0.0, 1.0 } else null },
+                },
+                .depth_attachment = .{ .texture = depth_texture, .clear = if (phase == .early) 1.0 else null },
+            },
+            phase_data,
+            indirectGraphicsCallback,
+        );
+        try render_graph.addBufferUsage(draw_pass, count_buffer, .indirect_read);
+        try render_graph.addBufferUsage(draw_pass, command_buffer, .indirect_storage_read);
+        try render_graph.addBufferUsage(draw_pass, try render_graph.importBuffer(scene.gpu_instances.buffer), .graphics_storage_read);
+        if (meshlet_index_buffer) |index_buffer| {
+            try render_graph.addBufferUsage(draw_pass, index_buffer, .index_read);
+        }
+    }
+
+    // Blended on top of the depth both phases wrote
+    const render_buckets = scene.getDrawLists();
+    try self.addLegacyPass("Indirect Alpha Blend Pass", target, depth_texture, false, render_graph, scene, camera, asset_pool, .{
+        .opaque_instances = .empty,
+        .alpha_mask_instances = .empty,
+        .alpha_blend_instances = render_buckets.alpha_blend_instances,
+    });
+}
+
+/// One render bucket's slice of the shared count and command buffers, offsets are within the early phase's part
+const IndirectBucket = struct {
+    material_binding: u32,
+    primitive_address: u64,
+    primitive_count: u32,
+    /// Null for buckets drawn once in the late phase without tracking visibility
+    visibility_address: ?u64,
+    count_offset: u64,
+    command_offset: u64,
+    /// Primitives drawn from the mesh index buffer while meshlet culling is enabled, either without meshlets or past the compacted buffer's capacity
+    whole_count_offset: u64,
+    whole_command_offset: u64,
+};
+
+const IndirectPassData = struct {
+    indirect_pass: *const IndirectScenePass,
+    camera: *const Camera,
+    target: saturn.RGTextureHandle,
+    count_buffer: saturn.RGBufferHandle,
+    command_buffer: saturn.RGBufferHandle,
+    /// Only set for the late phase when occlusion culling is enabled
+    depth_pyramid: ?saturn.RGBufferHandle,
+    /// Both only set when meshlet culling is enabled
+    meshlet_task_buffer: ?saturn.RGBufferHandle,
+    meshlet_index_buffer: ?saturn.RGBufferHandle,
+    count_phase_stride: u64,
+    command_phase_stride: u64,
+    meshlet_task_phase_stride: u64,
+    instance_address: u64,
+    mesh_info_address: u64,
+    vertex_buffer: saturn.BufferHandle,
+    index_buffer: saturn.BufferHandle,
+    texture_binding: u32,
+    buckets: [3]IndirectBucket,
+};
+
+const IndirectPhaseData = struct {
+    data: *const IndirectPassData,
+    phase: IndirectScenePass.Phase,
+};
+
+fn indirectBuildCallback(ctx: ?*anyopaque, cmd: saturn.ComputeCommandEncoder) void {
+    const phase_data: *const IndirectPhaseData = @ptrCast(@alignCast(ctx.?));
+    const data = phase_data.data;
+    const extent = cmd.getTextureInfo(.from(data.target)).?.extent;
+    const depth_pyramid_address: u64 = if (phase_data.phase == .late and data.depth_pyramid != null)
+        cmd.getBufferInfo(.from(data.depth_pyramid.?)).?.device_address.?
+    else
+        0;
+    const meshlet_task_address: u64 = if (data.meshlet_task_buffer) |task_buffer|
+        cmd.getBufferInfo(.from(task_buffer)).?.device_address.?
+    else
+        0;
+    data.indirect_pass.build(
+        cmd,
+        data,
+        phase_data.phase,
+        cmd.getBufferInfo(.from(data.count_buffer)).?.device_address.?,
+        cmd.getBufferInfo(.from(data.command_buffer)).?.device_address.?,
+        meshlet_task_address,
+        depth_pyramid_address,
+        .init(data.camera, .{ extent.width, extent.height }),
+    );
+}
+
+fn indirectMeshletCullCallback(ctx: ?*anyopaque, cmd: saturn.ComputeCommandEncoder) void {
+    const phase_data: *const IndirectPhaseData = @ptrCast(@alignCast(ctx.?));
+    const data = phase_data.data;
+    const extent = cmd.getTextureInfo(.from(data.target)).?.extent;
+    const depth_pyramid_address: u64 = if (phase_data.phase == .late and data.depth_pyramid != null)
+        cmd.getBufferInfo(.from(data.depth_pyramid.?)).?.device_address.?
+    else
+        0;
+    data.indirect_pass.cullMeshlets(
+        cmd,
+        data,
+        phase_data.phase,
+        cmd.getBufferInfo(.from(data.count_buffer)).?.device_address.?,
+        cmd.getBufferInfo(.from(data.command_buffer)).?.device_address.?,
+        cmd.getBufferInfo(.from(data.meshlet_task_buffer.?)).?.device_address.?,
+        cmd.getBufferInfo(.from(data.meshlet_index_buffer.?)).?.device_address.?,
+        depth_pyramid_address,
+        .init(data.camera, .{ extent.width, extent.height }),
+    );
+}
+
+fn indirectGraphicsCallback(ctx: ?*anyopaque, cmd: saturn.GraphicsCommandEncoder, target_resolution: [2]u32) void {
+    const phase_data: *const IndirectPhaseData = @ptrCast(@alignCast(ctx.?));
+    const data = phase_data.data;
+    data.indirect_pass.render(
+        cmd,
+        data,
+        phase_data.phase,
+        cmd.getBufferInfo(.from(data.command_buffer)).?.device_address.?,
+        .init(data.camera, target_resolution),
+    );
 }
 
+const CameraMatrices = struct {
+    view: zm.Mat,
+    projection: zm.Mat,
+    view_projection: zm.Mat,
+
+    fn init(camera: *const Camera, target_resolution: [2]u32) CameraMatrices {
+        const width_float: f32 = @floatFromInt(target_resolution[0]);
+        const height_float: f32 = @floatFromInt(target_resolution[1]);
+        const aspect_ratio: f32 = width_float / height_float;
+
+        const view_matrix = camera.transform.getViewMatrix();
+        var projection_matrix = camera.camera.getProjectionMatrix(aspect_ratio);
+        projection_matrix[1][1] *= -1.0; //TODO: only do this for vulkan
+
+        return .{
+            .view = view_matrix,
+            .projection = projection_matrix,
+            .view_projection = zm.mul(view_matrix, projection_matrix),
+        };
+    }
+};
+
 pub const ClearBufferPass = struct {
     buffer: saturn.RGBufferHandle,
     data: u32,
@@ -137,27 +581,33 @@ pub const ClearBufferPass = struct {
     }
 };
 
-const LegacyScenePass = struct {
-    const PushConstants = extern struct {
-        view_projection_matrix: zm.Mat,
-        model_matrix: zm.Mat,
-        texture_info_binding: u32,
-        material_instance_binding: u32,
-        material_index: u32,
+/// Opaque, alpha mask and alpha blend pipelines for one set of scene shaders, all reading the mesh pool vertex layout
+const ScenePipelines = struct {
+    pub const Shaders = struct {
+        vertex: []const u8,
+        opaque_fragment: []const u8,
+        alpha_mask_fragment: []const u8,
     };
 
     opaque_pipeline: saturn.GraphicsPipelineHandle,
     alpha_mask_pipeline: saturn.GraphicsPipelineHandle,
     alpha_blend_pipeline: saturn.GraphicsPipelineHandle,
 
-    pub fn init(gpa: std.mem.Allocator, device: saturn.DeviceInterface, registry: *const AssetRegistry, formats: RenderTargetState) !LegacyScenePass {
-        const vertex_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", "shaders/glsl/draw_legacy.vert.asset"));
+    pub fn init(
+        gpa: std.mem.Allocator,
+        device: saturn.DeviceInterface,
+        registry: *const AssetRegistry,
+        formats: RenderTargetState,
+        comptime name: []const u8,
+        shaders: Shaders,
+    ) !ScenePipelines {
+        const vertex_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", shaders.vertex));
         defer device.destroyShaderModule(vertex_shader);
 
-        const opaque_frag_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", "shaders/glsl/opaque_legacy.frag.asset"));
+        const opaque_frag_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", shaders.opaque_fragment));
         defer device.destroyShaderModule(opaque_frag_shader);
 
-        const alpha_mask_frag_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", "shaders/glsl/alpha_mask_legacy.frag.asset"));
+        const alpha_mask_frag_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", shaders.alpha_mask_fragment));
         defer device.destroyShaderModule(alpha_mask_frag_shader);
 
         const vertex_bindings = [_]saturn.VertexBinding{
@@ -233,7 +683,7 @@ const LegacyScenePass = struct {
         }
 
         const opaque_pipeline = try device.createGraphicsPipeline(&.{
-            .name = "Legacy Opaque Pipeline",
+            .name = name ++ " Opaque Pipeline",
             .vertex = vertex_shader,
             .fragment = opaque_frag_shader,
             .vertex_input_state = vertex_input_state,
@@ -245,7 +695,7 @@ const LegacyScenePass = struct {
         errdefer device.destroyGraphicsPipeline(opaque_pipeline);
 
         const alpha_mask_pipeline = try device.createGraphicsPipeline(&.{
-            .name = "Legacy Alpha Mask Pipeline",
+            .name = name ++ " Alpha Mask Pipeline",
             .vertex = vertex_shader,
             .fragment = alpha_mask_frag_shader,
             .vertex_input_state = vertex_input_state,
@@ -273,7 +723,7 @@ const LegacyScenePass = struct {
         }
 
         const alpha_blend_pipeline = try device.createGraphicsPipeline(&.{
-            .name = "Legacy Alpha Blend Pipeline",
+            .name = name ++ " Alpha Blend Pipeline",
             .vertex = vertex_shader,
             .fragment = opaque_frag_shader,
             .vertex_input_state = vertex_input_state,
@@ -291,101 +741,633 @@ const LegacyScenePass = struct {
         };
     }
 
-    pub fn deinit(self: *const LegacyScenePass, device: saturn.DeviceInterface) void {
+    pub fn deinit(self: *const ScenePipelines, device: saturn.DeviceInterface) void {
         device.destroyGraphicsPipeline(self.opaque_pipeline);
         device.destroyGraphicsPipeline(self.alpha_mask_pipeline);
         device.destroyGraphicsPipeline(self.alpha_blend_pipeline);
     }
+};
 
-    pub fn render(
+const LegacyScenePass = struct {
+    const PushConstants = extern struct {
+        view_binding: u32,
+        instance_binding: u32,
+        texture_info_binding: u32,
+        material_instance_binding: u32,
+    };
+
+    /// Matches LegacyView in draw_legacy.vert, written once per frame
+    const View = extern struct {
+        view_projection_matrix: zm.Mat,
+    };
+
+    /// Matches LegacyInstance in draw_legacy.vert, read through gl_InstanceIndex
+    const Instance = extern struct {
+        model_matrix: zm.Mat,
+        normal_matrix: zm.Mat,
+        material_index: u32,
+        pad: [3]u32 = @splat(0),
+    };
+
+    /// One instanced draw merged from a run of visible draws sharing a mesh primitive
+    const Draw = struct {
+        pipeline: saturn.GraphicsPipelineHandle,
+        material_instance_binding: u32,
+        index_count: u32,
+        instance_count: u32,
+        first_index: u32,
+        vertex_offset: i32,
+        first_instance: u32,
+    };
+
+    /// Everything the chunks need once culling, sorting and the instance writes are done
+    const Prepared = struct {
+        push_constants: PushConstants = undefined,
+        draws: []const Draw = &.{},
+    };
+
+    /// Large enough that the per chunk state setup and secondary command buffer stay cheap next to the draws
+    const DRAWS_PER_CHUNK = 256;
+
+    pipelines: ScenePipelines,
+
+    pub fn init(gpa: std.mem.Allocator, device: saturn.DeviceInterface, registry: *const AssetRegistry, formats: RenderTargetState) !LegacyScenePass {
+        return .{
+            .pipelines = try .init(gpa, device, registry, formats, "Legacy", .{
+                .vertex = "shaders/glsl/draw_legacy.vert.asset",
+                .opaque_fragment = "shaders/glsl/opaque_legacy.frag.asset",
+                .alpha_mask_fragment = "shaders/glsl/alpha_mask_legacy.frag.asset",
+            }),
+        };
+    }
+
+    pub fn deinit(self: *const LegacyScenePass, device: saturn.DeviceInterface) void {
+        self.pipelines.deinit(device);
+    }
+
+    pub fn chunkCount(draw_count: usize) u32 {
+        return @intCast(std.math.divCeil(usize, draw_count, DRAWS_PER_CHUNK) catch unreachable);
+    }
+
+    /// Culls and sorts every bucket, writes the instance data and merges the visible draws into `draws`
+    pub fn prepare(
         self: *const LegacyScenePass,
-        cmd: saturn.GraphicsCommandEncoder,
-        render_buckets: Scene.RenderBuckets,
+        task_pool: *TaskPool,
+        occlusion: *OcclusionBuffer,
+        scene: *const Scene,
+        render_buckets: Scene.DrawLists,
+        visibility: BucketVisibility,
+        sort_buffers: draw_sort.SortBuffers,
+        instances: FrameRingBuffer(Instance).Slot,
+        view: FrameRingBuffer(View).Slot,
+        draws: []Draw,
         camera: *const Camera,
         asset_pool: *const AssetPool,
         target_resolution: [2]u32,
-    ) void {
-        const width_float: f32 = @floatFromInt(target_resolution[0]);
-        const height_float: f32 = @floatFromInt(target_resolution[1]);
-        const aspect_ratio: f32 = width_float / height_float;
-
-        const view_matrix = camera.transform.getViewMatrix();
-        var projection_matrix = camera.camera.getProjectionMatrix(aspect_ratio);
-        projection_matrix[1][1] *= -1.0; //TODO: only do this for vulkan
-        const view_projection_matrix = zm.mul(view_matrix, projection_matrix);
+    ) Prepared {
+        const view_projection_matrix = CameraMatrices.init(camera, target_resolution).view_projection;
 
         const CULLING_ENABLED: bool = true;
         const frustum_opt: ?culling.Frustum = if (CULLING_ENABLED) .fromViewProjectionMatrix(view_projection_matrix) else null;
 
+        var opaque_visible = cullRenderBucket(task_pool, render_buckets.opaque_instances, visibility.opaque_instances, frustum_opt);
+        var alpha_mask_visible = cullRenderBucket(task_pool, render_buckets.alpha_mask_instances, visibility.alpha_mask_instances, frustum_opt);
+        var alpha_blend_visible = cullRenderBucket(task_pool, render_buckets.alpha_blend_instances, visibility.alpha_blend_instances, frustum_opt);
+
+        const camera_pos = camera.transform.position;
+
+        const OCCLUSION_CULLING_ENABLED: bool = true;
+        if (OCCLUSION_CULLING_ENABLED) {
+            // Only opaque draws are solid enough to occlude, but every bucket can be occluded
+            occlusion.clear();
+            addOccluders(occlusion, scene, asset_pool, render_buckets.opaque_instances, opaque_visible, view_projection_matrix, camera_pos);
+            if (occlusion.triangleCount() > 0) {
+                occlusion.rasterize(task_pool);
+                opaque_visible = occlusion.cullVisible(task_pool, view_projection_matrix, render_buckets.opaque_instances.spheres, opaque_visible, visibility.opaque_instances.chunk_counts);
+                alpha_mask_visible = occlusion.cullVisible(task_pool, view_projection_matrix, render_buckets.alpha_mask_instances.spheres, alpha_mask_visible, visibility.alpha_mask_instances.chunk_counts);
+                alpha_blend_visible = occlusion.cullVisible(task_pool, view_projection_matrix, render_buckets.alpha_blend_instances.spheres, alpha_blend_visible, visibility.alpha_blend_instances.chunk_counts);
+            }
+        }
+
+        draw_sort.sortDraws(.front_to_back, 0, render_buckets.opaque_instances.draws, render_buckets.opaque_instances.spheres, camera_pos, opaque_visible, sort_buffers);
+        draw_sort.sortDraws(.front_to_back, 1, render_buckets.alpha_mask_instances.draws, render_buckets.alpha_mask_instances.spheres, camera_pos, alpha_mask_visible, sort_buffers);
+        draw_sort.sortDraws(.back_to_front, 2, render_buckets.alpha_blend_instances.draws, render_buckets.alpha_blend_instances.spheres, camera_pos, alpha_blend_visible, sort_buffers);
+
+        view.items[0] = .{ .view_projection_matrix = view_projection_matrix };
+
+        var instance_count: u32 = 0;
+        var draw_count: usize = 0;
+
+        mergeRenderBucket(self.pipelines.opaque_pipeline, asset_pool.material_pool.opaque_material.instance_data.storage_binding.?, render_buckets.opaque_instances.draws, opaque_visible, instances.items, &instance_count, draws, &draw_count);
+        mergeRenderBucket(self.pipelines.alpha_mask_pipeline, asset_pool.material_pool.alpha_mask_material.instance_data.storage_binding.?, render_buckets.alpha_mask_instances.draws, alpha_mask_visible, instances.items, &instance_count, draws, &draw_count);
+        mergeRenderBucket(self.pipelines.alpha_blend_pipeline, asset_pool.material_pool.alpha_blend_material.instance_data.storage_binding.?, render_buckets.alpha_blend_instances.draws, alpha_blend_visible, instances.items, &instance_count, draws, &draw_count);
+
+        return .{
+            .push_constants = .{
+                .view_binding = view.binding,
+                .instance_binding = instances.binding,
+                .texture_info_binding = asset_pool.texture_pool.info_buffer.storage_binding.?,
+                .material_instance_binding = undefined,
+            },
+            .draws = draws[0..draw_count],
+        };
+    }
+
+    /// Records one chunk of prepared draws, may run on any task pool thread
+    pub fn recordChunk(cmd: saturn.GraphicsCommandEncoder, prepared: Prepared, asset_pool: *const AssetPool, chunk_index: u32) void {
+        const start = @as(usize, chunk_index) * DRAWS_PER_CHUNK;
+        const chunk_draws = prepared.draws[start..@min(start + DRAWS_PER_CHUNK, prepared.draws.len)];
+
         cmd.setVertexBuffer(0, .from(asset_pool.mesh_pool.vertex_buffer.buffer), 0);
         cmd.setIndexBuffer(.from(asset_pool.mesh_pool.index_buffer.buffer), .u32, 0);
 
-        const texture_info_binding = asset_pool.texture_pool.info_buffer.storage_binding.?;
+        var current_pipeline: saturn.GraphicsPipelineHandle = .null_handle;
+        for (chunk_draws) |draw| {
+            if (current_pipeline != draw.pipeline) {
+                current_pipeline = draw.pipeline;
 
-        drawRenderBucket(
-            cmd,
-            self.opaque_pipeline,
-            view_projection_matrix,
-            texture_info_binding,
-            asset_pool.material_pool.opaque_material.instance_data.storage_binding.?,
-            render_buckets.opaque_instances.items,
-            frustum_opt,
-        );
+                var push_constants = prepared.push_constants;
+                push_constants.material_instance_binding = draw.material_instance_binding;
+                cmd.setPipeline(draw.pipeline);
+                cmd.pushConstants(PushConstants, push_constants);
+            }
 
-        drawRenderBucket(
-            cmd,
-            self.alpha_mask_pipeline,
-            view_projection_matrix,
-            texture_info_binding,
-            asset_pool.material_pool.alpha_mask_material.instance_data.storage_binding.?,
-            render_buckets.alpha_mask_instances.items,
-            frustum_opt,
-        );
+            cmd.drawIndexed(draw.index_count, draw.instance_count, draw.first_index, draw.vertex_offset, draw.first_instance);
+        }
+    }
 
-        drawRenderBucket(
-            cmd,
-            self.alpha_blend_pipeline,
-            view_projection_matrix,
-            texture_info_binding,
-            asset_pool.material_pool.alpha_blend_material.instance_data.storage_binding.?,
-            render_buckets.alpha_blend_instances.items,
-            frustum_opt,
-        );
+    fn cullRenderBucket(
+        task_pool: *TaskPool,
+        draw_list: Scene.DrawList,
+        buffers: culling.ParallelCullBuffers,
+        frustum_opt: ?culling.Frustum,
+    ) []u32 {
+        const frustum = frustum_opt orelse {
+            for (buffers.indices, 0..) |*index, i| {
+                index.* = @intCast(i);
+            }
+            return buffers.indices;
+        };
+
+        const BVH_CULLING_ENABLED: bool = true;
+        if (BVH_CULLING_ENABLED) {
+            if (draw_list.bvh) |bvh| {
+                const visible_count = bvh.cullFrustum(&frustum, draw_list.spheres, buffers.indices);
+                return buffers.indices[0..visible_count];
+            }
+        }
+
+        return culling.cullSpheresParallel(task_pool, &frustum, draw_list.spheres, buffers);
     }
 
-    fn drawRenderBucket(
-        cmd: saturn.GraphicsCommandEncoder,
-        pipeline: saturn.GraphicsPipelineHandle,
+    /// Picks the largest visible draws on screen, plus any flagged as occluders, and queues their cpu meshes
+    fn addOccluders(
+        occlusion: *OcclusionBuffer,
+        scene: *const Scene,
+        asset_pool: *const AssetPool,
+        draw_list: Scene.DrawList,
+        visible_indices: []const u32,
         view_projection_matrix: zm.Mat,
-        texture_info_binding: u32,
-        mat_instance_binding: u32,
-        instances: []const Scene.InstanceDrawData,
-        frustum_opt: ?culling.Frustum,
+        camera_pos: zm.Vec,
     ) void {
-        cmd.setPipeline(pipeline);
-        for (instances) |instance| {
-            if (frustum_opt) |frustum| {
-                if (!frustum.intersects(culling.Sphere, instance.culling_sphere)) {
-                    continue;
+        const MAX_OCCLUDERS = 32;
+        // Bounds radius over distance, smaller draws hide too little to be worth rasterizing
+        const MIN_OCCLUDER_SIZE = 0.1;
+
+        const Candidate = struct {
+            index: u32,
+            size: f32,
+
+            fn greaterThan(_: void, a: @This(), b: @This()) bool {
+                return a.size > b.size;
+            }
+        };
+        var candidates: [MAX_OCCLUDERS]Candidate = undefined;
+        var candidate_count: usize = 0;
+        var smallest: usize = 0;
+
+        for (visible_indices) |index| {
+            const owner = draw_list.owners[index];
+            const instance = scene.static_mesh_instances.getPtr(owner.instance) orelse continue;
+
+            const sphere = draw_list.spheres.get(index).pos_radius;
+            const distance = zm.length3(sphere - camera_pos)[0];
+            const size = if (instance.occluder) std.math.inf(f32) else sphere[3] / @max(distance, 0.001);
+            if (size < MIN_OCCLUDER_SIZE) continue;
+
+            if (candidate_count < MAX_OCCLUDERS) {
+                candidates[candidate_count] = .{ .index = index, .size = size };
+                candidate_count += 1;
+            } else if (size > candidates[smallest].size) {
+                candidates[smallest] = .{ .index = index, .size = size };
+            } else {
+                continue;
+            }
+
+            if (candidate_count == MAX_OCCLUDERS) {
+                smallest = 0;
+                for (candidates[1..], 1..) |candidate, i| {
+                    if (candidate.size < candidates[smallest].size) smallest = i;
+                }
+            }
+        }
+
+        // Largest first so the triangle budget goes to the occluders that hide the most
+        std.mem.sort(Candidate, candidates[0..candidate_count], {}, Candidate.greaterThan);
+
+        for (candidates[0..candidate_count]) |candidate| {
+            const owner = draw_list.owners[candidate.index];
+            const instance = scene.static_mesh_instances.getPtr(owner.instance).?;
+            const mesh_asset = asset_pool.mesh_assets.get(instance.mesh) orelse continue;
+            const cpu_mesh = mesh_asset.cpu orelse continue;
+            const primitive = cpu_mesh.primitives[owner.primitive];
+
+            const model_view_projection = zm.mul(draw_list.draws[candidate.index].model_matrix, view_projection_matrix);
+            if (!occlusion.addOccluder(
+                cpu_mesh.vertices[primitive.vertex_offset..][0..primitive.vertex_count],
+                cpu_mesh.indices[primitive.index_offset..][0..primitive.index_count],
+                model_view_projection,
+            )) {
+                break;
+            }
+        }
+    }
+
+    /// Writes the instance data for every visible draw and merges runs of the same mesh primitive into one instanced draw.
+    /// Material comes from the instance data, so draws only need to share index and vertex ranges to be merged.
+    fn mergeRenderBucket(
+        pipeline: saturn.GraphicsPipelineHandle,
+        material_instance_binding: u32,
+        draws: []const Scene.InstanceDrawData,
+        visible_indices: []const u32,
+        instances: []Instance,
+        instance_count: *u32,
+        merged_draws: []Draw,
+        merged_count: *usize,
+    ) void {
+        var run_start: usize = 0;
+        while (run_start < visible_indices.len) {
+            const draw_data = draws[visible_indices[run_start]].draw_data;
+            const first_instance = instance_count.*;
+
+            var run_end = run_start;
+            while (run_end < visible_indices.len) : (run_end += 1) {
+                const draw = draws[visible_indices[run_end]];
+                if (draw.draw_data.first_index != draw_data.first_index or
+                    draw.draw_data.vertex_offset != draw_data.vertex_offset or
+                    draw.draw_data.index_count != draw_data.index_count)
+                {
+                    break;
                 }
+
+                instances[instance_count.*] = .{
+                    .model_matrix = draw.model_matrix,
+                    .normal_matrix = draw.normal_matrix,
+                    .material_index = draw.material_index,
+                };
+                instance_count.* += 1;
             }
 
-            const push_constants = LegacyScenePass.PushConstants{
-                .view_projection_matrix = view_projection_matrix,
-                .model_matrix = instance.model_matrix,
-                .texture_info_binding = texture_info_binding,
-                .material_instance_binding = mat_instance_binding,
-                .material_index = instance.material_index,
+            merged_draws[merged_count.*] = .{
+                .pipeline = pipeline,
+                .material_instance_binding = material_instance_binding,
+                .index_count = draw_data.index_count,
+                .instance_count = @intCast(run_end - run_start),
+                .first_index = draw_data.first_index,
+                .vertex_offset = draw_data.vertex_offset,
+                .first_instance = first_instance,
             };
-            cmd.pushConstants(LegacyScenePass.PushConstants, push_constants);
-
-            cmd.drawIndexed(
-                instance.draw_data.index_count,
-                instance.draw_data.instance_count,
-                instance.draw_data.first_index,
-                instance.draw_data.vertex_offset,
-                instance.draw_data.first_instance,
-            );
+            merged_count.* += 1;
+            run_start = run_end;
         }
     }
 };
+
+const IndirectScenePass = struct {
+    /// Size of DrawIndexedIndirectCommandInfo in indirect.glsl, the indirect command followed by instance and material indices
+    const COMMAND_STRIDE = 28;
+    /// local_size_x of build_indirect.comp
+    const BUILD_GROUP_SIZE = 64;
+    /// Counts and command slices are addressed through buffer references declared with buffer_reference_align = 8
+    const BUFFER_ALIGNMENT = 16;
+
+    // Must match include/meshlet.glsl
+    const MESHLET_TASK_CAPACITY = 256 * 1024;
+    const MESHLET_INDEX_CAPACITY = 8 * 1024 * 1024;
+    /// Size of MeshletTask in meshlet.glsl
+    const MESHLET_TASK_STRIDE = 12;
+
+    /// Two phase occlusion culling, each phase builds and draws its own commands
+    const Phase = enum {
+        /// Primitives visible last frame, before there is any depth to cull against
+        early,
+        /// Everything else, culled against the depth pyramid of the early phase
+        late,
+    };
+    const PHASE_COUNT = @typeInfo(Phase).@"enum".fields.len;
+
+    /// Matches the PHASE_ defines in build_indirect.comp
+    const BuildPhase = enum(u32) {
+        early = 0,
+        late = 1,
+        /// Buckets without visibility, drawn all at once in the late phase
+        single = 2,
+    };
+
+    /// Matches CullData in culling.glsl, view space is flipped so +z points forward
+    const CullData = extern struct {
+        view_matrix: zm.Mat,
+        p00: f32,
+        p11: f32,
+        znear: f32,
+        zfar: f32,
+        frustum: [4]f32,
+    };
+
+    /// Matches the push constants in build_indirect.comp
+    const BuildPushConstants = extern struct {
+        draw_counts_address: u64,
+        whole_draw_counts_address: u64,
+        mesh_infos_address: u64,
+        scene_instances_address: u64,
+        scene_primitives_address: u64,
+        command_infos_address: u64,
+        whole_command_infos_address: u64,
+        visibility_address: u64,
+        depth_pyramid_address: u64,
+        meshlet_state_address: u64,
+        meshlet_tasks_address: u64,
+        meshlet_index_allocator_address: u64,
+        culling: u32,
+        primitive_count: u32,
+        phase: BuildPhase,
+        occlusion: u32,
+        meshlet_culling: u32,
+        bucket: u32,
+        cull_data: CullData,
+    };
+
+    /// Matches the push constants in meshlet_cull.comp
+    const MeshletCullPushConstants = extern struct {
+        mesh_infos_address: u64,
+        scene_instances_address: u64,
+        command_infos_addresses: [3]u64,
+        meshlet_state_address: u64,
+        meshlet_tasks_address: u64,
+        compacted_indices_address: u64,
+        depth_pyramid_address: u64,
+        culling: u32,
+        occlusion: u32,
+        cull_data: CullData,
+    };
+
+    /// Matches push_indirect.glsl
+    const DrawPushConstants = extern struct {
+        view_projection_matrix: zm.Mat,
+        scene_instances_address: u64,
+        command_infos_address: u64,
+        texture_binding: u32,
+        material_binding: u32,
+    };
+
+    comptime {
+        std.debug.assert(@offsetOf(BuildPushConstants, "cull_data") == 128);
+        std.debug.assert(@sizeOf(BuildPushConstants) == 224);
+        std.debug.assert(@offsetOf(MeshletCullPushConstants, "cull_data") == 80);
+        std.debug.assert(@sizeOf(MeshletCullPushConstants) == 176);
+    }
+
+    build_pipeline: saturn.ComputePipelineHandle,
+    meshlet_cull_pipeline: saturn.ComputePipelineHandle,
+    pipelines: ScenePipelines,
+
+    pub fn init(gpa: std.mem.Allocator, device: saturn.DeviceInterface, registry: *const AssetRegistry, formats: RenderTargetState) !IndirectScenePass {
+        const build_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", "shaders/glsl/build_indirect.comp.asset"));
+        defer device.destroyShaderModule(build_shader);
+
+        const build_pipeline = try device.createComputePipeline(.{
+            .name = "Indirect Build Pipeline",
+            .shader = build_shader,
+        });
+        errdefer device.destroyComputePipeline(build_pipeline);
+
+        const meshlet_cull_shader = try utils.loadShader(gpa, device, registry, .fromRepoPath("engine", "shaders/glsl/meshlet_cull.comp.asset"));
+        defer device.destroyShaderModule(meshlet_cull_shader);
+
+        const meshlet_cull_pipeline = try device.createComputePipeline(.{
+            .name = "Indirect Meshlet Cull Pipeline",
+            .shader = meshlet_cull_shader,
+        });
+        errdefer device.destroyComputePipeline(meshlet_cull_pipeline);
+
+        return .{
+            .build_pipeline = build_pipeline,
+            .meshlet_cull_pipeline = meshlet_cull_pipeline,
+            .pipelines = try .init(gpa, device, registry, formats, "Indirect", .{
+                .vertex = "shaders/glsl/draw_indirect.vert.asset",
+                .opaque_fragment = "shaders/glsl/opaque_indirect.frag.asset",
+                .alpha_mask_fragment = "shaders/glsl/alpha_mask_indirect.frag.asset",
+            }),
+        };
+    }
+
+    pub fn deinit(self: *const IndirectScenePass, device: saturn.DeviceInterface) void {
+        device.destroyComputePipeline(self.build_pipeline);
+        device.destroyComputePipeline(self.meshlet_cull_pipeline);
+        self.pipelines.deinit(device);
+    }
+
+    /// The sphere tests assume a symmetric perspective projection, other cameras aren't culled
+    fn getCullData(camera: *const Camera, matrices: CameraMatrices) ?CullData {
+        if (camera.camera != .perspective) return null;
+
+        const p00 = matrices.projection[0][0];
+        const p11 = @abs(matrices.projection[1][1]);
+        return .{
+            .view_matrix = zm.mul(matrices.view, zm.scaling(1.0, 1.0, -1.0)),
+            .p00 = p00,
+            .p11 = p11,
+            // Read back from the projection so the occlusion depth test matches the depth buffer
+            .znear = matrices.projection[3][2] / matrices.projection[2][2],
+            .zfar = matrices.projection[3][2] / (matrices.projection[2][2] + 1.0),
+            .frustum = .{
+                p00 / @sqrt(p00 * p00 + 1.0),
+                1.0 / @sqrt(p00 * p00 + 1.0),
+                p11 / @sqrt(p11 * p11 + 1.0),
+                1.0 / @sqrt(p11 * p11 + 1.0),
+            },
+        };
+    }
+
+    /// Culls every primitive slot of each bucket and appends the survivors to that bucket's commands for the phase.
+    /// Occlusion is only tested when a depth pyramid address is given, meshlet tasks are only appended when a task address is given.
+    pub fn build(
+        self: *const IndirectScenePass,
+        cmd: saturn.ComputeCommandEncoder,
+        data: *const IndirectPassData,
+        phase: Phase,
+        count_address: u64,
+        command_address: u64,
+        meshlet_task_address: u64,
+        depth_pyramid_address: u64,
+        matrices: CameraMatrices,
+    ) void {
+        const cull_data = getCullData(data.camera, matrices);
+        const phase_index: u64 = @intFromEnum(phase);
+        const phase_count_address = count_address + phase_index * data.count_phase_stride;
+
+        var push_constants: BuildPushConstants = .{
+            .draw_counts_address = undefined,
+            .whole_draw_counts_address = undefined,
+            .mesh_infos_address = data.mesh_info_address,
+            .scene_instances_address = data.instance_address,
+            .scene_primitives_address = undefined,
+            .command_infos_address = undefined,
+            .whole_command_infos_address = undefined,
+            .visibility_address = 0,
+            .depth_pyramid_address = depth_pyramid_address,
+            .meshlet_state_address = phase_count_address + data.buckets.len * BUFFER_ALIGNMENT,
+            .meshlet_tasks_address = if (meshlet_task_address != 0) meshlet_task_address + phase_index * data.meshlet_task_phase_stride else 0,
+            .meshlet_index_allocator_address = count_address + PHASE_COUNT * data.count_phase_stride,
+            .culling = @intFromBool(cull_data != null),
+            .primitive_count = undefined,
+            .phase = undefined,
+            .occlusion = @intFromBool(depth_pyramid_address != 0),
+            .meshlet_culling = @intFromBool(meshlet_task_address != 0),
+            .bucket = undefined,
+            .cull_data = cull_data orelse std.mem.zeroes(CullData),
+        };
+
+        cmd.setPipeline(self.build_pipeline);
+        for (data.buckets, 0..) |bucket, i| {
+            if (bucket.primitive_count == 0) continue;
+
+            const build_phase = getBuildPhase(bucket, phase) orelse continue;
+
+            push_constants.draw_counts_address = phase_count_address + bucket.count_offset;
+            push_constants.whole_draw_counts_address = phase_count_address + bucket.whole_count_offset;
+            push_constants.scene_primitives_address = bucket.primitive_address;
+            push_constants.command_infos_address = command_address + phase_index * data.command_phase_stride + bucket.command_offset;
+            push_constants.whole_command_infos_address = command_address + phase_index * data.command_phase_stride + bucket.whole_command_offset;
+            push_constants.visibility_address = bucket.visibility_address orelse 0;
+            push_constants.primitive_count = bucket.primitive_count;
+            push_constants.phase = build_phase;
+            push_constants.bucket = @intCast(i);
+            cmd.pushConstants(BuildPushConstants, push_constants);
+            cmd.dispatch(std.math.divCeil(u32, bucket.primitive_count, BUILD_GROUP_SIZE) catch unreachable, 1, 1);
+        }
+    }
+
+    /// Culls the meshlet tasks the build pass appended for the phase and writes the surviving triangles into the compacted index buffer.
+    /// Dispatched indirectly since only the build pass knows how many tasks there are.
+    pub fn cullMeshlets(
+        self: *const IndirectScenePass,
+        cmd: saturn.ComputeCommandEncoder,
+        data: *const IndirectPassData,
+        phase: Phase,
+        count_address: u64,
+        command_address: u64,
+        meshlet_task_address: u64,
+        compacted_index_address: u64,
+        depth_pyramid_address: u64,
+        matrices: CameraMatrices,
+    ) void {
+        const cull_data = getCullData(data.camera, matrices);
+        const phase_index: u64 = @intFromEnum(phase);
+        const meshlet_state_offset = phase_index * data.count_phase_stride + data.buckets.len * BUFFER_ALIGNMENT;
+
+        var command_infos_addresses: [3]u64 = undefined;
+        for (&command_infos_addresses, data.buckets) |*address, bucket| {
+            address.* = command_address + phase_index * data.command_phase_stride + bucket.command_offset;
+        }
+
+        cmd.setPipeline(self.meshlet_cull_pipeline);
+        cmd.pushConstants(MeshletCullPushConstants, .{
+            .mesh_infos_address = data.mesh_info_address,
+            .scene_instances_address = data.instance_address,
+            .command_infos_addresses = command_infos_addresses,
+            .meshlet_state_address = count_address + meshlet_state_offset,
+            .meshlet_tasks_address = meshlet_task_address + phase_index * data.meshlet_task_phase_stride,
+            .compacted_indices_address = compacted_index_address,
+            .depth_pyramid_address = depth_pyramid_address,
+            .culling = @intFromBool(cull_data != null),
+            .occlusion = @intFromBool(depth_pyramid_address != 0),
+            .cull_data = cull_data orelse std.mem.zeroes(CullData),
+        });
+        cmd.dispatchIndirect(.from(data.count_buffer), meshlet_state_offset);
+    }
+
+    /// Buckets without visibility skip the early phase and are drawn once in the late phase
+    fn getBuildPhase(bucket: IndirectBucket, phase: Phase) ?BuildPhase {
+        if (bucket.visibility_address == null) {
+            return if (phase == .late) .single else null;
+        }
+        return switch (phase) {
+            .early => .early,
+            .late => .late,
+        };
+    }
+
+    pub fn render(
+        self: *const IndirectScenePass,
+        cmd: saturn.GraphicsCommandEncoder,
+        data: *const IndirectPassData,
+        phase: Phase,
+        command_address: u64,
+        matrices: CameraMatrices,
+    ) void {
+        cmd.setVertexBuffer(0, .from(data.vertex_buffer), 0);
+
+        // Meshlet culled draws read the compacted indices, the rest are drawn whole from the mesh index buffer afterwards
+        if (data.meshlet_index_buffer) |meshlet_index_buffer| {
+            cmd.setIndexBuffer(.from(meshlet_index_buffer), .u32, 0);
+            self.drawBuckets(cmd, data, phase, command_address, matrices, false);
+        }
+
+        cmd.setIndexBuffer(.from(data.index_buffer), .u32, 0);
+        self.drawBuckets(cmd, data, phase, command_address, matrices, data.meshlet_index_buffer != null);
+    }
+
+    fn drawBuckets(
+        self: *const IndirectScenePass,
+        cmd: saturn.GraphicsCommandEncoder,
+        data: *const IndirectPassData,
+        phase: Phase,
+        command_address: u64,
+        matrices: CameraMatrices,
+        whole: bool,
+    ) void {
+        const pipelines = [_]saturn.GraphicsPipelineHandle{
+            self.pipelines.opaque_pipeline,
+            self.pipelines.alpha_mask_pipeline,
+            self.pipelines.alpha_blend_pipeline,
+        };
+
+        const phase_index: u64 = @intFromEnum(phase);
+
+        for (data.buckets, pipelines) |bucket, pipeline| {
+            if (bucket.primitive_count == 0) continue;
+            if (getBuildPhase(bucket, phase) == null) continue;
+
+            const command_offset = phase_index * data.command_phase_stride + (if (whole) bucket.whole_command_offset else bucket.command_offset);
+            const count_offset = phase_index * data.count_phase_stride + (if (whole) bucket.whole_count_offset else bucket.count_offset);
+
+            cmd.setPipeline(pipeline);
+            cmd.pushConstants(DrawPushConstants, .{
+                .view_projection_matrix = matrices.view_projection,
+                .scene_instances_address = data.instance_address,
+                .command_infos_address = command_address + command_offset,
+                .texture_binding = data.texture_binding,
+                .material_binding = bucket.material_binding,
+            });
+            cmd.drawIndexedIndirectCount(
+                .from(data.command_buffer),
+                command_offset,
+                .from(data.count_buffer),
+                count_offset,
+                bucket.primitive_count,
+                COMMAND_STRIDE,
+            );
+        }
+    }
+};};
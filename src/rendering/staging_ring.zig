@@ -0,0 +1,111 @@
+//Ring allocator over persistently mapped upload memory shared by every frame in flight.
+//Positions are byte counters that only grow, the buffer offset is the counter modulo the capacity.
+//Space is retired into the slot of the frame whose graph copies out of it, and released once that slot begins again,
+//by then the device has waited for that frame and every frame before it.
+
+const std = @import("std");
+
+pub const Allocation = struct {
+    /// Into the ring's buffer
+    offset: u64,
+    slice: []u8,
+};
+
+const Self = @This();
+
+allocator: std.mem.Allocator,
+mapped: []u8,
+
+/// Everything before tail is free, everything between tail and head may still be read by the gpu
+head: u64 = 0,
+tail: u64 = 0,
+
+/// Head when the last frame that used each slot built its graph
+slot_ends: []u64,
+
+pub fn init(allocator: std.mem.Allocator, mapped: []u8, frames_in_flight: u32) error{OutOfMemory}!Self {
+    const slot_ends = try allocator.alloc(u64, @max(1, frames_in_flight));
+    @memset(slot_ends, 0);
+
+    return .{
+        .allocator = allocator,
+        .mapped = mapped,
+        .slot_ends = slot_ends,
+    };
+}
+
+pub fn deinit(self: *Self) void {
+    self.allocator.free(self.slot_ends);
+}
+
+/// Call once a frame has begun in slot, the frame that used it last is done on the gpu
+pub fn release(self: *Self, slot: u32) void {
+    self.tail = @max(self.tail, self.slot_ends[slot % self.slot_ends.len]);
+}
+
+/// Everything allocated so far is read by the graph of the frame in slot
+pub fn retire(self: *Self, slot: u32) void {
+    self.slot_ends[slot % self.slot_ends.len] = self.head;
+}
+
+pub fn usedBytes(self: *const Self) u64 {
+    return self.head - self.tail;
+}
+
+/// As much as fits up to max_size, in whole multiples of granularity and never less than one.
+/// Null when not even one granule fits, the caller has to wait for a frame to finish.
+pub fn alloc(self: *Self, granularity: u64, max_size: u64, alignment: u64) ?Allocation {
+    std.debug.assert(granularity > 0 and max_size >= granularity);
+
+    const capacity: u64 = self.mapped.len;
+    var start = std.mem.alignForward(u64, self.head, alignment);
+    var offset = start % capacity;
+
+    // Allocations never wrap, skip the end of the buffer when a granule doesn't fit there
+    if (capacity - offset < granularity) {
+        start += capacity - offset;
+        offset = 0;
+    }
+
+    const limit = self.tail + capacity;
+    if (start >= limit) return null;
+
+    const available = @min(capacity - offset, limit - start);
+    const size = @min(max_size, available) / granularity * granularity;
+    if (size == 0) return null;
+
+    self.head = start + size;
+    return .{
+        .offset = offset,
+        .slice = self.mapped[@intCast(offset)..][0..@intCast(size)],
+    };
+}
+
+test "staging_ring.reuse_after_release" {
+    var memory: [256]u8 = undefined;
+    var ring: Self = try .init(std.testing.allocator, &memory, 2);
+    defer ring.deinit();
+
+    // Frame 1 in slot 1
+    ring.release(1);
+    const first = ring.alloc(1, 200, 16).?;
+    try std.testing.expectEqual(@as(u64, 0), first.offset);
+    try std.testing.expectEqual(@as(usize, 200), first.slice.len);
+    ring.retire(1);
+
+    // Frame 2 in slot 0, only what's left is handed out and texture rows don't split
+    ring.release(0);
+    const second = ring.alloc(16, 100, 16).?;
+    try std.testing.expectEqual(@as(u64, 208), second.offset);
+    try std.testing.expectEqual(@as(usize, 48), second.slice.len);
+    try std.testing.expect(ring.alloc(1, 1, 16) == null);
+    ring.retire(0);
+
+    // Frame 3 reuses slot 1, frame 1's space comes back and the allocation wraps to the start
+    ring.release(1);
+    const third = ring.alloc(1, 100, 16).?;
+    try std.testing.expectEqual(@as(u64, 0), third.offset);
+    try std.testing.expectEqual(@as(usize, 100), third.slice.len);
+    // Frame 2's allocation with the padding before it is still in flight
+    try std.testing.expectEqual(@as(u64, 56 + 100), ring.usedBytes());
+}
@@ -37,6 +37,11 @@ pub const TextureInfo = struct {
     }
 };
 
+const PendingLoad = struct {
+    handle: TextureHandle,
+    upload: TransferQueue.UploadId,
+};
+
 const Self = @This();
 
 gpa: std.mem.Allocator,
@@ -46,6 +51,9 @@ info_buffer: GpuPool(TextureInfo.Gpu),
 
 map: std.AutoHashMapUnmanaged(TextureHandle, TextureInfo) = .empty,
 
+/// Textures whose info stays unloaded until publishUploaded sees all their rows copied
+pending_loads: std.ArrayList(PendingLoad) = .empty,
+
 pub fn init(
     gpa: std.mem.Allocator,
     device: saturn.DeviceInterface,
@@ -70,6 +78,7 @@ pub fn deinit(self: *Self) void {
         self.device.destroyTexture(info.gpu_handle);
     }
     self.map.deinit(self.gpa);
+    self.pending_loads.deinit(self.gpa);
     self.info_buffer.deinit();
 }
 
@@ -85,6 +94,9 @@ pub fn destroy(self: *Self, handle: TextureHandle) void {
 pub fn load(self: *Self, transfer_queue: *TransferQueue, handle: TextureHandle, cpu_texture: *const CpuTexture, sampler: ?saturn.SamplerHandle) saturn.Error!void {
     std.debug.assert(!self.map.contains(handle));
 
+    try self.map.ensureUnusedCapacity(self.gpa, 1);
+    try self.pending_loads.ensureUnusedCapacity(self.gpa, 1);
+
     const texture_format: saturn.TextureFormat = switch (cpu_texture.format) {
         .r8 => .rgba8_unorm,
         .rg8 => .rgba8_unorm,
@@ -104,20 +116,42 @@ pub fn load(self: *Self, transfer_queue: *TransferQueue, handle: TextureHandle,
     });
     errdefer self.device.destroyTexture(gpu_handle);
 
-    const info: TextureInfo = .{
-        .gpu_handle = gpu_handle,
-    };
-    errdefer self.info_buffer.stage(handle, .{});
+    try transfer_queue.addTextureUpload(gpu_handle, cpu_texture.data);
 
-    self.info_buffer.stage(handle, info.getGpu(self.device));
+    self.map.putAssumeCapacity(handle, .{ .gpu_handle = gpu_handle });
+    self.pending_loads.appendAssumeCapacity(.{
+        .handle = handle,
+        .upload = transfer_queue.lastUploadId(),
+    });
+}
 
-    try self.map.put(self.gpa, handle, info);
-    try transfer_queue.addTextureUpload(info.gpu_handle, cpu_texture.data);
+/// Marks textures loaded once their last rows are copied, which is also when they're transitioned for sampling.
+/// Must run after this frame's loads and before the info buffer's transfers are added
+pub fn publishUploaded(self: *Self, transfer_queue: *const TransferQueue) void {
+    var i: usize = 0;
+    while (i < self.pending_loads.items.len) {
+        const pending = self.pending_loads.items[i];
+        if (!transfer_queue.isUploaded(pending.upload)) {
+            i += 1;
+            continue;
+        }
+
+        const info = self.map.get(pending.handle).?;
+        self.info_buffer.stage(pending.handle, info.getGpu(self.device));
+        _ = self.pending_loads.swapRemove(i);
+    }
 }
 
 pub fn unload(self: *Self, handle: TextureHandle) void {
     if (self.map.fetchRemove(handle)) |entry| {
         self.device.destroyTexture(entry.value.gpu_handle);
         self.info_buffer.stage(handle, .{});
+
+        for (self.pending_loads.items, 0..) |pending, i| {
+            if (pending.handle == handle) {
+                _ = self.pending_loads.swapRemove(i);
+                break;
+            }
+        }
     }
 }
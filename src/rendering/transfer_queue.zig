@@ -1,7 +1,23 @@
+//Uploads go through one persistently mapped staging ring shared by the frames in flight, so streaming doesn't create buffers.
+//Uploads bigger than the free space are split into chunks, what doesn't fit is copied into a backlog and staged in order over the next frames.
+//Nothing overtakes the backlog, so later uploads to the same memory still land after earlier ones.
+//Callers that publish data once it's on the gpu hold on to the upload's id and check isUploaded every frame.
+
 const std = @import("std");
 
 const saturn = @import("../root.zig");
 
+const StagingRing = @import("staging_ring.zig");
+
+/// Staging memory per frame in flight
+pub const STAGING_BYTES_PER_FRAME = 16 * 1024 * 1024;
+
+// Keeps buffer to texture copies valid for every texel size
+const STAGING_ALIGNMENT = 16;
+
+/// Counts up with every upload added, so an upload is done once the oldest one in the backlog is newer
+pub const UploadId = u64;
+
 pub const BufferUpload = struct {
     dst: saturn.BufferHandle,
     offset: usize,
@@ -24,8 +40,39 @@ const BufferTextureCopy = struct {
 
     dst: saturn.TextureHandle,
     dst_mip_level: u32,
+    dst_offset: [3]u32,
 
     extent: saturn.TextureExtent,
+
+    /// Holds the last rows of the texture, it's transitioned for sampling after this copy
+    last: bool,
+};
+
+/// Where the next staged byte of an upload goes
+const Destination = union(enum) {
+    buffer: struct {
+        handle: saturn.BufferHandle,
+        offset: u64,
+    },
+    /// Texture data is staged in whole rows of blocks, a chunk never spans two depth slices.
+    /// Formats that aren't block compressed have 1x1 blocks, so a row of blocks is a row of texels.
+    texture: struct {
+        handle: saturn.TextureHandle,
+        extent: saturn.TextureExtent,
+        block_extent: u32,
+        row_bytes: u64,
+        rows_per_slice: u32,
+        /// Counting the block rows of every depth slice
+        row: u32,
+    },
+};
+
+const PendingUpload = struct {
+    id: UploadId,
+    dst: Destination,
+    /// Into pending_data
+    data_start: usize,
+    data_len: usize,
 };
 
 const Self = @This();
@@ -33,104 +80,225 @@ const Self = @This();
 allocator: std.mem.Allocator,
 gpu_device: saturn.DeviceInterface,
 
+staging_buffer: saturn.BufferHandle,
+staging_ring: StagingRing,
+
 buffer_copies: std.ArrayList(BufferCopy) = .empty,
 buffer_texture_copies: std.ArrayList(BufferTextureCopy) = .empty,
 
-pub fn init(allocator: std.mem.Allocator, gpu_device: saturn.DeviceInterface) Self {
+/// Uploads waiting for staging space, in the order they were added
+pending: std.ArrayList(PendingUpload) = .empty,
+pending_data: std.ArrayList(u8) = .empty,
+
+next_upload_id: UploadId = 1,
+
+pub fn init(allocator: std.mem.Allocator, gpu_device: saturn.DeviceInterface) saturn.Error!Self {
+    const size = STAGING_BYTES_PER_FRAME * @as(usize, @max(1, gpu_device.getFramesInFlight()));
+
+    const staging_buffer = try gpu_device.createBuffer(.{ .name = "Staging Ring", .size = size, .usage = .{ .transfer_src = true }, .memory = .cpu_to_gpu });
+    errdefer gpu_device.destroyBuffer(staging_buffer);
+
+    const mapped = gpu_device.getBufferInfo(staging_buffer).?.mapped_slice.?;
+
     return .{
         .allocator = allocator,
         .gpu_device = gpu_device,
+        .staging_buffer = staging_buffer,
+        .staging_ring = try .init(allocator, mapped[0..size], gpu_device.getFramesInFlight()),
     };
 }
 
 pub fn deinit(self: *Self) void {
+    self.staging_ring.deinit();
+    self.gpu_device.destroyBuffer(self.staging_buffer);
+
     self.buffer_copies.deinit(self.allocator);
     self.buffer_texture_copies.deinit(self.allocator);
+    self.pending.deinit(self.allocator);
+    self.pending_data.deinit(self.allocator);
 }
 
-pub fn addBufferUpload(self: *Self, buffer: saturn.BufferHandle, offset: usize, data: []const u8) saturn.Error!void {
-    //TODO: better lifetime for this, as it will be deleted in FRAMES-IN-FLIGHT, so a resubmitted frame would panic on trying to access this
-    const staging_buffer: saturn.BufferHandle = try self.gpu_device.createBuffer(.{ .name = "Staging Buffer", .size = data.len, .usage = .{ .transfer_src = true }, .memory = .cpu_to_gpu });
-    defer self.gpu_device.destroyBuffer(staging_buffer);
-
-    const staging_slice: []u8 = self.gpu_device.getBufferInfo(staging_buffer).?.mapped_slice.?;
-    @memcpy(staging_slice[0..data.len], data);
-
-    try self.buffer_copies.append(self.allocator, .{
-        .src = staging_buffer,
-        .src_offset = 0,
-        .dst = buffer,
-        .dst_offset = offset,
-        .size = data.len,
-    });
-}
+/// Call after the device has begun the frame, takes back the staging space of the frame that used the slot last
+/// and stages as much of the backlog as fits now.
+pub fn beginFrame(self: *Self, frame: saturn.FrameInfo) saturn.Error!void {
+    self.staging_ring.release(frame.slot);
 
-/// Same as addBufferUpload but it creates only a single staging buffer for the whole copy
-pub fn addBulkBufferUpload(self: *Self, uploads: []const BufferUpload) saturn.Error!void {
-    if (uploads.len == 0) {
-        return;
+    var drained: usize = 0;
+    for (self.pending.items) |*upload| {
+        const staged = try self.stage(&upload.dst, self.pending_data.items[upload.data_start..][0..upload.data_len]);
+        upload.data_start += staged;
+        upload.data_len -= staged;
+
+        if (upload.data_len != 0) break;
+        drained += 1;
     }
 
-    const src_offsets = try self.allocator.alloc(u64, uploads.len);
-    defer self.allocator.free(src_offsets);
+    if (drained == self.pending.items.len) {
+        self.pending.clearRetainingCapacity();
+        self.pending_data.clearRetainingCapacity();
+        return;
+    }
 
-    var offset: u64 = 0;
-    for (src_offsets, uploads) |*src_offset, upload| {
-        src_offset.* = offset;
+    if (drained != 0) {
+        std.mem.copyForwards(PendingUpload, self.pending.items, self.pending.items[drained..]);
+        self.pending.shrinkRetainingCapacity(self.pending.items.len - drained);
+    }
 
-        // IDK if I need to realign
-        // but this but it seems like a safe bet to not try to do buffer copy on weird alignments
-        offset += std.mem.alignForward(u64, offset + upload.data.len, 16);
+    // Drop the staged front of the backlog before it grows without bound
+    const consumed = self.pending.items[0].data_start;
+    if (consumed > self.pending_data.items.len / 2) {
+        std.mem.copyForwards(u8, self.pending_data.items, self.pending_data.items[consumed..]);
+        self.pending_data.shrinkRetainingCapacity(self.pending_data.items.len - consumed);
+        for (self.pending.items) |*upload| upload.data_start -= consumed;
     }
-    const total_bytes = offset;
-
-    //TODO: better lifetime for this, as it will be deleted in FRAMES-IN-FLIGHT, so a resubmitted frame would panic on trying to access this
-    const staging_buffer: saturn.BufferHandle = try self.gpu_device.createBuffer(.{ .name = "Staging Buffer", .size = total_bytes, .usage = .{ .transfer_src = true }, .memory = .cpu_to_gpu });
-    defer self.gpu_device.destroyBuffer(staging_buffer);
-
-    const staging_slice: []u8 = self.gpu_device.getBufferInfo(staging_buffer).?.mapped_slice.?;
-
-    for (src_offsets, uploads) |src_offset, upload| {
-        @memcpy(staging_slice[src_offset..(src_offset + upload.data.len)], upload.data);
-        try self.buffer_copies.append(self.allocator, .{
-            .src = staging_buffer,
-            .src_offset = src_offset,
-            .dst = upload.dst,
-            .dst_offset = upload.offset,
-            .size = upload.data.len,
-        });
+}
+
+/// True while uploads are waiting for staging space, callers streaming data should hold off until it clears
+pub fn isBackedUp(self: *const Self) bool {
+    return self.pending.items.len != 0;
+}
+
+/// Id of the upload added last, zero before the first one
+pub fn lastUploadId(self: *const Self) UploadId {
+    return self.next_upload_id - 1;
+}
+
+/// True once every byte of the upload is in a copy of the graph built this frame or an earlier one,
+/// so anything that reads it from the same graph on sees all of it
+pub fn isUploaded(self: *const Self, id: UploadId) bool {
+    return self.pending.items.len == 0 or id < self.pending.items[0].id;
+}
+
+pub fn pendingBytes(self: *const Self) usize {
+    var total: usize = 0;
+    for (self.pending.items) |upload| total += upload.data_len;
+    return total;
+}
+
+/// Copies as much of data into the ring as fits and records the copies, returns the bytes staged
+fn stage(self: *Self, dst: *Destination, data: []const u8) saturn.Error!usize {
+    var staged: usize = 0;
+    while (staged < data.len) {
+        const remaining: u64 = data.len - staged;
+
+        const granularity: u64, const max_size: u64 = switch (dst.*) {
+            .buffer => .{ 1, remaining },
+            .texture => |texture| blk: {
+                const rows_left_in_slice = texture.rows_per_slice - texture.row % texture.rows_per_slice;
+                break :blk .{ texture.row_bytes, @min(remaining, rows_left_in_slice * texture.row_bytes) };
+            },
+        };
+
+        switch (dst.*) {
+            .buffer => try self.buffer_copies.ensureUnusedCapacity(self.allocator, 1),
+            .texture => try self.buffer_texture_copies.ensureUnusedCapacity(self.allocator, 1),
+        }
+
+        const allocation = self.staging_ring.alloc(granularity, max_size, STAGING_ALIGNMENT) orelse break;
+        const size = allocation.slice.len;
+        @memcpy(allocation.slice, data[staged..][0..size]);
+
+        switch (dst.*) {
+            .buffer => |*buffer| {
+                self.buffer_copies.appendAssumeCapacity(.{
+                    .src = self.staging_buffer,
+                    .src_offset = allocation.offset,
+                    .dst = buffer.handle,
+                    .dst_offset = buffer.offset,
+                    .size = size,
+                });
+                buffer.offset += size;
+            },
+            .texture => |*texture| {
+                const rows: u32 = @intCast(size / texture.row_bytes);
+                const row_count = texture.rows_per_slice * texture.extent.depth;
+                // The last row of blocks may hang over the edge of the texture, the copy stops at the edge
+                const y = (texture.row % texture.rows_per_slice) * texture.block_extent;
+                self.buffer_texture_copies.appendAssumeCapacity(.{
+                    .src = self.staging_buffer,
+                    .src_offset = allocation.offset,
+                    .dst = texture.handle,
+                    .dst_mip_level = 0,
+                    .dst_offset = .{ 0, y, texture.row / texture.rows_per_slice },
+                    .extent = .{ .width = texture.extent.width, .height = @min(rows * texture.block_extent, texture.extent.height - y), .depth = 1 },
+                    .last = texture.row + rows == row_count,
+                });
+                texture.row += rows;
+            },
+        }
+
+        staged += size;
     }
+    return staged;
 }
 
-//TODO: mips and sub-regions
-pub fn addTextureUpload(self: *Self, texture: saturn.TextureHandle, data: []const u8) saturn.Error!void {
+fn addUpload(self: *Self, dst: Destination, data: []const u8) saturn.Error!void {
+    const id = self.next_upload_id;
+    self.next_upload_id += 1;
+
+    var next = dst;
+    const staged = if (self.isBackedUp()) 0 else try self.stage(&next, data);
+    if (staged == data.len) return;
+
+    try self.pending.ensureUnusedCapacity(self.allocator, 1);
+    try self.pending_data.appendSlice(self.allocator, data[staged..]);
+    self.pending.appendAssumeCapacity(.{
+        .id = id,
+        .dst = next,
+        .data_start = self.pending_data.items.len - (data.len - staged),
+        .data_len = data.len - staged,
+    });
+}
 
-    //TODO: better lifetime for this, as it will be deleted in FRAMES-IN-FLIGHT, so a resubmitted frame would panic on trying to access this
-    const staging_buffer: saturn.BufferHandle = try self.gpu_device.createBuffer(.{ .name = "Staging Buffer", .size = data.len, .usage = .{ .transfer_src = true }, .memory = .cpu_to_gpu });
-    defer self.gpu_device.destroyBuffer(staging_buffer);
+pub fn addBufferUpload(self: *Self, buffer: saturn.BufferHandle, offset: usize, data: []const u8) saturn.Error!void {
+    try self.addUpload(.{ .buffer = .{ .handle = buffer, .offset = offset } }, data);
+}
 
-    const staging_slice: []u8 = self.gpu_device.getBufferInfo(staging_buffer).?.mapped_slice.?;
-    @memcpy(staging_slice[0..data.len], data);
+pub fn addBulkBufferUpload(self: *Self, uploads: []const BufferUpload) saturn.Error!void {
+    for (uploads) |buffer_upload| {
+        // Zero sized copies aren't valid, optional data such as meshlets may be empty
+        if (buffer_upload.data.len == 0) continue;
+
+        try self.addBufferUpload(buffer_upload.dst, buffer_upload.offset, buffer_upload.data);
+    }
+}
 
-    const extent = self.gpu_device.getTextureInfo(texture).?.extent;
+//TODO: mips and sub-regions
+/// Data is the tightly packed first mip in the texture's format, returns InvalidUsage if its size doesn't match
+pub fn addTextureUpload(self: *Self, texture: saturn.TextureHandle, data: []const u8) saturn.Error!void {
+    const info = self.gpu_device.getTextureInfo(texture).?;
+    const extent = info.extent;
+
+    const block_extent = info.format.blockExtent();
+    const row_bytes = @as(u64, std.math.divCeil(u32, extent.width, block_extent) catch unreachable) * info.format.blockBytes();
+    const rows_per_slice = std.math.divCeil(u32, extent.height, block_extent) catch unreachable;
+    if (data.len != row_bytes * rows_per_slice * extent.depth) {
+        return error.InvalidUsage;
+    }
 
-    try self.buffer_texture_copies.append(self.allocator, .{
-        .src = staging_buffer,
-        .src_offset = 0,
-        .dst = texture,
-        .dst_mip_level = 0,
+    try self.addUpload(.{ .texture = .{
+        .handle = texture,
         .extent = extent,
-    });
+        .block_extent = block_extent,
+        .row_bytes = row_bytes,
+        .rows_per_slice = rows_per_slice,
+        .row = 0,
+    } }, data);
 }
 
 pub fn buildPasses(self: *Self, render_graph: *saturn.RenderGraph) saturn.Error!void {
+    // The graph is submitted in this frame's slot, the ring keeps what was staged until the slot comes around again
+    self.staging_ring.retire(self.gpu_device.getFrameInfo().slot);
+
     if (self.buffer_copies.items.len == 0 and self.buffer_texture_copies.items.len == 0) {
         return;
     }
 
     const callback_ctx = try render_graph.dupe(CallbackData, .{});
 
+    // Uploads only need the copy engine, so they can overlap the graphics work that doesn't read them
     const pass = try render_graph.addTransferPass("Transfer Pass", callback_ctx, transferCallback);
+    render_graph.setPassQueue(pass, .prefer_async_transfer);
 
     if (self.buffer_copies.items.len != 0) {
         callback_ctx.buffer_copies = try render_graph.alloc(CallbackBufferCopy, self.buffer_copies.items.len);
@@ -160,11 +328,14 @@ pub fn buildPasses(self: *Self, render_graph: *saturn.RenderGraph) saturn.Error!
                 .src_offset = src.src_offset,
                 .dst = dst_texture,
                 .dst_mip_level = src.dst_mip_level,
+                .dst_offset = src.dst_offset,
                 .extent = src.extent,
             };
 
-            //HACK for the moment since IDK what layout it should be in after upload
-            try render_graph.addTextureUsage(transition_pass, dst_texture, .graphics_sampled_read);
+            //Partly uploaded textures stay in transfer layout, the device keeps it until the next chunk is copied
+            if (src.last) {
+                try render_graph.addTextureUsage(transition_pass, dst_texture, .graphics_sampled_read);
+            }
         }
 
         self.buffer_texture_copies.clearRetainingCapacity();
@@ -187,6 +358,7 @@ const CallbackBufferTextureCopy = struct {
 
     dst: saturn.RGTextureHandle,
     dst_mip_level: u32,
+    dst_offset: [3]u32,
 
     extent: saturn.TextureExtent,
 };
@@ -213,7 +385,7 @@ fn transferCallback(ctx: ?*anyopaque, cmd: saturn.TransferCommandEncoder) void {
             .buffer_offset = copy.src_offset,
 
             .texture_mip_level = copy.dst_mip_level,
-            .texture_offset = @splat(0),
+            .texture_offset = copy.dst_offset,
             .extent = copy.extent,
         };
 
@@ -1,6 +1,7 @@
 const std = @import("std");
 
 const SdlPlatform = @import("platform/sdl3.zig");
+const TaskPool = @import("TaskPool.zig");
 
 // ----------------------------
 // Root Functions
@@ -188,7 +189,8 @@ pub const PlatformInterface = struct {
         return self.vtable.getWindowCapabilities(self.ctx, tpa, physical_device_index, window_handle);
     }
 
-    pub fn createDeviceBasic(self: *const Self, window_opt: ?WindowHandle, power_level: DevicePowerPreference) Error!DeviceInterface {
+    /// frames_in_flight defaults to three on discrete gpus and two otherwise
+    pub fn createDeviceBasic(self: *const Self, window_opt: ?WindowHandle, power_level: DevicePowerPreference, frames_in_flight: ?u32) Error!DeviceInterface {
         const SelectedDevice = struct {
             score: usize,
             info: DeviceInfo,
@@ -228,7 +230,7 @@ pub const PlatformInterface = struct {
             self.ctx,
             selected_device.info.physical_device_index,
             .{
-                .frames_in_flight = if (selected_device.info.type == .discrete) 3 else 2,
+                .frames_in_flight = @max(1, frames_in_flight orelse if (selected_device.info.type == .discrete) 3 else 2),
                 .queues = selected_device.info.queues,
                 .features = selected_device.info.features,
             },
@@ -456,6 +458,30 @@ pub const TextureFormat = enum {
             else => true,
         };
     }
+
+    /// Width and height of the blocks the format is stored in, 1 for formats stored per texel
+    pub fn blockExtent(self: TextureFormat) u32 {
+        return switch (self) {
+            .bc1_rgba_unorm, .bc1_rgba_srgb, .bc2_rgba_unorm, .bc2_rgba_srgb, .bc3_rgba_unorm, .bc3_rgba_srgb => 4,
+            .bc4_r_unorm, .bc4_r_snorm, .bc5_rg_unorm, .bc5_rg_snorm => 4,
+            .bc6h_rgb_ufloat, .bc6h_rgb_sfloat, .bc7_rgba_unorm, .bc7_rgba_srgb => 4,
+            else => 1,
+        };
+    }
+
+    /// Bytes of one block, which is a single texel for formats that aren't block compressed
+    pub fn blockBytes(self: TextureFormat) u32 {
+        return switch (self) {
+            .rgba8_unorm, .rgba8_srgb, .bgra8_unorm, .bgra8_srgb => 4,
+            .rgb10_a2_unorm, .bgr10_a2_unorm => 4,
+            .rgba16_float => 8,
+            .bc1_rgba_unorm, .bc1_rgba_srgb, .bc4_r_unorm, .bc4_r_snorm => 8,
+            .bc2_rgba_unorm, .bc2_rgba_srgb, .bc3_rgba_unorm, .bc3_rgba_srgb => 16,
+            .bc5_rg_unorm, .bc5_rg_snorm, .bc6h_rgb_ufloat, .bc6h_rgb_sfloat, .bc7_rgba_unorm, .bc7_rgba_srgb => 16,
+            .d32_float => 4,
+            .d16_unorm => 2,
+        };
+    }
 };
 
 pub const TextureUsage = struct {
@@ -726,6 +752,68 @@ pub const DevicePowerPreference = enum {
     prefer_high_power,
 };
 
+pub const RenderGraphStats = struct {
+    /// What the transient resources would take with an allocation each
+    transient_requested_bytes: u64 = 0,
+    /// What they took once resources with disjoint lifetimes share memory
+    transient_allocated_bytes: u64 = 0,
+    /// Transient buffers and textures that had to be created, zero once the graph's shape is stable
+    transient_resources_created: u32 = 0,
+
+    /// Pipeline barriers recorded for the last graph, counting each memory, buffer and image barrier
+    barriers_emitted: u32 = 0,
+    /// Read -> read barriers the last graph didn't need
+    barriers_eliminated: u32 = 0,
+
+    /// Passes of the last graph that were recorded, and the ones culled since nothing depended on them
+    passes_executed: u32 = 0,
+    passes_culled: u32 = 0,
+
+    /// Submits that reused the last compiled graph since the device was created
+    compile_cache_hits: u64 = 0,
+    compile_cache_misses: u64 = 0,
+
+    pub fn transientSavedBytes(self: RenderGraphStats) u64 {
+        return self.transient_requested_bytes -| self.transient_allocated_bytes;
+    }
+
+    pub fn compileCacheHitRate(self: RenderGraphStats) f32 {
+        const total = self.compile_cache_hits + self.compile_cache_misses;
+        if (total == 0) return 0.0;
+        return @as(f32, @floatFromInt(self.compile_cache_hits)) / @as(f32, @floatFromInt(total));
+    }
+};
+
+/// The frame the cpu is currently preparing
+pub const FrameInfo = struct {
+    /// Counts up by one every frame that begins, the frame being prepared or the last one submitted between frames
+    number: u64,
+    /// Which of the frames in flight this is, the gpu is done with everything the last frame in this slot used.
+    /// Per frame rings of size getFramesInFlight can index with it directly.
+    slot: u32,
+};
+
+/// How well the cpu and gpu overlapped, measured by the device at the start and end of each frame
+pub const FramePacingStats = struct {
+    frames_in_flight: u32 = 0,
+
+    /// Start of the previous frame to the start of the last one
+    frame_ns: u64 = 0,
+    /// Time the cpu was blocked waiting for the gpu to give back the frame slot
+    wait_ns: u64 = 0,
+    /// From the end of that wait to the end of the submit
+    cpu_ns: u64 = 0,
+
+    /// Earlier frames the gpu was still executing once the cpu could start, zero means the gpu ran dry
+    gpu_frames_queued: u32 = 0,
+
+    /// Share of the frame the cpu spent waiting on the gpu, close to one when gpu bound and zero when cpu bound
+    pub fn waitRatio(self: FramePacingStats) f32 {
+        if (self.frame_ns == 0) return 0.0;
+        return @min(1.0, @as(f32, @floatFromInt(self.wait_ns)) / @as(f32, @floatFromInt(self.frame_ns)));
+    }
+};
+
 pub const DeviceDesc = struct {
     frames_in_flight: u32,
     queues: DeviceQueues,
@@ -835,6 +923,9 @@ pub const DeviceInterface = struct {
 
     pub const VTable = struct {
         getInfo: *const fn (ctx: *anyopaque) DeviceInfo,
+        getFramesInFlight: *const fn (ctx: *anyopaque) u32,
+        beginFrame: *const fn (ctx: *anyopaque) Error!FrameInfo,
+        getFrameInfo: *const fn (ctx: *anyopaque) FrameInfo,
 
         createBuffer: *const fn (ctx: *anyopaque, desc: BufferDesc) Error!BufferHandle,
         destroyBuffer: *const fn (ctx: *anyopaque, handle: BufferHandle) void,
@@ -866,12 +957,30 @@ pub const DeviceInterface = struct {
         waitIdle: *const fn (ctx: *anyopaque) void,
 
         createImguiPass: *const fn (ctx: *anyopaque, target: RGTextureHandle, graph: *RenderGraph) ?RGPassHandle,
+
+        getRenderGraphStats: *const fn (ctx: *anyopaque) RenderGraphStats,
+        getFramePacingStats: *const fn (ctx: *anyopaque) FramePacingStats,
     };
 
     pub fn getInfo(self: *const Self) DeviceInfo {
         return self.vtable.getInfo(self.ctx);
     }
 
+    /// Number of frames the cpu can record ahead of the gpu, anything a frame hands to the gpu must live this many frames
+    pub fn getFramesInFlight(self: *const Self) u32 {
+        return self.vtable.getFramesInFlight(self.ctx);
+    }
+
+    /// Waits until the gpu is done with the frame that last used the next slot and releases what that frame held.
+    /// Call before preparing anything for the frame, submitRenderGraph ends it. Calling it again before the submit does nothing.
+    pub fn beginFrame(self: *const Self) Error!FrameInfo {
+        return self.vtable.beginFrame(self.ctx);
+    }
+
+    pub fn getFrameInfo(self: *const Self) FrameInfo {
+        return self.vtable.getFrameInfo(self.ctx);
+    }
+
     pub fn createBuffer(self: *const Self, desc: BufferDesc) Error!BufferHandle {
         return self.vtable.createBuffer(self.ctx, desc);
     }
@@ -944,6 +1053,7 @@ pub const DeviceInterface = struct {
         self.vtable.releaseWindow(self.ctx, window_handle);
     }
 
+    /// Chunked passes are recorded on TaskPool workers and allocate from tpa there, so it has to be safe per thread like FrameAllocator
     pub fn submitRenderGraph(self: *const Self, tpa: std.mem.Allocator, graph: *const RenderGraph) Error!void {
         return self.vtable.submit(self.ctx, tpa, graph);
     }
@@ -952,6 +1062,16 @@ pub const DeviceInterface = struct {
         self.vtable.waitIdle(self.ctx);
     }
 
+    /// Stats of the last submitted render graph
+    pub fn getRenderGraphStats(self: *const Self) RenderGraphStats {
+        return self.vtable.getRenderGraphStats(self.ctx);
+    }
+
+    /// Pacing of the last submitted frame
+    pub fn getFramePacingStats(self: *const Self) FramePacingStats {
+        return self.vtable.getFramePacingStats(self.ctx);
+    }
+
     pub fn createImguiPass(self: *const Self, target: RGTextureHandle, graph: *RenderGraph) ?RGPassHandle {
         return self.vtable.createImguiPass(self.ctx, target, graph);
     }
@@ -1008,6 +1128,8 @@ pub const RGTransientTextureDesc = struct {
     mip_levels: u32 = 1,
     usage: TextureUsage,
     memory: MemoryLocation,
+    /// Required for the texture to get a sampled binding
+    sampler: ?SamplerHandle = null,
 };
 pub const RGWindowTextureDesc = struct {
     handle: WindowHandle,
@@ -1023,6 +1145,8 @@ pub const BufferAccess = enum(u32) {
     vertex_read,
     index_read,
     indirect_read,
+    /// Indirect arguments that the shaders of the pass also read as storage, draw or dispatch
+    indirect_storage_read,
 
     compute_uniform_read,
     graphics_uniform_read,
@@ -1035,6 +1159,13 @@ pub const BufferAccess = enum(u32) {
 
     transfer_read,
     transfer_write,
+
+    pub fn isWrite(self: BufferAccess) bool {
+        return switch (self) {
+            .compute_storage_write, .graphics_storage_write, .transfer_write => true,
+            else => false,
+        };
+    }
 };
 
 pub const TextureAccess = enum(u32) {
@@ -1053,6 +1184,27 @@ pub const TextureAccess = enum(u32) {
 
     transfer_read,
     transfer_write,
+
+    /// Reads with the same state leave the texture in the same layout, so they can share one barrier
+    pub const ReadState = enum { none, attachment, sampled, storage, transfer };
+
+    pub fn isWrite(self: TextureAccess) bool {
+        return switch (self) {
+            .attachment_write, .compute_storage_write, .graphics_storage_write, .transfer_write => true,
+            else => false,
+        };
+    }
+
+    pub fn readState(self: TextureAccess) ?ReadState {
+        return switch (self) {
+            .none => .none,
+            .attachment_read => .attachment,
+            .compute_sampled_read, .graphics_sampled_read => .sampled,
+            .compute_storage_read, .graphics_storage_read => .storage,
+            .transfer_read => .transfer,
+            .attachment_write, .compute_storage_write, .graphics_storage_write, .transfer_write => null,
+        };
+    }
 };
 
 pub const RGColorAttachment = struct {
@@ -1084,47 +1236,46 @@ pub const RGPassCallback = union(enum) {
         ctx: ?*anyopaque,
         func: GraphicsCommandEncoder.Callback,
     },
+    graphics_chunked: struct {
+        render_target: RGRenderTarget,
+        ctx: ?*anyopaque,
+        prepare: GraphicsCommandEncoder.PrepareChunksCallback,
+        func: GraphicsCommandEncoder.ChunkCallback,
+    },
 };
 
 pub const RGPassHandle = struct { idx: u32 };
+
+/// A pass's slice of the graph's flat usage arrays
+pub const RGUsageRange = struct {
+    start: u32 = 0,
+    len: u32 = 0,
+};
+
 pub const RGPassDesc = struct {
     handle: RGPassHandle,
+    /// Interned by the graph, stays valid across resets
     name: []const u8,
     queue: QueuePreference = .graphics,
-    no_cull: bool = true,
+    /// Keeps the pass even when nothing that is kept reads what it writes
+    no_cull: bool = false,
 
-    //TODO: store these as Hashmaps for faster fetch?
-    //TODO: impl both and test perf
-    buffer_usages: std.ArrayList(RGBufferUsage) = .empty,
-    texture_usages: std.ArrayList(RGTextureUsage) = .empty,
+    buffer_usages: RGUsageRange = .{},
+    texture_usages: RGUsageRange = .{},
 
     callback: ?RGPassCallback = null,
-
-    pub fn getBufferAccess(self: *const RGPassDesc, handle: RGBufferHandle) ?BufferAccess {
-        for (self.buffer_usages.items) |usage| {
-            if (usage.handle.idx == handle.idx) {
-                return usage.access;
-            }
-        }
-        return null;
-    }
-
-    pub fn getTextureAccess(self: *const RGPassDesc, handle: RGTextureHandle) ?TextureAccess {
-        for (self.texture_usages.items) |usage| {
-            if (usage.handle.idx == handle.idx) {
-                return usage.access;
-            }
-        }
-        return null;
-    }
 };
 
+/// Everything a frame adds lives in the arena, reset keeps its memory so a graph with a steady shape is built without touching gpa.
+/// Only pass names outlive a reset, they are interned with gpa the first time they are seen.
 pub const RenderGraph = struct {
     pub const Self = @This();
 
     gpa: std.mem.Allocator,
     arena: std.heap.ArenaAllocator,
 
+    pass_names: std.StringHashMapUnmanaged(void) = .empty,
+
     imported_buffers: std.AutoArrayHashMapUnmanaged(BufferHandle, RGBufferHandle) = .empty,
     imported_textures: std.AutoArrayHashMapUnmanaged(TextureHandle, RGTextureHandle) = .empty,
     window_textures: std.ArrayList(RGWindowTextureDesc) = .empty,
@@ -1136,79 +1287,111 @@ pub const RenderGraph = struct {
 
     passes: std.ArrayList(RGPassDesc) = .empty,
 
+    /// Usages of every pass, each pass's are contiguous and in pass order
+    buffer_usages: std.ArrayList(RGBufferUsage) = .empty,
+    texture_usages: std.ArrayList(RGTextureUsage) = .empty,
+
+    /// Chunked graphics passes record their chunks across this pool, they are recorded in order on the submitting thread when null
+    task_pool: ?*TaskPool = null,
+
     pub fn init(gpa: std.mem.Allocator) Self {
         return .{ .gpa = gpa, .arena = .init(gpa) };
     }
 
     pub fn deinit(self: *Self) void {
-        for (self.passes.items) |*pass| {
-            self.gpa.free(pass.name);
-            pass.buffer_usages.deinit(self.gpa);
-            pass.texture_usages.deinit(self.gpa);
-
-            if (pass.callback) |callback| {
-                switch (callback) {
-                    .graphics => |c| {
-                        self.gpa.free(c.render_target.color_attachments);
-                    },
-                    else => {},
-                }
+        var names = self.pass_names.keyIterator();
+        while (names.next()) |name| self.gpa.free(name.*);
+        self.pass_names.deinit(self.gpa);
+
+        self.arena.deinit();
+    }
+
+    /// Empties the graph for the next frame, keeping the arena's memory and the interned names
+    pub fn reset(self: *Self) void {
+        _ = self.arena.reset(.retain_capacity);
+        self.* = .{
+            .gpa = self.gpa,
+            .arena = self.arena,
+            .pass_names = self.pass_names,
+            .task_pool = self.task_pool,
+        };
+    }
+
+    pub fn getBufferUsages(self: *const Self, pass: RGPassHandle) []const RGBufferUsage {
+        const range = self.passes.items[pass.idx].buffer_usages;
+        return self.buffer_usages.items[range.start..][0..range.len];
+    }
+
+    pub fn getTextureUsages(self: *const Self, pass: RGPassHandle) []const RGTextureUsage {
+        const range = self.passes.items[pass.idx].texture_usages;
+        return self.texture_usages.items[range.start..][0..range.len];
+    }
+
+    /// The access the pass leaves the buffer in, a write wins over reads when the pass uses it more than once
+    pub fn getBufferAccess(self: *const Self, pass: RGPassHandle, handle: RGBufferHandle) ?BufferAccess {
+        var result: ?BufferAccess = null;
+        for (self.getBufferUsages(pass)) |usage| {
+            if (usage.handle.idx == handle.idx) {
+                if (usage.access.isWrite()) return usage.access;
+                if (result == null) result = usage.access;
             }
         }
-        self.passes.deinit(self.gpa);
-        self.textures.deinit(self.gpa);
-        self.buffers.deinit(self.gpa);
-
-        self.transient_textures.deinit(self.gpa);
-        self.transient_buffers.deinit(self.gpa);
-        self.window_textures.deinit(self.gpa);
-        self.imported_textures.deinit(self.gpa);
-        self.imported_buffers.deinit(self.gpa);
+        return result;
+    }
 
-        self.arena.deinit();
+    /// The access the pass leaves the texture in, a write wins over reads when the pass uses it more than once
+    pub fn getTextureAccess(self: *const Self, pass: RGPassHandle, handle: RGTextureHandle) ?TextureAccess {
+        var result: ?TextureAccess = null;
+        for (self.getTextureUsages(pass)) |usage| {
+            if (usage.handle.idx == handle.idx) {
+                if (usage.access.isWrite()) return usage.access;
+                if (result == null) result = usage.access;
+            }
+        }
+        return result;
     }
 
     pub fn importBuffer(self: *Self, handle: BufferHandle) Error!RGBufferHandle {
         if (self.imported_buffers.get(handle)) |rg_handle| return rg_handle;
 
-        try self.buffers.append(self.gpa, .{ .source = .{ .persistent = handle } });
+        try self.buffers.append(self.arena.allocator(), .{ .source = .{ .persistent = handle } });
         const rg_handle: RGBufferHandle = .{ .idx = @intCast(self.buffers.items.len - 1) };
-        try self.imported_buffers.put(self.gpa, handle, rg_handle);
+        try self.imported_buffers.put(self.arena.allocator(), handle, rg_handle);
 
         return rg_handle;
     }
 
     pub fn createTransientBuffer(self: *Self, desc: RGTransientBufferDesc) Error!RGBufferHandle {
-        try self.transient_buffers.append(self.gpa, desc);
+        try self.transient_buffers.append(self.arena.allocator(), desc);
         const transient_idx = self.transient_buffers.items.len - 1;
-        try self.buffers.append(self.gpa, .{ .source = .{ .transient = transient_idx } });
+        try self.buffers.append(self.arena.allocator(), .{ .source = .{ .transient = transient_idx } });
         return RGBufferHandle{ .idx = @intCast(self.buffers.items.len - 1) };
     }
 
     pub fn importTexture(self: *Self, handle: TextureHandle) Error!RGTextureHandle {
         if (self.imported_textures.get(handle)) |rg_handle| return rg_handle;
 
-        try self.textures.append(self.gpa, .{ .source = .{ .persistent = handle } });
+        try self.textures.append(self.arena.allocator(), .{ .source = .{ .persistent = handle } });
         const rg_handle: RGTextureHandle = .{ .idx = @intCast(self.textures.items.len - 1) };
-        try self.imported_textures.put(self.gpa, handle, rg_handle);
+        try self.imported_textures.put(self.arena.allocator(), handle, rg_handle);
 
         return rg_handle;
     }
 
     pub fn createTransientTexture(self: *Self, desc: RGTransientTextureDesc) Error!RGTextureHandle {
-        try self.transient_textures.append(self.gpa, desc);
+        try self.transient_textures.append(self.arena.allocator(), desc);
         const transient_idx = self.transient_textures.items.len - 1;
-        try self.textures.append(self.gpa, .{ .source = .{ .transient = transient_idx } });
+        try self.textures.append(self.arena.allocator(), .{ .source = .{ .transient = transient_idx } });
         return RGTextureHandle{ .idx = @intCast(self.textures.items.len - 1) };
     }
 
     pub fn acquireWindowTexture(self: *Self, window: WindowHandle) Error!RGTextureHandle {
         const texture: RGTextureHandle = .{ .idx = @intCast(self.textures.items.len) };
 
-        try self.window_textures.append(self.gpa, .{ .handle = window, .texture = texture });
+        try self.window_textures.append(self.arena.allocator(), .{ .handle = window, .texture = texture });
 
         const window_idx = self.window_textures.items.len - 1;
-        try self.textures.append(self.gpa, .{ .source = .{ .window = window_idx } });
+        try self.textures.append(self.arena.allocator(), .{ .source = .{ .window = window_idx } });
         return texture;
     }
 
@@ -1247,6 +1430,43 @@ pub const RenderGraph = struct {
         ctx: ?*anyopaque,
         func: GraphicsCommandEncoder.Callback,
     ) Error!RGPassHandle {
+        const handle = try self.createRenderTargetPass(name, render_target);
+        self.passes.items[handle.idx].callback = .{ .graphics = .{
+            .ctx = ctx,
+            .func = func,
+            .render_target = .{
+                .color_attachments = try self.arena.allocator().dupe(RGColorAttachment, render_target.color_attachments),
+                .depth_attachment = render_target.depth_attachment,
+            },
+        } };
+        return handle;
+    }
+
+    /// Graphics pass whose draws are split into chunks that can be recorded on different threads.
+    /// `prepare` runs first on the submitting thread and returns the chunk count, then `func` is called once per chunk.
+    /// Chunks are executed in chunk order, so each one must set all the state it draws with.
+    pub fn addChunkedGraphicsPass(
+        self: *Self,
+        name: []const u8,
+        render_target: RGRenderTarget,
+        ctx: ?*anyopaque,
+        prepare: GraphicsCommandEncoder.PrepareChunksCallback,
+        func: GraphicsCommandEncoder.ChunkCallback,
+    ) Error!RGPassHandle {
+        const handle = try self.createRenderTargetPass(name, render_target);
+        self.passes.items[handle.idx].callback = .{ .graphics_chunked = .{
+            .ctx = ctx,
+            .prepare = prepare,
+            .func = func,
+            .render_target = .{
+                .color_attachments = try self.arena.allocator().dupe(RGColorAttachment, render_target.color_attachments),
+                .depth_attachment = render_target.depth_attachment,
+            },
+        } };
+        return handle;
+    }
+
+    fn createRenderTargetPass(self: *Self, name: []const u8, render_target: RGRenderTarget) Error!RGPassHandle {
         const handle = try self.createPass(name, .graphics);
 
         for (render_target.color_attachments) |attachment| {
@@ -1257,29 +1477,46 @@ pub const RenderGraph = struct {
             try self.addTextureUsage(handle, attachment.texture, .attachment_write);
         }
 
-        self.passes.items[handle.idx].callback = .{ .graphics = .{
-            .ctx = ctx,
-            .func = func,
-            .render_target = .{
-                .color_attachments = try self.gpa.dupe(RGColorAttachment, render_target.color_attachments),
-                .depth_attachment = render_target.depth_attachment,
-            },
-        } };
         return handle;
     }
 
+    /// Passes are culled when nothing outside the graph sees their writes, this keeps one regardless
+    pub fn setPassNoCull(self: *Self, pass: RGPassHandle, no_cull: bool) void {
+        self.passes.items[pass.idx].no_cull = no_cull;
+    }
+
+    /// Lets a transfer or compute pass run on an async queue, it stays on the graphics queue when the device has none
+    pub fn setPassQueue(self: *Self, pass: RGPassHandle, queue: QueuePreference) void {
+        self.passes.items[pass.idx].queue = queue;
+    }
+
     fn createPass(self: *Self, name: []const u8, queue: QueuePreference) Error!RGPassHandle {
         const handle = RGPassHandle{ .idx = @intCast(self.passes.items.len) };
-        try self.passes.append(self.gpa, .{
+        try self.passes.append(self.arena.allocator(), .{
             .handle = handle,
-            .name = try self.gpa.dupe(u8, name),
+            .name = try self.internName(name),
             .queue = queue,
+            .buffer_usages = .{ .start = @intCast(self.buffer_usages.items.len) },
+            .texture_usages = .{ .start = @intCast(self.texture_usages.items.len) },
         });
         return handle;
     }
 
+    /// Names are kept across resets so a pass seen before costs a lookup instead of a copy
+    fn internName(self: *Self, name: []const u8) Error![]const u8 {
+        if (self.pass_names.getKey(name)) |interned| return interned;
+
+        const interned = try self.gpa.dupe(u8, name);
+        errdefer self.gpa.free(interned);
+        try self.pass_names.put(self.gpa, interned, {});
+        return interned;
+    }
+
     pub fn addBufferUsage(self: *Self, pass: RGPassHandle, buffer: RGBufferHandle, access: BufferAccess) Error!void {
-        try self.passes.items[pass.idx].buffer_usages.append(self.gpa, .{ .handle = buffer, .access = access });
+        const range = &self.passes.items[pass.idx].buffer_usages;
+        try self.buffer_usages.insert(self.arena.allocator(), range.start + range.len, .{ .handle = buffer, .access = access });
+        range.len += 1;
+        for (self.passes.items[pass.idx + 1 ..]) |*later| later.buffer_usages.start += 1;
 
         // Passes are guaranteed to be executed in the order of creatation
         // but usages can be added out of order, so we chose the smallest idx to be the first
@@ -1299,7 +1536,10 @@ pub const RenderGraph = struct {
     }
 
     pub fn addTextureUsage(self: *Self, pass: RGPassHandle, texture: RGTextureHandle, access: TextureAccess) Error!void {
-        try self.passes.items[pass.idx].texture_usages.append(self.gpa, .{ .handle = texture, .access = access });
+        const range = &self.passes.items[pass.idx].texture_usages;
+        try self.texture_usages.insert(self.arena.allocator(), range.start + range.len, .{ .handle = texture, .access = access });
+        range.len += 1;
+        for (self.passes.items[pass.idx + 1 ..]) |*later| later.texture_usages.start += 1;
 
         // Passes are guaranteed to be executed in the order of creatation
         // but usages can be added out of order, so we chose the smallest idx to be the first
@@ -1326,6 +1566,44 @@ pub const RenderGraph = struct {
         return try self.arena.allocator().alloc(T, n);
     }
 
+    /// Hash of everything compile looks at, graphs with the same hash compile to the same schedule.
+    /// Persistent handles are left out since only their index in the graph matters.
+    pub fn structureHash(self: *const Self) u64 {
+        var hasher = std.hash.Wyhash.init(0);
+
+        std.hash.autoHash(&hasher, self.buffers.items.len);
+        for (self.buffers.items) |buffer| {
+            std.hash.autoHash(&hasher, std.meta.activeTag(buffer.source));
+            switch (buffer.source) {
+                .persistent => {},
+                .transient => |idx| std.hash.autoHash(&hasher, self.transient_buffers.items[idx]),
+            }
+        }
+
+        std.hash.autoHash(&hasher, self.textures.items.len);
+        for (self.textures.items) |texture| {
+            std.hash.autoHash(&hasher, std.meta.activeTag(texture.source));
+            switch (texture.source) {
+                .persistent => {},
+                .transient => |idx| std.hash.autoHash(&hasher, self.transient_textures.items[idx]),
+                .window => |idx| std.hash.autoHash(&hasher, idx),
+            }
+        }
+
+        std.hash.autoHash(&hasher, self.passes.items.len);
+        for (self.passes.items) |pass| {
+            std.hash.autoHash(&hasher, pass.queue);
+            std.hash.autoHash(&hasher, if (pass.callback) |callback| std.meta.activeTag(callback) else null);
+            std.hash.autoHash(&hasher, pass.no_cull);
+            std.hash.autoHash(&hasher, pass.buffer_usages.len);
+            for (self.getBufferUsages(pass.handle)) |usage| std.hash.autoHash(&hasher, usage);
+            std.hash.autoHash(&hasher, pass.texture_usages.len);
+            for (self.getTextureUsages(pass.handle)) |usage| std.hash.autoHash(&hasher, usage);
+        }
+
+        return hasher.final();
+    }
+
     pub fn dupe(self: *Self, comptime T: type, value: T) error{OutOfMemory}!*T {
         const ptr = try self.arena.allocator().create(T);
         ptr.* = value;
@@ -1338,26 +1616,71 @@ pub const RenderGraph = struct {
 };
 
 pub const RenderGraphCompiled = struct {
+    pub const BufferAccessSet = std.EnumSet(BufferAccess);
+    pub const TextureAccessSet = std.EnumSet(TextureAccess);
+
+    /// What a pass waits on before it runs, resolved when compiling so executing doesn't search the passes.
+    /// src is null for the first access of the frame, it then comes from the resource's state before the graph.
+    /// dst can hold reads of later passes too, those were merged in instead of getting a read -> read barrier.
+    pub const Barrier = union(enum) {
+        buffer: struct { handle: RGBufferHandle, src: ?BufferAccessSet, dst: BufferAccessSet, queue_transfer: ?QueueTransfer = null },
+        texture: struct { handle: RGTextureHandle, src: ?TextureAccessSet, dst: TextureAccessSet, queue_transfer: ?QueueTransfer = null },
+    };
+
+    /// The queue a pass was scheduled on, passes only leave graphics when they asked to and the device has the queue
+    pub const Queue = enum {
+        graphics,
+        async_compute,
+        async_transfer,
+    };
+
+    /// Resources are owned by one queue family at a time, moving to another takes a release on src and an acquire on dst.
+    /// The release goes after release_pass, or in front of the whole frame when null since the resource starts each frame on graphics.
+    pub const QueueTransfer = struct {
+        src: Queue,
+        dst: Queue,
+        release_pass: ?usize,
+    };
+
     pub const Pass = struct {
         handle: RGPassHandle,
+        queue: Queue = .graphics,
         first_usages: Dependencies = .empty,
 
         pass_dependencies: std.ArrayList(struct {
             pass: RGPassHandle,
             dependencies: Dependencies,
         }) = .empty,
+
+        barriers: std.ArrayList(Barrier) = .empty,
+        /// Ownership this pass gives up to a later pass on another queue, recorded after it
+        releases: std.ArrayList(Barrier) = .empty,
     };
 
     pub const Resource = struct {
         access_count: usize = 0,
         first_sorted_access: ?usize = null,
         last_sorted_access: ?usize = null,
+
+        fn addAccess(self: *Resource, sorted_index: usize) void {
+            self.access_count += 1;
+            if (self.first_sorted_access == null) self.first_sorted_access = sorted_index;
+            self.last_sorted_access = sorted_index;
+        }
     };
 
     passes: std.ArrayList(Pass) = .empty,
     buffers: std.ArrayList(Resource) = .empty,
     textures: std.ArrayList(Resource) = .empty,
 
+    /// Acquires giving persistent resources back to the graphics queue at the end of the frame, so every frame starts with them there
+    epilogue: std.ArrayList(Barrier) = .empty,
+
+    /// Reads that were merged into an earlier barrier instead of getting their own
+    merged_read_barriers: u32 = 0,
+    /// Passes left out since nothing that runs depends on them
+    culled_passes: u32 = 0,
+
     pub fn deinit(self: *RenderGraphCompiled, gpa: std.mem.Allocator) void {
         for (self.passes.items) |*pass| {
             pass.first_usages.deinit(gpa);
@@ -1365,45 +1688,125 @@ pub const RenderGraphCompiled = struct {
                 pass_deps.dependencies.deinit(gpa);
             }
             pass.pass_dependencies.deinit(gpa);
+            pass.barriers.deinit(gpa);
+            pass.releases.deinit(gpa);
         }
         self.passes.deinit(gpa);
         self.buffers.deinit(gpa);
         self.textures.deinit(gpa);
+        self.epilogue.deinit(gpa);
     }
 
-    pub fn compile(tpa: std.mem.Allocator, render_graph: *const RenderGraph) !RenderGraphCompiled {
-        const last_buffer_access = try tpa.alloc(?RGPassHandle, render_graph.buffers.items.len);
-        defer tpa.free(last_buffer_access);
-        @memset(last_buffer_access, null);
+    fn resolveQueue(render_graph: *const RenderGraph, pass: *const RGPassDesc, queues: DeviceQueues) Queue {
+        const callback = pass.callback orelse return .graphics;
 
-        const last_texture_access = try tpa.alloc(?RGPassHandle, render_graph.textures.items.len);
-        defer tpa.free(last_texture_access);
-        @memset(last_texture_access, null);
+        // Swapchain images are only ever touched on the queue that presents them
+        for (render_graph.getTextureUsages(pass.handle)) |usage| {
+            if (render_graph.textures.items[usage.handle.idx].source == .window) return .graphics;
+        }
 
-        // Build graph
+        return switch (pass.queue) {
+            .graphics => .graphics,
+            .prefer_async_compute => switch (callback) {
+                .compute, .transfer => if (queues.async_compute) .async_compute else .graphics,
+                .graphics, .graphics_chunked => .graphics,
+            },
+            .prefer_async_transfer => switch (callback) {
+                .transfer => if (queues.async_transfer) .async_transfer else if (queues.async_compute) .async_compute else .graphics,
+                .compute, .graphics, .graphics_chunked => .graphics,
+            },
+        };
+    }
+
+    /// Passes whose writes are seen outside the graph, and every pass those depend on, the rest are culled.
+    /// Roots are no_cull passes, passes writing a persistent or window resource, and passes writing nothing since they only run for their side effects.
+    fn findLivePasses(tpa: std.mem.Allocator, render_graph: *const RenderGraph) ![]bool {
+        const live = try tpa.alloc(bool, render_graph.passes.items.len);
+        errdefer tpa.free(live);
+
+        const needed_buffers = try tpa.alloc(bool, render_graph.buffers.items.len);
+        defer tpa.free(needed_buffers);
+        @memset(needed_buffers, false);
+
+        const needed_textures = try tpa.alloc(bool, render_graph.textures.items.len);
+        defer tpa.free(needed_textures);
+        @memset(needed_textures, false);
+
+        // A pass only depends on passes created before it, so one walk from the back settles every pass
+        var i = render_graph.passes.items.len;
+        while (i > 0) {
+            i -= 1;
+            const pass = &render_graph.passes.items[i];
+
+            var is_live = pass.no_cull;
+            var writes = false;
+            for (render_graph.getBufferUsages(pass.handle)) |usage| {
+                if (!usage.access.isWrite()) continue;
+                writes = true;
+                if (needed_buffers[usage.handle.idx] or render_graph.buffers.items[usage.handle.idx].source != .transient) is_live = true;
+            }
+            for (render_graph.getTextureUsages(pass.handle)) |usage| {
+                if (!usage.access.isWrite()) continue;
+                writes = true;
+                if (needed_textures[usage.handle.idx] or render_graph.textures.items[usage.handle.idx].source != .transient) is_live = true;
+            }
+
+            live[i] = is_live or !writes;
+            if (!live[i]) continue;
+
+            // Writes may keep what was there before, so earlier writers of anything a live pass touches are needed too
+            for (render_graph.getBufferUsages(pass.handle)) |usage| needed_buffers[usage.handle.idx] = true;
+            for (render_graph.getTextureUsages(pass.handle)) |usage| needed_textures[usage.handle.idx] = true;
+        }
+
+        return live;
+    }
+
+    /// The result is allocated with gpa so it can outlive the frame, tpa is only used while compiling.
+    /// queues are the async queues the device has, passes preferring one that is missing run on graphics.
+    pub fn compile(gpa: std.mem.Allocator, tpa: std.mem.Allocator, render_graph: *const RenderGraph, queues: DeviceQueues) !RenderGraphCompiled {
+        // Build graph, reads only depend on the last write and a write depends on every read since, so readers are free to reorder
         var graph: RGDependencyGraph = .init(tpa);
         defer graph.deinit();
 
-        for (render_graph.passes.items) |pass| {
-            try graph.nodes.put(tpa, pass.handle, .{ .pass = pass.handle });
+        const buffer_hazards = try tpa.alloc(Hazards, render_graph.buffers.items.len);
+        defer {
+            for (buffer_hazards) |*hazards| hazards.readers.deinit(tpa);
+            tpa.free(buffer_hazards);
+        }
+        @memset(buffer_hazards, .{});
 
-            for (pass.buffer_usages.items) |buffer_access| {
-                if (last_buffer_access[buffer_access.handle.idx] != null and last_buffer_access[buffer_access.handle.idx].?.idx == pass.handle.idx) continue;
+        const texture_hazards = try tpa.alloc(Hazards, render_graph.textures.items.len);
+        defer {
+            for (texture_hazards) |*hazards| hazards.readers.deinit(tpa);
+            tpa.free(texture_hazards);
+        }
+        @memset(texture_hazards, .{});
 
-                try graph.addDependency(last_buffer_access[buffer_access.handle.idx], pass.handle, .{ .buffer = buffer_access.handle });
-                last_buffer_access[buffer_access.handle.idx] = pass.handle;
+        const live = try findLivePasses(tpa, render_graph);
+        defer tpa.free(live);
+
+        var culled_passes: u32 = 0;
+        for (render_graph.passes.items) |pass| {
+            if (!live[pass.handle.idx]) {
+                culled_passes += 1;
+                continue;
             }
 
-            for (pass.texture_usages.items) |texture_access| {
-                if (last_texture_access[texture_access.handle.idx] != null and last_texture_access[texture_access.handle.idx].?.idx == pass.handle.idx) continue;
+            try graph.nodes.put(tpa, pass.handle, .{ .pass = pass.handle });
 
-                try graph.addDependency(last_texture_access[texture_access.handle.idx], pass.handle, .{ .texture = texture_access.handle });
-                last_texture_access[texture_access.handle.idx] = pass.handle;
+            const buffer_usages = render_graph.getBufferUsages(pass.handle);
+            for (buffer_usages, 0..) |usage, usage_index| {
+                const accesses = passAccesses(buffer_usages, usage_index) orelse continue;
+                try buffer_hazards[usage.handle.idx].add(tpa, &graph, pass.handle, .{ .buffer = usage.handle }, hasWrite(accesses));
             }
-        }
 
-        // Optimize Graph
-        // TODO: eleminate read -> read barriers
+            const texture_usages = render_graph.getTextureUsages(pass.handle);
+            for (texture_usages, 0..) |usage, usage_index| {
+                const accesses = passAccesses(texture_usages, usage_index) orelse continue;
+                try texture_hazards[usage.handle.idx].add(tpa, &graph, pass.handle, .{ .texture = usage.handle }, hasWrite(accesses));
+            }
+        }
 
         const reorder_graph: bool = true;
 
@@ -1457,36 +1860,401 @@ pub const RenderGraphCompiled = struct {
             }
         }
 
-        var result: RenderGraphCompiled = .{};
-        errdefer result.deinit(tpa);
+        var result: RenderGraphCompiled = .{ .culled_passes = culled_passes };
+        errdefer result.deinit(gpa);
 
-        result.buffers = try .initCapacity(tpa, render_graph.buffers.items.len);
+        result.buffers = try .initCapacity(gpa, render_graph.buffers.items.len);
         result.buffers.appendNTimesAssumeCapacity(.{}, result.buffers.capacity);
 
-        result.textures = try .initCapacity(tpa, render_graph.textures.items.len);
+        result.textures = try .initCapacity(gpa, render_graph.textures.items.len);
         result.textures.appendNTimesAssumeCapacity(.{}, result.textures.capacity);
 
+        try result.passes.ensureTotalCapacityPrecise(gpa, pass_execute_order.items.len);
         for (pass_execute_order.items) |pass_handle| {
             if (graph.nodes.getPtr(pass_handle)) |node| {
-                var result_pass: Pass = .{ .handle = pass_handle };
-                result_pass.first_usages = try node.first_usages.clone(tpa);
+                result.passes.appendAssumeCapacity(.{
+                    .handle = pass_handle,
+                    .queue = resolveQueue(render_graph, &render_graph.passes.items[pass_handle.idx], queues),
+                });
+                const result_pass = &result.passes.items[result.passes.items.len - 1];
+                result_pass.first_usages = try node.first_usages.clone(gpa);
 
                 var iter = node.pass_dependencies.iterator();
                 while (iter.next()) |entry| {
-                    try result_pass.pass_dependencies.append(tpa, .{
+                    try result_pass.pass_dependencies.append(gpa, .{
                         .pass = entry.key_ptr.*,
-                        .dependencies = try entry.value_ptr.clone(tpa),
+                        .dependencies = try entry.value_ptr.clone(gpa),
                     });
                 }
+            }
+        }
 
-                try result.passes.append(tpa, result_pass);
+        const buffer_syncs = try tpa.alloc(Sync(BufferAccess), render_graph.buffers.items.len);
+        defer tpa.free(buffer_syncs);
+        @memset(buffer_syncs, .{});
+
+        const texture_syncs = try tpa.alloc(Sync(TextureAccess), render_graph.textures.items.len);
+        defer tpa.free(texture_syncs);
+        @memset(texture_syncs, .{});
+
+        // Lifetimes and barriers in execution order, transient resources only need memory between their first and last access
+        for (0..result.passes.items.len) |sorted_index| {
+            const pass = &render_graph.passes.items[result.passes.items[sorted_index].handle.idx];
+            const buffer_usages = render_graph.getBufferUsages(pass.handle);
+            for (buffer_usages, 0..) |usage, usage_index| {
+                const accesses = passAccesses(buffer_usages, usage_index) orelse continue;
+                const persistent = render_graph.buffers.items[usage.handle.idx].source == .persistent;
+                result.buffers.items[usage.handle.idx].addAccess(sorted_index);
+                try result.addBarrier(gpa, .buffer, &buffer_syncs[usage.handle.idx], sorted_index, usage.handle, accesses, persistent);
             }
+            const texture_usages = render_graph.getTextureUsages(pass.handle);
+            for (texture_usages, 0..) |usage, usage_index| {
+                const accesses = passAccesses(texture_usages, usage_index) orelse continue;
+                const persistent = render_graph.textures.items[usage.handle.idx].source == .persistent;
+                result.textures.items[usage.handle.idx].addAccess(sorted_index);
+                try result.addBarrier(gpa, .texture, &texture_syncs[usage.handle.idx], sorted_index, usage.handle, accesses, persistent);
+            }
+        }
+
+        // Persistent resources left on an async queue go back to graphics, the next frame expects them there
+        for (render_graph.buffers.items, buffer_syncs, 0..) |buffer, *sync, idx| {
+            if (buffer.source != .persistent) continue;
+            try result.returnToGraphics(gpa, .buffer, sync, RGBufferHandle{ .idx = @intCast(idx) });
+        }
+        for (render_graph.textures.items, texture_syncs, 0..) |texture, *sync, idx| {
+            if (texture.source != .persistent) continue;
+            try result.returnToGraphics(gpa, .texture, sync, RGTextureHandle{ .idx = @intCast(idx) });
         }
 
         return result;
     }
+
+    /// Every access a pass makes to the resource of usages[index], null if an earlier usage of the pass already covered it.
+    /// A pass that reads and writes a resource is handled as one write, so it gets one dependency and one barrier.
+    fn passAccesses(usages: anytype, index: usize) ?std.EnumSet(@TypeOf(usages[0].access)) {
+        const handle = usages[index].handle;
+        for (usages[0..index]) |earlier| {
+            if (earlier.handle.idx == handle.idx) return null;
+        }
+
+        var accesses: std.EnumSet(@TypeOf(usages[0].access)) = .initEmpty();
+        for (usages[index..]) |usage| {
+            if (usage.handle.idx == handle.idx) accesses.insert(usage.access);
+        }
+        return accesses;
+    }
+
+    fn hasWrite(accesses: anytype) bool {
+        var iter = accesses.iterator();
+        while (iter.next()) |access| {
+            if (access.isWrite()) return true;
+        }
+        return false;
+    }
+
+    const Hazards = struct {
+        last_write: ?RGPassHandle = null,
+        /// Passes that read since last_write, the next write has to wait for all of them
+        readers: std.ArrayList(RGPassHandle) = .empty,
+
+        /// Called once per pass and resource, with the usages of the pass already merged
+        fn add(self: *Hazards, tpa: std.mem.Allocator, graph: *RGDependencyGraph, pass: RGPassHandle, dependency: Dependency, is_write: bool) !void {
+            if (!is_write) {
+                try graph.addDependency(self.last_write, pass, dependency);
+                try self.readers.append(tpa, pass);
+                return;
+            }
+
+            if (self.readers.items.len == 0) {
+                try graph.addDependency(self.last_write, pass, dependency);
+            } else for (self.readers.items) |reader| {
+                try graph.addDependency(reader, pass, dependency);
+            }
+            self.readers.clearRetainingCapacity();
+            self.last_write = pass;
+        }
+    };
+
+    fn Sync(comptime Access: type) type {
+        return struct {
+            seen: bool = false,
+            last_pass: ?usize = null,
+            /// Queue that owns the resource, persistent ones start every frame on graphics
+            queue: Queue = .graphics,
+            /// What the next write or transition has to wait on, the last write or every read since it
+            src: std.EnumSet(Access) = .initEmpty(),
+            /// The barrier the current reads went into, later reads in the same state are merged into it
+            reads_barrier: ?struct { pass: usize, index: usize } = null,
+        };
+    }
+
+    fn addBarrier(
+        self: *RenderGraphCompiled,
+        gpa: std.mem.Allocator,
+        comptime kind: std.meta.Tag(Barrier),
+        sync: anytype,
+        sorted_index: usize,
+        handle: anytype,
+        accesses: anytype,
+        persistent: bool,
+    ) !void {
+        std.debug.assert(sync.last_pass != sorted_index);
+        const previous_pass = sync.last_pass;
+        sync.last_pass = sorted_index;
+
+        const queue = self.passes.items[sorted_index].queue;
+
+        // A read after a read in the same state only needs the barrier in front of the first one to cover its stages too,
+        // as long as both run on the same queue, pipeline barriers don't reach across queues
+        const is_write = hasWrite(accesses);
+        if (!is_write and sync.queue == queue) {
+            if (sync.reads_barrier) |location| {
+                const barrier = &@field(self.passes.items[location.pass].barriers.items[location.index], @tagName(kind));
+                const same_state = if (kind == .texture) blk: {
+                    var barrier_iter = barrier.dst.iterator();
+                    var accesses_iter = accesses.iterator();
+                    break :blk barrier_iter.next().?.readState() == accesses_iter.next().?.readState();
+                } else true;
+
+                if (same_state) {
+                    barrier.dst.setUnion(accesses);
+                    sync.src.setUnion(accesses);
+                    self.merged_read_barriers += 1;
+                    return;
+                }
+            }
+        }
+
+        // Transients have nothing worth keeping before their first access, so whichever queue touches them first owns them
+        const queue_transfer: ?QueueTransfer = if (sync.queue == queue)
+            null
+        else if (sync.seen)
+            .{ .src = sync.queue, .dst = queue, .release_pass = previous_pass }
+        else if (persistent)
+            .{ .src = sync.queue, .dst = queue, .release_pass = null }
+        else
+            null;
+
+        const barrier = @unionInit(Barrier, @tagName(kind), .{
+            .handle = handle,
+            .src = if (sync.seen) sync.src else null,
+            .dst = accesses,
+            .queue_transfer = queue_transfer,
+        });
+
+        if (queue_transfer) |transfer| {
+            if (transfer.release_pass) |release_pass| {
+                try self.passes.items[release_pass].releases.append(gpa, barrier);
+            }
+        }
+
+        const barriers = &self.passes.items[sorted_index].barriers;
+        try barriers.append(gpa, barrier);
+
+        sync.seen = true;
+        sync.queue = queue;
+        sync.src = accesses;
+        sync.reads_barrier = if (is_write) null else .{ .pass = sorted_index, .index = barriers.items.len - 1 };
+    }
+
+    fn returnToGraphics(
+        self: *RenderGraphCompiled,
+        gpa: std.mem.Allocator,
+        comptime kind: std.meta.Tag(Barrier),
+        sync: anytype,
+        handle: anytype,
+    ) !void {
+        if (!sync.seen or sync.queue == .graphics) return;
+
+        // Same accesses on both sides, only ownership moves and the layout stays what the last access left
+        const barrier = @unionInit(Barrier, @tagName(kind), .{
+            .handle = handle,
+            .src = sync.src,
+            .dst = sync.src,
+            .queue_transfer = .{ .src = sync.queue, .dst = .graphics, .release_pass = sync.last_pass },
+        });
+        try self.passes.items[sync.last_pass.?].releases.append(gpa, barrier);
+        try self.epilogue.append(gpa, barrier);
+    }
 };
 
+test "render_graph.cull_dead_passes" {
+    const Callbacks = struct {
+        fn compute(data: ?*anyopaque, encoder: ComputeCommandEncoder) void {
+            _ = data;
+            _ = encoder;
+        }
+        fn graphics(data: ?*anyopaque, encoder: GraphicsCommandEncoder, target_resolution: [2]u32) void {
+            _ = data;
+            _ = encoder;
+            _ = target_resolution;
+        }
+    };
+
+    var render_graph: RenderGraph = .init(std.testing.allocator);
+    defer render_graph.deinit();
+
+    const buffer_desc: RGTransientBufferDesc = .{ .size = 64, .usage = .{ .storage = true }, .memory = .gpu_only };
+    const used = try render_graph.createTransientBuffer(buffer_desc);
+    const unused = try render_graph.createTransientBuffer(buffer_desc);
+    const kept = try render_graph.createTransientBuffer(buffer_desc);
+    const window = try render_graph.acquireWindowTexture(@enumFromInt(1));
+
+    const producer = try render_graph.addComputePass("Producer", null, Callbacks.compute);
+    try render_graph.addBufferUsage(producer, used, .compute_storage_write);
+
+    const dead = try render_graph.addComputePass("Dead", null, Callbacks.compute);
+    try render_graph.addBufferUsage(dead, used, .compute_storage_read);
+    try render_graph.addBufferUsage(dead, unused, .compute_storage_write);
+
+    const no_cull = try render_graph.addComputePass("No Cull", null, Callbacks.compute);
+    try render_graph.addBufferUsage(no_cull, kept, .compute_storage_write);
+    render_graph.setPassNoCull(no_cull, true);
+
+    const present = try render_graph.addGraphicsPass("Present", .{ .color_attachments = &.{.{ .texture = window, .clear = null }} }, null, Callbacks.graphics);
+    try render_graph.addBufferUsage(present, used, .graphics_storage_read);
+
+    var compiled: RenderGraphCompiled = try .compile(std.testing.allocator, std.testing.allocator, &render_graph, .{
+        .graphics = true,
+        .async_compute = false,
+        .async_transfer = false,
+    });
+    defer compiled.deinit(std.testing.allocator);
+
+    try std.testing.expectEqual(@as(u32, 1), compiled.culled_passes);
+    try std.testing.expectEqual(@as(usize, 3), compiled.passes.items.len);
+    for (compiled.passes.items) |pass| {
+        try std.testing.expect(pass.handle.idx != dead.idx);
+    }
+    try std.testing.expectEqual(@as(usize, 0), compiled.buffers.items[unused.idx].access_count);
+    try std.testing.expectEqual(@as(usize, 2), compiled.buffers.items[used.idx].access_count);
+}
+
+test "render_graph.read_write_same_pass" {
+    const Callbacks = struct {
+        fn compute(data: ?*anyopaque, encoder: ComputeCommandEncoder) void {
+            _ = data;
+            _ = encoder;
+        }
+
+        fn sortedIndex(compiled: *const RenderGraphCompiled, pass: RGPassHandle) usize {
+            for (compiled.passes.items, 0..) |compiled_pass, i| {
+                if (compiled_pass.handle.idx == pass.idx) return i;
+            }
+            unreachable;
+        }
+    };
+
+    var render_graph: RenderGraph = .init(std.testing.allocator);
+    defer render_graph.deinit();
+
+    const buffer = try render_graph.createTransientBuffer(.{ .size = 64, .usage = .{ .storage = true }, .memory = .gpu_only });
+
+    const producer = try render_graph.addComputePass("Producer", null, Callbacks.compute);
+    try render_graph.addBufferUsage(producer, buffer, .compute_storage_write);
+
+    // Read before write, the write must not be lost to the read already recorded for the pass
+    const update = try render_graph.addComputePass("Update", null, Callbacks.compute);
+    try render_graph.addBufferUsage(update, buffer, .compute_storage_read);
+    try render_graph.addBufferUsage(update, buffer, .compute_storage_write);
+
+    const consumer = try render_graph.addComputePass("Consumer", null, Callbacks.compute);
+    try render_graph.addBufferUsage(consumer, buffer, .compute_storage_read);
+    render_graph.setPassNoCull(consumer, true);
+
+    var compiled: RenderGraphCompiled = try .compile(std.testing.allocator, std.testing.allocator, &render_graph, .{
+        .graphics = true,
+        .async_compute = false,
+        .async_transfer = false,
+    });
+    defer compiled.deinit(std.testing.allocator);
+
+    try std.testing.expectEqual(@as(usize, 3), compiled.passes.items.len);
+    const update_index = Callbacks.sortedIndex(&compiled, update);
+    const consumer_index = Callbacks.sortedIndex(&compiled, consumer);
+    try std.testing.expect(update_index < consumer_index);
+
+    var depends_on_update = false;
+    for (compiled.passes.items[consumer_index].pass_dependencies.items) |dependency| {
+        if (dependency.pass.idx == update.idx) depends_on_update = true;
+    }
+    try std.testing.expect(depends_on_update);
+
+    // One barrier covering both accesses of the pass
+    const update_barriers = compiled.passes.items[update_index].barriers.items;
+    try std.testing.expectEqual(@as(usize, 1), update_barriers.len);
+    const update_barrier = update_barriers[0].buffer;
+    try std.testing.expect(update_barrier.dst.contains(.compute_storage_read));
+    try std.testing.expect(update_barrier.dst.contains(.compute_storage_write));
+    try std.testing.expect(update_barrier.src.?.contains(.compute_storage_write));
+
+    // The consumer waits on the update's write, not just its read
+    const consumer_barriers = compiled.passes.items[consumer_index].barriers.items;
+    try std.testing.expectEqual(@as(usize, 1), consumer_barriers.len);
+    try std.testing.expect(consumer_barriers[0].buffer.src.?.contains(.compute_storage_write));
+    try std.testing.expectEqual(@as(usize, 3), compiled.buffers.items[buffer.idx].access_count);
+
+    try std.testing.expectEqual(BufferAccess.compute_storage_write, render_graph.getBufferAccess(update, buffer).?);
+}
+
+test "render_graph.reset_reuses_memory" {
+    const Callbacks = struct {
+        fn compute(data: ?*anyopaque, encoder: ComputeCommandEncoder) void {
+            _ = data;
+            _ = encoder;
+        }
+        fn graphics(data: ?*anyopaque, encoder: GraphicsCommandEncoder, target_resolution: [2]u32) void {
+            _ = data;
+            _ = encoder;
+            _ = target_resolution;
+        }
+
+        fn build(render_graph: *RenderGraph) !void {
+            const window = try render_graph.acquireWindowTexture(@enumFromInt(1));
+            const scratch = try render_graph.createTransientBuffer(.{ .size = 256, .usage = .{ .storage = true }, .memory = .gpu_only });
+            const imported = try render_graph.importBuffer(@enumFromInt(7));
+
+            const first = try render_graph.addComputePass("First", null, compute);
+            try render_graph.addBufferUsage(first, scratch, .compute_storage_write);
+
+            const second = try render_graph.addComputePass("Second", null, compute);
+            try render_graph.addBufferUsage(second, scratch, .compute_storage_read);
+            try render_graph.addBufferUsage(second, imported, .compute_storage_write);
+
+            const present = try render_graph.addGraphicsPass("Present", .{ .color_attachments = &.{.{ .texture = window, .clear = null }} }, null, graphics);
+            try render_graph.addBufferUsage(present, imported, .graphics_storage_read);
+
+            // Added after later passes exist, like the transfer queue does
+            try render_graph.addBufferUsage(first, imported, .compute_storage_read);
+        }
+    };
+
+    var counting: std.testing.FailingAllocator = .init(std.testing.allocator, .{});
+    var render_graph: RenderGraph = .init(counting.allocator());
+    defer render_graph.deinit();
+
+    // Warm up the arena and the interned names
+    for (0..2) |_| {
+        render_graph.reset();
+        try Callbacks.build(&render_graph);
+    }
+
+    const allocations = counting.allocations;
+    const deallocations = counting.deallocations;
+
+    render_graph.reset();
+    try Callbacks.build(&render_graph);
+
+    try std.testing.expectEqual(allocations, counting.allocations);
+    try std.testing.expectEqual(deallocations, counting.deallocations);
+
+    try std.testing.expectEqual(@as(usize, 3), render_graph.passes.items.len);
+    try std.testing.expectEqual(@as(usize, 2), render_graph.getBufferUsages(.{ .idx = 0 }).len);
+    try std.testing.expectEqual(BufferAccess.compute_storage_read, render_graph.getBufferAccess(.{ .idx = 0 }, .{ .idx = 1 }).?);
+    try std.testing.expectEqual(BufferAccess.compute_storage_write, render_graph.getBufferAccess(.{ .idx = 1 }, .{ .idx = 1 }).?);
+    try std.testing.expectEqual(@as(?BufferAccess, null), render_graph.getBufferAccess(.{ .idx = 2 }, .{ .idx = 0 }));
+}
+
 pub const Dependency = union(enum) {
     buffer: RGBufferHandle,
     texture: RGTextureHandle,
@@ -1767,6 +2535,10 @@ pub const GraphicsCommandEncoder = struct {
     const Self = @This();
 
     pub const Callback = *const fn (data: ?*anyopaque, encoder: Self, target_resolution: [2]u32) void;
+    /// Runs on the submitting thread before any chunk is recorded, returns the number of chunks
+    pub const PrepareChunksCallback = *const fn (data: ?*anyopaque, target_resolution: [2]u32) u32;
+    /// Chunks may be recorded at the same time on any TaskPool thread, each gets its own encoder with only the viewport and scissor set
+    pub const ChunkCallback = *const fn (data: ?*anyopaque, chunk_index: u32, encoder: Self, target_resolution: [2]u32) void;
 
     ctx: *anyopaque,
     vtable: *const VTable,
@@ -0,0 +1,17 @@
+//Root of `zig build test`, files are only compiled into the test binary once something references them.
+//Add any file that gains a test block here.
+
+test {
+    _ = @import("root.zig");
+    _ = @import("FrameAllocator.zig");
+    _ = @import("MemoryTracker.zig");
+    _ = @import("c_alloc.zig");
+    _ = @import("TaskPool.zig");
+    _ = @import("platform/vulkan/transient_aliasing.zig");
+    _ = @import("rendering/bvh.zig");
+    _ = @import("rendering/camera.zig");
+    _ = @import("rendering/culling.zig");
+    _ = @import("rendering/draw_sort.zig");
+    _ = @import("rendering/occlusion.zig");
+    _ = @import("rendering/staging_ring.zig");
+}